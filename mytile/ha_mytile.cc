@@ -39,8 +39,10 @@
 #define MYSQL_SERVER 1
 
 #include "ha_mytile.h"
+#include "mytile-context-pool.h"
 #include "mytile-errors.h"
 #include "mytile-discovery.h"
+#include "mytile-schema-cache.h"
 #include "mytile-statusvars.h"
 #include "mytile-sysvars.h"
 #include "mytile-metadata.h"
@@ -49,6 +51,8 @@
 #include "item.h"
 #include "sql_type_geom.h"
 #include "spatial.h"
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <log.h>
 #include <my_config.h>
@@ -59,6 +63,7 @@
 #include <vector>
 #include <unordered_map>
 #include <key.h> // key_copy, key_unpack, key_cmp_if_same, key_cmp
+#include <my_bit.h> // my_count_bits
 
 // Handler for mytile engine
 handlerton *mytile_hton;
@@ -132,24 +137,84 @@ tiledb::Context tile::build_context(tiledb::Config &cfg) {
   return ctx;
 }
 
-int tile::mytile_group_by_handler::end_scan() {
-  DBUG_ENTER("tile::mytile_group_by_handler::end_scan");
-  // reset qc and ranges
-  if (this->aggr_query != nullptr) {
-    this->aggr_query = nullptr;
+/**
+ * Attribute or dimension read by an aggregate
+ * @param item The aggregate
+ * @return name of the column, empty when every cell is counted, nullopt if
+ * the argument is neither a column nor a constant of a count
+ */
+static std::optional<std::string> aggregate_column(Item_sum *item) {
+  if (item->get_arg_count() != 1)
+    return std::nullopt;
+
+  Item *arg = item->get_arg(0);
+  // COUNT(*) and counts of other non null constants count every cell
+  if (arg->const_item()) {
+    if (item->sum_func() == Item_sum::COUNT_FUNC && !arg->is_null())
+      return std::string();
+    return std::nullopt;
   }
 
-  if (this->tiledb_qc != nullptr) {
-    this->tiledb_qc = nullptr;
+  Item *real_arg = arg->real_item();
+  if (real_arg->type() != Item::FIELD_ITEM)
+    return std::nullopt;
+  const Item_field *field = static_cast<Item_field *>(real_arg);
+  return std::string(field->field_name.str, field->field_name.length);
+}
+
+/**
+ * Calls a function with a value of the C++ type of a numeric datatype
+ * @param type The datatype
+ * @param f function taking a value of the type
+ */
+template <typename F>
+static void with_numeric_type(tiledb_datatype_t type, F &&f) {
+  switch (type) {
+  case TILEDB_FLOAT32:
+    return f(float());
+  case TILEDB_FLOAT64:
+    return f(double());
+  case TILEDB_INT8:
+    return f(int8_t());
+  case TILEDB_UINT8:
+    return f(uint8_t());
+  case TILEDB_INT16:
+    return f(int16_t());
+  case TILEDB_UINT16:
+    return f(uint16_t());
+  case TILEDB_INT32:
+    return f(int32_t());
+  case TILEDB_UINT32:
+    return f(uint32_t());
+  case TILEDB_INT64:
+    return f(int64_t());
+  case TILEDB_UINT64:
+    return f(uint64_t());
+  default:
+    throw tiledb::TileDBError(
+        std::string("Unknown or Unsupported type for aggregate"));
   }
+}
+
+// Bytes read for the lowest or highest value of a string column
+static const uint64_t MAX_AGGREGATE_STRING_SIZE = 65535;
+
+// Hash partitions a GROUP BY is split into at most, the last ones are
+// aggregated regardless of the group_by_memory
+static const uint64_t MAX_GROUP_PARTITIONS = 1 << 16;
 
-  if (this->aggr_array != nullptr && this->aggr_array->is_open()) {
-    this->aggr_array->close();
+int tile::mytile_group_by_handler::end_scan() {
+  DBUG_ENTER("tile::mytile_group_by_handler::end_scan");
+  // reset qc and ranges, the array and context belong to the table handler
+  if (this->tiledb_qc != nullptr) {
+    this->tiledb_qc = nullptr;
   }
 
   this->pushdown_ranges.clear();
   this->pushdown_in_ranges.clear();
-  this->aggr_array.reset();
+  this->partition_subarrays.clear();
+  this->groups = nullptr;
+  this->group_partitions.clear();
   DBUG_RETURN(0);
 }
 
@@ -159,18 +224,61 @@ int tile::mytile_group_by_handler::init_scan() {
   int rc = 0;
 
   try {
-    // Get domain, schema and dimensions
-    auto schema = aggr_array->schema();
-    auto domain = schema.domain();
-    int empty_read;
+    if (this->grouping.has_value()) {
+      // Read buffers of the grouping and aggregated columns share the read
+      // buffer size, a batch holds the same cells of every column
+      uint64_t row_size = 0;
+      for (const group_read_column &column : this->grouping->columns) {
+        row_size += column.cell_size() + column.nullable;
+      }
+      uint64_t rows = std::max<uint64_t>(
+          1, tile::sysvars::read_buffer_size(thd) / row_size);
+      for (group_read_column &column : this->grouping->columns) {
+        column.data.resize(rows * column.cell_size());
+        if (column.nullable)
+          column.validity.resize(rows);
+      }
+      for (group_datetime_bucket &bucket : this->grouping->buckets) {
+        bucket.values.resize(rows);
+      }
+      this->datetimes.reset(thd->variables.time_zone);
 
-    this->tiledb_sub = std::unique_ptr<tiledb::Subarray>(
-        new tiledb::Subarray(*this->ctx, *aggr_array));
+      for (const group_output &output : this->grouping->outputs) {
+        if (output.key_column == SIZE_MAX)
+          this->grouping->results[output.aggregate].field =
+              table->field[output.field_index];
+      }
+
+      this->groups = std::make_unique<tile::group_by_table>(
+          group_batch(), this->grouping->key_columns,
+          this->grouping->aggregates);
+      // Groups are returned once their partition is aggregated. Without
+      // grouping columns the single group is returned even if nothing is read
+      this->group_partitions.clear();
+      this->next_group = this->empty_read ? 0 : this->groups->size();
+      if (!this->empty_read)
+        this->group_partitions.emplace_back(1, 0);
+      DBUG_RETURN(rc);
+    }
 
-    tile::build_subarray(thd, this->valid_ranges, this->valid_in_ranges,
-                         empty_read, domain, this->pushdown_ranges,
-                         this->pushdown_in_ranges, this->tiledb_sub,
-                         this->ctx.get(), this->aggr_array.get());
+    // Nothing is partitioned if metadata answers every aggregate, at most the
+    // partially covered fragments are scanned
+    if (!this->metadata_results.empty() &&
+        std::all_of(this->metadata_results.begin(),
+                    this->metadata_results.end(),
+                    [](const std::optional<tile::metadata_aggregate> &result) {
+                      return result.has_value();
+                    })) {
+      DBUG_RETURN(rc);
+    }
+
+    // Partitions are aggregated concurrently and their results merged
+    this->partition_subarrays.clear();
+    if (!this->empty_read) {
+      this->partition_subarrays = tile::partition_subarray(
+          *this->ctx, *this->aggr_array, this->aggr_array->schema().domain(),
+          *this->tiledb_sub, tile::sysvars::parallel_scan_partitions(thd));
+    }
   } catch (const tiledb::TileDBError &e) {
     // Log errors
     my_printf_error(ER_UNKNOWN_ERROR, "[init_scan] error for table %s : %s",
@@ -193,6 +301,321 @@ int tile::mytile_group_by_handler::init_scan() {
   DBUG_RETURN(rc);
 }
 
+std::vector<tile::mytile_group_by_handler::aggregate_result>
+tile::mytile_group_by_handler::submit_aggregates(
+    const std::vector<pushed_aggregate> &aggregates,
+    const tiledb::Subarray &subarray) {
+  tiledb::Query query(*this->ctx, *this->aggr_array, TILEDB_READ);
+  bool dense = this->aggr_array->schema().array_type() == TILEDB_DENSE;
+  query.set_layout(dense ? TILEDB_GLOBAL_ORDER : TILEDB_UNORDERED);
+  if (this->tiledb_qc != nullptr) {
+    query.set_condition(*this->tiledb_qc);
+  }
+  query.set_subarray(subarray);
+
+  // Every aggregate is added to the default channel, so the cells are read
+  // once for all of them. The cells counted give the values of each aggregate
+  tiledb::QueryChannel default_channel =
+      tiledb::QueryExperimental::get_default_channel(query);
+  std::string count_string = "Count";
+  std::vector<uint64_t> cells(1);
+  default_channel.apply_aggregate(count_string, tiledb::CountOperation());
+  query.set_data_buffer(count_string, cells);
+
+  // Buffers of each aggregate, they are all allocated before the query is
+  // given any of them
+  struct aggregate_buffers {
+    std::vector<uint64_t> nulls = std::vector<uint64_t>(1);
+    std::vector<uint64_t> value = std::vector<uint64_t>(1);
+    std::vector<uint64_t> offsets = std::vector<uint64_t>(1);
+    std::vector<uint8_t> validity = std::vector<uint8_t>(1);
+    std::string string_value;
+  };
+  std::vector<aggregate_buffers> buffers(aggregates.size());
+
+  for (size_t i = 0; i < aggregates.size(); i++) {
+    const pushed_aggregate &aggregate = aggregates[i];
+    aggregate_buffers &buffer = buffers[i];
+
+    // The values of a nullable column are its cells less its nulls
+    if (aggregate.nullable) {
+      std::string nulls_string = "NullCount" + std::to_string(i);
+      tiledb::ChannelOperation operation =
+          tiledb::QueryExperimental::create_unary_aggregate<
+              tiledb::NullCountOperator>(query, aggregate.column);
+      default_channel.apply_aggregate(nulls_string, operation);
+      query.set_data_buffer(nulls_string, buffer.nulls);
+    }
+
+    std::string value_string = "Value" + std::to_string(i);
+    switch (aggregate.func) {
+    case Item_sum::COUNT_FUNC:
+      continue;
+    case Item_sum::SUM_FUNC:
+    case Item_sum::AVG_FUNC: {
+      if (dense && aggregate.func == Item_sum::AVG_FUNC) {
+        // Cells counted on dense arrays are not the values averaged
+        default_channel.apply_aggregate(
+            value_string, tiledb::QueryExperimental::create_unary_aggregate<
+                              tiledb::MeanOperator>(query, aggregate.column));
+        query.set_data_buffer(
+            value_string, reinterpret_cast<double *>(buffer.value.data()), 1);
+        break;
+      }
+
+      // Averages are sums divided by the values, so partitions add up
+      default_channel.apply_aggregate(
+          value_string, tiledb::QueryExperimental::create_unary_aggregate<
+                            tiledb::SumOperator>(query, aggregate.column));
+      if (aggregate.type == TILEDB_FLOAT32 ||
+          aggregate.type == TILEDB_FLOAT64) {
+        query.set_data_buffer(
+            value_string, reinterpret_cast<double *>(buffer.value.data()), 1);
+      } else if (tile::is_signed_type(aggregate.type)) {
+        query.set_data_buffer(
+            value_string, reinterpret_cast<int64_t *>(buffer.value.data()), 1);
+      } else {
+        query.set_data_buffer(value_string, buffer.value.data(), 1);
+      }
+      break;
+    }
+    case Item_sum::MAX_FUNC:
+    case Item_sum::MIN_FUNC: {
+      tiledb::ChannelOperation operation =
+          aggregate.func == Item_sum::MAX_FUNC
+              ? tiledb::QueryExperimental::create_unary_aggregate<
+                    tiledb::MaxOperator>(query, aggregate.column)
+              : tiledb::QueryExperimental::create_unary_aggregate<
+                    tiledb::MinOperator>(query, aggregate.column);
+      default_channel.apply_aggregate(value_string, operation);
+
+      if (tile::is_string_type(aggregate.type)) {
+        buffer.string_value.resize(MAX_AGGREGATE_STRING_SIZE);
+        query.set_offsets_buffer(value_string, buffer.offsets);
+        query.set_data_buffer(value_string, buffer.string_value);
+      } else {
+        with_numeric_type(aggregate.type, [&](auto type_value) {
+          using T = decltype(type_value);
+          query.set_data_buffer(
+              value_string, reinterpret_cast<T *>(buffer.value.data()), 1);
+        });
+      }
+      break;
+    }
+    default:
+      throw tiledb::TileDBError(
+          std::string("Unknown or Unsupported aggregate"));
+    }
+
+    if (aggregate.nullable) {
+      query.set_validity_buffer(value_string, buffer.validity);
+    }
+  }
+
+  query.submit();
+
+  std::vector<aggregate_result> results(aggregates.size());
+  for (size_t i = 0; i < aggregates.size(); i++) {
+    const pushed_aggregate &aggregate = aggregates[i];
+    const aggregate_buffers &buffer = buffers[i];
+    aggregate_result &result = results[i];
+    result.values = cells[0] - (aggregate.nullable ? buffer.nulls[0] : 0);
+    // Cells counted on dense arrays include fill values and the cells a query
+    // condition filters, the validity of the aggregate tells if it has values
+    if (dense && aggregate.nullable)
+      result.values = buffer.validity[0] != 0;
+    if (aggregate.func == Item_sum::COUNT_FUNC || result.values == 0)
+      continue;
+
+    if (dense && aggregate.func == Item_sum::AVG_FUNC) {
+      double mean;
+      memcpy(&mean, buffer.value.data(), sizeof(double));
+      result.mean = mean;
+      continue;
+    }
+
+    if (tile::is_string_type(aggregate.type)) {
+      result.string_value = buffer.string_value;
+      result.string_value.erase(std::find(result.string_value.begin(),
+                                          result.string_value.end(), '\0'),
+                                result.string_value.end());
+      continue;
+    }
+
+    // Sums are 64 bit values, bounds have the type of the column
+    tiledb_datatype_t value_type = aggregate.type;
+    if (aggregate.func == Item_sum::SUM_FUNC ||
+        aggregate.func == Item_sum::AVG_FUNC) {
+      if (aggregate.type == TILEDB_FLOAT32 || aggregate.type == TILEDB_FLOAT64)
+        value_type = TILEDB_FLOAT64;
+      else if (tile::is_signed_type(aggregate.type))
+        value_type = TILEDB_INT64;
+      else
+        value_type = TILEDB_UINT64;
+    }
+    with_numeric_type(value_type, [&](auto type_value) {
+      using T = decltype(type_value);
+      T value;
+      memcpy(&value, buffer.value.data(), sizeof(T));
+      if (std::is_floating_point<T>::value)
+        result.double_value = value;
+      else if (std::is_signed<T>::value)
+        result.int_value = value;
+      else
+        result.uint_value = value;
+    });
+  }
+  return results;
+}
+
+std::vector<tile::mytile_group_by_handler::aggregate_result>
+tile::mytile_group_by_handler::aggregate_subarrays(
+    const std::vector<pushed_aggregate> &aggregates,
+    const std::vector<std::unique_ptr<tiledb::Subarray>> &subarrays) {
+  // Every subarray computes all aggregates in one query, at most
+  // mytile_parallel_scan_partitions of them at a time
+  tile::worker_pool workers(
+      std::min<size_t>(subarrays.size(),
+                       tile::sysvars::parallel_scan_partitions(thd)));
+  std::vector<std::future<std::vector<aggregate_result>>> partials;
+  for (const auto &subarray : subarrays) {
+    const tiledb::Subarray *partition_subarray = subarray.get();
+    partials.push_back(
+        workers.submit([this, &aggregates, partition_subarray]() {
+          return submit_aggregates(aggregates, *partition_subarray);
+        }));
+  }
+
+  std::vector<aggregate_result> results(aggregates.size());
+  for (auto &partial : partials) {
+    std::vector<aggregate_result> partial_results = partial.get();
+    for (size_t i = 0; i < aggregates.size(); i++) {
+      merge_aggregate(aggregates[i], partial_results[i], results[i]);
+    }
+  }
+  return results;
+}
+
+tile::mytile_group_by_handler::aggregate_result
+tile::mytile_group_by_handler::metadata_aggregate_result(
+    const pushed_aggregate &aggregate,
+    const tile::metadata_aggregate &metadata) {
+  aggregate_result result;
+  if (metadata.count) {
+    result.values = metadata.cells;
+    return result;
+  }
+  if (metadata.empty)
+    return result;
+
+  // A bound of a dimension is a single value of its type
+  result.values = 1;
+  if (metadata.var_sized || tile::is_string_type(aggregate.type)) {
+    result.string_value = metadata.value;
+  } else if (tile::TileDBDateTimeType(aggregate.type)) {
+    memcpy(&result.int_value, metadata.value.data(), sizeof(int64_t));
+  } else {
+    with_numeric_type(aggregate.type, [&](auto type_value) {
+      using T = decltype(type_value);
+      T value;
+      memcpy(&value, metadata.value.data(), sizeof(T));
+      if (std::is_floating_point<T>::value)
+        result.double_value = value;
+      else if (std::is_signed<T>::value)
+        result.int_value = value;
+      else
+        result.uint_value = value;
+    });
+  }
+  return result;
+}
+
+void tile::mytile_group_by_handler::merge_aggregate(
+    const pushed_aggregate &aggregate, const aggregate_result &partial,
+    aggregate_result &result) {
+  if (partial.values == 0)
+    return;
+
+  bool first = result.values == 0;
+  result.values += partial.values;
+  switch (aggregate.func) {
+  case Item_sum::SUM_FUNC:
+  case Item_sum::AVG_FUNC:
+    result.int_value += partial.int_value;
+    result.uint_value += partial.uint_value;
+    result.double_value += partial.double_value;
+    break;
+  case Item_sum::MAX_FUNC:
+  case Item_sum::MIN_FUNC: {
+    bool max = aggregate.func == Item_sum::MAX_FUNC;
+    auto replaces = [first, max](const auto &value, const auto &bound) {
+      return first || (max ? value > bound : value < bound);
+    };
+    if (replaces(partial.int_value, result.int_value))
+      result.int_value = partial.int_value;
+    if (replaces(partial.uint_value, result.uint_value))
+      result.uint_value = partial.uint_value;
+    if (replaces(partial.double_value, result.double_value))
+      result.double_value = partial.double_value;
+    if (replaces(partial.string_value, result.string_value))
+      result.string_value = partial.string_value;
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+int tile::mytile_group_by_handler::set_aggregate(
+    const pushed_aggregate &aggregate, const aggregate_result &result) {
+  DBUG_ENTER("tile::mytile_group_by_handler::set_aggregate");
+  Field *field = aggregate.field;
+  if (aggregate.func == Item_sum::COUNT_FUNC) {
+    field->set_notnull();
+    field->store(static_cast<longlong>(result.values), true);
+    DBUG_RETURN(0);
+  }
+
+  // Aggregates of no values are null
+  if (result.values == 0) {
+    field->set_null();
+    DBUG_RETURN(0);
+  }
+
+  field->set_notnull();
+  bool floating =
+      aggregate.type == TILEDB_FLOAT32 || aggregate.type == TILEDB_FLOAT64;
+  bool is_signed = tile::is_signed_type(aggregate.type);
+  if (result.mean.has_value()) {
+    field->store(*result.mean);
+    DBUG_RETURN(0);
+  }
+  if (aggregate.func == Item_sum::AVG_FUNC) {
+    double sum = floating    ? result.double_value
+                 : is_signed ? static_cast<double>(result.int_value)
+                             : static_cast<double>(result.uint_value);
+    field->store(sum / result.values);
+    DBUG_RETURN(0);
+  }
+
+  if (tile::TileDBDateTimeType(aggregate.type)) {
+    // Bounds of datetimes are epoch values, converted like a cell
+    const char *cell = reinterpret_cast<const char *>(&result.int_value);
+    DBUG_RETURN(set_field_from_cell(field, aggregate.type, cell,
+                                    sizeof(result.int_value), false));
+  } else if (tile::is_string_type(aggregate.type)) {
+    field->store(result.string_value.c_str(), result.string_value.length(),
+                 &my_charset_latin1);
+  } else if (floating) {
+    field->store(result.double_value);
+  } else if (is_signed) {
+    field->store(result.int_value, false);
+  } else {
+    field->store(static_cast<longlong>(result.uint_value), true);
+  }
+  DBUG_RETURN(0);
+}
+
 int tile::mytile_group_by_handler::next_row() {
   DBUG_ENTER("tile::mytile_group_by_handler::next_row");
   int rc = 0;
@@ -200,148 +623,107 @@ int tile::mytile_group_by_handler::next_row() {
   SELECT_LEX *select_lex = thd->lex->current_select;
   List_iterator_fast<Item> it(select_lex->item_list);
   Field **field_ptr = table->field;
-  std::vector<uint8_t> validity(1);
-  Item_sum *item_sum;
+  Item *item;
+  size_t items = 0;
 
   /*
     Check if this is the first call to the function. If not, we have already
     returned all data.
   */
-  if (!first_row) {
+  if (!first_row && !this->grouping.has_value()) {
     DBUG_RETURN(HA_ERR_END_OF_FILE);
   }
 
   first_row = 0;
   try {
-    while ((item_sum = (Item_sum *)it++)) {
-      Field *field = *(field_ptr++);
-      Item_sum *item_sum_ptr = dynamic_cast<Item_sum *>(item_sum);
-
-      if (!item_sum_ptr)
-        continue;
-
-      if (item_sum_ptr->get_arg_count() == 0)
-        continue;
+    if (this->grouping.has_value()) {
+      // Hash partitions are aggregated until one has groups left to return
+      while (this->next_group >= this->groups->size()) {
+        if (this->group_partitions.empty())
+          DBUG_RETURN(HA_ERR_END_OF_FILE);
 
-      std::string column_with_aggregate;
-      const char *str_ptr = item_sum_ptr->get_arg(0)->name.str;
-      if (str_ptr != nullptr) {
-        std::string column_with_aggregate = str_ptr;
-      } else {
-        continue;
+        auto [partitions, partition] = this->group_partitions.front();
+        this->group_partitions.pop_front();
+        this->groups->clear();
+        this->next_group = 0;
+        aggregate_groups(partitions, partition);
       }
+      DBUG_RETURN(set_group_row());
+    }
 
-      this->aggr_query =
-          std::make_unique<tiledb::Query>(*this->ctx, *aggr_array, TILEDB_READ);
-
-      auto schema = aggr_array->schema();
-      auto domain = schema.domain();
-
-      // set layout todo check correctness
-      if (schema.array_type() == TILEDB_SPARSE) {
-        aggr_query->set_layout(TILEDB_UNORDERED);
-      } else {
-        aggr_query->set_layout(TILEDB_GLOBAL_ORDER);
+    auto schema = aggr_array->schema();
+    std::vector<pushed_aggregate> aggregates;
+    // Metadata results over the fully covered fragments of each aggregate
+    std::vector<aggregate_result> covered;
+    while ((item = it++)) {
+      Field *field = *(field_ptr++);
+      size_t item_idx = items++;
+
+      // Aggregates answered from metadata need no query, unless partially
+      // covered fragments are left to scan
+      if (item_idx < this->metadata_results.size() &&
+          this->metadata_results[item_idx].has_value() &&
+          this->fragment_subarrays.empty()) {
+        rc = set_metadata_aggregate(*this->metadata_results[item_idx], field);
+        if (rc)
+          DBUG_RETURN(rc);
+        continue;
       }
 
-      tiledb::QueryChannel default_channel =
-          tiledb::QueryExperimental::get_default_channel(*aggr_query);
-
-      // add query condition
-      if (this->tiledb_qc != nullptr) {
-        aggr_query->set_condition(*this->tiledb_qc);
-      }
+      Item_sum *item_sum = dynamic_cast<Item_sum *>(item);
+      if (!item_sum)
+        continue;
 
-      aggr_query->set_subarray(*this->tiledb_sub);
+      std::optional<std::string> column = aggregate_column(item_sum);
+      if (!column.has_value())
+        continue;
 
-      bool nullable = false;
-      tiledb_datatype_t type;
-      if (schema.has_attribute(column_with_aggregate)) {
-        auto attr = schema.attribute(column_with_aggregate);
-        if (attr.nullable())
-          nullable = true;
-        type = attr.type();
-      } else {
-        auto dim = domain.dimension(column_with_aggregate);
-        type = dim.type();
+      pushed_aggregate aggregate{field, item_sum->sum_func(), *column};
+      if (schema.has_attribute(aggregate.column)) {
+        auto attr = schema.attribute(aggregate.column);
+        aggregate.nullable = attr.nullable();
+        aggregate.type = attr.type();
+      } else if (!aggregate.column.empty()) {
+        aggregate.type = schema.domain().dimension(aggregate.column).type();
       }
-      switch (item_sum->sum_func()) {
-      case Item_sum::SUM_FUNC: {
-        std::string sum_string = "Sum";
-        tiledb::ChannelOperation operation =
-            tiledb::QueryExperimental::create_unary_aggregate<
-                tiledb::SumOperator>(*aggr_query, column_with_aggregate);
-        default_channel.apply_aggregate(sum_string, operation);
-
-        if (nullable) {
-          aggr_query->set_validity_buffer(sum_string, validity);
-        }
-
-        submit_and_set_sum_aggregate(aggr_query, type, field, sum_string);
-
-        break;
+      if (!this->fragment_subarrays.empty()) {
+        covered.push_back(metadata_aggregate_result(
+            aggregate, *this->metadata_results[item_idx]));
       }
-      case Item_sum::COUNT_FUNC: {
-        std::string count_string = "Count";
-        default_channel.apply_aggregate(count_string, tiledb::CountOperation());
+      aggregates.push_back(std::move(aggregate));
+    }
 
-        if (nullable) {
-          aggr_query->set_validity_buffer(count_string, validity);
+    if (!aggregates.empty()) {
+      // Averages TileDB computes on dense arrays do not merge across
+      // partitions
+      bool mergeable =
+          schema.array_type() != TILEDB_DENSE ||
+          std::none_of(aggregates.begin(), aggregates.end(),
+                       [](const pushed_aggregate &aggregate) {
+                         return aggregate.func == Item_sum::AVG_FUNC;
+                       });
+
+      // Ranges matching no cells aggregate no values
+      std::vector<aggregate_result> results(aggregates.size());
+      if (!this->fragment_subarrays.empty()) {
+        // Only the partially covered fragments are scanned, the fully
+        // covered ones are answered from metadata
+        results = aggregate_subarrays(aggregates, this->fragment_subarrays);
+        for (size_t i = 0; i < aggregates.size(); i++) {
+          merge_aggregate(aggregates[i], covered[i], results[i]);
         }
-
-        std::vector<uint64_t> count(1);
-        aggr_query->set_data_buffer(count_string, count);
-
-        aggr_query->submit();
-
-        field->store(count[0], 0);
-        break;
-      }
-      case Item_sum::AVG_FUNC: {
-        std::string avg_string = "Avg";
-        tiledb::ChannelOperation operation =
-            tiledb::QueryExperimental::create_unary_aggregate<
-                tiledb::MeanOperator>(*aggr_query, column_with_aggregate);
-        default_channel.apply_aggregate(avg_string, operation);
-        if (nullable)
-          aggr_query->set_validity_buffer(avg_string, validity);
-        std::vector<double> avg(1);
-        aggr_query->set_data_buffer(avg_string, avg);
-
-        aggr_query->submit();
-
-        field->store(avg[0]);
-        break;
+      } else if ((this->partition_subarrays.empty() || !mergeable) &&
+                 !this->empty_read) {
+        results = submit_aggregates(aggregates, *this->tiledb_sub);
+      } else if (!this->empty_read) {
+        results = aggregate_subarrays(aggregates, this->partition_subarrays);
       }
-      case Item_sum::MAX_FUNC:
-      case Item_sum::MIN_FUNC: {
-        std::unique_ptr<tiledb::ChannelOperation> operation;
-
-        if (item_sum->sum_func() == Item_sum::MAX_FUNC) {
-          operation = std::make_unique<tiledb::ChannelOperation>(
-              tiledb::QueryExperimental::create_unary_aggregate<
-                  tiledb::MaxOperator>(*aggr_query, column_with_aggregate));
-        } else {
-          operation = std::make_unique<tiledb::ChannelOperation>(
-              tiledb::QueryExperimental::create_unary_aggregate<
-                  tiledb::MinOperator>(*aggr_query, column_with_aggregate));
-        }
-
-        std::string minmax_string = "minmax";
-        default_channel.apply_aggregate(minmax_string, *operation);
-        if (nullable) {
-          aggr_query->set_validity_buffer(minmax_string, validity);
-        }
-
-        submit_and_set_minmax_aggregate(aggr_query, type, field, minmax_string);
 
-        break;
-      }
-      default:
-        throw tiledb::TileDBError(
-            std::string("Unknown or Unsupported aggregate"));
+      for (size_t i = 0; i < aggregates.size(); i++) {
+        rc = set_aggregate(aggregates[i], results[i]);
+        if (rc)
+          break;
       }
-      field->set_notnull();
     }
   } catch (const tiledb::TileDBError &e) {
     // Log errors
@@ -363,87 +745,269 @@ int tile::mytile_group_by_handler::next_row() {
   DBUG_RETURN(rc);
 }
 
-int tile::mytile_group_by_handler::submit_and_set_minmax_aggregate(
-    std::shared_ptr<tiledb::Query> &aggr_query, const tiledb_datatype_t type,
-    Field *field, std::string minmax_string) {
-  DBUG_ENTER("tile::mytile_group_by_handler::submit_and_set_minmax_aggregate");
+int tile::mytile_group_by_handler::set_metadata_aggregate(
+    const tile::metadata_aggregate &result, Field *field) {
+  DBUG_ENTER("tile::mytile_group_by_handler::set_metadata_aggregate");
+  if (result.count) {
+    field->store(result.cells, 1);
+    field->set_notnull();
+    DBUG_RETURN(0);
+  }
+
+  // Bounds of no cells are null
+  if (result.empty) {
+    field->set_null();
+    DBUG_RETURN(0);
+  }
+
+  DBUG_RETURN(set_field_from_cell(field, result.type, result.value.data(),
+                                  result.value.size(), result.var_sized));
+}
+
+int tile::mytile_group_by_handler::set_field_from_cell(Field *field,
+                                                       tiledb_datatype_t type,
+                                                       const char *cell,
+                                                       uint64_t size,
+                                                       bool var_sized) {
+  DBUG_ENTER("tile::mytile_group_by_handler::set_field_from_cell");
+  // Wrap the cell in a single cell buffer so it is converted like the cells
+  // of a scan
+  std::string value(cell, size);
+  uint64_t offset = 0;
+  auto buff = std::make_shared<buffer>();
+  buff->type = type;
+  buff->buffer = value.data();
+  buff->buffer_size = value.size();
+  buff->allocated_buffer_size = value.size();
+  buff->dimension = true;
+  buff->fixed_size_elements =
+      var_sized ? TILEDB_VAR_NUM : size / tiledb_datatype_size(type);
+  if (var_sized) {
+    buff->offset_buffer = &offset;
+    buff->offset_buffer_size = sizeof(uint64_t);
+    buff->allocated_offset_buffer_size = sizeof(uint64_t);
+  }
+
+  tile::datetime_converter datetimes;
+  datetimes.reset(thd->variables.time_zone);
+  field->set_notnull();
+  int rc = tile::get_field_converter(buff)(thd, field, buff, 0, &datetimes);
+  DBUG_RETURN(rc);
+}
+
+int tile::mytile_group_by_handler::set_bucket_field(
+    Field *field, const tile::datetime_bucket &bucket, int64_t value) {
+  DBUG_ENTER("tile::mytile_group_by_handler::set_bucket_field");
+  field->set_notnull();
+  if (bucket.unit != tile::datetime_bucket_unit::DAY)
+    DBUG_RETURN(field->store(value, false));
+
+  // Days are converted to a date once per group
+  MYSQL_TIME date;
+  tile::epoch_seconds_to_datetime(&date, value * 24 * 60 * 60);
+  date.time_type = MYSQL_TIMESTAMP_DATE;
+  DBUG_RETURN(field->store_time(&date));
+}
 
-  try {
-    switch (type) {
-    case TILEDB_FLOAT32: {
-      std::vector<float> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0]);
-      break;
-    }
-    case TILEDB_FLOAT64: {
-      std::vector<double> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0]);
-      break;
-    }
-    case TILEDB_INT8: {
-      std::vector<int8_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 1);
-      break;
-    }
-    case TILEDB_UINT8: {
-      std::vector<uint8_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 0);
-      break;
-    }
-    case TILEDB_INT16: {
-      std::vector<int16_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 1);
-      break;
+std::vector<tile::group_column>
+tile::mytile_group_by_handler::group_batch() const {
+  std::vector<tile::group_column> batch;
+  for (const group_read_column &column : this->grouping->columns) {
+    tile::group_column cells;
+    cells.type = column.type;
+    cells.cell_size = column.cell_size();
+    cells.data = column.data.data();
+    cells.validity = column.nullable ? column.validity.data() : nullptr;
+    batch.push_back(cells);
+  }
+
+  // Buckets follow the columns read
+  for (const group_datetime_bucket &bucket : this->grouping->buckets) {
+    tile::group_column cells;
+    cells.type = TILEDB_INT64;
+    cells.cell_size = sizeof(int64_t);
+    cells.data = reinterpret_cast<const char *>(bucket.values.data());
+    batch.push_back(cells);
+  }
+  return batch;
+}
+
+void tile::mytile_group_by_handler::aggregate_groups(uint64_t partitions,
+                                                     uint64_t partition) {
+  tiledb::Query query(*this->ctx, *this->aggr_array, TILEDB_READ);
+  query.set_layout(TILEDB_UNORDERED);
+  if (this->tiledb_qc != nullptr) {
+    query.set_condition(*this->tiledb_qc);
+  }
+  query.set_subarray(*this->tiledb_sub);
+
+  uint64_t memory_limit = tile::sysvars::group_by_memory(thd);
+  std::vector<tile::group_column> batch = group_batch();
+  tiledb::Query::Status status;
+  do {
+    // Sizes were overwritten by the last submit
+    for (group_read_column &column : this->grouping->columns) {
+      column.data_size = column.data.size();
+      this->ctx->handle_error(tiledb_query_set_data_buffer(
+          this->ctx->ptr().get(), query.ptr().get(), column.name.c_str(),
+          column.data.data(), &column.data_size));
+      if (column.nullable) {
+        column.validity_size = column.validity.size();
+        this->ctx->handle_error(tiledb_query_set_validity_buffer(
+            this->ctx->ptr().get(), query.ptr().get(), column.name.c_str(),
+            column.validity.data(), &column.validity_size));
+      }
     }
-    case TILEDB_UINT16: {
-      std::vector<uint16_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 0);
-      break;
+
+    query.submit();
+    status = query.query_status();
+
+    const group_read_column &first = this->grouping->columns.front();
+    uint64_t rows = first.data_size / first.cell_size();
+    if (rows == 0 && status == tiledb::Query::Status::INCOMPLETE) {
+      throw tiledb::TileDBError(
+          "Read buffer size is too small to group a single cell");
     }
-    case TILEDB_INT32: {
-      std::vector<int32_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 1);
-      break;
+    for (group_datetime_bucket &bucket : this->grouping->buckets) {
+      tile::bucket_datetimes(batch[bucket.column], rows, bucket.bucket,
+                             this->datetimes, bucket.values.data());
     }
-    case TILEDB_UINT32: {
-      std::vector<uint32_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 0);
-      break;
+    this->groups->aggregate_batch(batch, rows, partitions, partition);
+
+    // Groups beyond the memory limit are split in two partitions, each
+    // scanning the array again. A single group can not be split
+    if (memory_limit != 0 && this->groups->memory() > memory_limit &&
+        this->groups->size() > 1 && partitions < MAX_GROUP_PARTITIONS) {
+      this->groups->clear();
+      this->group_partitions.emplace_front(2 * partitions,
+                                           partition + partitions);
+      this->group_partitions.emplace_front(2 * partitions, partition);
+      return;
     }
-    case TILEDB_UINT64: {
-      std::vector<uint64_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 0);
-      break;
+  } while (status == tiledb::Query::Status::INCOMPLETE);
+}
+
+int tile::mytile_group_by_handler::set_group_row() {
+  DBUG_ENTER("tile::mytile_group_by_handler::set_group_row");
+  uint64_t group = this->next_group++;
+  int rc = 0;
+  for (const group_output &output : this->grouping->outputs) {
+    if (output.key_column == SIZE_MAX) {
+      const tile::group_aggregate_state &state =
+          this->groups->state(group, output.aggregate);
+      aggregate_result result;
+      result.values = state.values;
+      result.int_value = state.int_value;
+      result.uint_value = state.uint_value;
+      result.double_value = state.double_value;
+      rc = set_aggregate(this->grouping->results[output.aggregate], result);
+    } else {
+      Field *field = table->field[output.field_index];
+      size_t column_idx = this->grouping->key_columns[output.key_column];
+      const char *cell = this->groups->key_value(group, output.key_column);
+      if (cell == nullptr) {
+        field->set_null();
+        continue;
+      }
+
+      if (column_idx < this->grouping->columns.size()) {
+        const group_read_column &column = this->grouping->columns[column_idx];
+        rc = set_field_from_cell(field, column.type, cell, column.cell_size(),
+                                 false);
+      } else {
+        size_t bucket_idx = column_idx - this->grouping->columns.size();
+        int64_t value;
+        memcpy(&value, cell, sizeof(value));
+        rc = set_bucket_field(field, this->grouping->buckets[bucket_idx].bucket,
+                              value);
+      }
     }
-    case TILEDB_INT64: {
-      std::vector<int64_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 1);
+    if (rc)
       break;
-    }
-    case TILEDB_DATETIME_YEAR:
-    case TILEDB_DATETIME_MONTH:
-    case TILEDB_DATETIME_WEEK:
-    case TILEDB_DATETIME_DAY:
+  }
+  DBUG_RETURN(rc);
+}
+
+/**
+ * Recognizes a grouping expression putting the cells of a datetime column in
+ * buckets: FLOOR(UNIX_TIMESTAMP(ts) / n), UNIX_TIMESTAMP(ts) DIV n, DATE(ts)
+ * and HOUR(ts)
+ * @param item The grouping expression
+ * @param bucket Set to the buckets of the expression
+ * @return the column, nullptr if the expression is not a bucket
+ */
+static Item_field *datetime_bucket_column(Item *item,
+                                          tile::datetime_bucket &bucket) {
+  if (item->type() != Item::FUNC_ITEM)
+    return nullptr;
+  Item_func *func = static_cast<Item_func *>(item);
+  if (func->argument_count() == 0)
+    return nullptr;
+
+  Item *arg = func->arguments()[0];
+  Item *divisor = nullptr;
+  if (dynamic_cast<Item_func_hour *>(func) != nullptr) {
+    bucket.unit = tile::datetime_bucket_unit::HOUR;
+  } else if (dynamic_cast<Item_date_typecast *>(func) != nullptr) {
+    bucket.unit = tile::datetime_bucket_unit::DAY;
+  } else if (dynamic_cast<Item_func_int_div *>(func) != nullptr) {
+    bucket.unit = tile::datetime_bucket_unit::INTERVAL;
+    divisor = func->arguments()[1];
+  } else if (dynamic_cast<Item_func_floor *>(func) != nullptr) {
+    Item_func_div *div = dynamic_cast<Item_func_div *>(arg->real_item());
+    if (div == nullptr)
+      return nullptr;
+    bucket.unit = tile::datetime_bucket_unit::INTERVAL;
+    arg = div->arguments()[0];
+    divisor = div->arguments()[1];
+  } else {
+    return nullptr;
+  }
+
+  // Intervals are whole seconds of UNIX_TIMESTAMP(), flooring the quotient
+  // of fractional seconds gives the same bucket
+  if (divisor != nullptr) {
+    if (!divisor->basic_const_item() || divisor->result_type() != INT_RESULT ||
+        divisor->is_null() || divisor->val_int() <= 0)
+      return nullptr;
+    bucket.interval = divisor->val_int();
+
+    Item_func_unix_timestamp *unix_timestamp =
+        dynamic_cast<Item_func_unix_timestamp *>(arg->real_item());
+    if (unix_timestamp == nullptr || unix_timestamp->argument_count() != 1)
+      return nullptr;
+    arg = unix_timestamp->arguments()[0];
+  }
+
+  arg = arg->real_item();
+  if (arg->type() != Item::FIELD_ITEM)
+    return nullptr;
+  Item_field *field = static_cast<Item_field *>(arg);
+  // TIMESTAMP columns are UTC, DATETIME columns are local datetimes
+  bucket.round_trip = field->field->type() != MYSQL_TYPE_TIMESTAMP;
+  return field;
+}
+
+/**
+ * Checks if the buckets of a column can be computed from its epoch values:
+ * it is a datetime dimension of one hour or less per unit, and every value
+ * of the non empty domain converts without consulting the time zone
+ * @param schema The array schema
+ * @param non_empty_domain The non empty domain of the array
+ * @param name The column
+ * @return
+ */
+static bool datetime_bucketable(const tiledb::ArraySchema &schema,
+                                const tile::non_empty_domain &non_empty_domain,
+                                const std::string &name) {
+  tiledb::Domain domain = schema.domain();
+  for (uint32_t dim_idx = 0; dim_idx < domain.ndim(); dim_idx++) {
+    tiledb::Dimension dimension = domain.dimension(dim_idx);
+    if (dimension.name() != name)
+      continue;
+
+    tiledb_datatype_t type = dimension.type();
+    switch (type) {
     case TILEDB_DATETIME_HR:
     case TILEDB_DATETIME_MIN:
     case TILEDB_DATETIME_SEC:
@@ -453,134 +1017,210 @@ int tile::mytile_group_by_handler::submit_and_set_minmax_aggregate(
     case TILEDB_DATETIME_PS:
     case TILEDB_DATETIME_FS:
     case TILEDB_DATETIME_AS:
-    case TILEDB_TIME_HR:
-    case TILEDB_TIME_MIN:
-    case TILEDB_TIME_SEC:
-    case TILEDB_TIME_MS:
-    case TILEDB_TIME_US:
-    case TILEDB_TIME_NS:
-    case TILEDB_TIME_PS:
-    case TILEDB_TIME_FS:
-    case TILEDB_TIME_AS: {
-      std::vector<int64_t> minmax(1);
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      field->store(minmax[0], 1);
       break;
+    default:
+      return false;
     }
-    case TILEDB_STRING_UTF8:
-    case TILEDB_STRING_ASCII:
-    case TILEDB_STRING_UCS2:
-    case TILEDB_STRING_UCS4:
-    case TILEDB_STRING_UTF16:
-    case TILEDB_STRING_UTF32:
-    case TILEDB_CHAR: {
-      std::vector<uint64_t> offsets(1);
-      aggr_query->set_offsets_buffer(minmax_string, offsets);
-      std::string minmax;
-      minmax.resize(32); // todo what size should we put here? maybe add option
-                         // for users to increase this?
-      aggr_query->set_data_buffer(minmax_string, minmax);
-      aggr_query->submit();
-      minmax.erase(std::find(minmax.begin(), minmax.end(), '\0'), minmax.end());
-      field->store(minmax.c_str(), minmax.length(), &my_charset_latin1);
-      break;
+    if (non_empty_domain.empty)
+      return true;
+
+    int64_t bounds[2];
+    memcpy(bounds, non_empty_domain.fixed[dim_idx].data(), sizeof(bounds));
+    return tile::datetime_seconds_cached(
+               tile::datetime_epoch_seconds(bounds[0], type)) &&
+           tile::datetime_seconds_cached(
+               tile::datetime_epoch_seconds(bounds[1], type));
+  }
+  return false;
+}
+
+std::optional<tile::mytile_group_by_handler::group_by_plan>
+tile::mytile_group_by_handler::plan_group_by(
+    Query *query, tiledb::Array &array,
+    const tile::non_empty_domain &non_empty_domain) {
+  // Dense reads return fill values for cells never written or filtered out
+  tiledb::ArraySchema schema = array.schema();
+  if (query->having != nullptr || schema.array_type() != TILEDB_SPARSE)
+    return std::nullopt;
+
+  group_by_plan plan;
+  // Index of a fixed size column in the columns read, added if not read yet
+  auto column_index = [&](Item *item) -> std::optional<size_t> {
+    Item *real_item = item->real_item();
+    if (real_item->type() != Item::FIELD_ITEM)
+      return std::nullopt;
+    const Item_field *field = static_cast<Item_field *>(real_item);
+    std::string name(field->field_name.str, field->field_name.length);
+    for (size_t i = 0; i < plan.columns.size(); i++) {
+      if (plan.columns[i].name == name)
+        return i;
     }
-    default: {
-      throw tiledb::TileDBError(
-          std::string("Unknown or Unsupported type for aggregate"));
+
+    group_read_column column;
+    column.name = name;
+    if (schema.has_attribute(name)) {
+      tiledb::Attribute attr = schema.attribute(name);
+      column.type = attr.type();
+      column.nullable = attr.nullable();
+      column.cell_val_num = attr.cell_val_num();
+    } else if (schema.domain().has_dimension(name)) {
+      tiledb::Dimension dim = schema.domain().dimension(name);
+      column.type = dim.type();
+      column.cell_val_num = dim.cell_val_num();
+    } else {
+      return std::nullopt;
     }
+    if (column.cell_val_num == TILEDB_VAR_NUM)
+      return std::nullopt;
+    plan.columns.push_back(std::move(column));
+    return plan.columns.size() - 1;
+  };
+
+  // Grouping expressions, buckets index into the buckets until every column
+  // read is known
+  std::vector<Item *> key_items;
+  std::vector<bool> key_buckets;
+  for (ORDER *order = query->group_by; order != nullptr; order = order->next) {
+    Item *group_item = (*order->item)->real_item();
+    if (std::any_of(key_items.begin(), key_items.end(), [&](Item *key_item) {
+          return key_item->eq(group_item, false);
+        }))
+      continue;
+
+    tile::datetime_bucket bucket;
+    std::optional<size_t> column = column_index(group_item);
+    if (column.has_value() && plan.columns[*column].cell_val_num == 1) {
+      plan.key_columns.push_back(*column);
+      key_buckets.push_back(false);
+    } else if (column.has_value()) {
+      return std::nullopt;
+    } else if (Item_field *field = datetime_bucket_column(group_item, bucket)) {
+      column = column_index(field);
+      if (!column.has_value() ||
+          !datetime_bucketable(schema, non_empty_domain,
+                               plan.columns[*column].name))
+        return std::nullopt;
+      plan.key_columns.push_back(plan.buckets.size());
+      key_buckets.push_back(true);
+      plan.buckets.push_back({*column, bucket, {}});
+    } else {
+      return std::nullopt;
     }
-  } catch (const tiledb::TileDBError &e) {
-    // Log errors
-    my_printf_error(ER_UNKNOWN_ERROR, "[submit_and_set_sum_aggregate] error",
-                    ME_ERROR_LOG | ME_FATAL);
-    DBUG_RETURN(ERR_AGGREGATES);
-  } catch (const std::exception &e) {
-    // Log errors
-    my_printf_error(ER_UNKNOWN_ERROR, "[submit_and_set_sum_aggregate] error",
-                    ME_ERROR_LOG | ME_FATAL, this->uri.c_str(), e.what());
-    DBUG_RETURN(ERR_AGGREGATES);
+    key_items.push_back(group_item);
   }
-  DBUG_RETURN(0);
-}
 
-int tile::mytile_group_by_handler::submit_and_set_sum_aggregate(
-    std::shared_ptr<tiledb::Query> &aggr_query, const tiledb_datatype_t type,
-    Field *field, std::string sum_string) {
-  DBUG_ENTER("tile::mytile_group_by_handler::submit_and_set_sum_aggregate");
-  try {
-    switch (type) {
-    case TILEDB_FLOAT32:
-    case TILEDB_FLOAT64: {
-      std::vector<double> sum(1);
-      aggr_query->set_data_buffer(sum_string, sum);
-      aggr_query->submit();
-      field->store(sum[0]);
-      break;
+  // Every field of the result table is a grouping column or an aggregate
+  Item *item;
+  size_t field_index = 0;
+  List_iterator_fast<Item> it(*query->select);
+  while ((item = it++)) {
+    group_output output{field_index++};
+    Item_sum *item_sum = dynamic_cast<Item_sum *>(item);
+    if (item_sum == nullptr) {
+      Item *real_item = item->real_item();
+      auto key = std::find_if(
+          key_items.begin(), key_items.end(),
+          [&](Item *key_item) { return key_item->eq(real_item, false); });
+      if (key == key_items.end())
+        return std::nullopt;
+      output.key_column = key - key_items.begin();
+      plan.outputs.push_back(output);
+      continue;
     }
-    case TILEDB_UINT8:
-    case TILEDB_UINT16:
-    case TILEDB_UINT32:
-    case TILEDB_UINT64: {
-      std::vector<uint64_t> sum(1);
-      aggr_query->set_data_buffer(sum_string, sum);
-      aggr_query->submit();
-      field->store(sum[0], 0);
+
+    tile::group_aggregate aggregate;
+    switch (item_sum->sum_func()) {
+    case Item_sum::COUNT_FUNC:
+      aggregate.function = tile::group_aggregate_function::COUNT;
       break;
-    }
-    case TILEDB_INT8:
-    case TILEDB_INT16:
-    case TILEDB_INT32:
-    case TILEDB_INT64: {
-      std::vector<int64_t> sum(1);
-      aggr_query->set_data_buffer(sum_string, sum);
-      aggr_query->submit();
-      field->store(sum[0], 1);
+    case Item_sum::SUM_FUNC:
+      aggregate.function = tile::group_aggregate_function::SUM;
+      break;
+    case Item_sum::AVG_FUNC:
+      aggregate.function = tile::group_aggregate_function::AVG;
+      break;
+    case Item_sum::MIN_FUNC:
+      aggregate.function = tile::group_aggregate_function::MIN;
+      break;
+    case Item_sum::MAX_FUNC:
+      aggregate.function = tile::group_aggregate_function::MAX;
       break;
-    }
     default:
-      throw tiledb::TileDBError(
-          std::string("Unknown or Unsupported type for aggregate"));
+      return std::nullopt;
     }
-  } catch (const tiledb::TileDBError &e) {
-    // Log errors
-    my_printf_error(ER_UNKNOWN_ERROR, "[submit_and_set_sum_aggregate] error",
-                    ME_ERROR_LOG | ME_FATAL);
-    DBUG_RETURN(ERR_AGGREGATES);
-  } catch (const std::exception &e) {
-    // Log errors
-    my_printf_error(ER_UNKNOWN_ERROR, "[submit_and_set_sum_aggregate] error",
-                    ME_ERROR_LOG | ME_FATAL, this->uri.c_str(), e.what());
-    DBUG_RETURN(ERR_AGGREGATES);
+
+    std::optional<std::string> name = aggregate_column(item_sum);
+    if (!name.has_value())
+      return std::nullopt;
+    pushed_aggregate result{nullptr, item_sum->sum_func(), *name};
+    if (!name->empty()) {
+      std::optional<size_t> column = column_index(item_sum->get_arg(0));
+      if (!column.has_value())
+        return std::nullopt;
+      const group_read_column &read = plan.columns[*column];
+      // Every column is counted, multi value cells as a whole. Numbers and
+      // booleans are added up, datetimes are only compared as epoch values
+      bool numeric =
+          tile::is_numeric_type(read.type) || read.type == TILEDB_BOOL;
+      bool comparable = numeric || tile::TileDBDateTimeType(read.type);
+      switch (aggregate.function) {
+      case tile::group_aggregate_function::COUNT:
+        break;
+      case tile::group_aggregate_function::SUM:
+      case tile::group_aggregate_function::AVG:
+        if (!numeric || read.cell_val_num != 1)
+          return std::nullopt;
+        break;
+      case tile::group_aggregate_function::MIN:
+      case tile::group_aggregate_function::MAX:
+        if (!comparable || read.cell_val_num != 1)
+          return std::nullopt;
+        break;
+      }
+      aggregate.column = *column;
+      result.type = read.type;
+      result.nullable = read.nullable;
+    }
+
+    output.aggregate = plan.aggregates.size();
+    plan.aggregates.push_back(aggregate);
+    plan.results.push_back(std::move(result));
+    plan.outputs.push_back(output);
   }
-  DBUG_RETURN(0);
+
+  for (size_t i = 0; i < plan.key_columns.size(); i++) {
+    if (key_buckets[i])
+      plan.key_columns[i] += plan.columns.size();
+  }
+  return plan;
 }
 
 /**
- * Checks if the given field in the given array is aggregation compatible
- * @param field The input field
- * @param aggregate The aggregation
+ * Checks if the given aggregate can be computed by TileDB on the given array
+ * @param item The aggregate
  * @param array_for_comp  The array
  * @return
  */
-static bool aggregate_is_supported(const std::string field,
-                                   const Item_sum::Sumfunctype aggregate,
+static bool aggregate_is_supported(Item_sum *item,
                                    tiledb::Array *array_for_comp) {
-  // if it not an attribute, no TileDB aggregation can be applied
+  std::optional<std::string> field = aggregate_column(item);
+  if (!field.has_value())
+    return false;
 
-  tiledb_datatype_t type;
+  tiledb_datatype_t type = TILEDB_ANY;
   tiledb::ArraySchema schema = array_for_comp->schema();
   tiledb::Domain domain = schema.domain();
-  if (schema.has_attribute(field)) {
-    auto attr = schema.attribute(field);
+  if (field->empty()) {
+    // Counts of every cell read no column
+  } else if (schema.has_attribute(*field)) {
+    auto attr = schema.attribute(*field);
     if (attr.cell_val_num() > 1 && !attr.variable_sized())
       return false; // multi valued not supported
     type = attr.type();
-  } else if (domain.has_dimension(field)) {
+  } else if (domain.has_dimension(*field)) {
     if (schema.array_type() == TILEDB_SPARSE)
       return false; // disable on sparse array dims
-    auto dim = schema.domain().dimension(field);
+    auto dim = schema.domain().dimension(*field);
     type = dim.type();
   } else {
     return false;
@@ -588,7 +1228,7 @@ static bool aggregate_is_supported(const std::string field,
 
   // The following switch is based on
   // https://docs.tiledb.com/main/background/internal-mechanics/aggregates
-  switch (aggregate) {
+  switch (item->sum_func()) {
   case Item_sum::SUM_FUNC:
   case Item_sum::AVG_FUNC:
     return tile::is_numeric_type(type);
@@ -604,114 +1244,311 @@ static bool aggregate_is_supported(const std::string field,
   }
 }
 
+/**
+ * Checks if an aggregate reads a nullable attribute
+ * @param item The aggregate
+ * @param array The array of the table
+ * @return
+ */
+static bool aggregate_of_nullable_column(Item_sum *item,
+                                         tiledb::Array *array) {
+  std::optional<std::string> column = aggregate_column(item);
+  tiledb::ArraySchema schema = array->schema();
+  return column.has_value() && schema.has_attribute(*column) &&
+         schema.attribute(*column).nullable();
+}
+
+/**
+ * Checks if every item of a select is an aggregate TileDB can compute on the
+ * only table of the select, so the group by handler can answer it
+ * @param select_lex The select
+ * @param array The array of the table
+ * @return
+ */
+static bool select_aggregates_pushable(SELECT_LEX *select_lex,
+                                       tiledb::Array *array) {
+  if (!select_lex->agg_func_used() || select_lex->group_list.elements != 0 ||
+      select_lex->order_list.elements != 0 || select_lex->having != nullptr ||
+      select_lex->table_list.elements != 1)
+    return false;
+
+  Item *item;
+  List_iterator_fast<Item> it(select_lex->item_list);
+  while ((item = it++)) {
+    Item_sum *isp = dynamic_cast<Item_sum *>(item);
+    if (isp == nullptr || !aggregate_is_supported(isp, array))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Answers a count of all cells or a bound of a dimension from metadata
+ * @param item The aggregate
+ * @param ctx The context
+ * @param array The array open for reads
+ * @param non_empty_domain The non empty domain of the array
+ * @param listing The fragments of the array
+ * @param subarray The subarray of the pushed ranges
+ * @param restricted True if the read is limited by pushed conditions
+ * @param fragments Fragments of a restricted sparse read, the result only
+ * covers those the ranges fully cover. Null to answer from the whole read
+ * @return result, nullopt if the aggregate needs a query
+ */
+static std::optional<tile::metadata_aggregate>
+metadata_aggregate_for_item(Item_sum *item, tiledb::Context &ctx,
+                            tiledb::Array &array,
+                            const tile::non_empty_domain &non_empty_domain,
+                            const tile::fragment_listing &listing,
+                            const tiledb::Subarray &subarray, bool restricted,
+                            const tile::fragment_plan *fragments) {
+  if (item->get_arg_count() != 1)
+    return std::nullopt;
+
+  tile::metadata_aggregate result;
+  Item *arg = item->get_arg(0);
+  tiledb::ArraySchema schema = array.schema();
+  switch (item->sum_func()) {
+  case Item_sum::COUNT_FUNC: {
+    // Only COUNT(*), counts of other non null constants and counts of non
+    // nullable columns count every cell
+    std::optional<std::string> column = aggregate_column(item);
+    if (!column.has_value() ||
+        (schema.has_attribute(*column) &&
+         schema.attribute(*column).nullable()))
+      return std::nullopt;
+
+    std::optional<uint64_t> cells;
+    if (fragments != nullptr)
+      cells = fragments->covered_cells;
+    else
+      cells = tile::metadata_cell_count(ctx, array, non_empty_domain, listing,
+                                        subarray, restricted);
+    if (!cells.has_value())
+      return std::nullopt;
+    result.count = true;
+    result.cells = *cells;
+    return result;
+  }
+  case Item_sum::MIN_FUNC:
+  case Item_sum::MAX_FUNC: {
+    Item *real_arg = arg->real_item();
+    if (real_arg->type() != Item::FIELD_ITEM)
+      return std::nullopt;
+    std::string name = static_cast<Item_field *>(real_arg)->field_name.str;
+    tiledb::Domain domain = schema.domain();
+    bool upper = item->sum_func() == Item_sum::MAX_FUNC;
+    for (uint32_t dim_idx = 0; dim_idx < domain.ndim(); dim_idx++) {
+      tiledb::Dimension dimension = domain.dimension(dim_idx);
+      if (dimension.name() != name)
+        continue;
+
+      std::optional<std::string> bound;
+      if (fragments == nullptr) {
+        bound = tile::metadata_dimension_bound(ctx, array, non_empty_domain,
+                                               listing, subarray, dim_idx,
+                                               upper, restricted);
+        if (!bound.has_value())
+          return std::nullopt;
+      } else if (fragments->bounds.empty()) {
+        // No fragment is fully covered
+        result.empty = true;
+      } else {
+        const auto &bounds = fragments->bounds[dim_idx];
+        bound = upper ? bounds.second : bounds.first;
+      }
+      result.type = dimension.type();
+      result.var_sized = dimension.cell_val_num() == TILEDB_VAR_NUM;
+      result.value = bound.value_or(std::string());
+      return result;
+    }
+    return std::nullopt;
+  }
+  default:
+    return std::nullopt;
+  }
+}
+
 static group_by_handler *mytile_create_group_by_handler(THD *thd,
                                                         Query *query) {
   tile::mytile_group_by_handler *handler;
-  if (!tile::sysvars::enable_aggregate_pushdown(thd)) {
+  tile::mytile *mytile_ptr =
+      dynamic_cast<tile::mytile *>(query->from->table->file);
+  if (mytile_ptr == nullptr)
     return 0;
-  }
 
-  /* check that there is no group_by. Not currently supported by TileDB*/
-  if (query->group_by != 0)
+  // Dense arrays only take query conditions for aggregates, a scan would
+  // return fill values for the cells they filter. Every query left to the
+  // server drops the condition, the server evaluates the whole condition again
+  std::shared_ptr<tiledb::QueryCondition> &qc = mytile_ptr->get_qc();
+  auto leave_to_server = [&]() -> group_by_handler * {
+    const std::shared_ptr<tiledb::Array> &array = mytile_ptr->get_array();
+    if (qc != nullptr && array != nullptr && array->is_open() &&
+        array->schema().array_type() == TILEDB_DENSE)
+      qc = nullptr;
     return 0;
+  };
 
-  /* check that there is no order_by. Not currently supported by TileDB*/
-  if (query->order_by != 0) {
-    return 0;
+  if (!tile::sysvars::enable_aggregate_pushdown(thd)) {
+    return leave_to_server();
   }
 
-  tile::mytile *mytile_ptr =
-      dynamic_cast<tile::mytile *>(query->from->table->file);
+  /* check that there is no order_by without a group_by, the server sorts the
+     groups but needs the rows for other orders */
+  if (query->order_by != 0 && query->group_by == 0) {
+    return leave_to_server();
+  }
+
+  // Joins and having clauses need the rows of the table
+  if (query->from->next_local != nullptr || query->having != nullptr)
+    return leave_to_server();
+
+  // Get the current SELECT statement
+  SELECT_LEX *select_lex = thd->lex->current_select;
+  if (!select_lex->agg_func_used() && query->group_by == 0)
+    return leave_to_server();
 
   // take everything we need from the mytile handler.
-  std::string encryption_key;
-  if (mytile_ptr->get_table()->s->option_struct->encryption_key != nullptr) {
-    encryption_key =
-        std::string(mytile_ptr->get_table()->s->option_struct->encryption_key);
-  }
-  uint64_t open_at = mytile_ptr->get_table()->s->option_struct->open_at;
-  std::string uri = mytile_ptr->get_uri();
-  std::shared_ptr<tiledb::QueryCondition> &qc = mytile_ptr->get_qc();
   std::vector<std::vector<std::shared_ptr<tile::range>>> &ranges =
       mytile_ptr->get_pushdown_ranges();
   std::vector<std::vector<std::shared_ptr<tile::range>>> &in_ranges =
       mytile_ptr->get_pushdown_in_ranges();
-  bool valid_ranges = mytile_ptr->valid_pushed_ranges();
-  bool valid_in_ranges = mytile_ptr->valid_pushed_in_ranges();
 
-  // open array here before init scan because we need to check if the aggregate
-  // requested can be processed by TileDB.
-  std::unique_ptr<tiledb::Array> aggr_array;
-  std::shared_ptr<tiledb::Config> cfg;
+  // The aggregates run on the array, context and subarray of the mytile
+  // handler, we open it here before init scan because we need to check if the
+  // aggregate requested can be processed by TileDB.
+  std::shared_ptr<tiledb::Array> aggr_array;
   std::shared_ptr<tiledb::Context> ctx;
-
-  cfg = std::make_shared<tiledb::Config>(tile::build_config(thd));
-  ctx = std::make_shared<tiledb::Context>(tile::build_context(*cfg));
-  tiledb_encryption_type_t encryption_type =
-      encryption_key.empty() ? TILEDB_NO_ENCRYPTION : TILEDB_AES_256_GCM;
-
-  if (open_at != UINT64_MAX) {
-#if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
-    aggr_array = std::make_unique<tiledb::Array>(
-        *ctx, uri, TILEDB_READ,
-        tiledb::TemporalPolicy(tiledb::TimeTravel, open_at),
-        tiledb::EncryptionAlgorithm(encryption_type, encryption_key.c_str()));
-#else
-    aggr_array = std::make_unique<tiledb::Array>(
-        *ctx, uri, TILEDB_READ, encryption_type, encryption_key, open_at);
-#endif
-
-  } else {
-
-#if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
-    aggr_array = std::make_unique<tiledb::Array>(
-        *ctx, uri, TILEDB_READ, tiledb::TemporalPolicy(),
-        tiledb::EncryptionAlgorithm(encryption_type, encryption_key.c_str()));
-#else
-    aggr_array = std::make_unique<tiledb::Array>(
-        *ctx, uri, TILEDB_READ, encryption_type, encryption_key);
-#endif
+  std::unique_ptr<tiledb::Subarray> subarray;
+  int empty_read = 0;
+  bool coalesced = false;
+  const tile::non_empty_domain *non_empty_domain = nullptr;
+  const tile::fragment_listing *listing = nullptr;
+  try {
+    mytile_ptr->open_array_for_reads(thd);
+    aggr_array = mytile_ptr->get_array();
+    ctx = mytile_ptr->get_context();
+    non_empty_domain = &mytile_ptr->get_non_empty_domain();
+    listing = &mytile_ptr->get_fragment_listing();
+
+    subarray = std::make_unique<tiledb::Subarray>(*ctx, *aggr_array);
+    tile::build_subarray(thd, mytile_ptr->valid_pushed_ranges(),
+                         mytile_ptr->valid_pushed_in_ranges(), empty_read,
+                         aggr_array->schema().domain(), *non_empty_domain,
+                         ranges, in_ranges, subarray, ctx.get(), &coalesced);
+  } catch (const std::exception &e) {
+    return leave_to_server();
   }
 
-  // Get the current SELECT statement
-  SELECT_LEX *select_lex = thd->lex->current_select;
+  // Aggregates only see the cells of the pushed conditions, conditions left
+  // for the server and coalesced ranges covering more cells than the
+  // conditions match need the rows
+  if (!mytile_ptr->condition_fully_pushed(query->where) || coalesced)
+    return leave_to_server();
 
-  if (select_lex->agg_func_used()) {
-    // Iterate through the item list to find TileDB compatible aggregates
-    Item *item;
-    List_iterator_fast<Item> it(*query->select);
-    while ((item = it++)) {
-      Item_sum *isp = dynamic_cast<Item_sum *>(item);
+  // Groups, and aggregates TileDB does not compute, are computed by the
+  // handler from a scan of the array
+  auto create_scan_handler = [&]() -> group_by_handler * {
+    std::optional<tile::mytile_group_by_handler::group_by_plan> grouping;
+    try {
+      grouping = tile::mytile_group_by_handler::plan_group_by(
+          query, *aggr_array, *non_empty_domain);
+    } catch (const tiledb::TileDBError &e) {
+      return leave_to_server();
+    }
+    if (!grouping.has_value())
+      return leave_to_server();
+
+    // Groups are computed by the handler, the server only sorts them
+    query->group_by = 0;
+    return new tile::mytile_group_by_handler(
+        thd, std::move(aggr_array), std::move(ctx), qc, ranges, in_ranges,
+        std::move(subarray), empty_read, {}, {}, std::move(grouping));
+  };
 
-      std::string column_with_aggregate;
-      const char *str_ptr = isp->get_arg(0)->name.str;
-      if (str_ptr != nullptr) {
-        std::string column_with_aggregate = str_ptr;
-      }
+  if (query->group_by != 0)
+    return create_scan_handler();
+
+  // Counts and bounds of dimensions are known from metadata when no condition
+  // is left to evaluate on attributes. Conflicting ranges leave the subarray
+  // incomplete
+  bool metadata_usable =
+      qc == nullptr && (!empty_read || non_empty_domain->empty);
+  bool restricted = query->where != nullptr;
+  std::vector<std::optional<tile::metadata_aggregate>> metadata_results;
+
+  // Ranges of a sparse array are planned over its fragments, those they fully
+  // cover are answered from metadata and only those they partially cover are
+  // scanned
+  std::optional<tile::fragment_plan> fragments;
+  if (metadata_usable && restricted && !non_empty_domain->empty &&
+      aggr_array->schema().array_type() == TILEDB_SPARSE) {
+    fragments = tile::plan_sparse_fragments(*ctx, *aggr_array, *listing,
+                                            *subarray);
+    metadata_usable = fragments.has_value();
+  }
 
-      if (isp && !aggregate_is_supported(column_with_aggregate, isp->sum_func(),
-                                         aggr_array.get())) {
-        if (aggr_array != nullptr && aggr_array->is_open()) {
-          aggr_array->close();
-          aggr_array.reset();
-        }
-        return 0;
+  // Iterate through the item list to find TileDB compatible aggregates
+  bool all_metadata = true;
+  bool all_supported = true;
+  Item *item;
+  List_iterator_fast<Item> it(*query->select);
+  while ((item = it++)) {
+    Item_sum *isp = dynamic_cast<Item_sum *>(item);
+    // Items which are not aggregates need the rows
+    if (isp == nullptr)
+      return leave_to_server();
+
+    std::optional<tile::metadata_aggregate> metadata_result;
+    if (metadata_usable) {
+      try {
+        metadata_result = metadata_aggregate_for_item(
+            isp, *ctx, *aggr_array, *non_empty_domain, *listing, *subarray,
+            restricted, fragments.has_value() ? &*fragments : nullptr);
+      } catch (const tiledb::TileDBError &e) {
+        metadata_usable = false;
       }
-      // if you find at least one not compatible aggregate abort entire pushdown
     }
+    metadata_results.push_back(std::move(metadata_result));
+    bool supported = aggregate_is_supported(isp, aggr_array.get());
+    // Cells counted on dense arrays include those the query condition
+    // filters, only the validity of nullable columns tells an aggregate of
+    // no values apart
+    if (qc != nullptr && aggr_array->schema().array_type() == TILEDB_DENSE &&
+        !aggregate_of_nullable_column(isp, aggr_array.get()))
+      supported = false;
+    all_supported = all_supported && supported;
+    if (metadata_results.back().has_value())
+      continue;
+    all_metadata = false;
 
-    /* Create handler and return it */
-    handler = new tile::mytile_group_by_handler(
-        thd, std::move(aggr_array), ctx, qc, valid_ranges, valid_in_ranges,
-        ranges, in_ranges, encryption_key, open_at);
-    return handler;
-  } else {
-    if (aggr_array != nullptr && aggr_array->is_open()) {
-      aggr_array->close();
-      aggr_array.reset();
+    // if you find at least one not compatible aggregate every aggregate is
+    // computed by the handler
+    if (!supported)
+      return create_scan_handler();
+  }
+
+  // Metadata only answers the fully covered fragments, every aggregate is
+  // computed by TileDB over the partially covered ones. If some aggregate
+  // has no metadata result the whole ranges are scanned instead
+  std::vector<std::unique_ptr<tiledb::Subarray>> fragment_subarrays;
+  if (metadata_usable && fragments.has_value() &&
+      !fragments->partial.empty()) {
+    if (all_metadata && all_supported) {
+      fragment_subarrays = std::move(fragments->partial);
+    } else {
+      metadata_results.assign(metadata_results.size(), std::nullopt);
+      if (!all_supported)
+        return create_scan_handler();
     }
   }
-  return 0;
+
+  /* Create handler and return it */
+  handler = new tile::mytile_group_by_handler(
+      thd, std::move(aggr_array), std::move(ctx), qc, ranges, in_ranges,
+      std::move(subarray), empty_read, std::move(metadata_results),
+      std::move(fragment_subarrays));
+  return handler;
 }
 
 // Create mytile object
@@ -743,6 +1580,18 @@ static int mytile_init_func(void *p) {
   DBUG_RETURN(0);
 }
 
+// Deinitialization function
+static int mytile_done_func(void *p) {
+  DBUG_ENTER("mytile_done_func");
+
+  // Release cached schemas, pooled contexts and pooled buffers
+  tile::schemacache::clear();
+  tile::contextpool::clear();
+  tile::bufferpool::clear();
+
+  DBUG_RETURN(0);
+}
+
 // Storage engine interface
 struct st_mysql_storage_engine mytile_storage_engine = {
     MYSQL_HANDLERTON_INTERFACE_VERSION};
@@ -755,25 +1604,46 @@ THR_LOCK_DATA **tile::mytile::store_lock(THD *thd, THR_LOCK_DATA **to,
 
 int tile::mytile::external_lock(THD *thd, int lock_type) {
   DBUG_ENTER("tile::mytile::external_lock");
+  // Positions saved for rnd_pos do not outlive the statement
+  if (lock_type == F_UNLCK) {
+    this->pending_positions.clear();
+    dealloc_position_buffers();
+  }
   DBUG_RETURN(0);
 }
 
 tile::mytile::mytile(handlerton *hton, TABLE_SHARE *table_arg)
     : handler(hton, table_arg){};
 
+tile::mytile_share *tile::mytile::get_share() {
+  DBUG_ENTER("tile::mytile::get_share");
+  mytile_share *tmp_share;
+
+  lock_shared_ha_data();
+  if (!(tmp_share = static_cast<mytile_share *>(get_ha_share_ptr()))) {
+    tmp_share = new mytile_share;
+    set_ha_share_ptr(static_cast<Handler_share *>(tmp_share));
+  }
+  unlock_shared_ha_data();
+  DBUG_RETURN(tmp_share);
+}
+
 tile::mytile_group_by_handler::mytile_group_by_handler(
-    THD *thd_arg, std::unique_ptr<tiledb::Array> array,
-    std::shared_ptr<tiledb::Context> &context,
-    std::shared_ptr<tiledb::QueryCondition> &qc, bool val_ranges,
-    bool val_in_ranges,
+    THD *thd_arg, std::shared_ptr<tiledb::Array> array,
+    std::shared_ptr<tiledb::Context> context,
+    std::shared_ptr<tiledb::QueryCondition> &qc,
     std::vector<std::vector<std::shared_ptr<tile::range>>> &ranges,
     std::vector<std::vector<std::shared_ptr<tile::range>>> &in_ranges,
-    const std::string encryption_key, const uint64_t open_at)
+    std::unique_ptr<tiledb::Subarray> subarray, bool empty_read,
+    std::vector<std::optional<tile::metadata_aggregate>> metadata,
+    std::vector<std::unique_ptr<tiledb::Subarray>> fragments,
+    std::optional<group_by_plan> grouping)
     : group_by_handler(thd_arg, mytile_hton), aggr_array(std::move(array)),
-      ctx(context), tiledb_qc(qc), valid_ranges(val_ranges),
-      valid_in_ranges(val_in_ranges), pushdown_ranges(ranges),
-      pushdown_in_ranges(in_ranges), encryption_key(encryption_key),
-      open_at(open_at){};
+      ctx(std::move(context)), tiledb_qc(qc), pushdown_ranges(ranges),
+      pushdown_in_ranges(in_ranges), tiledb_sub(std::move(subarray)),
+      empty_read(empty_read), metadata_results(std::move(metadata)),
+      fragment_subarrays(std::move(fragments)),
+      grouping(std::move(grouping)){};
 
 int tile::mytile::create(const char *name, TABLE *table_arg,
                          HA_CREATE_INFO *create_info) {
@@ -794,11 +1664,12 @@ int tile::mytile::create(const char *name, TABLE *table_arg,
     cfg["sm.encryption_key"] = encryption_key.c_str();
   }
 
-  if (cfg != this->config) {
+  if (cfg != this->config || this->ctx == nullptr) {
     this->config = cfg;
-    this->ctx = build_context(this->config);
+    this->ctx =
+        tile::contextpool::get_context(this->config, &this->ctx_id);
   }
-  DBUG_RETURN(create_array(name, table_arg, create_info, this->ctx));
+  DBUG_RETURN(create_array(name, table_arg, create_info, *this->ctx));
 }
 
 int tile::mytile::open(const char *name, int mode, uint test_if_locked) {
@@ -819,11 +1690,14 @@ int tile::mytile::open(const char *name, int mode, uint test_if_locked) {
     cfg["sm.encryption_key"] = encryption_key.c_str();
   }
 
-  if (cfg != this->config) {
+  if (cfg != this->config || this->ctx == nullptr) {
     this->config = cfg;
-    this->ctx = build_context(this->config);
+    this->ctx =
+        tile::contextpool::get_context(this->config, &this->ctx_id);
   }
 
+  this->share = get_share();
+
   // Open TileDB Array
   try {
     uri = name;
@@ -839,12 +1713,16 @@ int tile::mytile::open(const char *name, int mode, uint test_if_locked) {
       metadata_query = true;
     }
 
-    this->array_schema = std::unique_ptr<tiledb::ArraySchema>(
-        new tiledb::ArraySchema(this->ctx, this->uri));
-    this->domain =
-        std::make_unique<tiledb::Domain>(this->array_schema->domain());
+    // Fetch schema and domain from the server wide cache
+    this->schema_entry =
+        tile::schemacache::get_schema(this->ctx, this->uri, encryption_key);
+    this->array_schema = this->schema_entry->schema;
+    this->domain = this->schema_entry->domain;
     this->ndim = domain->ndim();
 
+    if (!this->metadata_query)
+      build_field_map();
+
     // Set ref length used for storing reference in position(), this is the size
     // of a subarray for querying
     this->ref_length = 0;
@@ -874,39 +1752,36 @@ int tile::mytile::open(const char *name, int mode, uint test_if_locked) {
       auto dims = domain->dimensions();
 
       this->subarray = std::unique_ptr<tiledb::Subarray>(
-          new tiledb::Subarray(this->ctx, *this->array));
-      // For each dimension we calculate the non empty domain (equivalent to
+          new tiledb::Subarray(*this->ctx, *this->array));
+      // For each dimension we use the non empty domain (equivalent to
       // `select * from ...`, and the result is used to add a range to the
       // subarray)
+      const tile::non_empty_domain &non_empty_domain = get_non_empty_domain();
+      this->empty_read = non_empty_domain.empty;
       for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
         tiledb::Dimension dimension = domain->dimension(dim_idx);
 
         if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
-          const auto pair = this->array->non_empty_domain_var(dim_idx);
+          const auto &pair = non_empty_domain.var[dim_idx];
           this->subarray->add_range(dim_idx, pair.first, pair.second);
         } else {
-          uint64_t size = (tiledb_datatype_size(dimension.type()) * 2);
-          auto nonEmptyDomain = std::unique_ptr<void, decltype(&std::free)>(
-              std::malloc(size), &std::free);
-
-          this->ctx.handle_error(tiledb_array_get_non_empty_domain_from_index(
-              this->ctx.ptr().get(), this->array->ptr().get(), dim_idx,
-              nonEmptyDomain.get(), &this->empty_read));
-
-          void *lower = static_cast<char *>(nonEmptyDomain.get());
-          void *upper = static_cast<char *>(nonEmptyDomain.get()) +
-                        tiledb_datatype_size(dimension.type());
+          const auto &bounds = non_empty_domain.fixed[dim_idx];
+          const void *lower = bounds.data();
+          const void *upper =
+              bounds.data() + tiledb_datatype_size(dimension.type());
 
           // set range
-          this->ctx.handle_error(tiledb_subarray_add_range(
-              this->ctx.ptr().get(), this->subarray->ptr().get(), dim_idx,
+          this->ctx->handle_error(tiledb_subarray_add_range(
+              this->ctx->ptr().get(), this->subarray->ptr().get(), dim_idx,
               lower, upper, nullptr));
         }
       }
 
       // Since we added ranges, we calculate the total number of records the
-      // array contains
-      this->records_upper_bound = this->computeRecordsUB();
+      // array contains, metadata knows it exactly for most arrays
+      std::optional<uint64_t> records = get_metadata_records();
+      this->records_upper_bound =
+          records.has_value() ? *records : this->computeRecordsUB();
       this->query->set_subarray(*this->subarray);
     }
 
@@ -927,6 +1802,10 @@ int tile::mytile::open(const char *name, int mode, uint test_if_locked) {
 int tile::mytile::close(void) {
   DBUG_ENTER("tile::mytile::close");
   try {
+    // A background submit must finish before its query and array go away
+    cancel_prefetch();
+    dealloc_scan_partitions();
+
     // remove query if exists
     if (this->query != nullptr) {
       this->query = nullptr;
@@ -935,9 +1814,16 @@ int tile::mytile::close(void) {
     if (this->query_condition != nullptr)
       this->query_condition = nullptr;
 
-    // close array
-    if (this->array != nullptr && this->array->is_open())
+    // close array, a shared array is only released as other handlers might
+    // still be using it
+    if (this->array_is_shared) {
+      this->array = nullptr;
+      this->array_is_shared = false;
+    } else if (this->array != nullptr && this->array->is_open()) {
       this->array->close();
+    }
+    this->array_non_empty_domain = nullptr;
+    this->array_fragments = nullptr;
 
     // Clear all allocated buffers
     dealloc_buffers();
@@ -1032,7 +1918,7 @@ bool tile::mytile::inplace_alter_table(TABLE *altered_table,
   DBUG_ENTER("tile::mytile::inplace_alter_table");
 
   // create evolution object
-  auto evolution = tiledb::ArraySchemaEvolution(this->ctx);
+  auto evolution = tiledb::ArraySchemaEvolution(*this->ctx);
   // if the evolution is a DROP column
   if (ha_alter_info->handler_flags & ALTER_DROP_COLUMN) {
     // figuring out what columns have been dropped
@@ -1045,6 +1931,10 @@ bool tile::mytile::inplace_alter_table(TABLE *altered_table,
     }
     // evolve array
     evolution.array_evolve(this->uri);
+    // cached schema and shared arrays are from the old schema
+    tile::schemacache::invalidate(this->uri);
+    if (this->share != nullptr)
+      this->share->clear();
 
     DBUG_RETURN(false); // success
 
@@ -1052,7 +1942,7 @@ bool tile::mytile::inplace_alter_table(TABLE *altered_table,
   } else if (ha_alter_info->handler_flags & ALTER_ADD_COLUMN) {
     // figuring out what columns to add
     std::vector<tiledb::Attribute> atts;
-    find_columns_to_add(altered_table, this->table, this->ctx, atts);
+    find_columns_to_add(altered_table, this->table, *this->ctx, atts);
 
     // adding attributes
     for (const tiledb::Attribute &a : atts) {
@@ -1061,6 +1951,10 @@ bool tile::mytile::inplace_alter_table(TABLE *altered_table,
 
     // evolve array
     evolution.array_evolve(this->uri);
+    // cached schema and shared arrays are from the old schema
+    tile::schemacache::invalidate(this->uri);
+    if (this->share != nullptr)
+      this->share->clear();
     DBUG_RETURN(false); // success
   }
 
@@ -1171,7 +2065,7 @@ int tile::mytile::create_array(const char *name, TABLE *table_arg,
 
   try {
     std::unique_ptr<tiledb::ArraySchema> schema;
-    tiledb::VFS vfs(ctx);
+    tiledb::VFS vfs(context);
     // Get array uri from name or table option
     std::string create_uri = name;
 
@@ -1189,7 +2083,7 @@ int tile::mytile::create_array(const char *name, TABLE *table_arg,
       encryption_key = std::string(create_info->option_struct->encryption_key);
     }
 
-    if (check_array_exists(vfs, ctx, create_uri, encryption_key, schema) &&
+    if (check_array_exists(vfs, context, create_uri, encryption_key, schema) &&
         sysvars::create_allow_subset_existing_array(ha_thd())) {
       // Next we write the frm file to persist the newly created table
       table_arg->s->write_frm_image();
@@ -1342,11 +2236,11 @@ int tile::mytile::create_array(const char *name, TABLE *table_arg,
             }
             // setting the enum to the attribute
             auto enmr =
-                tiledb::Enumeration::create(ctx, enum_name, enum_values);
-            tiledb::ArraySchemaExperimental::add_enumeration(ctx, const_schema,
-                                                             enmr);
-            tiledb::AttributeExperimental::set_enumeration_name(ctx, attr,
-                                                                enum_name);
+                tiledb::Enumeration::create(context, enum_name, enum_values);
+            tiledb::ArraySchemaExperimental::add_enumeration(
+                context, const_schema, enmr);
+            tiledb::AttributeExperimental::set_enumeration_name(
+                context, attr, enum_name);
           }
         }
         schema->add_attribute(attr);
@@ -1406,6 +2300,8 @@ int tile::mytile::create_array(const char *name, TABLE *table_arg,
     try {
       // Create the array on storage
       tiledb::Array::create(create_uri, *schema);
+      // Drop any schema cached for an array previously at this uri
+      tile::schemacache::invalidate(create_uri);
       // Next we write the frm file to persist the newly created table
       table_arg->s->write_frm_image();
     } catch (tiledb::TileDBError &e) {
@@ -1429,7 +2325,7 @@ uint64_t tile::mytile::computeRecordsUB() {
   uint64_t max_size = std::numeric_limits<uint64_t>::min();
 
   try {
-    tiledb::Domain domain = this->array_schema->domain();
+    const tiledb::Domain &domain = *this->domain;
     for (size_t dim_index = 0; dim_index < domain.ndim(); dim_index++) {
       auto dim = domain.dimension(dim_index);
       tiledb_datatype_t datatype = dim.type();
@@ -1445,8 +2341,8 @@ uint64_t tile::mytile::computeRecordsUB() {
         size = sizes.first;
 #endif
       } else {
-        this->ctx.handle_error(tiledb_query_get_est_result_size(
-            this->ctx.ptr().get(), this->query->ptr().get(),
+        this->ctx->handle_error(tiledb_query_get_est_result_size(
+            this->ctx->ptr().get(), this->query->ptr().get(),
             dimension_or_attribute_name.c_str(), &size));
       }
 
@@ -1467,7 +2363,7 @@ uint64_t tile::mytile::computeRecordsUB() {
   DBUG_RETURN(num_of_records);
 }
 
-int tile::mytile::init_scan(THD *thd) {
+int tile::mytile::init_scan(THD *thd, bool table_scan) {
   DBUG_ENTER("tile::mytile::init_scan");
   int rc = 0;
   // Reset indicators
@@ -1481,26 +2377,26 @@ int tile::mytile::init_scan(THD *thd) {
 
   try {
     // Always reset query object so we make sure no ranges are left set
+    cancel_prefetch();
+    dealloc_scan_partitions();
     this->query = nullptr;
 
     // Validate the array is open for reads
     open_array_for_reads(thd);
 
-    // Allocate user buffers
-    alloc_read_buffers(this->read_buffer_size);
-
     // Get domain and dimensions
-    auto domain = this->array_schema->domain();
+    const tiledb::Domain &domain = *this->domain;
     auto dims = domain.dimensions();
 
     this->subarray = std::unique_ptr<tiledb::Subarray>(
-        new tiledb::Subarray(this->ctx, *this->array));
+        new tiledb::Subarray(*this->ctx, *this->array));
 
+    this->pushdown_coalesced = false;
     tile::build_subarray(thd, this->valid_pushed_ranges(),
                          this->valid_pushed_in_ranges(), this->empty_read,
-                         domain, this->pushdown_ranges,
-                         this->pushdown_in_ranges, this->subarray, &this->ctx,
-                         this->array.get());
+                         domain, get_non_empty_domain(), this->pushdown_ranges,
+                         this->pushdown_in_ranges, this->subarray,
+                         this->ctx.get(), &this->pushdown_coalesced);
 
     // If a query condition on an attribute was set, apply it
     if (this->query_condition != nullptr) {
@@ -1510,6 +2406,27 @@ int tile::mytile::init_scan(THD *thd) {
     // set subarray
     this->query->set_subarray(*this->subarray);
 
+    // Selective scans read wide fields only for the rows passing the
+    // residual condition
+    dealloc_late_buffers();
+    this->late_materialization =
+        table_scan && setup_late_materialization(thd);
+
+    // Scans of a statement with a LIMIT only read the rows it needs
+    this->scan_limit = table_scan ? get_scan_limit() : UINT64_MAX;
+
+    // Table scans of sparse arrays can read partitions of the subarray
+    // concurrently, each partition has its own buffers
+    std::vector<std::unique_ptr<tiledb::Subarray>> partition_subarrays;
+    if (table_scan)
+      partition_subarrays = plan_parallel_scan(thd);
+
+    // Allocate user buffers, sized from the result estimate of the subarray.
+    // The budget is split across the buffers of the partitions
+    alloc_read_buffers(this->read_buffer_size /
+                       (partition_subarrays.size() + 1));
+    start_parallel_scan(partition_subarrays);
+
   } catch (const tiledb::TileDBError &e) {
     // Log errors
     my_printf_error(ER_UNKNOWN_ERROR, "[init_scan] error for table %s : %s",
@@ -1528,6 +2445,35 @@ int tile::mytile::init_scan(THD *thd) {
   DBUG_RETURN(rc);
 }
 
+uint64_t tile::mytile::get_scan_limit() {
+  DBUG_ENTER("tile::mytile::get_scan_limit");
+  TABLE_LIST *table_list = table->pos_in_table_list;
+  if (table_list == nullptr || table_list->select_lex == nullptr)
+    DBUG_RETURN(UINT64_MAX);
+
+  // Only the first rows of a single table select without sorting, grouping
+  // or aggregates make up its result
+  SELECT_LEX *select_lex = table_list->select_lex;
+  JOIN *join = select_lex->join;
+  if (join == nullptr || join->table_count != 1 || join->order != nullptr ||
+      join->group_list != nullptr || join->select_distinct ||
+      select_lex->with_sum_func || select_lex->having != nullptr ||
+      select_lex->have_window_funcs() ||
+      (join->select_options & OPTION_FOUND_ROWS)) {
+    DBUG_RETURN(UINT64_MAX);
+  }
+
+  // Every row returned has to be part of the result, so the whole condition
+  // must have been pushed down and read exactly
+  if (!condition_fully_pushed(select_lex->where) || this->pushdown_coalesced) {
+    DBUG_RETURN(UINT64_MAX);
+  }
+
+  // The select limit includes the offset
+  DBUG_RETURN(join->select_limit == HA_POS_ERROR ? UINT64_MAX
+                                                 : join->select_limit);
+}
+
 std::optional<Item_sum::Sumfunctype>
 tile::mytile::has_aggregate(THD *thd, const std::string &field) {
   DBUG_ENTER("tile::mytile::has_aggregate");
@@ -1538,44 +2484,19 @@ tile::mytile::has_aggregate(THD *thd, const std::string &field) {
   // Get the current SELECT statement
   SELECT_LEX *select_lex = thd->lex->current_select;
 
-  if (select_lex->agg_func_used()) {
-    // Iterate through the item list to find TileDB compatible aggregates
-    Item *item;
-    List_iterator_fast<Item> it(select_lex->item_list);
-    while ((item = it++)) {
-      Item_sum *isp = dynamic_cast<Item_sum *>(item);
-      if (isp) {
-        std::string column_with_aggregate;
-        const char *str_ptr = isp->get_arg(0)->name.str;
-        if (str_ptr != nullptr) {
-          std::string column_with_aggregate = str_ptr;
-        } else {
-          continue;
-        }
+  // Only aggregates the group by handler computes are reported
+  if (this->array == nullptr || !this->array->is_open() ||
+      this->array->query_type() != TILEDB_READ ||
+      !select_aggregates_pushable(select_lex, this->array.get())) {
+    DBUG_RETURN(std::nullopt);
+  }
 
-        if (field == column_with_aggregate) {
-          switch (isp->sum_func()) {
-          case Item_sum::SUM_FUNC:
-            DBUG_RETURN(Item_sum::SUM_FUNC);
-            break;
-          case Item_sum::AVG_FUNC:
-            DBUG_RETURN(Item_sum::AVG_FUNC);
-            break;
-          case Item_sum::MIN_FUNC:
-            DBUG_RETURN(Item_sum::MIN_FUNC);
-            break;
-          case Item_sum::COUNT_FUNC:
-            DBUG_RETURN(Item_sum::COUNT_FUNC);
-            break;
-          case Item_sum::MAX_FUNC:
-            DBUG_RETURN(Item_sum::MAX_FUNC);
-            break;
-          default:
-            DBUG_RETURN(std::nullopt);
-          }
-        }
-      }
-    }
+  Item *item;
+  List_iterator_fast<Item> it(select_lex->item_list);
+  while ((item = it++)) {
+    Item_sum *isp = static_cast<Item_sum *>(item);
+    if (aggregate_column(isp) == field)
+      DBUG_RETURN(isp->sum_func());
   }
   DBUG_RETURN(std::nullopt);
 }
@@ -1604,7 +2525,13 @@ int tile::mytile::rnd_init(bool scan) {
     this->metadata_map_iterator = this->metadata_map.begin();
     DBUG_RETURN(rc);
   }
-  DBUG_RETURN(init_scan(this->ha_thd()));
+
+  // A new scan saves new positions
+  if (scan) {
+    this->pending_positions.clear();
+    dealloc_position_buffers();
+  }
+  DBUG_RETURN(init_scan(this->ha_thd(), scan));
 };
 
 bool tile::mytile::query_complete() {
@@ -1644,25 +2571,35 @@ int tile::mytile::scan_rnd_row(TABLE *table) {
   }
 
   try {
+    // Skip the rows of the batch rejected by the residual condition
+    if (this->late_materialization) {
+      skip_rejected_rows();
+    }
+
     // If the cursor has passed the number of records from the previous query
     // (or if this is the first time), (re)submit the query->
-    if (this->record_index >= this->records) {
+    while (this->record_index >= this->records) {
+      // Every row of the last batch was rejected, or the statement has all
+      // the rows it needs
+      if (this->status == tiledb::Query::Status::COMPLETE ||
+          this->records_read >= this->scan_limit) {
+        // Reset bitmap to original
+        dbug_tmp_restore_column_map(&table->write_set, original_bitmap);
+        DBUG_RETURN(HA_ERR_END_OF_FILE);
+      }
+
+      // Pipelining only applies to table scans, index scans resubmit the
+      // query from their own position
+      bool prefetch_next = this->inited == RND &&
+                           this->scan_limit == UINT64_MAX &&
+                           tile::sysvars::pipelined_reads(ha_thd());
       do {
-        this->status = query->submit();
-        // Compute the number of cells (records) that were returned by the query
-        auto buff = this->buffers[0];
-        if (buff->offset_buffer != nullptr) {
-          this->records = buff->offset_buffer_size / sizeof(uint64_t);
-        } else {
-          this->records = buff->buffer_size / tiledb_datatype_size(buff->type);
-        }
+        fetch_read_batch(prefetch_next);
 
         // Increase the buffer allocation and resubmit if necessary.
         if (this->status == tiledb::Query::Status::INCOMPLETE &&
             this->records == 0) { // VERY IMPORTANT!!
-          this->read_buffer_size = this->read_buffer_size * 2;
-          dealloc_buffers();
-          alloc_read_buffers(read_buffer_size);
+          grow_read_buffers();
         } else if (records > 0) {
           this->record_index = 0;
           // Break out of resubmit loop as we have some results.
@@ -1674,6 +2611,11 @@ int tile::mytile::scan_rnd_row(TABLE *table) {
           DBUG_RETURN(HA_ERR_END_OF_FILE);
         }
       } while (status == tiledb::Query::Status::INCOMPLETE);
+
+      if (this->late_materialization) {
+        materialize_late_fields();
+        skip_rejected_rows();
+      }
     }
 
     tileToFields(record_index, false, table);
@@ -1756,6 +2698,10 @@ int tile::mytile::rnd_end() {
   this->pushdown_ranges.clear();
   this->pushdown_in_ranges.clear();
   this->query_condition = nullptr;
+  this->residual_conds.clear();
+  this->pushed_conds = 0;
+  this->scan_limit = UINT64_MAX;
+  this->late_materialization = false;
   // Reset indicators
   this->record_index = 0;
   this->records = 0;
@@ -1767,71 +2713,68 @@ int tile::mytile::rnd_end() {
 };
 
 /**
- * Returns the coordinates as a single byte vector in the form
- * <uint64_t>-<data>-<uint64_t>-<data>
- *
- * Where the prefix of <uint64_t> is the length of the data to follow
- *
+ * Location and size of a cell in a buffer
+ * @param buff
  * @param index
- * @return
+ * @param size set to the cell size in bytes
+ * @return cell data
  */
-std::vector<uint8_t> tile::mytile::get_coords_as_byte_vector(uint64_t index) {
-  auto domain = this->array_schema->domain();
-  std::vector<uint8_t> data;
+static const char *cell_data(const buffer &buff, uint64_t index,
+                             uint64_t *size) {
+  const char *data = static_cast<const char *>(buff.buffer);
+  if (buff.offset_buffer == nullptr) {
+    *size = tiledb_datatype_size(buff.type) * buff.fixed_size_elements;
+    return data + index * *size;
+  }
+
+  uint64_t start = buff.offset_buffer[index];
+  uint64_t end = buff.buffer_size;
+  if (index + 1 < buff.offset_buffer_size / sizeof(uint64_t)) {
+    end = buff.offset_buffer[index + 1];
+  }
+  *size = end - start;
+  return data + start;
+}
+
+void tile::mytile::append_coords(
+    const std::vector<std::shared_ptr<buffer>> &buffer_set, uint64_t index,
+    std::string &coords) const {
   for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
-    tiledb::Dimension dimension = domain.dimension(dim_idx);
+    size_t fieldIndex = this->dim_field_indexes[dim_idx];
+    if (fieldIndex >= buffer_set.size() || buffer_set[fieldIndex] == nullptr)
+      continue;
 
-    bool var_sized = dimension.cell_val_num() == TILEDB_VAR_NUM;
-    for (auto &buff : this->buffers) {
-      if (buff == nullptr || buff->name != dimension.name()) {
-        continue;
-      } else { // the buffer is found
-        uint64_t datatype_size = tiledb_datatype_size(dimension.type());
-        uint64_t size = datatype_size;
-        char *buffer_casted =
-            static_cast<char *>(buff->buffer) + (index * datatype_size);
-        if (var_sized) {
-          uint64_t end_position = index + 1;
-          uint64_t start_position = 0;
-          // If its not the first value, we need to see where the previous
-          // position ended to know where to start.
-          if (index > 0) {
-            start_position = buff->offset_buffer[index];
-          }
-          // If the current position is equal to the number of results - 1 then
-          // we are at the last varchar value
-          if (index >= (buff->offset_buffer_size / sizeof(uint64_t)) - 1) {
-            end_position = buff->buffer_size / sizeof(char);
-          } else { // Else read the end from the next offset.
-            end_position = buff->offset_buffer[index + 1];
-          }
-          // Set the size
-          size = end_position - start_position;
-          // Set the casted buffer position
-          buffer_casted = static_cast<char *>(buff->buffer) +
-                          (start_position * sizeof(char));
-        }
+    uint64_t size;
+    const char *data = cell_data(*buffer_set[fieldIndex], index, &size);
+    // Each coordinate is prefixed by its size, dimension order matters
+    coords.append(reinterpret_cast<const char *>(&size), sizeof(uint64_t));
+    coords.append(data, size);
+  }
+}
 
-        // Copy the size details
-        char *size_char = reinterpret_cast<char *>(&size);
-        for (uint64_t i = 0; i < sizeof(uint64_t); ++i) {
-          data.emplace_back(size_char[i]);
-        }
-        // The index offset for coordinates is computed based on the number of
-        // dimensions, the datatype size and the record index We must subtract
-        // one from the record index because position is called after the end
-        // of rnd_next which means we have already incremented the index
-        // position Current dimension's value is the (record_index - 1) Order of
-        // dimensions is important
-        for (uint64_t i = 0; i < size; ++i) {
-          data.emplace_back(buffer_casted[i]);
-        }
-      }
-    }
+uint64_t tile::mytile::coords_length(const uchar *pos) const {
+  uint64_t length = 0;
+  for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+    uint64_t size;
+    memcpy(&size, pos + length, sizeof(uint64_t));
+    length += sizeof(uint64_t) + size;
   }
-  return data;
+  return length;
 }
 
+// Most positions read together by rnd_pos
+static const uint64_t MAX_POSITIONS_PER_BATCH = 10000;
+
+// Most cells of the cross product of the points of a position batch
+static const uint64_t MAX_POSITION_CELLS_PER_BATCH =
+    4 * MAX_POSITIONS_PER_BATCH;
+
+// Most positions saved during a scan for batching
+static const uint64_t MAX_PENDING_POSITIONS = 1 << 18;
+
+// Row of the position buffers when the last row came from the scan
+static const uint64_t NO_POSITION_ROW = UINT64_MAX;
+
 int tile::mytile::rnd_pos(uchar *buf, uchar *pos) {
   DBUG_ENTER("tile::mytile::rnd_pos");
 
@@ -1846,63 +2789,143 @@ int tile::mytile::rnd_pos(uchar *buf, uchar *pos) {
     DBUG_RETURN(metadata_to_fields(*it));
   }
 
+  int rc = 0;
+  // We must set the bitmap for debug purpose, it is "write_set" because we use
+  // Field->store
+  MY_BITMAP *original_bitmap =
+      dbug_tmp_use_all_columns(table, &table->write_set);
   try {
-    // Always reset query object so we make sure no ranges are left set
-    this->query = nullptr;
-
-    // Validate the array is open for reads
-    open_array_for_reads(ha_thd());
-
-    // Allocate user buffers
-    alloc_read_buffers(this->read_buffer_size);
-
-    auto domain = this->array_schema->domain();
-    int current_offset = 0;
-    this->subarray = std::unique_ptr<tiledb::Subarray>(
-        new tiledb::Subarray(this->ctx, *this->array));
-    // Reads dimensions in the same order as we wrote them
-    // to ref in tile::mytile::position
-    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
-      tiledb::Dimension dimension = domain.dimension(dim_idx);
+    std::string coords(reinterpret_cast<const char *>(pos),
+                       coords_length(pos));
+
+    // Cached rows are only usable if they hold every requested field
+    bool cached = !this->position_buffers.empty();
+    for (size_t fieldIndex = 0; cached && fieldIndex < table->s->fields;
+         fieldIndex++) {
+      cached = !bitmap_is_set(table->read_set, fieldIndex) ||
+               !this->field_map[fieldIndex].in_array ||
+               this->position_buffers[fieldIndex] != nullptr;
+    }
 
-      // Get datatype size
-      uint64_t size = *reinterpret_cast<uint64_t *>(pos + current_offset);
-      current_offset += sizeof(uint64_t);
-      // Fetch the point
-      void *point = pos + current_offset;
-      // Move current offset for the next dimension's cordinate
-      current_offset += size;
-
-      // set range
-      if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
-        this->ctx.handle_error(tiledb_subarray_add_range_var(
-            this->ctx.ptr().get(), this->subarray->ptr().get(), dim_idx, point,
-            size, point, size));
-      } else {
-        this->ctx.handle_error(tiledb_subarray_add_range(
-            this->ctx.ptr().get(), this->subarray->ptr().get(), dim_idx, point,
-            point, nullptr));
-      }
+    auto it = this->position_rows.end();
+    if (cached)
+      it = this->position_rows.find(coords);
+    if (it == this->position_rows.end()) {
+      read_positions(pos);
+      it = this->position_rows.find(coords);
     }
-    this->query->set_subarray(*this->subarray);
 
-    // Reset indicators
-    this->record_index = 0;
-    this->records = 0;
-    this->records_read = 0;
-    this->status = tiledb::Query::Status::UNINITIALIZED;
+    if (it == this->position_rows.end()) {
+      rc = HA_ERR_END_OF_FILE;
+    } else {
+      decode_fields(ha_thd(), this->position_row_decoder,
+                    this->position_buffers, it->second);
+      this->position_row = it->second;
+    }
   } catch (const tiledb::TileDBError &e) {
     // Log errors
     my_printf_error(ER_UNKNOWN_ERROR, "[rnd_pos] error for table %s : %s",
                     ME_ERROR_LOG | ME_FATAL, this->uri.c_str(), e.what());
-    DBUG_RETURN(ERR_RND_POS_TILEDB);
+    rc = ERR_RND_POS_TILEDB;
   } catch (const std::exception &e) {
     // Log errors
     my_printf_error(ER_UNKNOWN_ERROR, "[rnd_pos] error for table %s : %s",
                     ME_ERROR_LOG | ME_FATAL, this->uri.c_str(), e.what());
-    DBUG_RETURN(ERR_RND_POS_OTHER);
+    rc = ERR_RND_POS_OTHER;
+  }
+
+  // Reset bitmap to original
+  dbug_tmp_restore_column_map(&table->write_set, original_bitmap);
+  DBUG_RETURN(rc);
+}
+
+void tile::mytile::read_positions(const uchar *pos) {
+  DBUG_ENTER("tile::mytile::read_positions");
+
+  // Validate the array is open for reads
+  open_array_for_reads(ha_thd());
+  dealloc_position_buffers();
+
+  // Distinct coordinates of the batch on each dimension, the batch is cut
+  // short once their cross product gets too large
+  std::vector<std::unordered_set<std::string>> distinct(this->ndim);
+  uint64_t positions = 0;
+  auto add_position = [&](const char *coords) {
+    uint64_t cells = 1;
+    uint64_t offset = 0;
+    std::vector<std::string> point(this->ndim);
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      uint64_t size;
+      memcpy(&size, coords + offset, sizeof(uint64_t));
+      point[dim_idx].assign(coords + offset + sizeof(uint64_t), size);
+      offset += sizeof(uint64_t) + size;
+      cells *= distinct[dim_idx].size() +
+               (distinct[dim_idx].count(point[dim_idx]) == 0 ? 1 : 0);
+    }
+
+    if (positions > 0 && (positions >= MAX_POSITIONS_PER_BATCH ||
+                          cells > MAX_POSITION_CELLS_PER_BATCH)) {
+      return false;
+    }
+
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      distinct[dim_idx].insert(std::move(point[dim_idx]));
+    }
+    positions++;
+    return true;
+  };
+
+  // The requested row and the rows saved by position during the scan
+  add_position(reinterpret_cast<const char *>(pos));
+  this->pending_positions.erase(
+      std::string(reinterpret_cast<const char *>(pos), coords_length(pos)));
+  auto it = this->pending_positions.begin();
+  while (it != this->pending_positions.end() && add_position(it->data())) {
+    it = this->pending_positions.erase(it);
+  }
+
+  std::vector<std::vector<std::string>> points(this->ndim);
+  for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+    points[dim_idx].assign(distinct[dim_idx].begin(), distinct[dim_idx].end());
+  }
+
+  read_position_rows(points);
+  DBUG_VOID_RETURN;
+}
+
+void tile::mytile::read_position_rows(
+    std::vector<std::vector<std::string>> &points, uint64_t max_rows) {
+  DBUG_ENTER("tile::mytile::read_position_rows");
+  // Read the requested fields and the dimensions to find rows by coordinates
+  std::vector<bool> fields(table->s->fields, false);
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    const field_details &details = this->field_map[fieldIndex];
+    fields[fieldIndex] =
+        details.in_array && (details.dimension ||
+                             bitmap_is_set(table->read_set, fieldIndex));
+  }
+
+  std::optional<uint64_t> rows =
+      read_points(points, fields, this->position_buffers, max_rows);
+  if (!rows.has_value()) {
+    throw tiledb::TileDBError(
+        std::string("Rows read by position do not fit the read buffers"));
+  }
+  for (uint64_t index = 0; index < *rows; index++) {
+    std::string coords;
+    append_coords(this->position_buffers, index, coords);
+    this->position_rows.emplace(std::move(coords), index);
+  }
+
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    const std::shared_ptr<buffer> &buff = this->position_buffers[fieldIndex];
+    if (!bitmap_is_set(table->read_set, fieldIndex) || buff == nullptr)
+      continue;
+
+    this->position_row_decoder.push_back({table->field[fieldIndex], fieldIndex,
+                                          tile::get_field_converter(buff)});
   }
-  DBUG_RETURN(rnd_next(buf));
+  DBUG_VOID_RETURN;
 }
 
 // Fetches each buffer coordinate and store coordinate.
@@ -1916,8 +2939,15 @@ void tile::mytile::position(const uchar *record) {
     DBUG_VOID_RETURN;
   }
 
-  std::vector<uint8_t> coords =
-      get_coords_as_byte_vector(this->record_index - 1);
+  // The scratch string keeps its capacity, so no allocation per row
+  this->coords_scratch.clear();
+  if (this->position_row != NO_POSITION_ROW) {
+    append_coords(this->position_buffers, this->position_row,
+                  this->coords_scratch);
+  } else {
+    append_coords(this->buffers, this->record_index - 1, this->coords_scratch);
+  }
+  const std::string &coords = this->coords_scratch;
 
   if (coords.size() > this->ref_length) {
     my_printf_error(
@@ -1930,6 +2960,12 @@ void tile::mytile::position(const uchar *record) {
   memcpy(this->ref, coords.data(),
          std::min<uint64_t>(this->ref_length, coords.size()));
 
+  // Rows of the scan are read back in batches by rnd_pos
+  if (this->position_row == NO_POSITION_ROW &&
+      this->pending_positions.size() < MAX_PENDING_POSITIONS) {
+    this->pending_positions.insert(coords);
+  }
+
   DBUG_VOID_RETURN;
 }
 
@@ -1937,17 +2973,17 @@ void tile::mytile::dealloc_buffer(std::shared_ptr<buffer> buff) const {
   DBUG_ENTER("tile::mytile::dealloc_buffer");
 
   if (buff->validity_buffer != nullptr) {
-    free(buff->validity_buffer);
+    tile::free_buffer(buff->validity_buffer);
     buff->validity_buffer = nullptr;
   }
 
   if (buff->offset_buffer != nullptr) {
-    free(buff->offset_buffer);
+    tile::free_buffer(buff->offset_buffer);
     buff->offset_buffer = nullptr;
   }
 
   if (buff->buffer != nullptr) {
-    free(buff->buffer);
+    tile::free_buffer(buff->buffer);
     buff->buffer = nullptr;
   }
 
@@ -1957,6 +2993,9 @@ void tile::mytile::dealloc_buffer(std::shared_ptr<buffer> buff) const {
 void tile::mytile::dealloc_buffers() {
   DBUG_ENTER("tile::mytile::dealloc_buffers");
   // Free allocated buffers
+  dealloc_prefetch_buffers();
+  dealloc_late_buffers();
+  dealloc_position_buffers();
   for (auto &buff : this->buffers) {
     // Ignore empty buffers
     if (buff == nullptr)
@@ -1969,35 +3008,87 @@ void tile::mytile::dealloc_buffers() {
   DBUG_VOID_RETURN;
 }
 
-const COND *tile::mytile::cond_push_cond(Item_cond *cond_item) {
-  DBUG_ENTER("tile::mytile::cond_push_cond");
-  tiledb_query_condition_combination_op_t op;
+void tile::mytile::dealloc_late_buffers() {
+  DBUG_ENTER("tile::mytile::dealloc_late_buffers");
+  for (auto &buff : this->late_buffers) {
+    // Ignore empty buffers
+    if (buff == nullptr)
+      continue;
 
-  switch (cond_item->functype()) {
-  case Item_func::COND_AND_FUNC:
-    op = TILEDB_AND;
-    break;
-  case Item_func::COND_OR_FUNC:
-    op = TILEDB_OR;
-    break;
-  default:
-    DBUG_RETURN(cond_item);
+    dealloc_buffer(buff);
   }
 
-  List<Item> *arglist = cond_item->argument_list();
-  List_iterator<Item> li(*arglist);
-  const Item *subitem;
-  std::shared_ptr<tiledb::QueryCondition> queryCondition;
-  std::shared_ptr<tiledb::QueryCondition> operatorCondition;
+  this->late_buffers.clear();
+  this->late_row_decoder.clear();
+  DBUG_VOID_RETURN;
+}
+
+void tile::mytile::dealloc_position_buffers() {
+  DBUG_ENTER("tile::mytile::dealloc_position_buffers");
+  for (auto &buff : this->position_buffers) {
+    // Ignore empty buffers
+    if (buff == nullptr)
+      continue;
+
+    dealloc_buffer(buff);
+  }
+
+  this->position_buffers.clear();
+  this->position_rows.clear();
+  this->position_row_decoder.clear();
+  this->position_row = NO_POSITION_ROW;
+  DBUG_VOID_RETURN;
+}
 
-  // Depending on the condition type (OR, AND), we create a combination of
-  // conditions. Then we combine this combined Query Condition with the
-  // "primary" Query Condition with an AND. In the end, the "primary" Query
-  // Condition contains all the sub conditions.
+void tile::mytile::dealloc_prefetch_buffers() {
+  DBUG_ENTER("tile::mytile::dealloc_prefetch_buffers");
+  // A background submit might still be writing to them
+  cancel_prefetch();
+  dealloc_scan_partitions();
+  for (auto &buff : this->prefetch_buffers) {
+    // Ignore empty buffers
+    if (buff == nullptr)
+      continue;
+
+    dealloc_buffer(buff);
+  }
+
+  this->prefetch_buffers.clear();
+  DBUG_VOID_RETURN;
+}
+
+const COND *tile::mytile::cond_push_cond(Item_cond *cond_item) {
+  DBUG_ENTER("tile::mytile::cond_push_cond");
+
+  switch (cond_item->functype()) {
+  case Item_func::COND_AND_FUNC:
+    break;
+  case Item_func::COND_OR_FUNC:
+    DBUG_RETURN(cond_push_disjunction(cond_item));
+  default:
+    DBUG_RETURN(cond_item);
+  }
+
+  List<Item> *arglist = cond_item->argument_list();
+  List_iterator<Item> li(*arglist);
+  const Item *subitem;
+  std::shared_ptr<tiledb::QueryCondition> queryCondition;
+  std::shared_ptr<tiledb::QueryCondition> operatorCondition;
+  bool residual = false;
+
+  // We create a combination of the conditions of all sub conditions. Then we
+  // combine this combined Query Condition with the "primary" Query Condition
+  // with an AND. In the end, the "primary" Query Condition contains all the
+  // sub conditions.
   for (uint32_t i = 0; i < arglist->elements; i++) {
     if ((subitem = li++)) {
       // COND_ITEMs
-      cond_push_local(dynamic_cast<const COND *>(subitem), queryCondition);
+      if (cond_push_local(dynamic_cast<const COND *>(subitem),
+                          queryCondition) != nullptr) {
+        // The pushed sub conditions still narrow the read, MariaDB
+        // evaluates the whole condition
+        residual = true;
+      }
       // Dimensions do not support QCs, hence the queryCondition ptr
       // returned from cond_push_local() will be null, so skip
       if (queryCondition != nullptr) {
@@ -2008,7 +3099,7 @@ const COND *tile::mytile::cond_push_cond(Item_cond *cond_item) {
               std::make_shared<tiledb::QueryCondition>(*queryCondition);
         } else {
           tiledb::QueryCondition tempCondition =
-              queryCondition->combine(*operatorCondition, op);
+              queryCondition->combine(*operatorCondition, TILEDB_AND);
           operatorCondition =
               std::make_shared<tiledb::QueryCondition>(tempCondition);
         }
@@ -2026,6 +3117,120 @@ const COND *tile::mytile::cond_push_cond(Item_cond *cond_item) {
       this->query_condition = std::make_shared<tiledb::QueryCondition>(qc);
     }
   }
+  DBUG_RETURN(residual ? cond_item : nullptr);
+}
+
+const COND *tile::mytile::cond_push_disjunction(Item_cond *cond_item) {
+  DBUG_ENTER("tile::mytile::cond_push_disjunction");
+
+  // Each alternative is pushed on its own, the conditions pushed so far are
+  // set aside until all alternatives are known to be pushable
+  auto saved_ranges = std::move(this->pushdown_ranges);
+  auto saved_in_ranges = std::move(this->pushdown_in_ranges);
+  auto saved_query_condition = this->query_condition;
+  auto restore = [&]() {
+    this->pushdown_ranges = std::move(saved_ranges);
+    this->pushdown_in_ranges = std::move(saved_in_ranges);
+    this->query_condition = saved_query_condition;
+  };
+
+  // Alternatives are either all ranges of the same dimension or all query
+  // conditions on attributes
+  std::optional<uint64_t> disjunction_dim;
+  std::vector<std::shared_ptr<tile::range>> alternatives;
+  std::shared_ptr<tiledb::QueryCondition> disjunction_condition;
+
+  List_iterator<Item> li(*cond_item->argument_list());
+  const Item *subitem;
+  while ((subitem = li++)) {
+    this->pushdown_ranges.assign(this->ndim, {});
+    this->pushdown_in_ranges.assign(this->ndim, {});
+    std::shared_ptr<tiledb::QueryCondition> queryCondition;
+
+    // An alternative which is not fully pushed lets rows through which the
+    // pushed alternatives would reject
+    if (cond_push_local(dynamic_cast<const COND *>(subitem), queryCondition) !=
+            nullptr ||
+        this->query_condition != saved_query_condition) {
+      restore();
+      DBUG_RETURN(cond_item);
+    }
+
+    std::optional<uint64_t> dim;
+    bool multiple_dims = false;
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      if (this->pushdown_ranges[dim_idx].empty() &&
+          this->pushdown_in_ranges[dim_idx].empty())
+        continue;
+      multiple_dims |= dim.has_value();
+      dim = dim_idx;
+    }
+
+    if (queryCondition != nullptr && !dim.has_value() &&
+        alternatives.empty()) {
+      if (disjunction_condition == nullptr) {
+        disjunction_condition = queryCondition;
+      } else {
+        tiledb::QueryCondition qc =
+            disjunction_condition->combine(*queryCondition, TILEDB_OR);
+        disjunction_condition = std::make_shared<tiledb::QueryCondition>(qc);
+      }
+      continue;
+    }
+
+    if (queryCondition != nullptr || !dim.has_value() || multiple_dims ||
+        disjunction_condition != nullptr ||
+        (disjunction_dim.has_value() && *disjunction_dim != *dim)) {
+      restore();
+      DBUG_RETURN(cond_item);
+    }
+    disjunction_dim = dim;
+
+    // The alternative is either a single range or the values of one IN
+    const auto &ranges = this->pushdown_ranges[*dim];
+    const auto &in_ranges = this->pushdown_in_ranges[*dim];
+    if (!ranges.empty() && in_ranges.empty()) {
+      auto range =
+          tile::merge_ranges(ranges, this->domain->dimension(*dim).type());
+      if (range == nullptr) {
+        restore();
+        DBUG_RETURN(cond_item);
+      }
+      alternatives.push_back(std::move(range));
+    } else if (ranges.empty() &&
+               std::all_of(in_ranges.begin(), in_ranges.end(),
+                           [&](const std::shared_ptr<tile::range> &range) {
+                             return range->disjunction ==
+                                    in_ranges.front()->disjunction;
+                           })) {
+      alternatives.insert(alternatives.end(), in_ranges.begin(),
+                          in_ranges.end());
+    } else {
+      restore();
+      DBUG_RETURN(cond_item);
+    }
+  }
+
+  restore();
+  if (disjunction_dim.has_value()) {
+    // The alternatives are unioned when the subarray is built
+    uint64_t disjunction = ++this->pushdown_disjunctions;
+    auto &range_vec = this->pushdown_in_ranges[*disjunction_dim];
+    for (auto &range : alternatives) {
+      range->disjunction = disjunction;
+      range_vec.push_back(std::move(range));
+    }
+  } else if (disjunction_condition != nullptr) {
+    if (this->query_condition == nullptr) {
+      this->query_condition = disjunction_condition;
+    } else {
+      tiledb::QueryCondition qc =
+          this->query_condition->combine(*disjunction_condition, TILEDB_AND);
+      this->query_condition = std::make_shared<tiledb::QueryCondition>(qc);
+    }
+  } else {
+    DBUG_RETURN(cond_item);
+  }
   DBUG_RETURN(nullptr);
 }
 
@@ -2063,39 +3268,32 @@ const COND *tile::mytile::cond_push_func_datetime(
 
   // Check attributes
   bool nullable = false;
-  if (this->array_schema->has_attribute(column_field->field_name.str)) {
+  const field_details *details =
+      find_field_details(column_field->field_name.str);
+  if (details != nullptr && !details->dimension) {
 
-    // Dense arrays do not support query conditions.
+    // Dense arrays do not support query conditions, unless the condition
+    // only filters the cells of aggregates TileDB computes
     auto has_aggr = has_aggregate(ha_thd(), column_field->field_name.str);
-    if (has_aggr == Item_sum::COUNT_FUNC) {
-      DBUG_RETURN(func_item);
-    }
-
     if (this->array_schema->array_type() == TILEDB_DENSE && !has_aggr) {
       DBUG_RETURN(func_item);
     }
 
-    auto attr = this->array_schema->attribute(column_field->field_name.str);
-    datatype = attr.type();
-    nullable = attr.nullable();
+    datatype = details->type;
+    nullable = details->nullable;
 
-    if (!attr.variable_sized() ||
-        (attr.variable_sized() &&
+    if (!details->var_len ||
+        (details->var_len &&
          (datatype == TILEDB_STRING_ASCII || datatype == TILEDB_STRING_UTF8))) {
       use_query_condition = true;
     } else {
       // If we can't use query condition let MariaDB filter the attribute
       DBUG_RETURN(func_item);
     }
-  } else {
+  } else if (details != nullptr) {
     // Check dimensions
-    auto dims = this->array_schema->domain().dimensions();
-    for (uint64_t j = 0; j < this->ndim; j++) {
-      if (dims[j].name() == column_field->field_name.str) {
-        dim_idx = j;
-        datatype = dims[j].type();
-      }
-    }
+    dim_idx = details->index;
+    datatype = details->type;
   }
 
   switch (func_item->functype()) {
@@ -2104,7 +3302,7 @@ const COND *tile::mytile::cond_push_func_datetime(
     if (!use_query_condition || !nullable)
       DBUG_RETURN(func_item); /* Is null is not supported for ranges*/
 
-    qcPtr = std::make_shared<tiledb::QueryCondition>(ctx);
+    qcPtr = std::make_shared<tiledb::QueryCondition>(*this->ctx);
     qcPtr->init(column_field->field_name.str, nullptr, 0, TILEDB_EQ);
     break;
   }
@@ -2113,7 +3311,7 @@ const COND *tile::mytile::cond_push_func_datetime(
     if (!use_query_condition || !nullable)
       DBUG_RETURN(func_item); /* Is not null is not supported for ranges*/
 
-    qcPtr = std::make_shared<tiledb::QueryCondition>(ctx);
+    qcPtr = std::make_shared<tiledb::QueryCondition>(*this->ctx);
     qcPtr->init(column_field->field_name.str, nullptr, 0, TILEDB_NE);
     break;
   }
@@ -2144,12 +3342,15 @@ const COND *tile::mytile::cond_push_func_datetime(
 
     // If this is an attribute add it to the query condition
     qcPtr = std::make_shared<tiledb::QueryCondition>(
-        range->QueryCondition(ctx, column_field->field_name.str));
+        range->QueryCondition(*this->ctx, column_field->field_name.str));
     break;
   }
     // In is special because we need to do a tiledb range per argument and treat
     // it as OR not AND
-  case Item_func::IN_FUNC:
+  case Item_func::IN_FUNC: {
+    // The values are alternatives of one disjunction, they are only pushed
+    // once all of them are converted
+    std::vector<std::shared_ptr<range>> in_values;
     // Start at 1 because 0 is the field
     for (uint i = 1; i < func_item->argument_count(); i++) {
       Item_basic_constant *lower_const =
@@ -2184,21 +3385,28 @@ const COND *tile::mytile::cond_push_func_datetime(
         DBUG_RETURN(func_item);
         /*if (this->query_condition == nullptr) {
           this->query_condition = std::make_shared<tiledb::QueryCondition>(
-              range->QueryCondition(ctx, column_field->field_name.str));
+              range->QueryCondition(*this->ctx, column_field->field_name.str));
         } else {
           tiledb::QueryCondition qc = this->query_condition->combine(
-              range->QueryCondition(ctx, column_field->field_name.str),
+              range->QueryCondition(*this->ctx, column_field->field_name.str),
               TILEDB_AND);
           this->query_condition = std::make_shared<tiledb::QueryCondition>(qc);
         }*/
       } else {
-        // Add the range to the pushdown in ranges
-        auto &range_vec = this->pushdown_in_ranges[dim_idx];
-        range_vec.push_back(std::move(range));
+        in_values.push_back(std::move(range));
       }
     }
 
+    // Add the ranges to the pushdown in ranges
+    uint64_t disjunction = ++this->pushdown_disjunctions;
+    auto &range_vec = this->pushdown_in_ranges[dim_idx];
+    for (auto &range : in_values) {
+      range->disjunction = disjunction;
+      range_vec.push_back(std::move(range));
+    }
+
     break;
+  }
     // Handle equal case by setting upper and lower ranges to same value
   case Item_func::EQ_FUNC: {
     // Create unique ptrs
@@ -2223,7 +3431,7 @@ const COND *tile::mytile::cond_push_func_datetime(
     // If this is an attribute add it to the query condition
     if (use_query_condition) {
       qcPtr = std::make_shared<tiledb::QueryCondition>(
-          range->QueryCondition(ctx, column_field->field_name.str));
+          range->QueryCondition(*this->ctx, column_field->field_name.str));
     } else {
       // Add the range to the pushdown in ranges
       auto &range_vec = this->pushdown_ranges[dim_idx];
@@ -2295,7 +3503,7 @@ const COND *tile::mytile::cond_push_func_datetime(
     // If this is an attribute add it to the query condition
     if (use_query_condition) {
       qcPtr = std::make_shared<tiledb::QueryCondition>(
-          range->QueryCondition(ctx, column_field->field_name.str));
+          range->QueryCondition(*this->ctx, column_field->field_name.str));
     } else {
       // Add the range to the pushdown in ranges
       auto &range_vec = this->pushdown_ranges[dim_idx];
@@ -2434,7 +3642,7 @@ const COND *tile::mytile::cond_push_func_spatial(
     y2 = y2 + (pad_y / 2.0);
 
     // Find X and Y dimensions
-    auto dims = this->array_schema->domain().dimensions();
+    auto dims = this->domain->dimensions();
     uint64_t x_idx = std::numeric_limits<uint64_t>::max();
     uint64_t y_idx = std::numeric_limits<uint64_t>::max();
     tiledb_datatype_t x_datatype;
@@ -2539,29 +3747,25 @@ tile::mytile::cond_push_func(const Item_func *func_item,
 
   // Check attributes
   bool nullable = false;
-  if (this->array_schema->has_attribute(column_field->field_name.str)) {
+  const field_details *details =
+      find_field_details(column_field->field_name.str);
+  if (details != nullptr && !details->dimension) {
 
-    // Dense arrays do not support query conditions
+    // Dense arrays do not support query conditions, unless the condition
+    // only filters the cells of aggregates TileDB computes
     auto has_aggr = has_aggregate(ha_thd(), column_field->field_name.str);
-    if (has_aggr == Item_sum::COUNT_FUNC) {
-      DBUG_RETURN(func_item);
-    }
-
     if (this->array_schema->array_type() == TILEDB_DENSE && !has_aggr) {
       DBUG_RETURN(func_item);
     }
 
-    auto attr = this->array_schema->attribute(column_field->field_name.str);
-    datatype = attr.type();
-    nullable = attr.nullable();
-    auto enmr_name =
-        tiledb::AttributeExperimental::get_enumeration_name(ctx, attr);
-    is_enum = enmr_name.has_value();
+    datatype = details->type;
+    nullable = details->nullable;
+    is_enum = details->enumeration;
 
     if (is_enum)
       DBUG_RETURN(func_item); // disable enum push down for now TODO
-    if (!attr.variable_sized() ||
-        (attr.variable_sized() &&
+    if (!details->var_len ||
+        (details->var_len &&
          (datatype == TILEDB_STRING_ASCII || datatype == TILEDB_STRING_UTF8))) {
       use_query_condition = true;
     } else {
@@ -2569,14 +3773,9 @@ tile::mytile::cond_push_func(const Item_func *func_item,
       DBUG_RETURN(func_item);
     }
 
-  } else {
-    auto dims = this->array_schema->domain().dimensions();
-    for (uint64_t j = 0; j < this->ndim; j++) {
-      if (dims[j].name() == column_field->field_name.str) {
-        dim_idx = j;
-        datatype = dims[j].type();
-      }
-    }
+  } else if (details != nullptr) {
+    dim_idx = details->index;
+    datatype = details->type;
   }
 
   switch (func_item->functype()) {
@@ -2585,7 +3784,7 @@ tile::mytile::cond_push_func(const Item_func *func_item,
     if (!use_query_condition || !nullable)
       DBUG_RETURN(func_item); /* Is null is not supported for ranges*/
 
-    qcPtr = std::make_shared<tiledb::QueryCondition>(ctx);
+    qcPtr = std::make_shared<tiledb::QueryCondition>(*this->ctx);
     qcPtr->init(column_field->field_name.str, nullptr, 0, TILEDB_EQ);
     break;
   }
@@ -2594,7 +3793,7 @@ tile::mytile::cond_push_func(const Item_func *func_item,
     if (!use_query_condition || !nullable)
       DBUG_RETURN(func_item); /* Is not null is not supported for ranges*/
 
-    qcPtr = std::make_shared<tiledb::QueryCondition>(ctx);
+    qcPtr = std::make_shared<tiledb::QueryCondition>(*this->ctx);
     qcPtr->init(column_field->field_name.str, nullptr, 0, TILEDB_NE);
     break;
   }
@@ -2625,12 +3824,15 @@ tile::mytile::cond_push_func(const Item_func *func_item,
 
     // If this is an attribute add it to the query condition
     qcPtr = std::make_shared<tiledb::QueryCondition>(
-        range->QueryCondition(ctx, column_field->field_name.str));
+        range->QueryCondition(*this->ctx, column_field->field_name.str));
     break;
   }
     // In is special because we need to do a tiledb range per argument and treat
     // it as OR not AND
-  case Item_func::IN_FUNC:
+  case Item_func::IN_FUNC: {
+    // The values are alternatives of one disjunction, they are only pushed
+    // once all of them are converted
+    std::vector<std::shared_ptr<range>> in_values;
     // Start at 1 because 0 is the field
     for (uint i = 1; i < func_item->argument_count(); i++) {
       Item_basic_constant *lower_const =
@@ -2665,21 +3867,28 @@ tile::mytile::cond_push_func(const Item_func *func_item,
         DBUG_RETURN(func_item);
         /*if (this->query_condition == nullptr) {
           this->query_condition = std::make_shared<tiledb::QueryCondition>(
-              range->QueryCondition(ctx, column_field->field_name.str));
+              range->QueryCondition(*this->ctx, column_field->field_name.str));
         } else {
           tiledb::QueryCondition qc = this->query_condition->combine(
-              range->QueryCondition(ctx, column_field->field_name.str),
+              range->QueryCondition(*this->ctx, column_field->field_name.str),
               TILEDB_AND);
           this->query_condition = std::make_shared<tiledb::QueryCondition>(qc);
         }*/
       } else {
-        // Add the range to the pushdown in ranges
-        auto &range_vec = this->pushdown_in_ranges[dim_idx];
-        range_vec.push_back(std::move(range));
+        in_values.push_back(std::move(range));
       }
     }
 
+    // Add the ranges to the pushdown in ranges
+    uint64_t disjunction = ++this->pushdown_disjunctions;
+    auto &range_vec = this->pushdown_in_ranges[dim_idx];
+    for (auto &range : in_values) {
+      range->disjunction = disjunction;
+      range_vec.push_back(std::move(range));
+    }
+
     break;
+  }
     // Handle equal case by setting upper and lower ranges to same value
   case Item_func::EQ_FUNC: {
     // Create unique ptrs
@@ -2706,7 +3915,7 @@ tile::mytile::cond_push_func(const Item_func *func_item,
     // If this is an attribute add it to the query condition
     if (use_query_condition) {
       qcPtr = std::make_shared<tiledb::QueryCondition>(
-          range->QueryCondition(ctx, column_field->field_name.str));
+          range->QueryCondition(*this->ctx, column_field->field_name.str));
     } else {
       // Add the range to the pushdown in ranges
       auto &range_vec = this->pushdown_ranges[dim_idx];
@@ -2765,7 +3974,7 @@ tile::mytile::cond_push_func(const Item_func *func_item,
     // If this is an attribute add it to the query condition
     if (use_query_condition) {
       qcPtr = std::make_shared<tiledb::QueryCondition>(
-          range->QueryCondition(ctx, column_field->field_name.str));
+          range->QueryCondition(*this->ctx, column_field->field_name.str));
     } else {
       // Add the range to the pushdown in ranges
       auto &range_vec = this->pushdown_ranges[dim_idx];
@@ -2785,11 +3994,20 @@ const COND *tile::mytile::cond_push(const COND *cond) {
   // NOTE: This is called one or more times by handle interface. Once for each
   // condition
 
-  if (!tile::sysvars::enable_pushdown(ha_thd())) {
-    DBUG_RETURN(cond);
+  const COND *residual = cond;
+  this->pushed_conds++;
+  if (tile::sysvars::enable_pushdown(ha_thd())) {
+    residual = cond_push_local(cond, this->query_condition);
   }
 
-  DBUG_RETURN(cond_push_local(cond, this->query_condition));
+  // MariaDB evaluates the residual condition on the rows we return, late
+  // materialization also evaluates it to skip reading wide fields of rows
+  // which will be rejected
+  if (residual != nullptr) {
+    this->residual_conds.push_back(const_cast<COND *>(residual));
+  }
+
+  DBUG_RETURN(residual);
 }
 
 const COND *
@@ -2829,293 +4047,1174 @@ tile::mytile::cond_push_local(const COND *cond,
       DBUG_RETURN(ret);
     }
 
-    if (func_item->argument_count() > 1) {
-      Item **args = func_item->arguments();
+    if (func_item->argument_count() > 1) {
+      Item **args = func_item->arguments();
+
+      Item_field *column_field = dynamic_cast<Item_field *>(args[0]);
+
+      if (column_field == nullptr) {
+        DBUG_RETURN(func_item);
+      }
+
+      tiledb_datatype_t datatype = tiledb_datatype_t::TILEDB_ANY;
+
+      const field_details *details =
+          find_field_details(column_field->field_name.str);
+      if (details != nullptr) {
+        datatype = details->type;
+      }
+
+      if (datatype == TILEDB_DATETIME_AS || datatype == TILEDB_DATETIME_FS ||
+          datatype == TILEDB_DATETIME_PS || datatype == TILEDB_DATETIME_NS ||
+          datatype == TILEDB_DATETIME_US || datatype == TILEDB_DATETIME_MS ||
+          datatype == TILEDB_DATETIME_SEC || datatype == TILEDB_DATETIME_MIN ||
+          datatype == TILEDB_DATETIME_HR || datatype == TILEDB_DATETIME_DAY ||
+          datatype == TILEDB_DATETIME_WEEK ||
+          datatype == TILEDB_DATETIME_MONTH ||
+          datatype == TILEDB_DATETIME_YEAR || datatype == TILEDB_TIME_AS ||
+          datatype == TILEDB_TIME_FS || datatype == TILEDB_TIME_PS ||
+          datatype == TILEDB_TIME_NS || datatype == TILEDB_TIME_US ||
+          datatype == TILEDB_TIME_MS || datatype == TILEDB_TIME_SEC ||
+          datatype == TILEDB_TIME_MIN || datatype == TILEDB_TIME_HR) {
+        ret = cond_push_func_datetime(func_item, qcPtr);
+        DBUG_RETURN(ret);
+      }
+    }
+
+    ret = cond_push_func(func_item, qcPtr);
+    DBUG_RETURN(ret);
+    break;
+  }
+  // not supported currently
+  // Field items are when two have two fields of a table, i.e. a join.
+  case Item::FIELD_ITEM:
+    // fall through
+  default: {
+    DBUG_RETURN(cond);
+  }
+  }
+  DBUG_RETURN(cond);
+}
+
+void tile::mytile::cond_pop() {
+  DBUG_ENTER("tile::mytile::cond_pop");
+  this->residual_conds.clear();
+  this->pushed_conds = 0;
+
+  DBUG_VOID_RETURN;
+}
+
+Item *tile::mytile::idx_cond_push(uint keyno, Item *idx_cond) {
+  DBUG_ENTER("tile::mytile::idx_cond_push");
+  std::shared_ptr<tiledb::QueryCondition> null;
+  auto ret = cond_push_local(static_cast<Item_cond *>(idx_cond), null);
+  DBUG_RETURN(const_cast<Item *>(ret));
+}
+
+void tile::mytile::drop_table(const char *name) {
+  DBUG_ENTER("tile::mytile::drop_table");
+  delete_table(name);
+  DBUG_VOID_RETURN;
+}
+
+int tile::mytile::delete_table(const char *name) {
+  DBUG_ENTER("tile::mytile::delete_table");
+  if (!tile::sysvars::delete_arrays(ha_thd())) {
+    DBUG_RETURN(0);
+  }
+
+  try {
+    tiledb::VFS vfs(*this->ctx);
+    TABLE_SHARE *s;
+    if (this->table != nullptr)
+      s = this->table->s;
+    else
+      s = this->table_share;
+    if (s != nullptr && s->option_struct != nullptr &&
+        s->option_struct->array_uri != nullptr) {
+      vfs.remove_dir(s->option_struct->array_uri);
+      tile::schemacache::invalidate(s->option_struct->array_uri);
+    } else {
+      vfs.remove_dir(name);
+      tile::schemacache::invalidate(name);
+    }
+  } catch (const tiledb::TileDBError &e) {
+    // Log errors
+    sql_print_error("delete_table error for table %s : %s", name, e.what());
+    DBUG_RETURN(ERR_DELETE_TABLE_TILEDB);
+  } catch (const std::exception &e) {
+    // Log errors
+    sql_print_error("delete_table error for table %s : %s", name, e.what());
+    DBUG_RETURN(ERR_DELETE_TABLE_OTHER);
+  }
+  DBUG_RETURN(0);
+}
+
+int tile::mytile::info(uint) {
+  DBUG_ENTER("tile::mytile::info");
+  // If the user requests table records, the exact number of cells is used
+  // when metadata knows it
+  std::optional<uint64_t> records;
+  if (tile::sysvars::compute_table_records(ha_thd()))
+    records = get_metadata_records();
+
+  // Need records to be greater than 1 to avoid 0/1 row optimizations by query
+  // optimizer
+  stats.records = records.has_value() ? std::max<uint64_t>(*records, 2)
+                                      : this->records_upper_bound;
+  DBUG_RETURN(0);
+};
+
+ulonglong tile::mytile::table_flags(void) const {
+  DBUG_ENTER("tile::mytile::table_flags");
+  DBUG_RETURN(
+      HA_PARTIAL_COLUMN_READ | HA_REC_NOT_IN_SEQ | HA_CAN_SQL_HANDLER |
+      //               HA_REQUIRE_PRIMARY_KEY | HA_PRIMARY_KEY_IN_READ_INDEX |
+      HA_FAST_KEY_READ | HA_SLOW_RND_POS | HA_CAN_TABLE_CONDITION_PUSHDOWN |
+      HA_CAN_EXPORT | HA_CONCURRENT_OPTIMIZE | HA_CAN_ONLINE_BACKUPS |
+      HA_CAN_BIT_FIELD | HA_FILE_BASED);
+}
+
+void tile::mytile::build_field_map() {
+  DBUG_ENTER("tile::mytile::build_field_map");
+  this->field_map.clear();
+  this->field_map.resize(table->s->fields);
+  this->field_indexes.clear();
+  this->dim_field_indexes.assign(this->ndim, SIZE_MAX);
+  this->var_cell_stats.assign(table->s->fields, {0, 0});
+  auto dims = this->domain->dimensions();
+
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    Field *field = table->field[fieldIndex];
+    std::string field_name = field->field_name.str;
+    field_details &details = this->field_map[fieldIndex];
+    this->field_indexes[field_name] = fieldIndex;
+
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      const tiledb::Dimension &dim = dims[dim_idx];
+      if (dim.name() == field_name) {
+        details.in_array = true;
+        details.dimension = true;
+        details.index = dim_idx;
+        this->dim_field_indexes[dim_idx] = fieldIndex;
+        details.type = dim.type();
+        details.cell_val_num = dim.cell_val_num();
+        details.var_len = dim.cell_val_num() == TILEDB_VAR_NUM;
+        break;
+      }
+    }
+
+    if (details.in_array)
+      continue;
+
+    for (uint32_t attr_idx = 0; attr_idx < this->array_schema->attribute_num();
+         attr_idx++) {
+      tiledb::Attribute attr = this->array_schema->attribute(attr_idx);
+      if (attr.name() == field_name) {
+        details.in_array = true;
+        details.index = attr_idx;
+        details.type = attr.type();
+        details.cell_val_num = attr.cell_val_num();
+        details.var_len = attr.variable_sized();
+        details.nullable = attr.nullable();
+        details.list =
+            attr.cell_val_num() > 1 && attr.cell_val_num() != TILEDB_VAR_NUM;
+        details.enumeration =
+            tiledb::AttributeExperimental::get_enumeration_name(*this->ctx,
+                                                                attr)
+                .has_value();
+        break;
+      }
+    }
+  }
+  DBUG_VOID_RETURN;
+}
+
+const tile::field_details *
+tile::mytile::find_field_details(const char *field_name) const {
+  auto it = this->field_indexes.find(field_name);
+  if (it == this->field_indexes.end())
+    return nullptr;
+
+  const field_details &details = this->field_map[it->second];
+  if (!details.in_array)
+    return nullptr;
+  return &details;
+}
+
+// Smallest buffer allocated from a result size estimate
+static const uint64_t MIN_ESTIMATED_BUFFER_SIZE = 16 * 1024;
+
+/**
+ * Size of a buffer for an estimated result size, estimates are not exact so
+ * some headroom is added
+ * @param estimate estimated bytes
+ * @return buffer size
+ */
+static uint64_t estimated_buffer_size(uint64_t estimate) {
+  return std::max(estimate + estimate / 4, MIN_ESTIMATED_BUFFER_SIZE);
+}
+
+tile::mytile::estimated_result_size
+tile::mytile::get_estimated_result_size(tiledb::Query &read_query,
+                                        const std::string &name,
+                                        const field_details &details) {
+  estimated_result_size est;
+  tiledb_ctx_t *c_ctx = this->ctx->ptr().get();
+  tiledb_query_t *c_query = read_query.ptr().get();
+
+  // Estimates are only available once the subarray is set, without one the
+  // budget sizes are kept
+  int rc;
+  if (details.var_len && details.nullable && !details.dimension) {
+    rc = tiledb_query_get_est_result_size_var_nullable(
+        c_ctx, c_query, name.c_str(), &est.offsets, &est.data, &est.validity);
+  } else if (details.var_len) {
+    rc = tiledb_query_get_est_result_size_var(c_ctx, c_query, name.c_str(),
+                                              &est.offsets, &est.data);
+  } else if (details.nullable && !details.dimension) {
+    rc = tiledb_query_get_est_result_size_nullable(
+        c_ctx, c_query, name.c_str(), &est.data, &est.validity);
+  } else {
+    rc = tiledb_query_get_est_result_size(c_ctx, c_query, name.c_str(),
+                                          &est.data);
+  }
+  est.valid = rc == TILEDB_OK;
+  return est;
+}
+
+// Bytes per cell assumed for var length fields with no statistics
+static const double DEFAULT_VAR_BYTES_PER_CELL = 8;
+
+double tile::mytile::var_bytes_per_cell(size_t fieldIndex,
+                                        const estimated_result_size &est) {
+  // Cells already read by this handler are the best guide
+  if (fieldIndex < this->var_cell_stats.size() &&
+      this->var_cell_stats[fieldIndex].second > 0) {
+    const auto &stats = this->var_cell_stats[fieldIndex];
+    return std::max(1.0, static_cast<double>(stats.first) / stats.second);
+  }
+
+  // Fall back to the ratio of the estimated result sizes
+  uint64_t est_cells = est.offsets / sizeof(uint64_t);
+  if (est.valid && est_cells > 0)
+    return std::max(1.0, static_cast<double>(est.data) / est_cells);
+
+  return DEFAULT_VAR_BYTES_PER_CELL;
+}
+
+void tile::mytile::alloc_buffers(uint64_t memory_budget,
+                                 bool size_from_estimates, uint64_t max_rows) {
+  DBUG_ENTER("tile::mytile::alloc_buffers");
+  std::vector<bool> fields(table->s->fields, false);
+  // Index only reads need nothing but the coordinates
+  bool keyread = this->keyread_only && this->query != nullptr &&
+                 this->query->query_type() == TILEDB_READ;
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    // Only set buffers for fields that are asked for except always set
+    // dimensions. We check the read_set because the read_set is set to ALL
+    // column for writes and set to the subset of columns for reads
+    fields[fieldIndex] =
+        (!keyread && bitmap_is_set(this->table->read_set, fieldIndex)) ||
+        this->field_map[fieldIndex].dimension;
+
+    // Late materialized fields are read separately for the rows passing the
+    // residual condition
+    if (this->late_materialization && this->late_fields[fieldIndex])
+      fields[fieldIndex] = false;
+  }
+
+  alloc_buffer_set(this->buffers, fields, *this->query, memory_budget,
+                   size_from_estimates, max_rows);
+  DBUG_VOID_RETURN;
+}
+
+void tile::mytile::alloc_buffer_set(
+    std::vector<std::shared_ptr<buffer>> &buffer_set,
+    const std::vector<bool> &fields, tiledb::Query &read_query,
+    uint64_t memory_budget, bool size_from_estimates, uint64_t max_rows) {
+  DBUG_ENTER("tile::mytile::alloc_buffer_set");
+  // Set Attribute Buffers
+  if (buffer_set.empty()) {
+    for (size_t i = 0; i < table->s->fields; i++)
+      buffer_set.emplace_back();
+  }
+
+  // Expected bytes per cell of the data, offset and validity buffer of each
+  // field, the budget is split by these weights
+  std::vector<size_t> field_indexes;
+  std::vector<estimated_result_size> estimates;
+  std::vector<double> bytes_per_cell;
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    const field_details &details = this->field_map[fieldIndex];
+    if (!fields[fieldIndex]) {
+      continue;
+    }
+
+    estimated_result_size est;
+    if (size_from_estimates)
+      est = get_estimated_result_size(
+          read_query, table->field[fieldIndex]->field_name.str, details);
+
+    double data_bytes;
+    double offset_bytes = 0;
+    double validity_bytes = 0;
+    if (details.var_len) {
+      data_bytes = var_bytes_per_cell(fieldIndex, est);
+      offset_bytes = sizeof(uint64_t);
+    } else {
+      uint64_t cell_val_num = details.dimension ? 1 : details.cell_val_num;
+      data_bytes = tiledb_datatype_size(details.type) * cell_val_num;
+    }
+    if (details.nullable && !details.dimension)
+      validity_bytes = sizeof(uint8_t);
+
+    field_indexes.push_back(fieldIndex);
+    estimates.push_back(est);
+    bytes_per_cell.push_back(data_bytes);
+    bytes_per_cell.push_back(offset_bytes);
+    bytes_per_cell.push_back(validity_bytes);
+  }
+
+  // Buffers for a few rows are enough when the scan is limited
+  if (max_rows != UINT64_MAX) {
+    double row_bytes = 0;
+    for (double bytes : bytes_per_cell)
+      row_bytes += bytes;
+    memory_budget = std::min<uint64_t>(
+        memory_budget, static_cast<uint64_t>(std::ceil(row_bytes * max_rows)));
+  }
+
+  std::vector<uint64_t> sizes =
+      tile::compute_buffer_sizes(bytes_per_cell, memory_budget);
+
+  for (size_t i = 0; i < field_indexes.size(); i++) {
+    size_t fieldIndex = field_indexes[i];
+    Field *field = table->field[fieldIndex];
+    const field_details &details = this->field_map[fieldIndex];
+
+    // Create buffer
+    std::shared_ptr<buffer> buff = std::make_shared<buffer>();
+    buff->name = field->field_name.str;
+    buff->dimension = details.dimension;
+    buff->buffer_offset = 0;
+    buff->fixed_size_elements = details.dimension ? 1 : details.cell_val_num;
+    buff->type = details.type;
+
+    // Split of the memory budget for this field
+    uint64_t data_size = sizes[i * 3];
+    uint64_t offset_size = sizes[i * 3 + 1];
+    uint64_t validity_size = sizes[i * 3 + 2];
+
+    // Small results do not need the full budget
+    const estimated_result_size &est = estimates[i];
+    if (est.valid) {
+      data_size = std::min(data_size, estimated_buffer_size(est.data));
+      if (offset_size > 0)
+        offset_size = std::min(offset_size, estimated_buffer_size(est.offsets));
+      if (validity_size > 0)
+        validity_size =
+            std::min(validity_size, estimated_buffer_size(est.validity));
+    }
+
+    buff->validity_buffer = nullptr;
+    buff->validity_buffer_size = 0;
+    buff->allocated_validity_buffer_size = 0;
+    if (validity_size > 0) {
+      buff->validity_buffer = static_cast<uint8_t *>(
+          alloc_buffer(tiledb_datatype_t::TILEDB_UINT8, validity_size));
+      buff->validity_buffer_size = validity_size;
+      buff->allocated_validity_buffer_size = validity_size;
+    }
+
+    buff->offset_buffer = nullptr;
+    buff->offset_buffer_size = 0;
+    buff->allocated_offset_buffer_size = 0;
+    if (offset_size > 0) {
+      buff->offset_buffer = static_cast<uint64_t *>(
+          alloc_buffer(tiledb_datatype_t::TILEDB_UINT64, offset_size));
+      buff->offset_buffer_size = offset_size;
+      buff->allocated_offset_buffer_size = offset_size;
+    }
+
+    buff->buffer = alloc_buffer(details.type, data_size);
+    buff->buffer_size = data_size;
+    buff->allocated_buffer_size = data_size;
+    buffer_set[fieldIndex] = buff;
+  }
+  DBUG_VOID_RETURN;
+}
+
+void tile::mytile::alloc_buffers_like(
+    const std::vector<std::shared_ptr<buffer>> &source,
+    std::vector<std::shared_ptr<buffer>> &target) {
+  DBUG_ENTER("tile::mytile::alloc_buffers_like");
+  target.clear();
+  target.resize(source.size());
+  for (size_t fieldIndex = 0; fieldIndex < source.size(); fieldIndex++) {
+    if (source[fieldIndex] == nullptr)
+      continue;
+
+    std::shared_ptr<buffer> buff =
+        std::make_shared<buffer>(*source[fieldIndex]);
+    buff->buffer = alloc_buffer(buff->type, buff->allocated_buffer_size);
+    buff->buffer_size = buff->allocated_buffer_size;
+    if (buff->offset_buffer != nullptr) {
+      buff->offset_buffer = static_cast<uint64_t *>(
+          alloc_buffer(tiledb_datatype_t::TILEDB_UINT64,
+                       buff->allocated_offset_buffer_size));
+      buff->offset_buffer_size = buff->allocated_offset_buffer_size;
+    }
+    if (buff->validity_buffer != nullptr) {
+      buff->validity_buffer = static_cast<uint8_t *>(
+          alloc_buffer(tiledb_datatype_t::TILEDB_UINT8,
+                       buff->allocated_validity_buffer_size));
+      buff->validity_buffer_size = buff->allocated_validity_buffer_size;
+    }
+    target[fieldIndex] = buff;
+  }
+  DBUG_VOID_RETURN;
+}
+
+/**
+ * Grow the buffers of a set which kept an incomplete query from returning any
+ * record
+ * @param buffer_set
+ */
+static void grow_buffer_set(std::vector<std::shared_ptr<buffer>> &buffer_set) {
+  // Double a single buffer, its content is not kept
+  auto grow = [](void *&region, uint64_t &allocated_size,
+                 tiledb_datatype_t type) {
+    tile::free_buffer(region);
+    allocated_size = std::max<uint64_t>(allocated_size * 2,
+                                        tiledb_datatype_size(type));
+    region = alloc_buffer(type, allocated_size);
+  };
+
+  // An incomplete batch without records means a single cell did not fit.
+  // First grow the buffers too small for one cell
+  bool grown = false;
+  for (auto &buff : buffer_set) {
+    if (buff == nullptr)
+      continue;
+
+    uint64_t cell_size =
+        tiledb_datatype_size(buff->type) * buff->fixed_size_elements;
+    if (buff->offset_buffer == nullptr &&
+        buff->allocated_buffer_size < cell_size) {
+      grow(buff->buffer, buff->allocated_buffer_size, buff->type);
+      grown = true;
+    }
+
+    if (buff->offset_buffer != nullptr &&
+        buff->allocated_offset_buffer_size < sizeof(uint64_t)) {
+      void *offsets = buff->offset_buffer;
+      grow(offsets, buff->allocated_offset_buffer_size,
+           tiledb_datatype_t::TILEDB_UINT64);
+      buff->offset_buffer = static_cast<uint64_t *>(offsets);
+      grown = true;
+    }
+
+    if (buff->validity_buffer != nullptr &&
+        buff->allocated_validity_buffer_size < sizeof(uint8_t)) {
+      void *validity = buff->validity_buffer;
+      grow(validity, buff->allocated_validity_buffer_size,
+           tiledb_datatype_t::TILEDB_UINT8);
+      buff->validity_buffer = static_cast<uint8_t *>(validity);
+      grown = true;
+    }
+  }
+
+  // The size of a var length cell is unknown, grow the var length data
+  if (!grown) {
+    for (auto &buff : buffer_set) {
+      if (buff == nullptr || buff->offset_buffer == nullptr)
+        continue;
+
+      grow(buff->buffer, buff->allocated_buffer_size, buff->type);
+      grown = true;
+    }
+  }
+
+  // Should not happen, but never resubmit with the same buffers
+  if (!grown) {
+    for (auto &buff : buffer_set) {
+      if (buff == nullptr)
+        continue;
+
+      grow(buff->buffer, buff->allocated_buffer_size, buff->type);
+    }
+  }
+}
+
+void tile::mytile::grow_read_buffers() {
+  DBUG_ENTER("tile::mytile::grow_read_buffers");
+  // The prefetch buffers are reallocated on demand to match the new sizes
+  dealloc_prefetch_buffers();
+  grow_buffer_set(this->buffers);
+  set_read_buffers(this->buffers);
+  DBUG_VOID_RETURN;
+}
+
+void tile::mytile::alloc_read_buffers(uint64_t memory_budget) {
+  // The prefetch buffers are reallocated on demand to match the new buffers
+  dealloc_prefetch_buffers();
+  alloc_buffers(memory_budget, true, this->scan_limit);
+  set_read_buffers(this->buffers);
+  build_row_decoder();
+}
+
+void tile::mytile::set_read_buffers(
+    std::vector<std::shared_ptr<buffer>> &buffer_set) {
+  set_read_buffers(*this->query, buffer_set);
+}
+
+/**
+ * Set a buffer set as the buffers of a read query, sizes are reset to the
+ * allocated sizes first
+ * @param ctx
+ * @param read_query
+ * @param buffer_set
+ */
+static void
+set_query_buffers(tiledb::Context &ctx, tiledb::Query &read_query,
+                  std::vector<std::shared_ptr<buffer>> &buffer_set) {
+  for (auto &buff : buffer_set) {
+    // Only set buffers which are non-null
+    if (buff == nullptr)
+      continue;
+
+    // Sizes were overwritten by the last submit into this set
+    buff->buffer_size = buff->allocated_buffer_size;
+    ctx.handle_error(tiledb_query_set_data_buffer(
+        ctx.ptr().get(), read_query.ptr().get(), buff->name.c_str(),
+        buff->buffer, &buff->buffer_size));
+
+    if (buff->validity_buffer != nullptr) {
+      buff->validity_buffer_size = buff->allocated_validity_buffer_size;
+      ctx.handle_error(tiledb_query_set_validity_buffer(
+          ctx.ptr().get(), read_query.ptr().get(), buff->name.c_str(),
+          buff->validity_buffer, &buff->validity_buffer_size));
+    }
+
+    if (buff->offset_buffer != nullptr) {
+      buff->offset_buffer_size = buff->allocated_offset_buffer_size;
+      ctx.handle_error(tiledb_query_set_offsets_buffer(
+          ctx.ptr().get(), read_query.ptr().get(), buff->name.c_str(),
+          buff->offset_buffer, &buff->offset_buffer_size));
+    }
+  }
+}
+
+/**
+ * Number of records read into a buffer set
+ * @param buffer_set
+ * @return
+ */
+static uint64_t
+buffer_set_records(const std::vector<std::shared_ptr<buffer>> &buffer_set) {
+  auto buff = buffer_set[0];
+  if (buff->offset_buffer != nullptr) {
+    return buff->offset_buffer_size / sizeof(uint64_t);
+  }
+  return buff->buffer_size / tiledb_datatype_size(buff->type);
+}
+
+void tile::mytile::set_read_buffers(
+    tiledb::Query &read_query,
+    std::vector<std::shared_ptr<buffer>> &buffer_set) {
+  set_query_buffers(*this->ctx, read_query, buffer_set);
+}
+
+void tile::mytile::fetch_read_batch(bool prefetch_next) {
+  DBUG_ENTER("tile::mytile::fetch_read_batch");
+  if (!this->partitions.empty()) {
+    // Batches of a parallel scan come from the partitions
+    this->records = fetch_partition_batch();
+    prefetch_next = false;
+  } else {
+    if (this->prefetch.valid()) {
+      // The batch was submitted in the background while the previous one was
+      // returned, swap it in as the current buffers
+      this->status = this->prefetch.get();
+      std::swap(this->buffers, this->prefetch_buffers);
+    } else {
+      this->status = this->query->submit();
+    }
+
+    // Compute the number of cells (records) that were returned by the query
+    this->records = buffer_set_records(this->buffers);
+  }
+  this->read_batches++;
+
+  // Track the size of var length cells so later batches split the budget by
+  // the bytes actually read
+  for (size_t fieldIndex = 0; fieldIndex < this->buffers.size();
+       fieldIndex++) {
+    const auto &var_buff = this->buffers[fieldIndex];
+    // Once all partitions are done the buffers hold an already counted batch
+    if (this->records == 0 || var_buff == nullptr ||
+        var_buff->offset_buffer == nullptr)
+      continue;
+    auto &stats = this->var_cell_stats[fieldIndex];
+    stats.first += var_buff->buffer_size;
+    stats.second += var_buff->offset_buffer_size / sizeof(uint64_t);
+  }
+
+  // Overlap the storage read of the next batch with returning this one. An
+  // incomplete query without results needs larger buffers, the caller
+  // resubmits it synchronously
+  if (prefetch_next && this->status == tiledb::Query::Status::INCOMPLETE &&
+      this->records > 0) {
+    start_prefetch();
+  }
+  DBUG_VOID_RETURN;
+}
 
-      Item_field *column_field = dynamic_cast<Item_field *>(args[0]);
+void tile::mytile::start_prefetch() {
+  DBUG_ENTER("tile::mytile::start_prefetch");
+  if (this->prefetch_buffers.empty()) {
+    // Allocate the second set with the same fields and sizes as the first
+    alloc_buffers_like(this->buffers, this->prefetch_buffers);
+  }
 
-      if (column_field == nullptr) {
-        DBUG_RETURN(func_item);
-      }
+  set_read_buffers(this->prefetch_buffers);
 
-      tiledb_datatype_t datatype = tiledb_datatype_t::TILEDB_ANY;
+  if (this->prefetch_worker == nullptr)
+    this->prefetch_worker = std::make_unique<tile::worker_pool>(1);
 
-      if (this->array_schema->has_attribute(column_field->name.str)) {
-        auto attr = this->array_schema->attribute(column_field->name.str);
-        datatype = attr.type();
-      } else {
-        auto dim =
-            this->array_schema->domain().dimension(column_field->name.str);
-        datatype = dim.type();
-      }
+  // The task holds a reference so the query outlives a handler reset
+  std::shared_ptr<tiledb::Query> read_query = this->query;
+  this->prefetch = this->prefetch_worker->submit(
+      [read_query]() { return read_query->submit(); });
+  DBUG_VOID_RETURN;
+}
 
-      if (datatype == TILEDB_DATETIME_AS || datatype == TILEDB_DATETIME_FS ||
-          datatype == TILEDB_DATETIME_PS || datatype == TILEDB_DATETIME_NS ||
-          datatype == TILEDB_DATETIME_US || datatype == TILEDB_DATETIME_MS ||
-          datatype == TILEDB_DATETIME_SEC || datatype == TILEDB_DATETIME_MIN ||
-          datatype == TILEDB_DATETIME_HR || datatype == TILEDB_DATETIME_DAY ||
-          datatype == TILEDB_DATETIME_WEEK ||
-          datatype == TILEDB_DATETIME_MONTH ||
-          datatype == TILEDB_DATETIME_YEAR || datatype == TILEDB_TIME_AS ||
-          datatype == TILEDB_TIME_FS || datatype == TILEDB_TIME_PS ||
-          datatype == TILEDB_TIME_NS || datatype == TILEDB_TIME_US ||
-          datatype == TILEDB_TIME_MS || datatype == TILEDB_TIME_SEC ||
-          datatype == TILEDB_TIME_MIN || datatype == TILEDB_TIME_HR) {
-        ret = cond_push_func_datetime(func_item, qcPtr);
-        DBUG_RETURN(ret);
-      }
+void tile::mytile::cancel_prefetch() {
+  DBUG_ENTER("tile::mytile::cancel_prefetch");
+  if (this->prefetch.valid()) {
+    try {
+      this->prefetch.get();
+    } catch (const std::exception &e) {
+      // The batch is discarded, so are errors from reading it
     }
-
-    ret = cond_push_func(func_item, qcPtr);
-    DBUG_RETURN(ret);
-    break;
-  }
-  // not supported currently
-  // Field items are when two have two fields of a table, i.e. a join.
-  case Item::FIELD_ITEM:
-    // fall through
-  default: {
-    DBUG_RETURN(cond);
   }
+  DBUG_VOID_RETURN;
+}
+
+std::vector<std::unique_ptr<tiledb::Subarray>>
+tile::mytile::plan_parallel_scan(THD *thd) {
+  DBUG_ENTER("tile::mytile::plan_parallel_scan");
+  std::vector<std::unique_ptr<tiledb::Subarray>> subarrays;
+
+  // Partitions return their cells interleaved, so only unordered reads of
+  // sparse arrays are split
+  uint64_t partitions = tile::sysvars::parallel_scan_partitions(thd);
+  if (partitions < 2 || this->empty_read ||
+      this->scan_limit != UINT64_MAX ||
+      this->array_schema->array_type() != TILEDB_SPARSE ||
+      this->query->query_layout() != TILEDB_UNORDERED) {
+    DBUG_RETURN(subarrays);
   }
-  DBUG_RETURN(cond);
+
+  subarrays = tile::partition_subarray(*this->ctx, *this->array, *this->domain,
+                                       *this->subarray, partitions);
+  DBUG_RETURN(subarrays);
 }
 
-void tile::mytile::cond_pop() {
-  DBUG_ENTER("tile::mytile::cond_pop");
+void tile::mytile::start_parallel_scan(
+    std::vector<std::unique_ptr<tiledb::Subarray>> &subarrays) {
+  DBUG_ENTER("tile::mytile::start_parallel_scan");
+  // Every partition has at most one batch in flight, one worker each. There
+  // are never more partitions than mytile_parallel_scan_partitions
+  if (this->scan_workers == nullptr ||
+      this->scan_workers->size() < subarrays.size()) {
+    this->scan_workers = nullptr;
+    this->scan_workers = std::make_unique<tile::worker_pool>(subarrays.size());
+  }
+
+  for (auto &subarray : subarrays) {
+    auto partition = std::make_unique<scan_partition>();
+    partition->subarray = std::move(subarray);
+    partition->query =
+        std::make_unique<tiledb::Query>(*this->ctx, *this->array, TILEDB_READ);
+    partition->query->set_layout(TILEDB_UNORDERED);
+    if (this->query_condition != nullptr) {
+      partition->query->set_condition(*this->query_condition);
+    }
+    partition->query->set_subarray(*partition->subarray);
 
+    // Every partition reads into its own copy of the scan buffers
+    alloc_buffers_like(this->buffers, partition->buffers);
+    submit_partition(*partition);
+    this->partitions.push_back(std::move(partition));
+  }
+  this->next_partition = 0;
   DBUG_VOID_RETURN;
 }
 
-Item *tile::mytile::idx_cond_push(uint keyno, Item *idx_cond) {
-  DBUG_ENTER("tile::mytile::idx_cond_push");
-  std::shared_ptr<tiledb::QueryCondition> null;
-  auto ret = cond_push_local(static_cast<Item_cond *>(idx_cond), null);
-  DBUG_RETURN(const_cast<Item *>(ret));
-}
+void tile::mytile::submit_partition(scan_partition &partition) {
+  DBUG_ENTER("tile::mytile::submit_partition");
+  set_read_buffers(*partition.query, partition.buffers);
+
+  // Partitions are only released after their submit finished
+  scan_partition *part = &partition;
+  std::shared_ptr<tiledb::Context> context = this->ctx;
+  partition.batch = this->scan_workers->submit([part, context]() {
+    while (true) {
+      tiledb::Query::Status status = part->query->submit();
+      if (status != tiledb::Query::Status::INCOMPLETE ||
+          buffer_set_records(part->buffers) > 0) {
+        return status;
+      }
 
-void tile::mytile::drop_table(const char *name) {
-  DBUG_ENTER("tile::mytile::drop_table");
-  delete_table(name);
+      // A single cell did not fit, grow the buffers and resubmit
+      grow_buffer_set(part->buffers);
+      set_query_buffers(*context, *part->query, part->buffers);
+    }
+  });
   DBUG_VOID_RETURN;
 }
 
-int tile::mytile::delete_table(const char *name) {
-  DBUG_ENTER("tile::mytile::delete_table");
-  if (!tile::sysvars::delete_arrays(ha_thd())) {
-    DBUG_RETURN(0);
-  }
+uint64_t tile::mytile::fetch_partition_batch() {
+  DBUG_ENTER("tile::mytile::fetch_partition_batch");
+  while (!this->partitions.empty()) {
+    // Take the first ready batch, starting after the last partition taken.
+    // If none is ready wait for the first one checked
+    size_t count = this->partitions.size();
+    size_t picked = this->next_partition % count;
+    for (size_t i = 0; i < count; i++) {
+      size_t index = (this->next_partition + i) % count;
+      if (this->partitions[index]->batch.wait_for(std::chrono::seconds(0)) ==
+          std::future_status::ready) {
+        picked = index;
+        break;
+      }
+    }
+    this->next_partition = picked + 1;
 
-  try {
-    tiledb::VFS vfs(this->ctx);
-    TABLE_SHARE *s;
-    if (this->table != nullptr)
-      s = this->table->s;
-    else
-      s = this->table_share;
-    if (s != nullptr && s->option_struct != nullptr &&
-        s->option_struct->array_uri != nullptr) {
-      vfs.remove_dir(s->option_struct->array_uri);
+    scan_partition &partition = *this->partitions[picked];
+    tiledb::Query::Status partition_status = partition.batch.get();
+
+    // The batch becomes the current buffers, the partition reads its next
+    // batch into the buffers of the previous one
+    std::swap(this->buffers, partition.buffers);
+    uint64_t batch_records = buffer_set_records(this->buffers);
+    if (partition_status == tiledb::Query::Status::INCOMPLETE) {
+      submit_partition(partition);
     } else {
-      vfs.remove_dir(name);
+      for (auto &buff : partition.buffers) {
+        if (buff != nullptr)
+          dealloc_buffer(buff);
+      }
+      this->partitions.erase(this->partitions.begin() + picked);
+    }
+
+    if (batch_records > 0) {
+      this->status = this->partitions.empty()
+                         ? tiledb::Query::Status::COMPLETE
+                         : tiledb::Query::Status::INCOMPLETE;
+      DBUG_RETURN(batch_records);
     }
-  } catch (const tiledb::TileDBError &e) {
-    // Log errors
-    sql_print_error("delete_table error for table %s : %s", name, e.what());
-    DBUG_RETURN(ERR_DELETE_TABLE_TILEDB);
-  } catch (const std::exception &e) {
-    // Log errors
-    sql_print_error("delete_table error for table %s : %s", name, e.what());
-    DBUG_RETURN(ERR_DELETE_TABLE_OTHER);
   }
+
+  this->status = tiledb::Query::Status::COMPLETE;
   DBUG_RETURN(0);
 }
 
-int tile::mytile::info(uint) {
-  DBUG_ENTER("tile::mytile::info");
-  // Need records to be greater than 1 to avoid 0/1 row optimizations by query
-  // optimizer
-  stats.records = this->records_upper_bound;
-  DBUG_RETURN(0);
-};
+void tile::mytile::dealloc_scan_partitions() {
+  DBUG_ENTER("tile::mytile::dealloc_scan_partitions");
+  for (auto &partition : this->partitions) {
+    // A background submit might still be writing to the buffers
+    if (partition->batch.valid()) {
+      try {
+        partition->batch.get();
+      } catch (const std::exception &e) {
+        // The batch is discarded, so are errors from reading it
+      }
+    }
 
-ulonglong tile::mytile::table_flags(void) const {
-  DBUG_ENTER("tile::mytile::table_flags");
-  DBUG_RETURN(
-      HA_PARTIAL_COLUMN_READ | HA_REC_NOT_IN_SEQ | HA_CAN_SQL_HANDLER |
-      //               HA_REQUIRE_PRIMARY_KEY | HA_PRIMARY_KEY_IN_READ_INDEX |
-      HA_FAST_KEY_READ | HA_SLOW_RND_POS | HA_CAN_TABLE_CONDITION_PUSHDOWN |
-      HA_CAN_EXPORT | HA_CONCURRENT_OPTIMIZE | HA_CAN_ONLINE_BACKUPS |
-      HA_CAN_BIT_FIELD | HA_FILE_BASED);
+    for (auto &buff : partition->buffers) {
+      if (buff != nullptr)
+        dealloc_buffer(buff);
+    }
+  }
+
+  this->partitions.clear();
+  DBUG_VOID_RETURN;
 }
 
-std::vector<std::tuple<tiledb_datatype_t, bool, bool, bool>>
-tile::mytile::build_field_details_for_buffers(const tiledb::ArraySchema &schema,
-                                              Field **fields,
-                                              const uint64_t &field_num,
-                                              MY_BITMAP *read_set) {
-  DBUG_ENTER("tile::mytile::build_field_details_for_buffers");
-  std::vector<std::tuple<tiledb_datatype_t, bool, bool, bool>> ret;
-  for (size_t fieldIndex = 0; fieldIndex < field_num; fieldIndex++) {
-    Field *field = fields[fieldIndex];
-    std::string field_name = field->field_name.str;
-    // Only set buffers for fields that are asked for except always set
-    // dimension We check the read_set because the read_set is set to ALL column
-    // for writes and set to the subset of columns for reads
-    if (!bitmap_is_set(read_set, fieldIndex) &&
-        !schema.domain().has_dimension(field_name)) {
-      continue;
+// Smallest fixed cell size in bytes worth reading in a second phase
+static const uint64_t LATE_MATERIALIZATION_MIN_CELL_SIZE = 16;
+
+// Largest multiple of the read buffer size, or of 1MB if smaller, the buffers
+// of a multi point read grow to
+static const uint64_t MAX_POINT_READ_GROWTH = 16;
+
+// Late row of a first phase row rejected by the residual condition
+static const uint64_t NO_LATE_ROW = UINT64_MAX;
+
+// Late row of a first phase row passing the residual condition whose late
+// fields are not read yet
+static const uint64_t PENDING_LATE_ROW = UINT64_MAX - 1;
+
+bool tile::mytile::setup_late_materialization(THD *thd) {
+  DBUG_ENTER("tile::mytile::setup_late_materialization");
+  this->late_fields.assign(table->s->fields, false);
+
+  // The second read costs a multi point query, it only pays off when few
+  // rows are expected to pass the residual condition. Index only reads have
+  // no attributes to defer
+  double max_selectivity = tile::sysvars::late_materialization_selectivity(thd);
+  if (max_selectivity <= 0 || this->residual_conds.empty() ||
+      this->keyread_only || table->cond_selectivity > max_selectivity) {
+    DBUG_RETURN(false);
+  }
+
+  // Rows of the two phases are matched by coordinates
+  if (this->array_schema->array_type() == TILEDB_SPARSE &&
+      this->array_schema->allows_dups()) {
+    DBUG_RETURN(false);
+  }
+  for (size_t fieldIndex : this->dim_field_indexes) {
+    if (fieldIndex == SIZE_MAX)
+      DBUG_RETURN(false);
+  }
+
+  // Fields of the residual condition are read in the first phase
+  bitmap_clear_all(&table->tmp_set);
+  for (COND *cond : this->residual_conds) {
+    // Only cheap conditions on this table can be evaluated during the scan
+    if ((cond->used_tables() & ~table->map) != 0 || cond->is_expensive()) {
+      bitmap_clear_all(&table->tmp_set);
+      DBUG_RETURN(false);
     }
+    cond->walk(&Item::register_field_in_bitmap, true, &table->tmp_set);
+  }
 
-    tiledb_datatype_t datatype;
-    bool var_len = false;
-    bool nullable = false;
-    bool list = false;
+  bool has_late_fields = false;
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    const field_details &details = this->field_map[fieldIndex];
+    if (!bitmap_is_set(table->read_set, fieldIndex) || details.dimension ||
+        !details.in_array || bitmap_is_set(&table->tmp_set, fieldIndex)) {
+      continue;
+    }
 
-    if (schema.domain().has_dimension(field_name)) {
-      auto dim = schema.domain().dimension(field_name);
-      datatype = dim.type();
-      var_len = dim.cell_val_num() == TILEDB_VAR_NUM;
-      // Dimension can't be nullable
-      nullable = false;
-    } else { // attribute
-      tiledb::Attribute attr = schema.attribute(field_name);
-      datatype = attr.type();
-      var_len = attr.cell_val_num();
-      nullable = attr.nullable();
-      list = attr.cell_val_num() > 1 && attr.cell_val_num() != TILEDB_VAR_NUM;
+    // Only wide fields are worth reading separately
+    if (details.var_len ||
+        tiledb_datatype_size(details.type) * details.cell_val_num >=
+            LATE_MATERIALIZATION_MIN_CELL_SIZE) {
+      this->late_fields[fieldIndex] = true;
+      has_late_fields = true;
     }
+  }
+  bitmap_clear_all(&table->tmp_set);
+
+  DBUG_RETURN(has_late_fields);
+}
 
-    ret.emplace_back(std::make_tuple(datatype, var_len, nullable, list));
+void tile::mytile::skip_rejected_rows() {
+  while (this->record_index < this->records &&
+         this->late_rows[this->record_index] == NO_LATE_ROW) {
+    this->record_index++;
   }
 
-  DBUG_RETURN(ret);
+  // The late fields of the next rows passing are read once the cursor
+  // reaches them
+  if (this->record_index < this->records &&
+      this->late_rows[this->record_index] == PENDING_LATE_ROW) {
+    read_late_fields();
+  }
 }
 
-void tile::mytile::alloc_buffers(uint64_t memory_budget) {
-  DBUG_ENTER("tile::mytile::alloc_buffers");
-  // Set Attribute Buffers
-  auto domain = this->array_schema->domain();
-  auto dims = domain.dimensions();
+void tile::mytile::materialize_late_fields() {
+  DBUG_ENTER("tile::mytile::materialize_late_fields");
+  THD *thd = ha_thd();
+  this->late_rows.assign(this->records, NO_LATE_ROW);
+
+  // Evaluate the residual condition on the fields of the first phase
+  this->late_survivors.clear();
+  this->next_late_survivor = 0;
+  for (uint64_t index = 0; index < this->records; index++) {
+    decode_fields(thd, this->row_decoder, this->buffers, index);
+
+    bool passed = true;
+    for (COND *cond : this->residual_conds) {
+      if (!cond->val_int()) {
+        passed = false;
+        break;
+      }
+    }
 
-  if (this->buffers.empty()) {
-    for (size_t i = 0; i < table->s->fields; i++)
-      this->buffers.emplace_back();
+    if (passed) {
+      this->late_survivors.push_back(index);
+      this->late_rows[index] = PENDING_LATE_ROW;
+    }
   }
 
-  std::vector<std::tuple<tiledb_datatype_t, bool, bool, bool>> field_details =
-      build_field_details_for_buffers(*this->array_schema, table->field,
-                                      table->s->fields, table->read_set);
+  DBUG_VOID_RETURN;
+}
 
-  tile::BufferSizeByType bufferSizesByType =
-      tile::compute_buffer_sizes(field_details, memory_budget);
+void tile::mytile::read_late_fields() {
+  DBUG_ENTER("tile::mytile::read_late_fields");
 
+  // Read the late fields and the dimensions to match cells to rows
+  std::vector<bool> fields(table->s->fields, false);
   for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
-    Field *field = table->field[fieldIndex];
-    std::string field_name = field->field_name.str;
-    // Only set buffers for fields that are asked for except always set
-    // dimensions. We check the read_set because the read_set is set to ALL
-    // column for writes and set to the subset of columns for reads
-    if (!bitmap_is_set(this->table->read_set, fieldIndex) &&
-        !this->array_schema->domain().has_dimension(field_name)) {
-      continue;
+    fields[fieldIndex] =
+        this->late_fields[fieldIndex] || this->field_map[fieldIndex].dimension;
+  }
+
+  // Coordinates of each pending surviving row on each dimension
+  auto survivor_point = [this](uint64_t index) {
+    std::vector<std::string> point(this->ndim);
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      const buffer &buff = *this->buffers[this->dim_field_indexes[dim_idx]];
+      uint64_t size;
+      const char *data = cell_data(buff, index, &size);
+      point[dim_idx].assign(data, size);
     }
+    return point;
+  };
 
-    // Create buffer
-    std::shared_ptr<buffer> buff = std::make_shared<buffer>();
-    tiledb_datatype_t datatype;
-    uint64_t data_size = 0;
-    buff->name = field_name;
-    buff->dimension = false;
-    buff->buffer_offset = 0;
-    buff->fixed_size_elements = 1;
+  // The next survivors are read together as long as the cross product of
+  // their coordinates stays small, a dense read returns every cell of it
+  std::vector<std::unordered_set<std::string>> distinct(this->ndim);
+  uint64_t first = this->next_late_survivor;
+  uint64_t last = first;
+  while (last < this->late_survivors.size() &&
+         last - first < MAX_POSITIONS_PER_BATCH) {
+    std::vector<std::string> point =
+        survivor_point(this->late_survivors[last]);
+    uint64_t cells = 1;
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      cells *= distinct[dim_idx].size() +
+               (distinct[dim_idx].count(point[dim_idx]) == 0 ? 1 : 0);
+    }
+    if (last > first && cells > MAX_POSITION_CELLS_PER_BATCH)
+      break;
 
-    if (this->array_schema->domain().has_dimension(field_name)) {
-      auto dim = this->array_schema->domain().dimension(field_name);
-      datatype = dim.type();
-      buff->dimension = true;
-      data_size = bufferSizesByType.SizeByType(datatype);
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      distinct[dim_idx].insert(std::move(point[dim_idx]));
+    }
+    last++;
+  }
 
-      if (dim.cell_val_num() == TILEDB_VAR_NUM) {
-        uint64_t *offset_buffer = static_cast<uint64_t *>(
-            alloc_buffer(tiledb_datatype_t::TILEDB_UINT64,
-                         bufferSizesByType.uint64_buffer_size));
-        buff->offset_buffer_size = bufferSizesByType.uint64_buffer_size;
-        buff->allocated_offset_buffer_size =
-            bufferSizesByType.uint64_buffer_size;
-        buff->offset_buffer = offset_buffer;
-
-        // Override buffer size as this is var length
-        data_size = bufferSizesByType.var_length_uint8_buffer_size;
-      }
-    } else { // attribute
-      tiledb::Attribute attr = this->array_schema->attribute(field_name);
-
-      uint8_t *validity_buffer = nullptr;
-      uint64_t *offset_buffer = nullptr;
-
-      buff->fixed_size_elements = attr.cell_val_num();
-      datatype = attr.type();
-      data_size = bufferSizesByType.SizeByType(datatype);
-
-      if (attr.nullable()) {
-        validity_buffer = static_cast<uint8_t *>(
-            alloc_buffer(tiledb_datatype_t::TILEDB_UINT8,
-                         bufferSizesByType.var_length_uint8_buffer_size));
-        buff->validity_buffer_size =
-            bufferSizesByType.var_length_uint8_buffer_size;
-        buff->allocated_validity_buffer_size =
-            bufferSizesByType.var_length_uint8_buffer_size;
-      }
-      if (attr.variable_sized()) {
-        offset_buffer = static_cast<uint64_t *>(
-            alloc_buffer(tiledb_datatype_t::TILEDB_UINT64,
-                         bufferSizesByType.uint64_buffer_size));
-        buff->offset_buffer_size = bufferSizesByType.uint64_buffer_size;
-        buff->allocated_offset_buffer_size =
-            bufferSizesByType.uint64_buffer_size;
-
-        // Override buffer size as this is var length
-        data_size = bufferSizesByType.var_length_uint8_buffer_size;
+  // Batches whose cells do not fit the largest point read buffers are halved
+  std::optional<uint64_t> late_records;
+  while (true) {
+    std::vector<std::vector<std::string>> points(this->ndim);
+    for (uint64_t survivor = first; survivor < last; survivor++) {
+      std::vector<std::string> point =
+          survivor_point(this->late_survivors[survivor]);
+      for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+        points[dim_idx].push_back(std::move(point[dim_idx]));
       }
+    }
 
-      buff->validity_buffer = validity_buffer;
-      buff->offset_buffer = offset_buffer;
-      buff->type = attr.type();
+    dealloc_late_buffers();
+    late_records = read_points(points, fields, this->late_buffers);
+    if (late_records.has_value())
+      break;
+    if (last - first == 1) {
+      throw tiledb::TileDBError(
+          std::string("Late fields of a row do not fit the read buffers"));
     }
-    buff->buffer = alloc_buffer(datatype, data_size);
-    buff->type = datatype;
-    buff->buffer_size = data_size;
-    buff->allocated_buffer_size = data_size;
-    this->buffers[fieldIndex] = buff;
+    last = first + (last - first) / 2;
+  }
+  this->next_late_survivor = last;
+
+  // Match the cells read to the surviving rows by their coordinates
+  std::unordered_map<std::string, uint64_t> late_cells;
+  for (uint64_t index = 0; index < *late_records; index++) {
+    std::string coords;
+    append_coords(this->late_buffers, index, coords);
+    late_cells.emplace(std::move(coords), index);
+  }
+
+  for (uint64_t survivor = first; survivor < last; survivor++) {
+    uint64_t index = this->late_survivors[survivor];
+    this->coords_scratch.clear();
+    append_coords(this->buffers, index, this->coords_scratch);
+    auto it = late_cells.find(this->coords_scratch);
+    // The cell was read in the first phase, it can only be missing if the
+    // array changed between the two reads
+    if (it == late_cells.end()) {
+      throw tiledb::TileDBError(
+          std::string("Late fields of a row passing the residual condition "
+                      "were not found"));
+    }
+    this->late_rows[index] = it->second;
+  }
+
+  this->late_row_decoder.clear();
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    const std::shared_ptr<buffer> &buff = this->late_buffers[fieldIndex];
+    if (!this->late_fields[fieldIndex] || buff == nullptr)
+      continue;
+
+    this->late_row_decoder.push_back({table->field[fieldIndex], fieldIndex,
+                                      tile::get_field_converter(buff)});
   }
   DBUG_VOID_RETURN;
 }
 
-void tile::mytile::alloc_read_buffers(uint64_t memory_budget) {
-  alloc_buffers(memory_budget);
-  auto domain = this->array_schema->domain();
+/**
+ * Sort fixed size points by value and remove duplicates
+ * @tparam T type of the dimension
+ * @param points
+ */
+template <typename T>
+static void sort_points(std::vector<std::string> &points) {
+  auto value = [](const std::string &point) {
+    T v;
+    memcpy(&v, point.data(), sizeof(T));
+    return v;
+  };
+  std::sort(points.begin(), points.end(),
+            [&value](const std::string &a, const std::string &b) {
+              return value(a) < value(b);
+            });
+  points.erase(std::unique(points.begin(), points.end()), points.end());
+}
 
-  for (auto &buff : this->buffers) {
-    // Only set buffers which are non-null
-    if (buff == nullptr)
-      continue;
+/**
+ * Sort points of a dimension in cell order and remove duplicates
+ * @param datatype of the dimension
+ * @param points
+ */
+static void sort_points(tiledb_datatype_t datatype,
+                        std::vector<std::string> &points) {
+  switch (datatype) {
+  case TILEDB_FLOAT64:
+    return sort_points<double>(points);
+  case TILEDB_FLOAT32:
+    return sort_points<float>(points);
+  case TILEDB_INT8:
+    return sort_points<int8_t>(points);
+  case TILEDB_UINT8:
+    return sort_points<uint8_t>(points);
+  case TILEDB_INT16:
+    return sort_points<int16_t>(points);
+  case TILEDB_UINT16:
+    return sort_points<uint16_t>(points);
+  case TILEDB_INT32:
+    return sort_points<int32_t>(points);
+  case TILEDB_UINT32:
+    return sort_points<uint32_t>(points);
+  case TILEDB_UINT64:
+    return sort_points<uint64_t>(points);
+  default:
+    // Signed 64 bit integers and datetimes
+    if (tiledb_datatype_size(datatype) == sizeof(int64_t)) {
+      return sort_points<int64_t>(points);
+    }
+    // String dimensions are ordered by their bytes
+    std::sort(points.begin(), points.end());
+    points.erase(std::unique(points.begin(), points.end()), points.end());
+  }
+}
 
-    this->ctx.handle_error(tiledb_query_set_data_buffer(
-        this->ctx.ptr().get(), this->query->ptr().get(), buff->name.c_str(),
-        buff->buffer, &buff->buffer_size));
+std::optional<uint64_t>
+tile::mytile::read_points(std::vector<std::vector<std::string>> &points,
+                          const std::vector<bool> &fields,
+                          std::vector<std::shared_ptr<buffer>> &buffer_set,
+                          uint64_t max_rows) {
+  DBUG_ENTER("tile::mytile::read_points");
+  const tiledb::Domain &domain = *this->domain;
 
-    if (buff->validity_buffer != nullptr) {
-      this->ctx.handle_error(tiledb_query_set_validity_buffer(
-          this->ctx.ptr().get(), this->query->ptr().get(), buff->name.c_str(),
-          buff->validity_buffer, &buff->validity_buffer_size));
+  // Ranges in cell order let TileDB visit each tile once
+  for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+    sort_points(domain.dimension(dim_idx).type(), points[dim_idx]);
+  }
+
+  // The read has to complete in one submit to keep all cells, if it does not
+  // it is retried with larger buffers up to a bound
+  uint64_t memory_budget = this->read_buffer_size;
+  uint64_t max_memory_budget =
+      std::max<uint64_t>(this->read_buffer_size, 1024 * 1024) *
+      MAX_POINT_READ_GROWTH;
+  bool size_from_estimates = true;
+  while (true) {
+    for (auto &buff : buffer_set) {
+      if (buff != nullptr)
+        dealloc_buffer(buff);
     }
+    buffer_set.clear();
 
-    if (buff->offset_buffer != nullptr) {
-      this->ctx.handle_error(tiledb_query_set_offsets_buffer(
-          this->ctx.ptr().get(), this->query->ptr().get(), buff->name.c_str(),
-          buff->offset_buffer, &buff->offset_buffer_size));
+    tiledb::Query point_query(*this->ctx, *this->array, TILEDB_READ);
+    point_query.set_layout(this->array_schema->array_type() == TILEDB_SPARSE
+                               ? TILEDB_UNORDERED
+                               : TILEDB_ROW_MAJOR);
+
+    // The cross product of the points covers every requested cell
+    tiledb::Subarray point_subarray(*this->ctx, *this->array);
+    for (uint64_t dim_idx = 0; dim_idx < this->ndim; dim_idx++) {
+      bool var_sized =
+          domain.dimension(dim_idx).cell_val_num() == TILEDB_VAR_NUM;
+      for (const std::string &point : points[dim_idx]) {
+        if (var_sized) {
+          this->ctx->handle_error(tiledb_subarray_add_range_var(
+              this->ctx->ptr().get(), point_subarray.ptr().get(), dim_idx,
+              point.data(), point.size(), point.data(), point.size()));
+        } else {
+          this->ctx->handle_error(tiledb_subarray_add_range(
+              this->ctx->ptr().get(), point_subarray.ptr().get(), dim_idx,
+              point.data(), point.data(), nullptr));
+        }
+      }
+    }
+    point_query.set_subarray(point_subarray);
+
+    alloc_buffer_set(buffer_set, fields, point_query, memory_budget,
+                     size_from_estimates,
+                     size_from_estimates ? max_rows : UINT64_MAX);
+    set_read_buffers(point_query, buffer_set);
+    if (point_query.submit() == tiledb::Query::Status::COMPLETE)
+      break;
+
+    // The estimate was short, use the full budget and then keep doubling it
+    if (!size_from_estimates) {
+      if (memory_budget >= max_memory_budget)
+        DBUG_RETURN(std::nullopt);
+      memory_budget = std::min<uint64_t>(
+          max_memory_budget,
+          std::max<uint64_t>(memory_budget * 2, 1024 * 1024));
     }
+    size_from_estimates = false;
+  }
+
+  const buffer &dim_buff = *buffer_set[this->dim_field_indexes[0]];
+  DBUG_RETURN(dim_buff.offset_buffer != nullptr
+                  ? dim_buff.offset_buffer_size / sizeof(uint64_t)
+                  : dim_buff.buffer_size / tiledb_datatype_size(dim_buff.type));
+}
+
+void tile::mytile::build_row_decoder() {
+  DBUG_ENTER("tile::mytile::build_row_decoder");
+  this->row_decoder.clear();
+  this->datetimes.reset(ha_thd()->variables.time_zone);
+  for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
+    const std::shared_ptr<buffer> &buff = this->buffers[fieldIndex];
+    // Only read fields that are asked for and the buffer was originally set
+    if (!bitmap_is_set(this->table->read_set, fieldIndex) ||
+        buff == nullptr) {
+      continue;
+    }
+
+    this->row_decoder.push_back({table->field[fieldIndex], fieldIndex,
+                                 tile::get_field_converter(buff)});
+  }
+  DBUG_VOID_RETURN;
+}
+
+void tile::mytile::decode_fields(
+    THD *thd, const std::vector<decoded_field> &decoder,
+    std::vector<std::shared_ptr<buffer>> &buffer_set, uint64_t index) {
+  // Buffers are looked up by index as the prefetch swaps the buffer sets
+  for (const decoded_field &decoded : decoder) {
+    decoded.converter(thd, decoded.field, buffer_set[decoded.buffer_index],
+                      index, &this->datetimes);
   }
 }
 
@@ -3123,22 +5222,20 @@ int tile::mytile::tileToFields(uint64_t orignal_index, bool dimensions_only,
                                TABLE *table) {
   DBUG_ENTER("tile::mytile::tileToFields");
   int rc = 0;
-  try {
-    for (size_t fieldIndex = 0; fieldIndex < table->s->fields; fieldIndex++) {
-      Field *field = table->field[fieldIndex];
-      std::shared_ptr<buffer> buff = this->buffers[fieldIndex];
-      // Only read fields that are asked for and the buffer was originally set
-      if (!bitmap_is_set(this->table->read_set, fieldIndex) ||
-          buff == nullptr) {
-        continue;
-      }
-      uint64_t index = orignal_index;
+  // The row comes from the scan buffers, not the rows read for rnd_pos
+  this->position_row = NO_POSITION_ROW;
+  if (dimensions_only) {
+    DBUG_RETURN(rc);
+  }
 
-      if (dimensions_only) {
-        continue;
-      }
+  try {
+    THD *thd = ha_thd();
+    decode_fields(thd, this->row_decoder, this->buffers, orignal_index);
 
-      set_field(ha_thd(), field, buff, index);
+    // Late materialized fields come from the second phase read
+    if (this->late_materialization) {
+      decode_fields(thd, this->late_row_decoder, this->late_buffers,
+                    this->late_rows[orignal_index]);
     }
   } catch (const tiledb::TileDBError &e) {
     // Log errors
@@ -3195,6 +5292,9 @@ int tile::mytile::mysql_row_to_tiledb_buffers(const uchar *buf) {
 void tile::mytile::setup_write() {
   DBUG_ENTER("tile::mytile::setup_write");
 
+  // Rows cached for rnd_pos might be overwritten
+  dealloc_position_buffers();
+
   // Make sure array is open for writes
   open_array_for_writes(ha_thd());
 
@@ -3238,6 +5338,10 @@ int tile::mytile::finalize_write() {
 
       // Clear all allocated buffers
       dealloc_buffers();
+
+      // Make sure the next read picks up the new fragment
+      if (this->share != nullptr)
+        this->share->invalidate();
     }
     rc = close();
 
@@ -3302,8 +5406,8 @@ int tile::mytile::flush_write() {
             (char *)buff->buffer + (num_elements - 1) * type_size;
 
         // Use the c-api because it uses void*
-        this->ctx.handle_error(tiledb_subarray_add_range_by_name(
-            this->ctx.ptr().get(), this->subarray->ptr().get(),
+        this->ctx->handle_error(tiledb_subarray_add_range_by_name(
+            this->ctx->ptr().get(), this->subarray->ptr().get(),
             buff->name.c_str(), first_element, last_element, nullptr));
 
         // set the subarray to the query
@@ -3313,20 +5417,22 @@ int tile::mytile::flush_write() {
         continue;
       }
 
-      this->ctx.handle_error(tiledb_query_set_data_buffer(
-          this->ctx.ptr().get(), this->query->ptr().get(), buff->name.c_str(),
-          buff->buffer, &buff->buffer_size));
+      this->ctx->handle_error(tiledb_query_set_data_buffer(
+          this->ctx->ptr().get(), this->query->ptr().get(),
+          buff->name.c_str(), buff->buffer, &buff->buffer_size));
 
       if (buff->validity_buffer != nullptr) {
-        this->ctx.handle_error(tiledb_query_set_validity_buffer(
-            this->ctx.ptr().get(), this->query->ptr().get(), buff->name.c_str(),
-            buff->validity_buffer, &buff->validity_buffer_size));
+        this->ctx->handle_error(tiledb_query_set_validity_buffer(
+            this->ctx->ptr().get(), this->query->ptr().get(),
+            buff->name.c_str(), buff->validity_buffer,
+            &buff->validity_buffer_size));
       }
 
       if (buff->offset_buffer != nullptr) {
-        this->ctx.handle_error(tiledb_query_set_offsets_buffer(
-            this->ctx.ptr().get(), this->query->ptr().get(), buff->name.c_str(),
-            buff->offset_buffer, &buff->offset_buffer_size));
+        this->ctx->handle_error(tiledb_query_set_offsets_buffer(
+            this->ctx->ptr().get(), this->query->ptr().get(),
+            buff->name.c_str(), buff->offset_buffer,
+            &buff->offset_buffer_size));
       }
     }
 
@@ -3387,7 +5493,6 @@ int tile::mytile::write_row(const uchar *buf) {
       DBUG_RETURN(rc);
     }
     this->record_index++;
-    auto domain = this->array_schema->domain();
 
     if (!this->bulk_write) {
       rc = finalize_write();
@@ -3420,6 +5525,22 @@ ulong tile::mytile::index_flags(uint idx, uint part, bool all_parts) const {
 #endif
 }
 
+int tile::mytile::extra(enum ha_extra_function operation) {
+  DBUG_ENTER("tile::mytile::extra");
+  switch (operation) {
+  case HA_EXTRA_KEYREAD:
+    this->keyread_only = true;
+    break;
+  case HA_EXTRA_NO_KEYREAD:
+  case HA_EXTRA_RESET_STATE:
+    this->keyread_only = false;
+    break;
+  default:
+    break;
+  }
+  DBUG_RETURN(0);
+}
+
 void tile::mytile::open_array_for_reads(THD *thd) {
   bool reopen_for_every_query = tile::sysvars::reopen_for_every_query(thd);
   std::string encryption_key;
@@ -3433,14 +5554,27 @@ void tile::mytile::open_array_for_reads(THD *thd) {
     // First rebuild context with new config if needed
     tiledb::Config cfg = build_config(ha_thd());
 
-    if (cfg != this->config) {
+    if (cfg != this->config || this->ctx == nullptr) {
       this->config = cfg;
-      this->ctx = build_context(this->config);
+      this->ctx =
+          tile::contextpool::get_context(this->config, &this->ctx_id);
     }
-    if (this->table->s->option_struct->open_at != UINT64_MAX) {
+
+    this->array_is_shared =
+        this->share != nullptr && tile::sysvars::shared_array_cache(thd);
+    if (this->array_is_shared) {
+      // Use the array shared by all handlers of this table, it is only
+      // reopened if new fragments have been written. Drop our reference first
+      // so an unused shared array can be reopened in place
+      this->array = nullptr;
+      this->array = this->share->get_read_array(
+          this->ctx, this->ctx_id, this->uri, encryption_key,
+          this->table->s->option_struct->open_at, thd->query_id,
+          tile::sysvars::shared_array_check_interval(thd));
+    } else if (this->table->s->option_struct->open_at != UINT64_MAX) {
 #if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
       this->array = std::make_shared<tiledb::Array>(
-          this->ctx, this->uri, TILEDB_READ,
+          *this->ctx, this->uri, TILEDB_READ,
           tiledb::TemporalPolicy(tiledb::TimeTravel,
                                  this->table->s->option_struct->open_at),
           tiledb::EncryptionAlgorithm(
@@ -3449,7 +5583,7 @@ void tile::mytile::open_array_for_reads(THD *thd) {
               this->table->s->option_struct->encryption_key));
 #else
       this->array = std::make_shared<tiledb::Array>(
-          this->ctx, this->uri, TILEDB_READ,
+          *this->ctx, this->uri, TILEDB_READ,
           encryption_key.empty() ? TILEDB_NO_ENCRYPTION : TILEDB_AES_256_GCM,
           encryption_key, this->table->s->option_struct->open_at);
 #endif
@@ -3458,26 +5592,30 @@ void tile::mytile::open_array_for_reads(THD *thd) {
 
 #if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
       this->array = std::make_shared<tiledb::Array>(
-          this->ctx, this->uri, TILEDB_READ, tiledb::TemporalPolicy(),
+          *this->ctx, this->uri, TILEDB_READ, tiledb::TemporalPolicy(),
           tiledb::EncryptionAlgorithm(
               encryption_key.empty() ? TILEDB_NO_ENCRYPTION
                                      : TILEDB_AES_256_GCM,
               this->table->s->option_struct->encryption_key));
 #else
       this->array = std::make_shared<tiledb::Array>(
-          this->ctx, this->uri, TILEDB_READ,
+          *this->ctx, this->uri, TILEDB_READ,
           encryption_key.empty() ? TILEDB_NO_ENCRYPTION : TILEDB_AES_256_GCM,
           encryption_key);
 #endif
     }
-    this->query =
-        std::make_unique<tiledb::Query>(this->ctx, *this->array, TILEDB_READ);
+    this->array_non_empty_domain = nullptr;
+    this->array_fragments = nullptr;
+    this->query = std::make_unique<tiledb::Query>(*this->ctx, *this->array,
+                                                  TILEDB_READ);
     // Else lets try to open reopen and use existing contexts
   } else {
     if ((this->array->is_open() && this->array->query_type() != TILEDB_READ) ||
         !this->array->is_open()) {
       if (this->array->is_open())
         this->array->close();
+      this->array_non_empty_domain = nullptr;
+      this->array_fragments = nullptr;
 
       if (this->table->s->option_struct->open_at != UINT64_MAX) {
         this->array->open(
@@ -3493,8 +5631,8 @@ void tile::mytile::open_array_for_reads(THD *thd) {
     }
 
     if (this->query == nullptr || this->query->query_type() != TILEDB_READ) {
-      this->query =
-          std::make_unique<tiledb::Query>(this->ctx, *this->array, TILEDB_READ);
+      this->query = std::make_unique<tiledb::Query>(*this->ctx, *this->array,
+                                                    TILEDB_READ);
     }
   }
 
@@ -3519,6 +5657,61 @@ void tile::mytile::open_array_for_reads(THD *thd) {
   }
 }
 
+const tile::non_empty_domain &tile::mytile::get_non_empty_domain() {
+  if (this->array_non_empty_domain == nullptr) {
+    if (this->array_is_shared) {
+      this->array_non_empty_domain = this->share->get_non_empty_domain(
+          this->ctx, this->ctx_id, this->array, *this->domain);
+    } else {
+      this->array_non_empty_domain =
+          tile::load_non_empty_domain(*this->ctx, *this->array, *this->domain);
+    }
+  }
+  return *this->array_non_empty_domain;
+}
+
+const tile::fragment_listing &tile::mytile::get_fragment_listing() {
+  if (this->array_fragments == nullptr) {
+    if (this->array_is_shared) {
+      this->array_fragments =
+          this->share->get_fragment_listing(this->ctx, this->ctx_id,
+                                            this->array);
+    } else {
+      this->array_fragments =
+          tile::load_fragment_listing(*this->ctx, *this->array);
+    }
+  }
+  return *this->array_fragments;
+}
+
+std::optional<uint64_t> tile::mytile::get_metadata_records() {
+  if (this->array == nullptr || !this->array->is_open() ||
+      this->array->query_type() != TILEDB_READ) {
+    return std::nullopt;
+  }
+
+  try {
+    const tile::non_empty_domain &non_empty_domain = get_non_empty_domain();
+    if (this->metadata_records_domain != this->array_non_empty_domain) {
+      // The whole non empty domain is counted
+      int empty_read = 0;
+      auto full_subarray =
+          std::make_unique<tiledb::Subarray>(*this->ctx, *this->array);
+      tile::build_subarray(ha_thd(), false, false, empty_read, *this->domain,
+                           non_empty_domain, this->pushdown_ranges,
+                           this->pushdown_in_ranges, full_subarray,
+                           this->ctx.get());
+      this->metadata_records = tile::metadata_cell_count(
+          *this->ctx, *this->array, non_empty_domain, get_fragment_listing(),
+          *full_subarray, false);
+      this->metadata_records_domain = this->array_non_empty_domain;
+    }
+  } catch (const tiledb::TileDBError &e) {
+    return std::nullopt;
+  }
+  return this->metadata_records;
+}
+
 void tile::mytile::open_array_for_writes(THD *thd) {
   bool reopen_for_every_query = tile::sysvars::reopen_for_every_query(thd);
   std::string encryption_key;
@@ -3527,30 +5720,36 @@ void tile::mytile::open_array_for_writes(THD *thd) {
   }
 
   // If we want to reopen for every query then we'll build a new context and do
-  // it
-  if (reopen_for_every_query || this->array == nullptr) {
+  // it. A shared read array is never reopened for writes, writes always get
+  // their own array
+  if (reopen_for_every_query || this->array == nullptr ||
+      this->array_is_shared) {
     // First rebuild context with new config if needed
     tiledb::Config cfg = build_config(ha_thd());
 
-    if (cfg != this->config) {
+    if (cfg != this->config || this->ctx == nullptr) {
       this->config = cfg;
-      this->ctx = build_context(this->config);
+      this->ctx =
+          tile::contextpool::get_context(this->config, &this->ctx_id);
     }
 
+    this->array_is_shared = false;
 #if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
     this->array = std::make_shared<tiledb::Array>(
-        this->ctx, this->uri, TILEDB_WRITE, tiledb::TemporalPolicy(),
+        *this->ctx, this->uri, TILEDB_WRITE, tiledb::TemporalPolicy(),
         tiledb::EncryptionAlgorithm(
             encryption_key.empty() ? TILEDB_NO_ENCRYPTION : TILEDB_AES_256_GCM,
             this->table->s->option_struct->encryption_key));
 #else
     this->array = std::make_shared<tiledb::Array>(
-        this->ctx, this->uri, TILEDB_WRITE,
+        *this->ctx, this->uri, TILEDB_WRITE,
         encryption_key.empty() ? TILEDB_NO_ENCRYPTION : TILEDB_AES_256_GCM,
         encryption_key);
 #endif
-    this->query =
-        std::make_unique<tiledb::Query>(this->ctx, *this->array, TILEDB_WRITE);
+    this->array_non_empty_domain = nullptr;
+    this->array_fragments = nullptr;
+    this->query = std::make_unique<tiledb::Query>(*this->ctx, *this->array,
+                                                  TILEDB_WRITE);
     // Else lets try to open reopen and use existing contexts
   } else {
 
@@ -3558,6 +5757,8 @@ void tile::mytile::open_array_for_writes(THD *thd) {
         !this->array->is_open()) {
       if (this->array->is_open())
         this->array->close();
+      this->array_non_empty_domain = nullptr;
+      this->array_fragments = nullptr;
 
       this->array->open(TILEDB_WRITE,
                         encryption_key.empty() ? TILEDB_NO_ENCRYPTION
@@ -3565,7 +5766,7 @@ void tile::mytile::open_array_for_writes(THD *thd) {
                         encryption_key);
     }
     if (this->query == nullptr || this->query->query_type() != TILEDB_WRITE) {
-      this->query = std::make_unique<tiledb::Query>(this->ctx, *this->array,
+      this->query = std::make_unique<tiledb::Query>(*this->ctx, *this->array,
                                                     TILEDB_WRITE);
     }
   }
@@ -3576,7 +5777,7 @@ void tile::mytile::open_array_for_writes(THD *thd) {
     this->query->set_layout(this->array_schema->cell_order());
     // dense writes need a subarray
     this->subarray = std::unique_ptr<tiledb::Subarray>(
-        new tiledb::Subarray(this->ctx, *this->array));
+        new tiledb::Subarray(*this->ctx, *this->array));
   };
 }
 
@@ -3620,6 +5821,11 @@ bool tile::mytile::valid_pushed_in_ranges() {
   return one_valid_range;
 }
 
+bool tile::mytile::condition_fully_pushed(const Item *where) const {
+  return this->residual_conds.empty() &&
+         (where == nullptr || this->pushed_conds > 0);
+}
+
 int tile::mytile::index_init(uint idx, bool sorted) {
   DBUG_ENTER("tile::mytile::index_init");
   // If we are doing an index scan we need to use row-major order to get the
@@ -3669,172 +5875,309 @@ int tile::mytile::index_next(uchar *buf) {
   DBUG_RETURN(scan_rnd_row(table));
 }
 
-int8_t tile::mytile::compare_key_to_dims(const uchar *key, uint key_len,
-                                         uint64_t index) {
-  int key_position = 0;
-
-  const KEY *key_info = table->key_info;
-
-  for (uint64_t key_part_index = 0;
-       key_part_index < key_info->user_defined_key_parts; key_part_index++) {
-
-    const KEY_PART_INFO *key_part_info = &(key_info->key_part[key_part_index]);
-
-    for (auto &dim_buffer : this->buffers) {
-      if (dim_buffer == nullptr ||
-          dim_buffer->name != this->dimensionNames[key_part_index]) {
-        continue;
-      } else { // buffer for dimension was found
-        uint8_t dim_comparison =
-            compare_key_to_dim(key_part_index, key + key_position,
-                               key_part_info->length, index, dim_buffer);
-        key_position += key_part_info->length;
-        if (dim_comparison != 0) {
-          return dim_comparison;
-        }
-      }
-      break; // skipping rest of buffers, proceed with next dimension
-    }
-
-    if (key_position >= (int)key_len) {
-      break;
-    }
-  }
-  return 0;
+/**
+ * Compare two values of a fixed sized datatype
+ * @return negative if lhs is less than rhs, 0 if equal, positive if greater
+ */
+template <typename T>
+static int compare_key_values(const char *lhs, uint64_t lhs_size,
+                              const char *rhs, uint64_t rhs_size) {
+  T lhs_value;
+  T rhs_value;
+  memcpy(&lhs_value, lhs, sizeof(T));
+  memcpy(&rhs_value, rhs, sizeof(T));
+  return lhs_value < rhs_value ? -1 : (rhs_value < lhs_value ? 1 : 0);
 }
 
-int8_t tile::mytile::compare_key_to_dim(const uint64_t dim_idx,
-                                        const uchar *key, uint64_t key_part_len,
-                                        const uint64_t index,
-                                        const std::shared_ptr<buffer> &buf) {
-
-  uint64_t datatype_size = tiledb_datatype_size(buf->type);
-
-  void *fixed_buff_pointer =
-      (static_cast<char *>(buf->buffer) + index * datatype_size);
-
-  switch (buf->type) {
+/**
+ * Compare two values bytewise, a value which is a prefix of the other is less
+ */
+static int compare_key_bytes(const char *lhs, uint64_t lhs_size,
+                             const char *rhs, uint64_t rhs_size) {
+  int cmp = memcmp(lhs, rhs, std::min(lhs_size, rhs_size));
+  if (cmp != 0)
+    return cmp;
+  return lhs_size < rhs_size ? -1 : (lhs_size > rhs_size ? 1 : 0);
+}
 
+/**
+ * Comparison of the values of a dimension datatype
+ * @param type
+ * @return comparison function
+ */
+static int (*key_comparator(tiledb_datatype_t type))(const char *, uint64_t,
+                                                      const char *, uint64_t) {
+  switch (type) {
   case TILEDB_FLOAT32:
-    return compare_key_to_dim<float>(dim_idx, key, key_part_len,
-                                     fixed_buff_pointer);
+    return compare_key_values<float>;
   case TILEDB_FLOAT64:
-    return compare_key_to_dim<double>(dim_idx, key, key_part_len,
-                                      fixed_buff_pointer);
-    //  case TILEDB_CHAR:
+    return compare_key_values<double>;
   case TILEDB_INT8:
-    return compare_key_to_dim<int8>(dim_idx, key, key_part_len,
-                                    fixed_buff_pointer);
+    return compare_key_values<int8_t>;
   case TILEDB_UINT8:
-    return compare_key_to_dim<uint8>(dim_idx, key, key_part_len,
-                                     fixed_buff_pointer);
+    return compare_key_values<uint8_t>;
   case TILEDB_INT16:
-    return compare_key_to_dim<int16>(dim_idx, key, key_part_len,
-                                     fixed_buff_pointer);
+    return compare_key_values<int16_t>;
   case TILEDB_UINT16:
-    return compare_key_to_dim<uint16>(dim_idx, key, key_part_len,
-                                      fixed_buff_pointer);
+    return compare_key_values<uint16_t>;
   case TILEDB_INT32:
-    return compare_key_to_dim<int32>(dim_idx, key, key_part_len,
-                                     fixed_buff_pointer);
+    return compare_key_values<int32_t>;
   case TILEDB_UINT32:
-    return compare_key_to_dim<uint32>(dim_idx, key, key_part_len,
-                                      fixed_buff_pointer);
-  case TILEDB_UINT64:
-    return compare_key_to_dim<uint64>(dim_idx, key, key_part_len,
-                                      fixed_buff_pointer);
+    return compare_key_values<uint32_t>;
   case TILEDB_INT64:
-    return compare_key_to_dim<int64>(dim_idx, key, key_part_len,
-                                     fixed_buff_pointer);
-  case TILEDB_DATETIME_YEAR: {
-    // XXX: for some reason maria uses year offset from 1900 here
-    MYSQL_TIME mysql_time = {1900U + *((uint8_t *)(key)), 0, 0, 0, 0, 0, 0, 0,
-                             MYSQL_TIMESTAMP_TIME};
-    int64_t xs = MysqlTimeToTileDBTimeVal(ha_thd(), mysql_time, buf->type);
-    return compare_key_to_dim<int64>(dim_idx, (uchar *)&xs, key_part_len,
-                                     fixed_buff_pointer);
-  }
-  case TILEDB_DATETIME_MONTH:
-  case TILEDB_DATETIME_WEEK:
-  case TILEDB_DATETIME_DAY:
-  case TILEDB_DATETIME_HR:
-  case TILEDB_DATETIME_MIN:
-  case TILEDB_DATETIME_SEC:
-  case TILEDB_DATETIME_MS:
-  case TILEDB_DATETIME_US:
-  case TILEDB_DATETIME_NS:
-  case TILEDB_DATETIME_PS:
-  case TILEDB_DATETIME_FS:
-  case TILEDB_DATETIME_AS:
-  case TILEDB_TIME_HR:
-  case TILEDB_TIME_MIN:
-  case TILEDB_TIME_SEC:
-  case TILEDB_TIME_MS:
-  case TILEDB_TIME_US:
-  case TILEDB_TIME_NS:
-  case TILEDB_TIME_PS:
-  case TILEDB_TIME_FS:
-  case TILEDB_TIME_AS: {
-    MYSQL_TIME mysql_time;
-    Field *field = table->field[dim_idx];
-
-    uchar *tmp = field->ptr;
-    field->ptr = (uchar *)key;
-    field->get_date(&mysql_time, date_mode_t(0));
-    field->ptr = tmp;
-
-    int64_t xs = MysqlTimeToTileDBTimeVal(ha_thd(), mysql_time, buf->type);
-    return compare_key_to_dim<int64>(dim_idx, (uchar *)&xs, key_part_len,
-                                     fixed_buff_pointer);
-  }
-  case TILEDB_STRING_ASCII: {
-    const uint16_t char_length = *reinterpret_cast<const uint16_t *>(key);
-    uint64_t key_offset = sizeof(uint16_t);
-
-    uint64_t end_position = index + 1;
-    uint64_t start_position = 0;
-    // If its not the first value, we need to see where the previous position
-    // ended to know where to start.
-    if (index > 0) {
-      start_position = buf->offset_buffer[index];
-    }
-    // If the current position is equal to the number of results - 1 then we are
-    // at the last varchar value
-    if (index >= (buf->offset_buffer_size / sizeof(uint64_t)) - 1) {
-      end_position = buf->buffer_size / sizeof(char);
-    } else { // Else read the end from the next offset.
-      end_position = buf->offset_buffer[index + 1];
-    }
-    size_t size = end_position - start_position;
-
-    // If the key size is zero, this can happen when we are doing partial key
-    // matches For strings a size of 0 means anything should be considered a
-    // match so we return 0
-    if (char_length == 0)
-      return 0;
-
-    void *buff = (static_cast<char *>(buf->buffer) + start_position);
-
-    return compare_key_to_dim<char>(dim_idx, key + key_offset, char_length,
-                                    buff, size);
-  }
-  case TILEDB_BLOB:
-  case TILEDB_GEOM_WKB:
-  case TILEDB_GEOM_WKT:
-    return compare_key_to_dim<std::byte>(dim_idx, key, key_part_len,
-                                         fixed_buff_pointer);
+    return compare_key_values<int64_t>;
+  case TILEDB_UINT64:
+    return compare_key_values<uint64_t>;
   case TILEDB_BOOL:
-    return compare_key_to_dim<bool>(dim_idx, key, key_part_len,
-                                    fixed_buff_pointer);
-  default: {
-    my_printf_error(ER_UNKNOWN_ERROR, "Unsupported datatype in key compare",
-                    ME_ERROR_LOG | ME_FATAL);
+    return compare_key_values<bool>;
+  default:
+    if (tile::TileDBDateTimeType(type))
+      return compare_key_values<int64_t>;
+    return compare_key_bytes;
   }
+}
+
+std::vector<tile::mytile::decoded_key_part>
+tile::mytile::decode_key(const uchar *key, uint key_len) {
+  std::vector<decoded_key_part> parts;
+  const KEY *key_info = table->key_info;
+  uint64_t key_position = 0;
+
+  for (uint64_t part_idx = 0;
+       part_idx < key_info->user_defined_key_parts && key_position < key_len;
+       part_idx++) {
+    const KEY_PART_INFO *key_part_info = &(key_info->key_part[part_idx]);
+    const uchar *key_part = key + key_position;
+    key_position += key_part_info->length;
+
+    // Key parts may list the dimensions in any order
+    size_t fieldIndex = key_part_info->fieldnr - 1;
+    if (fieldIndex >= this->field_map.size() ||
+        !this->field_map[fieldIndex].dimension)
+      continue;
+
+    tiledb_datatype_t type = this->field_map[fieldIndex].type;
+    decoded_key_part part{fieldIndex, false, std::string(),
+                          key_comparator(type)};
+
+    if (type == TILEDB_DATETIME_YEAR) {
+      // XXX: for some reason maria uses year offset from 1900 here
+      MYSQL_TIME mysql_time = {1900U + *((uint8_t *)(key_part)),
+                               0,
+                               0,
+                               0,
+                               0,
+                               0,
+                               0,
+                               0,
+                               MYSQL_TIMESTAMP_TIME};
+      int64_t xs = MysqlTimeToTileDBTimeVal(ha_thd(), mysql_time, type);
+      part.value.assign(reinterpret_cast<const char *>(&xs), sizeof(xs));
+    } else if (TileDBDateTimeType(type)) {
+      MYSQL_TIME mysql_time;
+      Field *field = table->field[fieldIndex];
+
+      uchar *tmp = field->ptr;
+      field->ptr = const_cast<uchar *>(key_part);
+      field->get_date(&mysql_time, date_mode_t(0));
+      field->ptr = tmp;
+
+      int64_t xs = MysqlTimeToTileDBTimeVal(ha_thd(), mysql_time, type);
+      part.value.assign(reinterpret_cast<const char *>(&xs), sizeof(xs));
+    } else if (type == TILEDB_STRING_ASCII) {
+      uint16_t char_length;
+      memcpy(&char_length, key_part, sizeof(uint16_t));
+      // If the key size is zero, this can happen when we are doing partial
+      // key matches For strings a size of 0 means anything should be
+      // considered a match
+      if (char_length == 0)
+        part.any = true;
+      part.value.assign(
+          reinterpret_cast<const char *>(key_part + sizeof(uint16_t)),
+          char_length);
+    } else if (part.compare == compare_key_bytes) {
+      part.value.assign(reinterpret_cast<const char *>(key_part),
+                        key_part_info->length);
+    } else {
+      part.value.assign(reinterpret_cast<const char *>(key_part),
+                        tiledb_datatype_size(type));
+    }
+    parts.push_back(std::move(part));
   }
+  return parts;
+}
+
+int tile::mytile::compare_key_to_cell(
+    const std::vector<decoded_key_part> &key, uint64_t index) const {
+  for (const auto &part : key) {
+    if (part.any)
+      continue;
 
+    uint64_t size;
+    const char *data =
+        cell_data(*this->buffers[part.buffer_index], index, &size);
+    int cmp = part.compare(part.value.data(), part.value.size(), data, size);
+    if (cmp != 0)
+      return cmp;
+  }
   return 0;
 }
 
+/**
+ * Check if a cell compared to a key satisfies the find flag of an index read
+ * @param key_cmp comparison of the key to the cell
+ * @param find_flag
+ * @return true if the cell is returned
+ */
+static bool key_matches(int key_cmp, enum ha_rkey_function find_flag) {
+  return (key_cmp == 0 &&
+          (find_flag == ha_rkey_function::HA_READ_KEY_EXACT ||
+           find_flag == ha_rkey_function::HA_READ_KEY_OR_NEXT ||
+           find_flag == ha_rkey_function::HA_READ_KEY_OR_PREV)) ||
+         (key_cmp > 0 && (find_flag == ha_rkey_function::HA_READ_BEFORE_KEY ||
+                          find_flag == ha_rkey_function::HA_READ_KEY_OR_PREV ||
+                          find_flag == ha_rkey_function::HA_READ_AFTER_KEY)) ||
+         (key_cmp < 0 && (find_flag == ha_rkey_function::HA_READ_AFTER_KEY ||
+                          find_flag == ha_rkey_function::HA_READ_KEY_OR_NEXT));
+}
+
+std::optional<uint64_t>
+tile::mytile::find_key_in_batch(const std::vector<decoded_key_part> &key,
+                                enum ha_rkey_function find_flag) {
+  DBUG_ENTER("tile::mytile::find_key_in_batch");
+  if (this->records == 0)
+    DBUG_RETURN(std::nullopt);
+
+  // The order of the batch is checked once, index scans read in row-major
+  // order but sparse multi range reads may not be sorted across ranges
+  if (this->key_lookup_batch != this->read_batches) {
+    this->key_lookup_batch = this->read_batches;
+    this->key_lookup_rows.clear();
+
+    std::vector<std::pair<const buffer *, decltype(&compare_key_bytes)>> dims;
+    for (size_t fieldIndex : this->dim_field_indexes) {
+      if (fieldIndex >= this->buffers.size() ||
+          this->buffers[fieldIndex] == nullptr)
+        continue;
+      const buffer *buff = this->buffers[fieldIndex].get();
+      dims.emplace_back(buff, key_comparator(buff->type));
+    }
+
+    this->key_lookup_sorted = true;
+    for (uint64_t index = 1; this->key_lookup_sorted && index < this->records;
+         index++) {
+      for (const auto &dim : dims) {
+        uint64_t prev_size, size;
+        const char *prev = cell_data(*dim.first, index - 1, &prev_size);
+        const char *cell = cell_data(*dim.first, index, &size);
+        int cmp = dim.second(prev, prev_size, cell, size);
+        if (cmp > 0)
+          this->key_lookup_sorted = false;
+        if (cmp != 0)
+          break;
+      }
+    }
+  }
+
+  // The key orders the cells if its parts are the leading dimensions, and
+  // parts matching every cell are not followed by a compared part
+  bool key_ordered = true;
+  bool any_part = false;
+  bool full_key = key.size() == this->ndim;
+  for (size_t part_idx = 0; part_idx < key.size(); part_idx++) {
+    const decoded_key_part &part = key[part_idx];
+    key_ordered &= this->field_map[part.buffer_index].index == part_idx &&
+                   (!any_part || part.any);
+    any_part |= part.any;
+    full_key &= !part.any;
+  }
+
+  if (this->key_lookup_sorted && key_ordered) {
+    // First cell not less than the key and first cell greater than the key
+    uint64_t lower = 0;
+    uint64_t upper = this->records;
+    while (lower < upper) {
+      uint64_t middle = lower + (upper - lower) / 2;
+      if (compare_key_to_cell(key, middle) > 0)
+        lower = middle + 1;
+      else
+        upper = middle;
+    }
+    uint64_t first_greater = lower;
+    upper = this->records;
+    while (first_greater < upper) {
+      uint64_t middle = first_greater + (upper - first_greater) / 2;
+      if (compare_key_to_cell(key, middle) >= 0)
+        first_greater = middle + 1;
+      else
+        upper = middle;
+    }
+
+    switch (find_flag) {
+    case ha_rkey_function::HA_READ_KEY_EXACT:
+      if (lower < first_greater)
+        DBUG_RETURN(lower);
+      break;
+    case ha_rkey_function::HA_READ_KEY_OR_NEXT:
+      if (lower < this->records)
+        DBUG_RETURN(lower);
+      break;
+    case ha_rkey_function::HA_READ_AFTER_KEY:
+      if (first_greater < this->records)
+        DBUG_RETURN(first_greater);
+      break;
+    case ha_rkey_function::HA_READ_BEFORE_KEY:
+      if (lower > 0)
+        DBUG_RETURN(lower - 1);
+      break;
+    case ha_rkey_function::HA_READ_KEY_OR_PREV:
+      if (first_greater > 0)
+        DBUG_RETURN(first_greater - 1);
+      break;
+    default:
+      break;
+    }
+    DBUG_RETURN(std::nullopt);
+  }
+
+  if (full_key && find_flag == ha_rkey_function::HA_READ_KEY_EXACT) {
+    if (this->key_lookup_rows.empty()) {
+      for (uint64_t index = 0; index < this->records; index++) {
+        std::string coords;
+        append_coords(this->buffers, index, coords);
+        this->key_lookup_rows.emplace(std::move(coords), index);
+      }
+    }
+
+    // Coordinates are hashed in dimension order
+    std::vector<const std::string *> values(this->ndim, nullptr);
+    for (const auto &part : key)
+      values[this->field_map[part.buffer_index].index] = &part.value;
+
+    std::string coords;
+    for (const std::string *value : values) {
+      if (value == nullptr)
+        DBUG_RETURN(std::nullopt);
+      uint64_t size = value->size();
+      coords.append(reinterpret_cast<const char *>(&size), sizeof(uint64_t));
+      coords.append(*value);
+    }
+    auto it = this->key_lookup_rows.find(coords);
+    if (it == this->key_lookup_rows.end())
+      DBUG_RETURN(std::nullopt);
+    DBUG_RETURN(it->second);
+  }
+
+  // Otherwise scan the batch from the current position, wrapping around to
+  // its beginning
+  for (uint64_t examined = 0; examined < this->records; examined++) {
+    uint64_t index = (this->record_index + examined) % this->records;
+    if (key_matches(compare_key_to_cell(key, index), find_flag))
+      DBUG_RETURN(index);
+  }
+  DBUG_RETURN(std::nullopt);
+}
+
 int tile::mytile::index_read_scan(const uchar *key, uint key_len,
                                   enum ha_rkey_function find_flag, bool reset) {
   DBUG_ENTER("tile::mytile::index_read_scan");
@@ -3858,6 +6201,23 @@ int tile::mytile::index_read_scan(const uchar *key, uint key_len,
   tiledb_query_status_to_str(static_cast<tiledb_query_status_t>(status),
                              &query_status);
 
+  // The key is decoded once and compared to the cells of each batch
+  std::vector<decoded_key_part> decoded_key = decode_key(key, key_len);
+  decoded_key.erase(
+      std::remove_if(decoded_key.begin(), decoded_key.end(),
+                     [this](const decoded_key_part &part) {
+                       return part.buffer_index >= this->buffers.size() ||
+                              this->buffers[part.buffer_index] == nullptr;
+                     }),
+      decoded_key.end());
+  for (auto &part : decoded_key) {
+    // A dimension without pushed ranges matches every cell
+    uint64_t dim_idx = this->field_map[part.buffer_index].index;
+    part.any |= (dim_idx >= this->pushdown_ranges.size() ||
+                 this->pushdown_ranges[dim_idx].empty()) &&
+                (dim_idx >= this->pushdown_in_ranges.size() ||
+                 this->pushdown_in_ranges[dim_idx].empty());
+  }
   bool restarted_scan = false;
 begin:
   if (!this->mrr_query && this->records == this->records_examined &&
@@ -3875,22 +6235,12 @@ begin:
     if (this->records_examined >= this->records) {
 
       do {
-        this->status = query->submit();
-
-        // Compute the number of cells (records) that were returned by the query
-        auto buff = this->buffers[0];
-        if (buff->offset_buffer != nullptr) {
-          this->records = buff->offset_buffer_size / sizeof(uint64_t);
-        } else {
-          this->records = buff->buffer_size / tiledb_datatype_size(buff->type);
-        }
+        fetch_read_batch(false);
 
         // Increase the buffer allocation and resubmit if necessary.
         if (this->status == tiledb::Query::Status::INCOMPLETE &&
             this->records == 0) { // VERY IMPORTANT!!
-          this->read_buffer_size = this->read_buffer_size * 2;
-          dealloc_buffers();
-          alloc_read_buffers(read_buffer_size);
+          grow_read_buffers();
         } else if (records > 0) {
           this->record_index = 0;
           this->records_examined = 0;
@@ -3908,77 +6258,18 @@ begin:
       } while (status == tiledb::Query::Status::INCOMPLETE);
     }
 
-    bool found = false;
-    do {
-      if (this->record_index == this->records) {
-        // if we reached the end, go back to the beginning.
-        // This will ensure that we don't miss out on keys.
-        // Worst case is that the key is at position n-1 and we are at
-        // position n. If all keys are sorted as they are supposed to be
-        // since we are passing the mrr_sort_keys=on parameter, this
-        // algorithm should be optimal. Worst case is when the sort
-        // order is descending.
-        this->record_index = 0;
-      }
-      int key_cmp = compare_key_to_dims(key, key_len, this->record_index);
-      // If the current index coordinates matches the key we are looking for we
-      // must set the fields. Key is found!
-      if ((key_cmp == 0 &&
-           (find_flag == ha_rkey_function::HA_READ_KEY_EXACT ||
-            find_flag == ha_rkey_function::HA_READ_KEY_OR_NEXT ||
-            find_flag == ha_rkey_function::HA_READ_KEY_OR_PREV)) ||
-          (key_cmp > 0 && (find_flag == ha_rkey_function::HA_READ_BEFORE_KEY ||
-                           find_flag == ha_rkey_function::HA_READ_KEY_OR_PREV ||
-                           find_flag == ha_rkey_function::HA_READ_AFTER_KEY)) ||
-          (key_cmp < 0 &&
-           (find_flag == ha_rkey_function::HA_READ_AFTER_KEY ||
-            find_flag == ha_rkey_function::HA_READ_KEY_OR_NEXT))) {
-        tileToFields(record_index, false, table);
-        found = true;
-
-        // set up next read in this batch
-        this->record_index++;
-        this->records_examined = 0;
-        break;
-      } else if (key_cmp < 0) {
-
-        // First lets make sure the "start" record of this (potentially
-        // incomplete) query buffers is before what we are looking for
-        // If the key we are looking for is before the first record it
-        // means we've missed the key and the request can not be resolved
-        if (compare_key_to_dims(key, key_len, 0) < 0) {
-
-          // If we have already tried rerunning the query from the
-          // start then the request can not be satisfied we need to
-          // return key not found to prevent an infinite loop
-          if (restarted_scan) {
-            // Reset bitmap to original
-            dbug_tmp_restore_column_map(&table->write_set, original_bitmap);
-            if (reset)
-              index_end();
-            DBUG_RETURN(HA_ERR_KEY_NOT_FOUND);
-          }
-
-          // restart scan
-          this->query->set_layout(tiledb_layout_t::TILEDB_ROW_MAJOR);
-          restarted_scan = true;
-          goto begin;
-        }
-      }
-
-      // always increase record index. The records_examined refers to the
-      // records we have checked to see if our key matches.
-      // When the records_examined value equals to all records in this batch
-      // we can safely say that we have checked all keys
-      this->record_index++;
-      this->records_examined++;
-    } while (this->records_examined < this->records);
-
-    // if key not found
-    if (!found) {
-      // check for restart
-      if (!restarted_scan) {
-        restarted_scan = true;
+    std::optional<uint64_t> match = find_key_in_batch(decoded_key, find_flag);
+    if (!match.has_value()) {
+      // Keys after the batch of a sorted incomplete query are in the batches
+      // which follow. Otherwise the next batch is searched once, wrapping
+      // around to the start of a completed query
+      bool later_batch =
+          this->key_lookup_sorted &&
+          this->status == tiledb::Query::Status::INCOMPLETE &&
+          compare_key_to_cell(decoded_key, this->records - 1) > 0;
+      this->records_examined = this->records;
+      if (later_batch || !restarted_scan) {
+        restarted_scan |= !later_batch;
         goto begin;
       }
       // Key not found even after restart, reset bitmap to original
@@ -3988,6 +6279,11 @@ begin:
       DBUG_RETURN(HA_ERR_KEY_NOT_FOUND);
     }
 
+    // The key is found, set the fields and set up the next read in this batch
+    tileToFields(*match, false, table);
+    this->record_index = *match + 1;
+    this->records_examined = 0;
+
   } catch (const tiledb::TileDBError &e) {
     // Log errors
     my_printf_error(ER_UNKNOWN_ERROR,
@@ -4016,6 +6312,22 @@ int tile::mytile::index_read_idx_map(uchar *buf, uint idx, const uchar *key,
 
   uint key_len = calculate_key_len(table, idx, key, keypart_map);
 
+  // A key with every dimension is read as a single point
+  if (!this->mrr_query && !this->metadata_query &&
+      find_flag == ha_rkey_function::HA_READ_KEY_EXACT &&
+      this->query_condition == nullptr && !this->valid_pushed_ranges() &&
+      !this->valid_pushed_in_ranges() &&
+      this->array_schema->array_type() == TILEDB_SPARSE) {
+    std::vector<decoded_key_part> decoded_key = decode_key(key, key_len);
+    std::vector<bool> dims(this->ndim, false);
+    for (const auto &part : decoded_key) {
+      if (!part.any)
+        dims[this->field_map[part.buffer_index].index] = true;
+    }
+    if (std::all_of(dims.begin(), dims.end(), [](bool dim) { return dim; }))
+      DBUG_RETURN(point_lookup(decoded_key));
+  }
+
   // reset or add pushdowns for this key if not MRR
   if (!this->mrr_query) {
     this->set_pushdowns_for_key(key, key_len, true /* start_key */, find_flag);
@@ -4033,6 +6345,56 @@ int tile::mytile::index_read_idx_map(uchar *buf, uint idx, const uchar *key,
   DBUG_RETURN(index_read_scan(key, key_len, find_flag, true /* reset */));
 }
 
+int tile::mytile::point_lookup(const std::vector<decoded_key_part> &key) {
+  DBUG_ENTER("tile::mytile::point_lookup");
+  int rc = 0;
+  // We must set the bitmap for debug purpose, it is "write_set" because we use
+  // Field->store
+  MY_BITMAP *original_bitmap =
+      dbug_tmp_use_all_columns(table, &table->write_set);
+  try {
+    // The opened array is reused, only the buffers the single cell needs are
+    // allocated from the size estimate of the point
+    open_array_for_reads(ha_thd());
+    dealloc_position_buffers();
+    this->read_buffer_size = tile::sysvars::read_buffer_size(ha_thd());
+
+    std::vector<std::vector<std::string>> points(this->ndim);
+    for (const auto &part : key) {
+      points[this->field_map[part.buffer_index].index].push_back(part.value);
+    }
+    // Without duplicates the point holds at most one cell
+    read_position_rows(points, this->array_schema->allows_dups() ? UINT64_MAX
+                                                                  : 1);
+
+    // The row is kept with the rows of rnd_pos, so position() finds it
+    if (this->position_rows.empty()) {
+      rc = HA_ERR_KEY_NOT_FOUND;
+    } else {
+      this->position_row = this->position_rows.begin()->second;
+      decode_fields(ha_thd(), this->position_row_decoder,
+                    this->position_buffers, this->position_row);
+    }
+  } catch (const tiledb::TileDBError &e) {
+    // Log errors
+    my_printf_error(ER_UNKNOWN_ERROR, "[point_lookup] error for table %s : %s",
+                    ME_ERROR_LOG | ME_FATAL, this->uri.c_str(), e.what());
+    rc = ERR_INDEX_READ_SCAN_TILEDB;
+  } catch (const std::exception &e) {
+    // Log errors
+    my_printf_error(ER_UNKNOWN_ERROR, "[point_lookup] error for table %s : %s",
+                    ME_ERROR_LOG | ME_FATAL, this->uri.c_str(), e.what());
+    rc = ERR_INDEX_READ_SCAN_OTHER;
+  }
+
+  // Reset bitmap to original
+  dbug_tmp_restore_column_map(&table->write_set, original_bitmap);
+  DBUG_RETURN(rc);
+}
+
+// Range estimates kept per handler before the cache is emptied
+static const size_t MAX_RANGE_ESTIMATES = 1024;
+
 #if MYSQL_VERSION_ID < 100500
 ha_rows tile::mytile::records_in_range(uint inx, key_range *min_key,
                                        key_range *max_key) {
@@ -4041,7 +6403,160 @@ ha_rows tile::mytile::records_in_range(uint inx, const key_range *min_key,
                                        const key_range *max_key,
                                        page_range *page) {
 #endif
-  return (ha_rows)10000;
+  DBUG_ENTER("tile::mytile::records_in_range");
+  // Guess used when TileDB can not estimate the range
+  const ha_rows default_rows = 10000;
+  if (this->array == nullptr || !this->array->is_open() ||
+      this->array->query_type() != TILEDB_READ ||
+      !key_parts_are_dimensions(inx))
+    DBUG_RETURN(default_rows);
+
+  try {
+    // Estimates belong to a snapshot of the array, they are dropped when it is
+    // reopened
+    const tile::non_empty_domain &non_empty_domain = get_non_empty_domain();
+    if (this->range_estimates_domain != this->array_non_empty_domain) {
+      this->range_estimates.clear();
+      this->range_estimates_domain = this->array_non_empty_domain;
+    }
+
+    std::string estimate_key = range_estimate_key(inx, min_key, max_key);
+    auto cached = this->range_estimates.find(estimate_key);
+    if (cached != this->range_estimates.end())
+      DBUG_RETURN(cached->second);
+
+    ha_rows rows = estimate_records_in_range(inx, min_key, max_key,
+                                             non_empty_domain);
+    if (this->range_estimates.size() >= MAX_RANGE_ESTIMATES)
+      this->range_estimates.clear();
+    this->range_estimates.emplace(std::move(estimate_key), rows);
+    DBUG_RETURN(rows);
+  } catch (const tiledb::TileDBError &e) {
+    DBUG_RETURN(default_rows);
+  } catch (const std::exception &e) {
+    DBUG_RETURN(default_rows);
+  }
+}
+
+bool tile::mytile::key_parts_are_dimensions(uint inx) const {
+  const KEY &key_info = this->table->key_info[inx];
+  if (key_info.user_defined_key_parts > this->ndim)
+    return false;
+
+  // Keys are decoded into ranges of the dimensions in key part order
+  for (uint i = 0; i < key_info.user_defined_key_parts; i++) {
+    if (key_info.key_part[i].fieldnr == 0 ||
+        key_info.key_part[i].fieldnr - 1 != this->dim_field_indexes[i])
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Append a key of a range to the cache key of its estimate
+ * @param cache_key
+ * @param key
+ */
+static void append_estimate_key(std::string &cache_key, const key_range *key) {
+  if (key == nullptr) {
+    cache_key.push_back('\0');
+    return;
+  }
+  cache_key.push_back('\1');
+  cache_key.push_back(static_cast<char>(key->flag));
+  cache_key.append(reinterpret_cast<const char *>(&key->length),
+                   sizeof(key->length));
+  cache_key.append(reinterpret_cast<const char *>(key->key), key->length);
+}
+
+std::string tile::mytile::range_estimate_key(uint inx, const key_range *min_key,
+                                             const key_range *max_key) const {
+  std::string cache_key(reinterpret_cast<const char *>(&inx), sizeof(inx));
+  append_estimate_key(cache_key, min_key);
+  append_estimate_key(cache_key, max_key);
+  return cache_key;
+}
+
+ha_rows tile::mytile::estimate_records_in_range(
+    uint inx, const key_range *min_key, const key_range *max_key,
+    const tile::non_empty_domain &non_empty_domain) {
+  DBUG_ENTER("tile::mytile::estimate_records_in_range");
+  const ha_rows default_rows = 10000;
+
+  // Without duplicates an exact match on every dimension is a single cell
+  if (min_key != nullptr && min_key->flag == HA_READ_KEY_EXACT &&
+      my_count_bits(min_key->keypart_map) == this->ndim &&
+      !(this->array_schema->array_type() == TILEDB_SPARSE &&
+        this->array_schema->allows_dups()))
+    DBUG_RETURN(1);
+
+  // The key range is turned into a range per dimension, like the keys of a
+  // multi range read
+  std::vector<std::shared_ptr<tile::range>> key_ranges;
+  for (uint64_t i = 0; i < this->ndim; i++) {
+    key_ranges.emplace_back(std::make_shared<tile::range>(tile::range{
+        std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
+        std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
+        Item_func::EQ_FUNC, tiledb_datatype_t::TILEDB_ANY, 0, 0}));
+  }
+  if (min_key != nullptr && min_key->key != nullptr)
+    update_ranges_from_key(key_ranges, *min_key, inx, true /* start_key */);
+  if (max_key != nullptr && max_key->key != nullptr)
+    update_ranges_from_key(key_ranges, *max_key, inx, false /* start_key */);
+
+  std::vector<std::vector<std::shared_ptr<tile::range>>> ranges(this->ndim);
+  std::vector<std::vector<std::shared_ptr<tile::range>>> in_ranges(this->ndim);
+  bool valid_ranges = false;
+  for (uint64_t i = 0; i < this->ndim; i++) {
+    auto &range = key_ranges[i];
+    if (range->lower_value == nullptr && range->upper_value == nullptr)
+      continue;
+    if (range->lower_value != nullptr && range->upper_value != nullptr)
+      range->operation_type = Item_func::BETWEEN;
+    ranges[i].push_back(std::move(range));
+    valid_ranges = true;
+  }
+
+  int empty_read = 0;
+  auto key_subarray =
+      std::make_unique<tiledb::Subarray>(*this->ctx, *this->array);
+  tile::build_subarray(ha_thd(), valid_ranges, false, empty_read,
+                       *this->domain, non_empty_domain, ranges, in_ranges,
+                       key_subarray, this->ctx.get());
+
+  // The range misses the non empty domain, zero would be taken as certain so
+  // one row is reported
+  if (empty_read)
+    DBUG_RETURN(1);
+
+  // Dense reads return every cell of the subarray
+  std::optional<uint64_t> cells = tile::metadata_cell_count(
+      *this->ctx, *this->array, non_empty_domain, get_fragment_listing(),
+      *key_subarray, true);
+
+  // Otherwise TileDB estimates the cells of the tiles overlapping the
+  // subarray from the size of the first dimension
+  size_t dim_field_index = this->dim_field_indexes[0];
+  if (!cells.has_value() && dim_field_index != SIZE_MAX) {
+    tiledb::Query query(*this->ctx, *this->array, TILEDB_READ);
+    query.set_subarray(*key_subarray);
+    const field_details &details = this->field_map[dim_field_index];
+    estimated_result_size est =
+        get_estimated_result_size(query, this->dimensionNames[0], details);
+    if (est.valid) {
+      cells = details.var_len
+                  ? est.offsets / sizeof(uint64_t)
+                  : est.data / tiledb_datatype_size(details.type);
+    }
+  }
+
+  if (!cells.has_value())
+    DBUG_RETURN(default_rows);
+
+  std::optional<uint64_t> records = get_metadata_records();
+  if (records.has_value())
+    cells = std::min(*cells, *records);
+  DBUG_RETURN(std::max<ha_rows>(*cells, 1));
 }
 
 int tile::mytile::set_pushdowns_for_key(const uchar *key, uint key_len,
@@ -4050,7 +6565,7 @@ int tile::mytile::set_pushdowns_for_key(const uchar *key, uint key_len,
   DBUG_ENTER("tile::mytile::set_pushdowns_for_key");
   std::map<uint64_t, std::shared_ptr<tile::range>> ranges_from_keys =
       tile::build_ranges_from_key(ha_thd(), table, key, key_len, find_flag,
-                                  start_key, this->array_schema->domain());
+                                  start_key, *this->domain);
 
   if (!ranges_from_keys.empty()) {
     if (this->query_complete() ||
@@ -4076,140 +6591,123 @@ int tile::mytile::set_pushdowns_for_key(const uchar *key, uint key_len,
  * MRR implementation: use DS-MRR
  ***************************************************************************/
 
-int tile::mytile::build_mrr_ranges() {
-  DBUG_ENTER("tile::mytile::build_mrr_ranges");
-  this->pushdown_ranges.clear();
-  this->pushdown_in_ranges.clear();
-
-  std::vector<std::shared_ptr<tile::range>> tmp_ranges;
-  this->pushdown_ranges.resize(this->ndim);
-  this->pushdown_in_ranges.resize(this->ndim);
-  for (uint64_t i = 0; i < this->ndim; i++) {
-    tmp_ranges.emplace_back(std::make_shared<tile::range>(tile::range{
-        std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
-        std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
-        Item_func::EQ_FUNC, tiledb_datatype_t::TILEDB_ANY, 0, 0}));
-  };
-
+void tile::mytile::update_ranges_from_key(
+    std::vector<std::shared_ptr<tile::range>> &ranges, const key_range &key,
+    uint key_index, bool start_key) {
+  DBUG_ENTER("tile::mytile::update_ranges_from_key");
   // Get domain and dimensions
-  auto domain = this->array_schema->domain();
+  const tiledb::Domain &domain = *this->domain;
   auto dims = domain.dimensions();
 
-  // Loop over all keys
-  while (!mrr_funcs.next(mrr_iter, &mrr_cur_range)) {
-
-    if (mrr_cur_range.start_key.key != nullptr) {
-      uint64_t key_offset = 0;
-      for (uint64_t i = 0; i < this->ndim; i++) {
-
-        // Exit when we've reached the end of the key
-        if (key_offset >= mrr_cur_range.start_key.length)
-          break;
-
-        uint64_t key_len = 0;
-        bool last_key_part = false;
-        tiledb_datatype_t datatype = dims[i].type();
-        Field *field;
-        for (uint64_t fi = 0; fi < table->s->fields; fi++) {
-          Field *f = table->s->field[fi];
-          if (std::string(f->field_name.str, f->field_name.length) ==
-              dims[i].name()) {
-            field = f;
-            break;
-          }
-        }
+  uint64_t key_offset = 0;
+  for (uint64_t i = 0; i < this->ndim; i++) {
 
-        auto &range = tmp_ranges[i];
-        if (datatype == TILEDB_STRING_ASCII) {
-          const uint16_t char_length = *reinterpret_cast<const uint16_t *>(
-              mrr_cur_range.start_key.key + key_offset);
-          key_len += sizeof(uint16_t);
-          key_len += char_length;
-
-          // If the key size is zero, this can happen when we are doing partial
-          // key matches For strings a size of 0 means anything should be
-          // considered a match so we return 0
-          if (char_length == 0) {
-            range->lower_value = nullptr;
-            range->upper_value = nullptr;
-            continue;
-          }
-        } else {
-          key_len += table->s->key_info[active_index].key_part[i].length;
-        }
+    // Exit when we've reached the end of the key
+    if (key_offset >= key.length)
+      break;
 
-        if (key_offset + key_len >= mrr_cur_range.start_key.length)
-          last_key_part = true;
+    uint64_t key_len = 0;
+    bool last_key_part = false;
+    tiledb_datatype_t datatype = dims[i].type();
+    Field *field = nullptr;
+    for (uint64_t fi = 0; fi < table->s->fields; fi++) {
+      Field *f = table->s->field[fi];
+      if (std::string(f->field_name.str, f->field_name.length) ==
+          dims[i].name()) {
+        field = f;
+        break;
+      }
+    }
 
-        range->datatype = datatype;
-        update_range_from_key_for_super_range(
-            range, mrr_cur_range.start_key, key_offset, true /* start_key */,
-            last_key_part, datatype, ha_thd(), field);
-        key_offset += key_len;
+    auto &range = ranges[i];
+    if (datatype == TILEDB_STRING_ASCII) {
+      const uint16_t char_length =
+          *reinterpret_cast<const uint16_t *>(key.key + key_offset);
+      key_len += sizeof(uint16_t);
+      key_len += char_length;
+
+      // If the key size is zero, this can happen when we are doing partial
+      // key matches For strings a size of 0 means anything should be
+      // considered a match so we return 0
+      if (char_length == 0) {
+        range->lower_value = nullptr;
+        range->upper_value = nullptr;
+        continue;
       }
+    } else {
+      key_len += table->s->key_info[key_index].key_part[i].length;
     }
 
-    // If the end key is not the same as the start key we need to also build the
-    // range from it
-    if (mrr_cur_range.end_key.key != nullptr) {
-      uint64_t key_offset = 0;
-      for (uint64_t i = 0; i < this->ndim; i++) {
+    if (key_offset + key_len >= key.length)
+      last_key_part = true;
 
-        // Exit when we've reached the end of the key
-        if (key_offset >= mrr_cur_range.end_key.length)
-          break;
+    range->datatype = datatype;
+    update_range_from_key_for_super_range(range, key, key_offset, start_key,
+                                          last_key_part, datatype, ha_thd(),
+                                          field);
+    key_offset += key_len;
+  }
+  DBUG_VOID_RETURN;
+}
 
-        uint64_t key_len = 0;
-        bool last_key_part = false;
-        tiledb_datatype_t datatype = dims[i].type();
-        Field *field;
-        for (uint64_t fi = 0; fi < table->s->fields; fi++) {
-          Field *f = table->s->field[fi];
-          if (std::string(f->field_name.str, f->field_name.length) ==
-              dims[i].name()) {
-            field = f;
-            break;
-          }
-        }
+int tile::mytile::build_mrr_ranges() {
+  DBUG_ENTER("tile::mytile::build_mrr_ranges");
+  this->pushdown_ranges.clear();
+  this->pushdown_in_ranges.clear();
 
-        auto &range = tmp_ranges[i];
+  this->pushdown_ranges.resize(this->ndim);
+  this->pushdown_in_ranges.resize(this->ndim);
 
-        if (datatype == TILEDB_STRING_ASCII) {
-          const uint16_t char_length = *reinterpret_cast<const uint16_t *>(
-              mrr_cur_range.end_key.key + key_offset);
-          key_len += sizeof(uint16_t);
-          key_len += char_length;
+  // Ranges of each key per dimension, and the dimensions some key leaves
+  // unconstrained
+  std::vector<std::vector<std::shared_ptr<tile::range>>> key_ranges(
+      this->ndim);
+  std::vector<bool> unconstrained(this->ndim, false);
 
-          if (char_length == 0) {
-            range->lower_value = nullptr;
-            range->upper_value = nullptr;
-            continue;
-          }
-        } else {
-          key_len += table->s->key_info[active_index].key_part[i].length;
-        }
+  // Loop over all keys
+  while (!mrr_funcs.next(mrr_iter, &mrr_cur_range)) {
+    std::vector<std::shared_ptr<tile::range>> tmp_ranges;
+    for (uint64_t i = 0; i < this->ndim; i++) {
+      tmp_ranges.emplace_back(std::make_shared<tile::range>(tile::range{
+          std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
+          std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
+          Item_func::EQ_FUNC, tiledb_datatype_t::TILEDB_ANY, 0, 0}));
+    }
 
-        if (key_offset + key_len >= mrr_cur_range.end_key.length)
-          last_key_part = true;
+    if (mrr_cur_range.start_key.key != nullptr)
+      update_ranges_from_key(tmp_ranges, mrr_cur_range.start_key,
+                             active_index, true /* start_key */);
 
-        range->datatype = datatype;
-        update_range_from_key_for_super_range(
-            range, mrr_cur_range.end_key, key_offset, false /* start_key */,
-            last_key_part, datatype, ha_thd(), field);
-        key_offset += key_len;
-      }
+    // If the end key is not the same as the start key we need to also build the
+    // range from it
+    if (mrr_cur_range.end_key.key != nullptr)
+      update_ranges_from_key(tmp_ranges, mrr_cur_range.end_key, active_index,
+                             false /* start_key */);
+
+    for (size_t i = 0; i < tmp_ranges.size(); i++) {
+      auto &range = tmp_ranges[i];
+      if (range->operation_type != Item_func::BETWEEN &&
+          range->lower_value != nullptr && range->upper_value != nullptr)
+        range->operation_type = Item_func::BETWEEN;
+
+      if (range->lower_value != nullptr || range->upper_value != nullptr)
+        key_ranges[i].push_back(range);
+      else
+        unconstrained[i] = true;
     }
   }
 
-  // Now that we have all ranges, let's build them into super ranges
-  for (size_t i = 0; i < tmp_ranges.size(); i++) {
-    auto &range = tmp_ranges[i];
-    if (range->operation_type != Item_func::BETWEEN &&
-        range->lower_value != nullptr && range->upper_value != nullptr)
-      range->operation_type = Item_func::BETWEEN;
+  // The ranges of all keys are alternatives, instead of one super range
+  // spanning the gaps between keys each dimension reads only the keys
+  for (uint64_t i = 0; i < this->ndim; i++) {
+    if (unconstrained[i] || key_ranges[i].empty())
+      continue;
 
-    if (range->lower_value != nullptr || range->upper_value != nullptr)
-      this->pushdown_ranges[i].push_back(range);
+    uint64_t disjunction = ++this->pushdown_disjunctions;
+    for (auto &range : key_ranges[i]) {
+      range->disjunction = disjunction;
+      this->pushdown_in_ranges[i].push_back(std::move(range));
+    }
   }
 
   int rc = init_scan(this->ha_thd());
@@ -4349,6 +6847,10 @@ std::shared_ptr<tiledb::Array> &tile::mytile::get_array() {
   return this->array;
 }
 
+std::shared_ptr<tiledb::Context> &tile::mytile::get_context() {
+  return this->ctx;
+}
+
 std::shared_ptr<tiledb::QueryCondition> &tile::mytile::get_qc() {
   return this->query_condition;
 }
@@ -4377,7 +6879,7 @@ mysql_declare_plugin(mytile){
                                                      (for I_S.PLUGINS)   */
     PLUGIN_LICENSE_PROPRIETARY, /* the plugin license (PLUGIN_LICENSE_XXX) */
     mytile_init_func,           /* Plugin Init */
-    NULL,                       /* Plugin Deinit */
+    mytile_done_func,           /* Plugin Deinit */
     0x0360,                     /* version number (0.36.0) */
     tile::statusvars::mytile_status_variables, /* status variables */
     tile::sysvars::mytile_system_variables,    /* system variables */
@@ -4394,7 +6896,7 @@ maria_declare_plugin(mytile){
                                                      (for I_S.PLUGINS)   */
     PLUGIN_LICENSE_PROPRIETARY, /* the plugin license (PLUGIN_LICENSE_XXX) */
     mytile_init_func,           /* Plugin Init */
-    NULL,                       /* Plugin Deinit */
+    mytile_done_func,           /* Plugin Deinit */
     0x0360,                     /* version number (0.36.0) */
     tile::statusvars::mytile_status_variables, /* status variables */
     tile::sysvars::mytile_system_variables,    /* system variables */
@@ -38,11 +38,18 @@
 
 #include "ha_mytile_share.h"
 #include "mytile-buffer.h"
+#include "mytile-group-by.h"
+#include "mytile-metadata-aggregates.h"
 #include "mytile-range.h"
+#include "mytile-schema-cache.h"
 #include "mytile-sysvars.h"
+#include "mytile-worker-pool.h"
 #include <handler.h>
+#include <deque>
+#include <future>
 #include <memory>
 #include <map>
+#include <unordered_set>
 #include <tiledb/tiledb>
 #include <tiledb/tiledb_experimental>
 #include "handler.h"   /* handler */
@@ -61,70 +68,302 @@ namespace tile {
 
 /*****************************************************************************
 This handler supports SUM(), COUNT(), AVG(), MIN(), and MAX()
-pushdown to TileDB
+pushdown to TileDB, with or without a GROUP BY
 *****************************************************************************/
 
 class mytile_group_by_handler : public group_by_handler {
 private:
+  /**
+   * An aggregate of the select list computed by a query
+   */
+  struct pushed_aggregate {
+    // Field of the aggregate in the result table
+    Field *field;
+    // Aggregate function
+    Item_sum::Sumfunctype func;
+    // Aggregated attribute or dimension, empty when every cell is counted
+    std::string column;
+    // Datatype of the column
+    tiledb_datatype_t type = TILEDB_ANY;
+    // True if the column is nullable
+    bool nullable = false;
+  };
+
+  /**
+   * Result of a pushed aggregate over a subarray. Sums and bounds are kept in
+   * the member matching the type of the column
+   */
+  struct aggregate_result {
+    // Non null values aggregated
+    uint64_t values = 0;
+    int64_t int_value = 0;
+    uint64_t uint_value = 0;
+    double double_value = 0;
+    std::string string_value;
+    // Average computed by TileDB, set for dense arrays whose cell counts
+    // include fill values and the cells a query condition filters
+    std::optional<double> mean;
+  };
+
+  /**
+   * A fixed size column read to compute the aggregates of a scan, grouped or
+   * not
+   */
+  struct group_read_column {
+    // Attribute or dimension name
+    std::string name;
+    // Datatype of the column
+    tiledb_datatype_t type = TILEDB_ANY;
+    // True if the column is nullable
+    bool nullable = false;
+    // Values per cell
+    uint32_t cell_val_num = 1;
+    // Buffers of a batch and their sizes after a submit
+    std::vector<char> data;
+    std::vector<uint8_t> validity;
+    uint64_t data_size = 0;
+    uint64_t validity_size = 0;
+
+    /**
+     * @return bytes of a cell
+     */
+    uint64_t cell_size() const {
+      return tiledb_datatype_size(type) * cell_val_num;
+    }
+  };
+
+  /**
+   * A field of the result table set from a group
+   */
+  struct group_output {
+    // Index of the field in the result table
+    size_t field_index;
+    // Index of the grouping column, SIZE_MAX for an aggregate
+    size_t key_column = SIZE_MAX;
+    // Index of the aggregate
+    size_t aggregate = 0;
+  };
+
+  /**
+   * Buckets of a datetime dimension grouped by an expression
+   */
+  struct group_datetime_bucket {
+    // Index of the dimension in the columns read
+    size_t column;
+    tile::datetime_bucket bucket;
+    // Buckets of the cells of a batch
+    std::vector<int64_t> values;
+  };
+
+  /**
+   * Columns read, groups and aggregates of a pushed GROUP BY
+   */
+  struct group_by_plan {
+    // Columns read, the aggregates index into them
+    std::vector<group_read_column> columns;
+    // Datetime buckets computed from the columns read
+    std::vector<group_datetime_bucket> buckets;
+    // Grouping columns, indexes in the columns read followed by the buckets
+    std::vector<size_t> key_columns;
+    std::vector<tile::group_aggregate> aggregates;
+    // Function and column of each aggregate, their fields are set when the
+    // scan starts
+    std::vector<pushed_aggregate> results;
+    std::vector<group_output> outputs;
+  };
+
   // flag to only fetch one row
   bool first_row;
 
-  // The array we run the aggregates on
-  std::unique_ptr<tiledb::Array> aggr_array;
+  // The array we run the aggregates on, the array of the table handler
+  std::shared_ptr<tiledb::Array> aggr_array;
 
-  // The context
+  // The context of the table handler
   std::shared_ptr<tiledb::Context> ctx;
 
   // The constructed query condition for the query if requested
   std::shared_ptr<tiledb::QueryCondition> &tiledb_qc;
 
-  // True if we have valid pushed ranges
-  bool valid_ranges;
-
-  // True if we have valid pushed in ranges
-  bool valid_in_ranges;
-
   // The pushed ranges if present
   std::vector<std::vector<std::shared_ptr<tile::range>>> &pushdown_ranges;
 
   // The pushed in ranges if present
   std::vector<std::vector<std::shared_ptr<tile::range>>> &pushdown_in_ranges;
 
-  // The encryption key if applicabl
-  const std::string encryption_key;
+  // The subarray for the dims
+  std::unique_ptr<tiledb::Subarray> tiledb_sub;
 
-  // The open at timestamp is applicable
-  const uint64_t open_at;
+  // True if the pushed ranges match no cells
+  bool empty_read;
 
-  // The array uri
-  const std::string uri;
+  // Partitions of the subarray aggregated concurrently, empty if aggregates
+  // run as a single query
+  std::vector<std::unique_ptr<tiledb::Subarray>> partition_subarrays;
 
-  // The query for the aggregation
-  std::shared_ptr<tiledb::Query> aggr_query;
+  // Results of the select items answered from metadata, indexed like the
+  // select list, unset for items aggregated by a query
+  std::vector<std::optional<tile::metadata_aggregate>> metadata_results;
 
-  // The subarray for the dims
-  std::unique_ptr<tiledb::Subarray> tiledb_sub;
+  // Ranges of the fragments the pushed ranges partially cover, when metadata
+  // only answers the aggregates over the fully covered ones. Every aggregate
+  // is computed over them and merged with its metadata result
+  std::vector<std::unique_ptr<tiledb::Subarray>> fragment_subarrays;
+
+  // The GROUP BY computed, unset when the select has none
+  std::optional<group_by_plan> grouping;
+
+  // Groups of the hash partition being returned
+  std::unique_ptr<tile::group_by_table> groups;
+
+  // Hash partitions of the groups left to aggregate, as the number of
+  // partitions and the one to keep
+  std::deque<std::pair<uint64_t, uint64_t>> group_partitions;
+
+  // Next group to return
+  uint64_t next_group = 0;
+
+  // Converter of datetime buckets to the session time zone
+  tile::datetime_converter datetimes;
+
+  /**
+   * Sets a MariaDB field from the bucket of a datetime grouping expression
+   * @param field The MariaDB field
+   * @param bucket The buckets of the expression
+   * @param value The bucket
+   * @return
+   */
+  int set_bucket_field(Field *field, const tile::datetime_bucket &bucket,
+                       int64_t value);
+
+  /**
+   * Cells of the columns read for the GROUP BY, pointing at their buffers
+   * @return columns of a batch
+   */
+  std::vector<tile::group_column> group_batch() const;
+
+  /**
+   * Scans the subarray aggregating the groups of a hash partition. If the
+   * groups outgrow the group_by_memory the partition is split in two, both
+   * halves are queued to be scanned again
+   * @param partitions number of hash partitions
+   * @param partition the partition aggregated
+   */
+  void aggregate_groups(uint64_t partitions, uint64_t partition);
+
+  /**
+   * Sets the fields of the result table from the next group
+   * @return
+   */
+  int set_group_row();
+
+  /**
+   * Sets a MariaDB field from a single cell
+   * @param field The MariaDB field
+   * @param type Datatype of the cell
+   * @param cell The cell
+   * @param size Bytes of the cell
+   * @param var_sized True if the cell is var sized
+   * @return
+   */
+  int set_field_from_cell(Field *field, tiledb_datatype_t type,
+                          const char *cell, uint64_t size, bool var_sized);
+
+  /**
+   * Submits one query computing every aggregate over a subarray
+   * @param aggregates The aggregates
+   * @param subarray The subarray to aggregate
+   * @return result of each aggregate
+   */
+  std::vector<aggregate_result>
+  submit_aggregates(const std::vector<pushed_aggregate> &aggregates,
+                    const tiledb::Subarray &subarray);
+
+  /**
+   * Computes every aggregate over each subarray concurrently and merges them
+   * @param aggregates The aggregates
+   * @param subarrays Disjoint subarrays to aggregate
+   * @return result of each aggregate
+   */
+  std::vector<aggregate_result>
+  aggregate_subarrays(const std::vector<pushed_aggregate> &aggregates,
+                      const std::vector<std::unique_ptr<tiledb::Subarray>>
+                          &subarrays);
+
+  /**
+   * Result of an aggregate over the fully covered fragments, answered from
+   * metadata
+   * @param aggregate The aggregate
+   * @param metadata The metadata result
+   * @return result to merge with the scanned fragments
+   */
+  static aggregate_result
+  metadata_aggregate_result(const pushed_aggregate &aggregate,
+                            const tile::metadata_aggregate &metadata);
+
+  /**
+   * Merges the result of an aggregate over a partition into the result over
+   * the previous partitions
+   * @param aggregate The aggregate
+   * @param partial Result over a partition
+   * @param result Merged result
+   */
+  static void merge_aggregate(const pushed_aggregate &aggregate,
+                              const aggregate_result &partial,
+                              aggregate_result &result);
+
+  /**
+   * Sets the MariaDB field with the result of an aggregate
+   * @param aggregate The aggregate
+   * @param result The result
+   * @return
+   */
+  int set_aggregate(const pushed_aggregate &aggregate,
+                    const aggregate_result &result);
 
 public:
   /**
    * This handler is responsible for the aggregate pusdhown
    * @param thd_arg
-   * @param array
-   * @param context
+   * @param array array open for reads of the table handler
+   * @param context context of the table handler
    * @param qc
-   * @param val_ranges
-   * @param val_in_ranges
+   * @param ranges
+   * @param in_ranges
+   * @param subarray subarray built from the pushed ranges
+   * @param empty_read true if the pushed ranges match no cells
+   * @param metadata results of the select items answered from metadata
+   * @param fragments ranges of the partially covered fragments scanned to
+   * complete the metadata results, empty if these are complete
+   * @param grouping the GROUP BY computed, unset when the select has none
    */
   mytile_group_by_handler(
-      THD *thd_arg, std::unique_ptr<tiledb::Array> array,
-      std::shared_ptr<tiledb::Context> &context,
-      std::shared_ptr<tiledb::QueryCondition> &qc, bool val_ranges,
-      bool val_in_ranges,
+      THD *thd_arg, std::shared_ptr<tiledb::Array> array,
+      std::shared_ptr<tiledb::Context> context,
+      std::shared_ptr<tiledb::QueryCondition> &qc,
       std::vector<std::vector<std::shared_ptr<tile::range>>> &ranges,
       std::vector<std::vector<std::shared_ptr<tile::range>>> &in_ranges,
-      const std::string encryption_key, const uint64_t open_at);
+      std::unique_ptr<tiledb::Subarray> subarray, bool empty_read,
+      std::vector<std::optional<tile::metadata_aggregate>> metadata,
+      std::vector<std::unique_ptr<tiledb::Subarray>> fragments = {},
+      std::optional<group_by_plan> grouping = std::nullopt);
   ~mytile_group_by_handler() = default;
 
+  /**
+   * Checks if the GROUP BY of a query can be computed on a sparse array: the
+   * grouping columns are fixed size single value attributes or dimensions, or
+   * buckets of datetime dimensions, and the select list holds grouping
+   * columns and aggregates of them. A query without GROUP BY has a single
+   * group, its aggregates are those TileDB does not compute
+   * @param query The query
+   * @param array The array of the only table of the query
+   * @param non_empty_domain The non empty domain of the array
+   * @return columns and aggregates of the GROUP BY, nullopt if the server must
+   * group the rows
+   */
+  static std::optional<group_by_plan>
+  plan_group_by(Query *query, tiledb::Array &array,
+                const tile::non_empty_domain &non_empty_domain);
+
   /**
    * Initiates the aggregation query
    * @return
@@ -144,30 +383,13 @@ public:
   int end_scan();
 
   /**
-   * Submits the TileDB query and sets the MariaDB field with the aggregate
-   * result of min or max
-   * @param aggr_query  The TileDB query
-   * @param type The attribute/dimension type
+   * Sets the MariaDB field with an aggregate answered from metadata
+   * @param result The count or bound of a dimension
    * @param field The MariaDB field
-   * @param minmax_string The string for TileDB
    * @return
    */
-  int submit_and_set_minmax_aggregate(
-      std::shared_ptr<tiledb::Query> &aggr_query, const tiledb_datatype_t type,
-      Field *field, std::string minmax_string);
-
-  /**
-   * Submits the TileDB query and sets the MariaDB field with the aggregate
-   * result of sum
-   * @param aggr_query  The TileDB query
-   * @param type The attribute/dimension type
-   * @param field The MariaDB field
-   * @param minmax_string The string for TileDB
-   * @return
-   */
-  int submit_and_set_sum_aggregate(std::shared_ptr<tiledb::Query> &aggr_query,
-                                   const tiledb_datatype_t type, Field *field,
-                                   std::string sum_string);
+  int set_metadata_aggregate(const tile::metadata_aggregate &result,
+                             Field *field);
 };
 
 class mytile : public handler {
@@ -303,9 +525,46 @@ public:
 
   /**
    * Initialize table scanning
+   * @param thd
+   * @param table_scan true for table scans, which may read wide fields only
+   * for the rows passing the residual condition and read partitions in
+   * parallel
    * @return
    */
-  int init_scan(THD *thd);
+  int init_scan(THD *thd, bool table_scan = false);
+
+  /**
+   * Number of rows a table scan has to return for the statement, when every
+   * row returned is part of a result cut by LIMIT
+   * @return limit including the offset, UINT64_MAX if all rows are needed
+   */
+  uint64_t get_scan_limit();
+
+  /**
+   * Decide if the scan reads wide fields in a second phase and find them
+   * @param thd
+   * @return true if late materialization is used
+   */
+  bool setup_late_materialization(THD *thd);
+
+  /**
+   * Evaluate the residual condition on the rows of the batch, the late fields
+   * of the rows passing it are read when the cursor reaches them
+   */
+  void materialize_late_fields();
+
+  /**
+   * Read the late fields of the next rows passing the residual condition
+   * with a multi point query, as many as keep the cross product of their
+   * coordinates small
+   */
+  void read_late_fields();
+
+  /**
+   * Move the cursor past rows rejected by the residual condition and read the
+   * late fields of the row it stops at if needed
+   */
+  void skip_rejected_rows();
 
   /* Table Scanning */
   int rnd_init(bool scan) override;
@@ -344,14 +603,60 @@ public:
   void position(const uchar *record) override;
 
   /**
-   * Fetches the current coordinates as a byte vector
+   * Appends the coordinates of a cell in the form
    * <uint64_t>-<data>-<uint64_t>-<data>
    *
    * Where the prefix of <uint64_t> is the length of the data to follow
+   * @param buffer_set buffers holding the dimensions
    * @param index of buffers to use
-   * @return byte vector
+   * @param coords string the coordinates are appended to
+   */
+  void append_coords(const std::vector<std::shared_ptr<buffer>> &buffer_set,
+                     uint64_t index, std::string &coords) const;
+
+  /**
+   * Length of the coordinates stored in a ref by position
+   * @param pos
+   * @return length in bytes
+   */
+  uint64_t coords_length(const uchar *pos) const;
+
+  /**
+   * Read the rows of the pending positions and the requested one in a single
+   * multi point query and cache them by coordinates
+   * @param pos coordinates of the requested row
+   */
+  void read_positions(const uchar *pos);
+
+  /**
+   * Read the cells at the cross product of the points on each dimension,
+   * retrying with larger buffers until the query completes
+   * @param points coordinates on each dimension
+   * @param fields fields to read
+   * @param buffer_set buffers the cells are read into
+   * @param max_rows most cells the points hold, sizes the first buffers
+   * @return number of cells read, nullopt if they do not fit the largest
+   * buffers
+   */
+  std::optional<uint64_t>
+  read_points(std::vector<std::vector<std::string>> &points,
+              const std::vector<bool> &fields,
+              std::vector<std::shared_ptr<buffer>> &buffer_set,
+              uint64_t max_rows = UINT64_MAX);
+
+  /**
+   * Read the cells at the cross product of the points into the position
+   * buffers and cache them by coordinates
+   * @param points coordinates on each dimension
+   * @param max_rows most cells the points hold
+   */
+  void read_position_rows(std::vector<std::vector<std::string>> &points,
+                          uint64_t max_rows = UINT64_MAX);
+
+  /**
+   * Free the cached rows of rnd_pos
    */
-  std::vector<uint8_t> get_coords_as_byte_vector(uint64_t index);
+  void dealloc_position_buffers();
 
   /**
    * Write row
@@ -420,6 +725,15 @@ public:
    */
   const COND *cond_push_cond(Item_cond *cond_item);
 
+  /**
+   * Handle condition pushdown of a disjunction. It is pushed when all its
+   * alternatives are ranges of the same dimension, or all are query
+   * conditions on attributes
+   * @param cond_item
+   * @return nullptr if pushed, else the condition
+   */
+  const COND *cond_push_disjunction(Item_cond *cond_item);
+
   /**
    *  Handle function condition pushdowns
    * @param func_item
@@ -499,6 +813,14 @@ public:
    */
   ulong index_flags(uint idx, uint part, bool all_parts) const override;
 
+  /**
+   * Handle hints from the server, in keyread mode only the dimensions are
+   * read
+   * @param operation
+   * @return
+   */
+  int extra(enum ha_extra_function operation) override;
+
   /**
    * Returns limit on the number of keys imposed.
    * @return
@@ -521,10 +843,115 @@ public:
    */
   int external_lock(THD *thd, int lock_type) override;
 
+  /**
+   * Projected field of a read buffer and its converter
+   */
+  struct decoded_field {
+    Field *field;
+    size_t buffer_index;
+    tile::field_converter converter;
+  };
+
+  /**
+   * Key part of an index read decoded to the datatype of its dimension
+   */
+  struct decoded_key_part {
+    // Index of the buffer of the dimension
+    size_t buffer_index;
+    // Set if the key part matches every cell
+    bool any;
+    // Value in the datatype of the dimension as raw bytes
+    std::string value;
+    // Compares two values of the datatype, negative if lhs is less
+    int (*compare)(const char *lhs, uint64_t lhs_size, const char *rhs,
+                   uint64_t rhs_size);
+  };
+
+  /**
+   * Partition of the subarray read concurrently by a parallel scan
+   */
+  struct scan_partition {
+    // Subarray of the partition
+    std::unique_ptr<tiledb::Subarray> subarray;
+    // Query reading the partition
+    std::unique_ptr<tiledb::Query> query;
+    // Buffers the next batch of the partition is read into
+    std::vector<std::shared_ptr<buffer>> buffers;
+    // Background submit filling the buffers
+    std::future<tiledb::Query::Status> batch;
+  };
+
+  /**
+   * Estimated result sizes in bytes of the buffers of a field
+   */
+  struct estimated_result_size {
+    bool valid = false;
+    uint64_t data = 0;
+    uint64_t offsets = 0;
+    uint64_t validity = 0;
+  };
+
   /**
    * Helper function to allocate all buffers
+   * @param memory_budget
+   * @param size_from_estimates cap buffers to the estimated result sizes of
+   * the query, the subarray must be set
+   * @param max_rows cap buffers to the size of this many rows
+   */
+  void alloc_buffers(uint64_t memory_budget, bool size_from_estimates = false,
+                     uint64_t max_rows = UINT64_MAX);
+
+  /**
+   * Helper function to allocate the buffers of a set of fields
+   * @param buffer_set buffers in field index order
+   * @param fields true for the fields which need a buffer
+   * @param read_query query used for the result estimates
+   * @param memory_budget
+   * @param size_from_estimates cap buffers to the estimated result sizes of
+   * the query, the subarray must be set
+   * @param max_rows cap buffers to the size of this many rows
+   */
+  void alloc_buffer_set(std::vector<std::shared_ptr<buffer>> &buffer_set,
+                        const std::vector<bool> &fields,
+                        tiledb::Query &read_query, uint64_t memory_budget,
+                        bool size_from_estimates,
+                        uint64_t max_rows = UINT64_MAX);
+
+  /**
+   * Helper to allocate a buffer set with the same fields and sizes as another
+   * @param source
+   * @param target
    */
-  void alloc_buffers(uint64_t memory_budget);
+  void alloc_buffers_like(const std::vector<std::shared_ptr<buffer>> &source,
+                          std::vector<std::shared_ptr<buffer>> &target);
+
+  /**
+   * Get the estimated result size of a field for a read query, the subarray
+   * must be set
+   * @param read_query
+   * @param name field name
+   * @param details field details
+   * @return estimated sizes, not valid if TileDB could not estimate them
+   */
+  estimated_result_size
+  get_estimated_result_size(tiledb::Query &read_query, const std::string &name,
+                            const field_details &details);
+
+  /**
+   * Expected bytes per cell of a var length field, from the cells read so far
+   * or else from the estimated result size
+   * @param fieldIndex
+   * @param est estimated result size of the field
+   * @return bytes per cell
+   */
+  double var_bytes_per_cell(size_t fieldIndex,
+                            const estimated_result_size &est);
+
+  /**
+   * Grow the read buffers which kept an incomplete query from returning any
+   * record and set them on the query
+   */
+  void grow_read_buffers();
 
   /**
    * Helper function to alloc and set read buffers
@@ -542,6 +969,86 @@ public:
    */
   void dealloc_buffers();
 
+  /**
+   * Helper to free the buffers of late materialized fields
+   */
+  void dealloc_late_buffers();
+
+  /**
+   * Helper to free the buffers used for prefetching
+   */
+  void dealloc_prefetch_buffers();
+
+  /**
+   * Helper to set a buffer set as the read query buffers, sizes are reset to
+   * the allocated sizes first
+   * @param buffer_set
+   */
+  void set_read_buffers(std::vector<std::shared_ptr<buffer>> &buffer_set);
+
+  /**
+   * Helper to set a buffer set as the buffers of a read query, sizes are reset
+   * to the allocated sizes first
+   * @param read_query
+   * @param buffer_set
+   */
+  void set_read_buffers(tiledb::Query &read_query,
+                        std::vector<std::shared_ptr<buffer>> &buffer_set);
+
+  /**
+   * Submit the read query, or collect the batch prefetched in the background,
+   * and count the records in the current buffers
+   * @param prefetch_next submit the next batch in the background if the query
+   * is incomplete
+   */
+  void fetch_read_batch(bool prefetch_next);
+
+  /**
+   * Submit the next batch of the read query in the background into the
+   * prefetch buffers
+   */
+  void start_prefetch();
+
+  /**
+   * Wait for a background submit and discard its results, must be called
+   * before the query or its buffers are released
+   */
+  void cancel_prefetch();
+
+  /**
+   * Split the subarray of an unordered scan of a sparse array into partitions
+   * for a parallel scan
+   * @param thd
+   * @return subarrays of the partitions, empty if the scan is not parallel
+   */
+  std::vector<std::unique_ptr<tiledb::Subarray>>
+  plan_parallel_scan(THD *thd);
+
+  /**
+   * Start reading every partition in the background
+   * @param subarrays subarrays of the partitions
+   */
+  void start_parallel_scan(
+      std::vector<std::unique_ptr<tiledb::Subarray>> &subarrays);
+
+  /**
+   * Submit the next batch of a partition in the background
+   * @param partition
+   */
+  void submit_partition(scan_partition &partition);
+
+  /**
+   * Swap in the next batch read by any partition, waiting for one if none is
+   * ready yet
+   * @return number of records in the batch, 0 once all partitions are done
+   */
+  uint64_t fetch_partition_batch();
+
+  /**
+   * Wait for the partitions of a parallel scan and free their buffers
+   */
+  void dealloc_scan_partitions();
+
   /**
    * Helper to get field attribute value specified as DEFAULT during table
    * creation
@@ -565,6 +1072,23 @@ public:
   int tileToFields(uint64_t record_position, bool dimensions_only,
                    TABLE *table);
 
+  /**
+   * Convert the fields of a decoder from a row of a buffer set
+   * @param thd
+   * @param decoder
+   * @param buffer_set
+   * @param index row index
+   */
+  void decode_fields(THD *thd, const std::vector<decoded_field> &decoder,
+                     std::vector<std::shared_ptr<buffer>> &buffer_set,
+                     uint64_t index);
+
+  /**
+   * Build the row decoder for the projected fields of the read buffers, must
+   * be called whenever the read buffers are allocated
+   */
+  void build_row_decoder();
+
   /**
    * Table info
    * @return
@@ -633,55 +1157,43 @@ public:
   int index_end() override;
 
   /**
-   * Compares two buffers checking their bytes
-   * Iterates through dimension buffers
-   * First buffer is the key, second buffer is the dimension buffer
+   * Decode the parts of a key to the datatypes of their dimensions, so cells
+   * are compared to it without converting the key again
    * @param key
    * @param key_len
-   * @param index
-   * @return minus(<0) if key is less than buffer, 0 if equal, positive (>0) if
-   * key is greater than buffer
+   * @return decoded key parts in dimension order
    */
-  int8_t compare_key_to_dims(const uchar *key, uint key_length, uint64_t index);
-
-  int8_t compare_key_to_dim(const uint64_t dim_idx, const uchar *key,
-                            uint64_t key_part_len, const uint64_t index,
-                            const std::shared_ptr<buffer> &buf);
-
-  template <typename T>
-  int8_t compare_key_to_dim(const uint64_t dim_index, const uchar *key,
-                            uint64_t key_length, const void *buffer,
-                            uint64_t buffer_size = sizeof(T)) {
-    // if a dim has zero ranges, return 0 (key == buffer)
-    const auto &ranges = this->pushdown_ranges[dim_index];
-    const auto &in_ranges = this->pushdown_in_ranges[dim_index];
-
-    if (ranges.empty() && in_ranges.empty()) {
-      return 0;
-    }
+  std::vector<decoded_key_part> decode_key(const uchar *key, uint key_len);
 
-    // If the lower is null, set it
-    if (std::is_same<T, char>()) {
-      auto cmp = memcmp(buffer, key, std::min(key_length, buffer_size));
-      if (cmp == 0 && key_length < buffer_size) {
-        return -1;
-      } else if (cmp == 0 && key_length > buffer_size) {
-        return 1;
-      }
-      return cmp;
-    }
-
-    const T *key_typed = reinterpret_cast<const T *>(key);
-    const T *buffer_typed = reinterpret_cast<const T *>(buffer);
+  /**
+   * Read the row of a key holding every dimension with a single point query,
+   * without setting up a scan
+   * @param key decoded key
+   * @return 0 if the row is found, else HA_ERR_KEY_NOT_FOUND or an error
+   */
+  int point_lookup(const std::vector<decoded_key_part> &key);
 
-    if (*key_typed < *buffer_typed)
-      return -1;
-    if (*key_typed == *buffer_typed)
-      return 0;
+  /**
+   * Compare a decoded key to a cell of the current batch
+   * @param key
+   * @param index
+   * @return minus(<0) if key is less than the cell, 0 if equal, positive (>0)
+   * if key is greater than the cell
+   */
+  int compare_key_to_cell(const std::vector<decoded_key_part> &key,
+                          uint64_t index) const;
 
-    // last case is always if (key_typed > buffer_size)
-    return 1;
-  }
+  /**
+   * Find the cell of the current batch an index read of a key returns. Batches
+   * in row-major order are binary searched, others are looked up by
+   * coordinates for full keys and scanned otherwise
+   * @param key
+   * @param find_flag
+   * @return index of the cell, nullopt if no cell of the batch matches
+   */
+  std::optional<uint64_t>
+  find_key_in_batch(const std::vector<decoded_key_part> &key,
+                    enum ha_rkey_function find_flag);
 
   /**
    * Returns an estimation for number of records expected from the current query
@@ -717,8 +1229,8 @@ public:
   int index_next(uchar *buf) override;
 
   /**
-   * Implement initial records in range
-   * Currently returns static large value
+   * Estimate the records of a key range from TileDB, estimates are cached per
+   * range until the array is reopened
    */
 #if MYSQL_VERSION_ID < 100500
   ha_rows records_in_range(uint inx, key_range *min_key,
@@ -756,10 +1268,6 @@ public:
    */
   int index_next_same(uchar *buf, const uchar *key, uint keylen) override;
 
-  static std::vector<std::tuple<tiledb_datatype_t, bool, bool, bool>>
-  build_field_details_for_buffers(const tiledb::ArraySchema &array_schema,
-                                  Field **fields, const uint64_t &field_num,
-                                  MY_BITMAP *read_set);
   /**
    * Checks if there are any ranges pushed
    * @return
@@ -772,6 +1280,14 @@ public:
    */
   bool valid_pushed_in_ranges();
 
+  /**
+   * Checks if a where clause was pushed down as a whole, without leaving
+   * conditions for the server to evaluate
+   * @param where
+   * @return
+   */
+  bool condition_fully_pushed(const Item *where) const;
+
   /**
    *
    * @return
@@ -784,6 +1300,31 @@ public:
    */
   std::shared_ptr<tiledb::Array> &get_array();
 
+  /**
+   *
+   * @return
+   */
+  std::shared_ptr<tiledb::Context> &get_context();
+
+  /**
+   * Helper function which validates the array is open for reads
+   */
+  void open_array_for_reads(THD *thd);
+
+  /**
+   * Fetch the non empty domain of the array open for reads, it is only
+   * computed once per opened array
+   * @return non empty domain
+   */
+  const tile::non_empty_domain &get_non_empty_domain();
+
+  /**
+   * Fetch the fragments of the array open for reads, they are only listed
+   * once per opened array
+   * @return fragments
+   */
+  const tile::fragment_listing &get_fragment_listing();
+
   /**
    *
    * @return
@@ -818,8 +1359,11 @@ private:
   // Table uri
   std::string uri;
 
-  // TileDB context
-  tiledb::Context ctx;
+  // TileDB context, shared with other handlers using the same config
+  std::shared_ptr<tiledb::Context> ctx;
+
+  // Id of the context in the context pool
+  uint64_t ctx_id = 0;
 
   // TileDB Config
   tiledb::Config config;
@@ -827,6 +1371,31 @@ private:
   // TileDB Array
   std::shared_ptr<tiledb::Array> array;
 
+  // Share for all handlers of this table
+  mytile_share *share = nullptr;
+
+  // True if array is the read array shared through the mytile_share
+  bool array_is_shared = false;
+
+  // Non empty domain of the opened array, reset whenever it is reopened
+  std::shared_ptr<const tile::non_empty_domain> array_non_empty_domain;
+
+  // Fragments of the opened array, reset whenever it is reopened
+  std::shared_ptr<const tile::fragment_listing> array_fragments;
+
+  // Non empty domain the cells counted from metadata belong to, the count is
+  // recomputed when the array is reopened
+  std::shared_ptr<const tile::non_empty_domain> metadata_records_domain;
+
+  // Cells of the opened array counted from metadata, unset if unknown
+  std::optional<uint64_t> metadata_records;
+
+  // Non empty domain the cached range estimates belong to
+  std::shared_ptr<const tile::non_empty_domain> range_estimates_domain;
+
+  // Estimated records of key ranges by index and keys
+  std::map<std::string, ha_rows> range_estimates;
+
   // TileDB Query
   std::shared_ptr<tiledb::Query> query;
 
@@ -842,14 +1411,122 @@ private:
   // Vector of buffers in field index order
   std::vector<std::shared_ptr<buffer>> buffers;
 
+  // Coordinates of the last row, reused to avoid an allocation per row
+  std::string coords_scratch;
+
+  // Coordinates saved by position during a scan, read in batches by rnd_pos
+  std::unordered_set<std::string> pending_positions;
+
+  // Rows read for rnd_pos
+  std::vector<std::shared_ptr<buffer>> position_buffers;
+
+  // Row of the position buffers by coordinates
+  std::unordered_map<std::string, uint64_t> position_rows;
+
+  // Fields converted for the rows read for rnd_pos
+  std::vector<decoded_field> position_row_decoder;
+
+  // Row of the position buffers last returned, if the last row came from them
+  uint64_t position_row = UINT64_MAX;
+
+  // Batches read so far, identifies the batch the key lookup was built for
+  uint64_t read_batches = 0;
+
+  // Batch the key lookup below was built for
+  uint64_t key_lookup_batch = UINT64_MAX;
+
+  // Set if the cells of the batch are in row-major order of the dimensions
+  bool key_lookup_sorted = false;
+
+  // First cell of the batch per coordinates, for batches not in order
+  std::unordered_map<std::string, uint64_t> key_lookup_rows;
+
+  // Second buffer set the next batch is read into for pipelined reads
+  std::vector<std::shared_ptr<buffer>> prefetch_buffers;
+
+  // Fields converted for every row of a scan, built once per scan
+  std::vector<decoded_field> row_decoder;
+
+  // Converts datetime cells to the session time zone
+  tile::datetime_converter datetimes;
+
+  // Conditions pushed to the handler which MariaDB still evaluates
+  std::vector<COND *> residual_conds;
+
+  // Number of conditions pushed to the handler
+  uint64_t pushed_conds = 0;
+
+  // Rows the statement needs from a table scan, from its LIMIT, UINT64_MAX if
+  // all rows are needed
+  uint64_t scan_limit = UINT64_MAX;
+
+  // Set by HA_EXTRA_KEYREAD when the server only needs key parts, all keys
+  // are made of dimensions so attributes are not read
+  bool keyread_only = false;
+
+  // Wide fields are read only for the rows passing the residual conditions
+  bool late_materialization = false;
+
+  // Fields read for the rows passing the residual conditions
+  std::vector<bool> late_fields;
+
+  // Buffers of the late fields and dimensions of the passing rows
+  std::vector<std::shared_ptr<buffer>> late_buffers;
+
+  // Late fields converted for every returned row
+  std::vector<decoded_field> late_row_decoder;
+
+  // Row of the late buffers for each row of the batch, rows failing the
+  // residual conditions have none
+  std::vector<uint64_t> late_rows;
+
+  // Rows of the batch passing the residual conditions
+  std::vector<uint64_t> late_survivors;
+
+  // First row of late_survivors whose late fields are not read yet
+  uint64_t next_late_survivor = 0;
+
+  // Bytes and cells read so far of each var length field, used to split the
+  // read buffer budget
+  std::vector<std::pair<uint64_t, uint64_t>> var_cell_stats;
+
+  // Background submit of the next batch into the prefetch buffers
+  std::future<tiledb::Query::Status> prefetch;
+
+  // Thread submitting the prefetched batches, started on the first prefetch
+  // and kept for all later batches and scans of the handler
+  std::unique_ptr<tile::worker_pool> prefetch_worker;
+
+  // Partitions of a parallel scan which still have batches to read
+  std::vector<std::unique_ptr<scan_partition>> partitions;
+
+  // Threads reading the partitions, one per partition, kept for later
+  // parallel scans of the handler
+  std::unique_ptr<tile::worker_pool> scan_workers;
+
+  // Partition checked first for a ready batch, so none is starved
+  size_t next_partition = 0;
+
   // Number of dimensions, this is used frequently so let's cache it
   uint64_t ndim = 0;
 
+  // Cached schema entry, keeps the schema, domain and their context alive
+  std::shared_ptr<const cached_schema> schema_entry;
+
   // Array Schema
-  std::unique_ptr<tiledb::ArraySchema> array_schema;
+  std::shared_ptr<tiledb::ArraySchema> array_schema;
 
   // Domain
-  std::unique_ptr<tiledb::Domain> domain;
+  std::shared_ptr<tiledb::Domain> domain;
+
+  // Schema details of each field in field index order
+  std::vector<field_details> field_map;
+
+  // Field index by field name
+  std::unordered_map<std::string, uint64_t> field_indexes;
+
+  // Field index of each dimension, SIZE_MAX if the table lacks it
+  std::vector<size_t> dim_field_indexes;
 
   // Dimension names
   std::vector<std::string> dimensionNames;
@@ -867,6 +1544,13 @@ private:
   // Vector of pushdown in ranges
   std::vector<std::vector<std::shared_ptr<tile::range>>> pushdown_in_ranges;
 
+  // Last id given to the alternatives of a pushed IN or OR predicate
+  uint64_t pushdown_disjunctions = 0;
+
+  // Set when the ranges of the subarray were coalesced, the scan then returns
+  // rows not matching the pushed conditions
+  bool pushdown_coalesced = false;
+
   // read buffer size
   uint64_t read_buffer_size = 0;
 
@@ -928,9 +1612,29 @@ private:
   int finalize_write();
 
   /**
-   * Helper function which validates the array is open for reads
+   * Build the field map from the array schema
    */
-  void open_array_for_reads(THD *thd);
+  void build_field_map();
+
+  /**
+   * Find the schema details of a field by name
+   * @param field_name
+   * @return details or nullptr if the field is not in the array
+   */
+  const field_details *find_field_details(const char *field_name) const;
+
+  /**
+   * Fetch or create the share for this table
+   * @return share
+   */
+  mytile_share *get_share();
+
+  /**
+   * Count the cells of the array open for reads from metadata, it is only
+   * computed once per opened array
+   * @return cell count, nullopt if it can not be derived from metadata
+   */
+  std::optional<uint64_t> get_metadata_records();
 
   /**
    * Helper function which validates the array is open for writes
@@ -954,6 +1658,50 @@ private:
    */
   int build_mrr_ranges();
 
+  /**
+   * Widen the range of each dimension to include a key, key part i is taken
+   * as dimension i
+   * @param ranges range per dimension
+   * @param key start or end key
+   * @param key_index index the key belongs to
+   * @param start_key true if the key starts the key range
+   */
+  void update_ranges_from_key(std::vector<std::shared_ptr<tile::range>> &ranges,
+                              const key_range &key, uint key_index,
+                              bool start_key);
+
+  /**
+   * Check if the key parts of an index are the leading dimensions in order
+   * @param inx index
+   * @return true if keys of the index can be turned into dimension ranges
+   */
+  bool key_parts_are_dimensions(uint inx) const;
+
+  /**
+   * Cache key of the estimate of a key range
+   * @param inx index
+   * @param min_key start of the range, nullptr if open
+   * @param max_key end of the range, nullptr if open
+   * @return cache key
+   */
+  std::string range_estimate_key(uint inx, const key_range *min_key,
+                                 const key_range *max_key) const;
+
+  /**
+   * Estimate the records of a key range from the subarray it covers, dense
+   * arrays count the cells of the subarray and sparse arrays use the result
+   * size TileDB estimates
+   * @param inx index
+   * @param min_key start of the range, nullptr if open
+   * @param max_key end of the range, nullptr if open
+   * @param non_empty_domain non empty domain of the opened array
+   * @return estimated records, at least 1
+   */
+  ha_rows
+  estimate_records_in_range(uint inx, const key_range *min_key,
+                            const key_range *max_key,
+                            const tile::non_empty_domain &non_empty_domain);
+
   /**
    * Check if a query is complete or not
    * @return true if query is complete, false otherwise
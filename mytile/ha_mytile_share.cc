@@ -0,0 +1,309 @@
+/**
+ * @file   ha_mytile_share.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This is the handler share implementation
+ */
+
+#include <my_global.h>
+
+#define MYSQL_SERVER 1
+
+#include "ha_mytile_share.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+/**
+ * Build a signature of the fragments of an array by listing the fragment,
+ * commit and metadata directories. Listing is much cheaper than opening the
+ * array and loading all fragment metadata.
+ *
+ * @param ctx context
+ * @param uri array uri
+ * @param signature set to the hash of the listings
+ * @return false if the array directory could not be listed
+ */
+static bool fragments_signature(tiledb::Context &ctx, const std::string &uri,
+                                std::size_t &signature) {
+  tiledb::VFS vfs(ctx);
+  std::vector<std::string> entries;
+  bool listed = false;
+  for (const std::string &dir :
+       {uri, uri + "/__fragments", uri + "/__commits", uri + "/__meta"}) {
+    try {
+      std::vector<std::string> children = vfs.ls(dir);
+      entries.insert(entries.end(), children.begin(), children.end());
+      listed = true;
+    } catch (const tiledb::TileDBError &e) {
+      // Directory does not exist for this format version or the backend
+      // does not support listing
+    }
+  }
+
+  std::sort(entries.begin(), entries.end());
+  std::string listing;
+  for (const std::string &entry : entries) {
+    listing.append(entry);
+    listing.push_back(';');
+  }
+  signature = std::hash<std::string>{}(listing);
+  return listed;
+}
+
+/**
+ * Open an array for reads
+ * @param ctx context
+ * @param uri array uri
+ * @param encryption_key encryption key, empty if none
+ * @param open_at timestamp to open at, UINT64_MAX for latest
+ * @return opened array
+ */
+static std::shared_ptr<tiledb::Array>
+open_read_array(tiledb::Context &ctx, const std::string &uri,
+                const std::string &encryption_key, uint64_t open_at) {
+  tiledb_encryption_type_t encryption_type =
+      encryption_key.empty() ? TILEDB_NO_ENCRYPTION : TILEDB_AES_256_GCM;
+
+  if (open_at != UINT64_MAX) {
+#if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
+    return std::make_shared<tiledb::Array>(
+        ctx, uri, TILEDB_READ,
+        tiledb::TemporalPolicy(tiledb::TimeTravel, open_at),
+        tiledb::EncryptionAlgorithm(encryption_type, encryption_key.c_str()));
+#else
+    return std::make_shared<tiledb::Array>(ctx, uri, TILEDB_READ,
+                                           encryption_type, encryption_key,
+                                           open_at);
+#endif
+  }
+
+#if TILEDB_VERSION_MAJOR >= 2 && TILEDB_VERSION_MINOR >= 15
+  return std::make_shared<tiledb::Array>(
+      ctx, uri, TILEDB_READ, tiledb::TemporalPolicy(),
+      tiledb::EncryptionAlgorithm(encryption_type, encryption_key.c_str()));
+#else
+  return std::make_shared<tiledb::Array>(ctx, uri, TILEDB_READ,
+                                         encryption_type, encryption_key);
+#endif
+}
+
+tile::mytile_share::mytile_share() {
+  thr_lock_init(&lock);
+  mysql_mutex_init(0, &mutex, MY_MUTEX_INIT_FAST);
+}
+
+tile::mytile_share::~mytile_share() {
+  read_arrays.clear();
+  thr_lock_delete(&lock);
+  mysql_mutex_destroy(&mutex);
+}
+
+void tile::mytile_share::release_unused(std::vector<shared_array> &released) {
+  for (auto it = read_arrays.begin(); it != read_arrays.end();) {
+    if (it->second.ctx != nullptr && it->second.ctx.use_count() == 1) {
+      released.push_back(std::move(it->second));
+      it = read_arrays.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::shared_ptr<tiledb::Array> tile::mytile_share::get_read_array(
+    const std::shared_ptr<tiledb::Context> &ctx, uint64_t ctx_id,
+    const std::string &uri, const std::string &encryption_key,
+    uint64_t open_at, uint64_t query_id, uint64_t check_interval) {
+  // Arrays opened at a fixed timestamp never see new fragments
+  bool time_travel = open_at != UINT64_MAX;
+  std::vector<shared_array> released;
+  std::shared_ptr<tiledb::Array> current;
+  bool stale = false;
+  std::size_t known_signature = 0;
+  bool known_signature_valid = false;
+  uint64_t sequence = 0;
+
+  mysql_mutex_lock(&mutex);
+  release_unused(released);
+  {
+    shared_array &entry = read_arrays[ctx_id];
+    auto now = std::chrono::steady_clock::now();
+    current = entry.array;
+    if (current != nullptr &&
+        (entry.last_query_id == query_id ||
+         (!entry.stale &&
+          (time_travel || now - entry.last_check <
+                              std::chrono::milliseconds(check_interval))))) {
+      mysql_mutex_unlock(&mutex);
+      released.clear();
+      return current;
+    }
+
+    if (entry.ctx == nullptr)
+      entry.ctx = ctx;
+    entry.last_query_id = query_id;
+    entry.last_check = now;
+    stale = entry.stale;
+    known_signature = entry.fragments_signature;
+    known_signature_valid = entry.signature_valid;
+    sequence = ++next_sequence;
+  }
+  mysql_mutex_unlock(&mutex);
+  // Released arrays are closed outside of the lock, before their contexts
+  released.clear();
+
+  // Listing and opening hit storage, they run outside of the lock so other
+  // statements on the table keep reading the current snapshot meanwhile. Take
+  // the signature before opening, a fragment written in between only causes
+  // an extra reopen later on
+  std::size_t signature = 0;
+  bool signature_valid =
+      !time_travel && fragments_signature(*ctx, uri, signature);
+  if (current != nullptr && !stale && signature_valid &&
+      known_signature_valid && signature == known_signature)
+    return current;
+
+  // An array no other handler reads from is taken out of the entry and
+  // reopened in place, which only loads the new fragments. Handlers still
+  // reading keep their snapshot and a new array is opened
+  std::shared_ptr<tiledb::Array> array;
+  if (current != nullptr) {
+    mysql_mutex_lock(&mutex);
+    auto it = read_arrays.find(ctx_id);
+    if (it != read_arrays.end() && it->second.array == current &&
+        current.use_count() == 2) {
+      array = std::move(it->second.array);
+      it->second.non_empty_domain = nullptr;
+      it->second.fragments = nullptr;
+    }
+    mysql_mutex_unlock(&mutex);
+    current = nullptr;
+  }
+  if (array != nullptr)
+    array->reopen();
+  else
+    array = open_read_array(*ctx, uri, encryption_key, open_at);
+
+  // Install the array unless a check started later already installed its
+  // own, which is then used instead
+  std::shared_ptr<tiledb::Array> replaced;
+  mysql_mutex_lock(&mutex);
+  if (sequence > cleared_sequence) {
+    shared_array &entry = read_arrays[ctx_id];
+    if (entry.ctx == nullptr)
+      entry.ctx = ctx;
+    if (sequence > entry.sequence || entry.array == nullptr) {
+      replaced = std::move(entry.array);
+      entry.array = array;
+      entry.non_empty_domain = nullptr;
+      entry.fragments = nullptr;
+      entry.fragments_signature = signature;
+      entry.signature_valid = signature_valid;
+      entry.sequence = sequence;
+      if (sequence > entry.stale_sequence)
+        entry.stale = false;
+    } else {
+      replaced = std::move(array);
+      array = entry.array;
+    }
+  }
+  mysql_mutex_unlock(&mutex);
+  return array;
+}
+
+std::shared_ptr<const tile::non_empty_domain>
+tile::mytile_share::get_non_empty_domain(
+    const std::shared_ptr<tiledb::Context> &ctx, uint64_t ctx_id,
+    const std::shared_ptr<tiledb::Array> &array,
+    const tiledb::Domain &domain) {
+  mysql_mutex_lock(&mutex);
+  auto it = read_arrays.find(ctx_id);
+  if (it != read_arrays.end() && it->second.array == array &&
+      it->second.non_empty_domain != nullptr) {
+    auto non_empty_domain = it->second.non_empty_domain;
+    mysql_mutex_unlock(&mutex);
+    return non_empty_domain;
+  }
+  mysql_mutex_unlock(&mutex);
+
+  // Load outside of the lock, the caller holds a reference so the snapshot
+  // can not be reopened in place meanwhile
+  auto non_empty_domain = tile::load_non_empty_domain(*ctx, *array, domain);
+
+  mysql_mutex_lock(&mutex);
+  it = read_arrays.find(ctx_id);
+  if (it != read_arrays.end() && it->second.array == array) {
+    it->second.non_empty_domain = non_empty_domain;
+  }
+  mysql_mutex_unlock(&mutex);
+  return non_empty_domain;
+}
+
+std::shared_ptr<const tile::fragment_listing>
+tile::mytile_share::get_fragment_listing(
+    const std::shared_ptr<tiledb::Context> &ctx, uint64_t ctx_id,
+    const std::shared_ptr<tiledb::Array> &array) {
+  mysql_mutex_lock(&mutex);
+  auto it = read_arrays.find(ctx_id);
+  if (it != read_arrays.end() && it->second.array == array &&
+      it->second.fragments != nullptr) {
+    auto fragments = it->second.fragments;
+    mysql_mutex_unlock(&mutex);
+    return fragments;
+  }
+  mysql_mutex_unlock(&mutex);
+
+  // List outside of the lock like the non empty domain
+  auto fragments = tile::load_fragment_listing(*ctx, *array);
+
+  mysql_mutex_lock(&mutex);
+  it = read_arrays.find(ctx_id);
+  if (it != read_arrays.end() && it->second.array == array) {
+    it->second.fragments = fragments;
+  }
+  mysql_mutex_unlock(&mutex);
+  return fragments;
+}
+
+void tile::mytile_share::invalidate() {
+  mysql_mutex_lock(&mutex);
+  uint64_t sequence = ++next_sequence;
+  for (auto &it : read_arrays) {
+    it.second.stale = true;
+    it.second.stale_sequence = sequence;
+    it.second.last_query_id = 0;
+  }
+  mysql_mutex_unlock(&mutex);
+}
+
+void tile::mytile_share::clear() {
+  mysql_mutex_lock(&mutex);
+  cleared_sequence = ++next_sequence;
+  read_arrays.clear();
+  mysql_mutex_unlock(&mutex);
+}
@@ -33,11 +33,20 @@
 #pragma once
 
 #include <handler.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <tiledb/tiledb>
+#include "mytile-metadata-aggregates.h"
+#include "mytile-non-empty-domain.h"
 
 namespace tile {
 /** @brief
 mytile_share is a class that will be shared among all open handlers.
-This mytile implements the minimum of what you will probably need.
+It caches the arrays opened for reads so handlers of the same table do not
+have to open the array, and load its fragment metadata, for every query.
 */
 
 class mytile_share : public Handler_share {
@@ -47,9 +56,112 @@ public:
 
   mytile_share();
 
-  ~mytile_share() override {
-    thr_lock_delete(&lock);
-    mysql_mutex_destroy(&mutex);
-  }
+  ~mytile_share() override;
+
+  /**
+   * Fetch the shared array opened for reads with the given context. The array
+   * is opened on first use and reopened when new fragments are detected
+   *
+   * @param ctx context the array is opened with
+   * @param ctx_id id of the context in the context pool
+   * @param uri array uri
+   * @param encryption_key encryption key, empty if array is not encrypted
+   * @param open_at timestamp to open the array at, UINT64_MAX for latest
+   * @param query_id statement id, fragments are checked once per statement
+   * @param check_interval minimum milliseconds between fragment checks
+   * @return array open for reads
+   */
+  std::shared_ptr<tiledb::Array>
+  get_read_array(const std::shared_ptr<tiledb::Context> &ctx, uint64_t ctx_id,
+                 const std::string &uri, const std::string &encryption_key,
+                 uint64_t open_at, uint64_t query_id, uint64_t check_interval);
+
+  /**
+   * Fetch the non empty domain of a shared array. It is computed once per
+   * opened snapshot and dropped when the array is reopened
+   *
+   * @param ctx context the array is opened with
+   * @param ctx_id id of the context in the context pool
+   * @param array shared array returned by get_read_array
+   * @param domain domain of the array
+   * @return non empty domain of the array snapshot
+   */
+  std::shared_ptr<const tile::non_empty_domain>
+  get_non_empty_domain(const std::shared_ptr<tiledb::Context> &ctx,
+                       uint64_t ctx_id,
+                       const std::shared_ptr<tiledb::Array> &array,
+                       const tiledb::Domain &domain);
+
+  /**
+   * Fetch the fragments of a shared array. They are listed once per opened
+   * snapshot and dropped when the array is reopened
+   *
+   * @param ctx context the array is opened with
+   * @param ctx_id id of the context in the context pool
+   * @param array shared array returned by get_read_array
+   * @return fragments of the array snapshot
+   */
+  std::shared_ptr<const tile::fragment_listing>
+  get_fragment_listing(const std::shared_ptr<tiledb::Context> &ctx,
+                       uint64_t ctx_id,
+                       const std::shared_ptr<tiledb::Array> &array);
+
+  /**
+   * Mark all shared arrays as stale so the next read reopens them, used after
+   * writes from this server
+   */
+  void invalidate();
+
+  /**
+   * Drop all shared arrays, used after schema evolution
+   */
+  void clear();
+
+private:
+  // A shared read array and the state used to detect new fragments
+  typedef struct shared_array {
+    // Context is held so it outlives the array, the entry is dropped once no
+    // handler holds the context anymore
+    std::shared_ptr<tiledb::Context> ctx;
+    std::shared_ptr<tiledb::Array> array;
+    // Non empty domain of the opened snapshot, loaded on first use
+    std::shared_ptr<const tile::non_empty_domain> non_empty_domain;
+    // Fragments of the opened snapshot, listed on first use
+    std::shared_ptr<const tile::fragment_listing> fragments;
+    // Hash of the fragment and commit listings when the array was opened
+    std::size_t fragments_signature = 0;
+    // Set when the listing can not be fetched, array is reopened on checks
+    bool signature_valid = false;
+    // Set on local writes, forces a reopen on next use
+    bool stale = false;
+    // Sequence of the check that installed the array, a check only installs
+    // its result over an older one
+    uint64_t sequence = 0;
+    // Sequence when the entry was marked stale, only checks started later see
+    // the write
+    uint64_t stale_sequence = 0;
+    uint64_t last_query_id = 0;
+    std::chrono::steady_clock::time_point last_check;
+  } shared_array;
+
+  /**
+   * Remove the entries whose context is only held by the share, so pooled
+   * contexts are released with the last handler using them. Caller must hold
+   * mutex
+   * @param released set to the removed entries, to be destroyed after the
+   * mutex is unlocked
+   */
+  void release_unused(std::vector<shared_array> &released);
+
+  // Shared arrays keyed by the pool id of the context they were opened with
+  std::unordered_map<uint64_t, shared_array> read_arrays;
+
+  // Orders the checks of shared arrays, which list and open outside of the
+  // mutex
+  uint64_t next_sequence = 0;
+
+  // Sequence when all shared arrays were dropped, checks started earlier do
+  // not install their arrays
+  uint64_t cleared_sequence = 0;
 };
-} // namespace tile
\ No newline at end of file
+} // namespace tile
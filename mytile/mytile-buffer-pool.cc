@@ -0,0 +1,225 @@
+/**
+ * @file   mytile-buffer-pool.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This implements the server wide pool of query buffers
+ */
+
+#include <my_global.h>
+
+#define MYSQL_SERVER 1
+
+#include "mytile-buffer-pool.h"
+#include "mytile-sysvars.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <sys/mman.h>
+
+namespace tile {
+namespace bufferpool {
+
+// Smallest size class, small regions are rounded up to a page
+static constexpr uint64_t MIN_CLASS_SIZE = 4096;
+
+// Regions of at least this size are classed by multiples of it, this is also
+// the size of a transparent huge page
+static constexpr uint64_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+static std::mutex pool_mutex;
+// Released regions by size class
+static std::unordered_map<uint64_t, std::vector<void *>> free_regions;
+// Size class of every region allocated and not freed. Kept apart from the
+// regions so they start right on their alignment, huge page regions on the
+// huge page boundary
+static std::unordered_map<void *, uint64_t> region_classes;
+static uint64_t pooled = 0;
+static uint64_t in_use = 0;
+static uint64_t high_water = 0;
+static std::atomic<uint64_t> pool_hits(0);
+static std::atomic<uint64_t> pool_misses(0);
+
+/**
+ * Round a size up to its size class, powers of two below the huge page size
+ * and multiples of the huge page size above it. Query buffers are sized from
+ * the same budget on every scan so the classes are reused exactly.
+ * @param size
+ * @return class size
+ */
+static uint64_t size_class(uint64_t size) {
+  if (size <= MIN_CLASS_SIZE)
+    return MIN_CLASS_SIZE;
+
+  if (size >= HUGE_PAGE_SIZE)
+    return (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+  uint64_t class_size = MIN_CLASS_SIZE;
+  while (class_size < size)
+    class_size <<= 1;
+  return class_size;
+}
+
+/**
+ * Allocate a new region, huge page regions span whole huge pages
+ * @param class_size
+ * @return region, nullptr on failure
+ */
+static void *allocate_region(uint64_t class_size) {
+  bool huge_pages = tile::sysvars::buffer_pool_huge_pages() &&
+                    class_size >= HUGE_PAGE_SIZE;
+  void *region = nullptr;
+  if (posix_memalign(&region, huge_pages ? HUGE_PAGE_SIZE : ALIGNMENT,
+                     class_size) != 0) {
+    return nullptr;
+  }
+
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    // Only advice, the kernel falls back to regular pages
+    madvise(region, class_size, MADV_HUGEPAGE);
+  }
+#endif
+
+  return region;
+}
+
+/**
+ * Remove pooled regions until the pool fits in the limit. Caller must hold
+ * pool_mutex
+ * @param limit
+ * @param evicted set to the regions to free
+ */
+static void trim(uint64_t limit, std::vector<void *> &evicted) {
+  for (auto it = free_regions.begin();
+       it != free_regions.end() && pooled > limit;) {
+    while (!it->second.empty() && pooled > limit) {
+      evicted.push_back(it->second.back());
+      region_classes.erase(it->second.back());
+      it->second.pop_back();
+      pooled -= it->first;
+    }
+    if (it->second.empty()) {
+      it = free_regions.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void *allocate(uint64_t size) {
+  uint64_t class_size = size_class(size);
+  void *region = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto it = free_regions.find(class_size);
+    if (it != free_regions.end() && !it->second.empty()) {
+      region = it->second.back();
+      it->second.pop_back();
+      pooled -= class_size;
+      in_use += class_size;
+      pool_hits++;
+      return region;
+    }
+  }
+
+  region = allocate_region(class_size);
+  if (region == nullptr)
+    return nullptr;
+  pool_misses++;
+
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  region_classes[region] = class_size;
+  in_use += class_size;
+  high_water = std::max(high_water, in_use + pooled);
+  return region;
+}
+
+void release(void *region) {
+  if (region == nullptr)
+    return;
+
+  uint64_t limit = tile::sysvars::buffer_pool_size();
+  std::vector<void *> evicted;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    auto region_class = region_classes.find(region);
+    if (region_class == region_classes.end()) {
+      // Not allocated by the pool, releases must not throw as they run while
+      // closing handlers
+      DBUG_ASSERT(0);
+      evicted.push_back(region);
+    } else {
+      uint64_t class_size = region_class->second;
+      in_use -= class_size;
+      // The limit might have been lowered since regions were pooled
+      trim(limit, evicted);
+      if (pooled + class_size <= limit) {
+        free_regions[class_size].push_back(region);
+        pooled += class_size;
+      } else {
+        evicted.push_back(region);
+        region_classes.erase(region);
+      }
+    }
+  }
+
+  for (void *evicted_region : evicted)
+    free(evicted_region);
+}
+
+void clear() {
+  std::vector<void *> evicted;
+  {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    trim(0, evicted);
+  }
+
+  for (void *evicted_region : evicted)
+    free(evicted_region);
+}
+
+uint64_t pooled_bytes() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  return pooled;
+}
+
+uint64_t hits() { return pool_hits; }
+
+uint64_t misses() { return pool_misses; }
+
+uint64_t high_water_mark() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  return high_water;
+}
+} // namespace bufferpool
+} // namespace tile
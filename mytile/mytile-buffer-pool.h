@@ -0,0 +1,94 @@
+/**
+ * @file   mytile-buffer-pool.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the server wide pool of query buffers
+ */
+
+#pragma once
+
+#ifndef MYTILE_BUFFER_POOL_H
+#define MYTILE_BUFFER_POOL_H
+
+#include <cstdint>
+
+namespace tile {
+namespace bufferpool {
+
+/**
+ * Alignment of every region handed out by the pool
+ */
+constexpr uint64_t ALIGNMENT = 64;
+
+/**
+ * Fetch a 64 byte aligned region of at least size bytes. Regions are size
+ * classed and a released region of the same class is handed back before new
+ * memory is allocated, so reused regions are already faulted in.
+ *
+ * @param size requested size in bytes
+ * @return region, nullptr if memory could not be allocated
+ */
+void *allocate(uint64_t size);
+
+/**
+ * Give a region back to the pool, it is freed instead if the pool would grow
+ * past mytile_buffer_pool_size
+ *
+ * @param region region returned by allocate, may be nullptr
+ */
+void release(void *region);
+
+/**
+ * Free all pooled regions, used on plugin shutdown
+ */
+void clear();
+
+/**
+ * @return bytes held by the pool and not in use
+ */
+uint64_t pooled_bytes();
+
+/**
+ * @return number of allocations served by a pooled region
+ */
+uint64_t hits();
+
+/**
+ * @return number of allocations which needed new memory
+ */
+uint64_t misses();
+
+/**
+ * @return highest number of bytes allocated through the pool, in use and
+ * pooled
+ */
+uint64_t high_water_mark();
+} // namespace bufferpool
+} // namespace tile
+
+#endif // MYTILE_BUFFER_POOL_H
@@ -0,0 +1,143 @@
+/**
+ * @file   mytile-context-pool.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This implements the server wide pool of TileDB contexts
+ */
+
+#include <my_global.h>
+
+#define MYSQL_SERVER 1
+
+#include "mytile-context-pool.h"
+#include "utils.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace tile {
+namespace contextpool {
+
+// A pooled context along with the config it was built from, the config is
+// kept to resolve hash collisions
+typedef struct pool_entry {
+  tiledb::Config config;
+  std::weak_ptr<tiledb::Context> ctx;
+  uint64_t id;
+} pool_entry;
+
+static std::mutex pool_mutex;
+static uint64_t next_context_id = 1;
+static std::unordered_multimap<std::size_t, pool_entry> pool;
+static std::atomic<uint64_t> pool_hits(0);
+static std::atomic<uint64_t> pool_misses(0);
+
+/**
+ * Hash all parameters of a config, this covers the tiledb_config session
+ * parameters as well as the encryption settings
+ * @param cfg
+ * @return hash
+ */
+static std::size_t hash_config(tiledb::Config cfg) {
+  std::string serialized;
+  for (auto &it : cfg) {
+    serialized.append(it.first);
+    serialized.push_back('=');
+    serialized.append(it.second);
+    serialized.push_back(';');
+  }
+  return std::hash<std::string>{}(serialized);
+}
+
+/**
+ * Remove entries whose context is no longer referenced by any handler.
+ * Caller must hold pool_mutex
+ */
+static void prune_expired() {
+  for (auto it = pool.begin(); it != pool.end();) {
+    if (it->second.ctx.expired()) {
+      it = pool.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::shared_ptr<tiledb::Context> get_context(const tiledb::Config &cfg,
+                                             uint64_t *id) {
+  std::size_t key = hash_config(cfg);
+
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  auto range = pool.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.config != cfg)
+      continue;
+
+    std::shared_ptr<tiledb::Context> ctx = it->second.ctx.lock();
+    if (ctx != nullptr) {
+      pool_hits++;
+      if (id != nullptr)
+        *id = it->second.id;
+      return ctx;
+    }
+  }
+
+  pool_misses++;
+  prune_expired();
+
+  tiledb::Config config = cfg;
+  auto ctx = std::make_shared<tiledb::Context>(build_context(config));
+  uint64_t ctx_id = next_context_id++;
+  pool.emplace(key, pool_entry{config, ctx, ctx_id});
+  if (id != nullptr)
+    *id = ctx_id;
+  return ctx;
+}
+
+void clear() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  pool.clear();
+}
+
+uint64_t size() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  uint64_t live = 0;
+  for (const auto &it : pool) {
+    if (!it.second.ctx.expired())
+      live++;
+  }
+  return live;
+}
+
+uint64_t hits() { return pool_hits; }
+
+uint64_t misses() { return pool_misses; }
+} // namespace contextpool
+} // namespace tile
@@ -0,0 +1,81 @@
+/**
+ * @file   mytile-context-pool.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the server wide pool of TileDB contexts
+ */
+
+#pragma once
+
+#ifndef MYTILE_CONTEXT_POOL_H
+#define MYTILE_CONTEXT_POOL_H
+
+#include <cstdint>
+#include <memory>
+#include <tiledb/tiledb>
+
+namespace tile {
+namespace contextpool {
+
+/**
+ * Fetch a context for the given config. Handlers whose effective config
+ * (including encryption settings) is identical share the same context, and
+ * with it the same thread pools, caches and VFS clients. A context stays in
+ * the pool as long as at least one handler holds a reference to it.
+ *
+ * @param cfg effective config
+ * @param id if set, receives the id of the context. Ids are never reused, so
+ * unlike addresses they identify a context after it has been released
+ * @return shared context
+ */
+std::shared_ptr<tiledb::Context> get_context(const tiledb::Config &cfg,
+                                             uint64_t *id = nullptr);
+
+/**
+ * Drop all pooled contexts, used on plugin shutdown
+ */
+void clear();
+
+/**
+ * @return number of live contexts in the pool
+ */
+uint64_t size();
+
+/**
+ * @return number of lookups served by an existing context
+ */
+uint64_t hits();
+
+/**
+ * @return number of lookups which had to build a new context
+ */
+uint64_t misses();
+} // namespace contextpool
+} // namespace tile
+
+#endif // MYTILE_CONTEXT_POOL_H
@@ -0,0 +1,180 @@
+/**
+ * @file   mytile-datetime.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ *
+ * @section DESCRIPTION
+ *
+ * This implements the conversion of epoch timestamps to MariaDB datetimes in a
+ * session time zone
+ */
+
+#include <my_global.h>
+
+#define MYSQL_SERVER 1
+
+#include "mytile-datetime.h"
+#include <tztime.h>
+
+// Seconds of the last second of 9999-12-31, the largest datetime
+static const int64_t MAX_DATETIME_SECONDS = 253402300799;
+
+static const int64_t SECONDS_PER_HOUR = 60 * 60;
+static const int64_t SECONDS_PER_DAY = SECONDS_PER_HOUR * 24;
+
+void tile::datetime_converter::reset(const Time_zone *tz) {
+  this->time_zone = tz;
+  this->cached_hour = -1;
+  this->cached_offset_valid = false;
+  this->cached_offset = 0;
+  this->cached_local_hour = -1;
+  this->cached_local_valid = false;
+  this->cached_local_start = 0;
+}
+
+void tile::datetime_converter::cache_hour(int64_t hour) {
+  my_time_t start = hour * SECONDS_PER_HOUR;
+  my_time_t end = start + SECONDS_PER_HOUR - 1;
+
+  MYSQL_TIME local;
+  this->time_zone->gmt_sec_to_TIME(&local, start);
+  int64_t start_offset = datetime_to_epoch_seconds(local) - start;
+  this->time_zone->gmt_sec_to_TIME(&local, end);
+  int64_t end_offset = datetime_to_epoch_seconds(local) - end;
+
+  this->cached_hour = hour;
+  this->cached_offset = start_offset;
+  this->cached_offset_valid = start_offset == end_offset;
+}
+
+void tile::datetime_converter::to_time(MYSQL_TIME *to, my_time_t seconds) {
+  // Values the offset cache can not cover go through the time zone
+  if (!datetime_seconds_cached(seconds)) {
+    this->time_zone->gmt_sec_to_TIME(to, seconds);
+    return;
+  }
+
+  int64_t hour = seconds / SECONDS_PER_HOUR;
+  if (hour != this->cached_hour)
+    cache_hour(hour);
+
+  if (!this->cached_offset_valid) {
+    this->time_zone->gmt_sec_to_TIME(to, seconds);
+    return;
+  }
+
+  epoch_seconds_to_datetime(to, seconds + this->cached_offset);
+}
+
+int64_t tile::datetime_converter::to_local_seconds(my_time_t seconds) {
+  if (datetime_seconds_cached(seconds)) {
+    int64_t hour = seconds / SECONDS_PER_HOUR;
+    if (hour != this->cached_hour)
+      cache_hour(hour);
+    if (this->cached_offset_valid)
+      return seconds + this->cached_offset;
+  }
+
+  MYSQL_TIME local;
+  this->time_zone->gmt_sec_to_TIME(&local, seconds);
+  return datetime_to_epoch_seconds(local);
+}
+
+my_time_t tile::datetime_converter::to_round_trip_seconds(my_time_t seconds) {
+  int64_t local_seconds = to_local_seconds(seconds);
+  uint error = 0;
+  MYSQL_TIME local;
+
+  // Every datetime of a local hour maps back to consecutive seconds, unless
+  // the offset changes within the hour
+  int64_t local_hour = local_seconds / SECONDS_PER_HOUR;
+  if (local_hour != this->cached_local_hour) {
+    epoch_seconds_to_datetime(&local, local_hour * SECONDS_PER_HOUR);
+    my_time_t start = this->time_zone->TIME_to_gmt_sec(&local, &error);
+    epoch_seconds_to_datetime(&local,
+                              (local_hour + 1) * SECONDS_PER_HOUR - 1);
+    my_time_t end = this->time_zone->TIME_to_gmt_sec(&local, &error);
+
+    this->cached_local_hour = local_hour;
+    this->cached_local_start = start;
+    this->cached_local_valid = end - start == SECONDS_PER_HOUR - 1;
+  }
+
+  if (this->cached_local_valid)
+    return this->cached_local_start + local_seconds % SECONDS_PER_HOUR;
+
+  epoch_seconds_to_datetime(&local, local_seconds);
+  return this->time_zone->TIME_to_gmt_sec(&local, &error);
+}
+
+int64_t tile::datetime_to_epoch_seconds(const MYSQL_TIME &time) {
+  // Days from civil, proleptic Gregorian calendar with March based years
+  int64_t year = time.year - (time.month <= 2);
+  int64_t era = (year >= 0 ? year : year - 399) / 400;
+  int64_t year_of_era = year - era * 400;
+  int64_t month = time.month;
+  int64_t day_of_year =
+      (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + time.day - 1;
+  int64_t day_of_era =
+      year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+  int64_t days = era * 146097 + day_of_era - 719468;
+
+  return days * SECONDS_PER_DAY + time.hour * SECONDS_PER_HOUR +
+         time.minute * 60 + time.second;
+}
+
+void tile::epoch_seconds_to_datetime(MYSQL_TIME *to, int64_t seconds) {
+  int64_t days = seconds / SECONDS_PER_DAY;
+  int64_t second_of_day = seconds % SECONDS_PER_DAY;
+
+  // Civil from days, proleptic Gregorian calendar with March based years
+  days += 719468;
+  int64_t era = days / 146097;
+  int64_t day_of_era = days - era * 146097;
+  int64_t year_of_era = (day_of_era - day_of_era / 1460 +
+                         day_of_era / 36524 - day_of_era / 146096) /
+                        365;
+  int64_t day_of_year =
+      day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  int64_t month_index = (5 * day_of_year + 2) / 153;
+  int64_t month = month_index < 10 ? month_index + 3 : month_index - 9;
+
+  to->year = static_cast<unsigned int>(year_of_era + era * 400 + (month <= 2));
+  to->month = static_cast<unsigned int>(month);
+  to->day =
+      static_cast<unsigned int>(day_of_year - (153 * month_index + 2) / 5 + 1);
+  to->hour = static_cast<unsigned int>(second_of_day / SECONDS_PER_HOUR);
+  to->minute = static_cast<unsigned int>(second_of_day / 60 % 60);
+  to->second = static_cast<unsigned int>(second_of_day % 60);
+  to->second_part = 0;
+  to->neg = false;
+  to->time_type = MYSQL_TIMESTAMP_DATETIME;
+}
+
+bool tile::datetime_seconds_cached(int64_t seconds) {
+  return seconds >= SECONDS_PER_DAY &&
+         seconds <= MAX_DATETIME_SECONDS - SECONDS_PER_DAY;
+}
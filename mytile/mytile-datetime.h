@@ -0,0 +1,139 @@
+/**
+ * @file   mytile-datetime.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the conversion of epoch timestamps to MariaDB datetimes in a
+ * session time zone
+ */
+
+#pragma once
+
+#ifndef MYTILE_DATETIME_H
+#define MYTILE_DATETIME_H
+
+#include <my_global.h>
+#include <mysql_time.h>
+#include <cstdint>
+
+class Time_zone;
+
+namespace tile {
+
+/**
+ * Converts epoch seconds to datetimes in a time zone. The UTC offset of the
+ * current hour is cached and the datetime is decomposed arithmetically, the
+ * time zone is only consulted when a value falls in another hour or in an hour
+ * with an offset change. Time zones never change offset twice within an hour.
+ */
+class datetime_converter {
+public:
+  /**
+   * Reset the converter for a time zone, must be called when the time zone
+   * may have changed, e.g. at the start of each scan
+   * @param tz
+   */
+  void reset(const Time_zone *tz);
+
+  /**
+   * Convert epoch seconds to a datetime in the time zone
+   * @param to
+   * @param seconds
+   */
+  void to_time(MYSQL_TIME *to, my_time_t seconds);
+
+  /**
+   * Convert epoch seconds to the seconds since the epoch of the datetime in
+   * the time zone, read as if it were in UTC
+   * @param seconds
+   * @return local seconds
+   */
+  int64_t to_local_seconds(my_time_t seconds);
+
+  /**
+   * Convert epoch seconds to a datetime in the time zone and back to epoch
+   * seconds, as UNIX_TIMESTAMP() does for DATETIME columns. The result only
+   * differs from the seconds for datetimes repeated when the offset decreases
+   * @param seconds
+   * @return epoch seconds of the local datetime
+   */
+  my_time_t to_round_trip_seconds(my_time_t seconds);
+
+private:
+  /**
+   * Cache the UTC offset of an hour since the epoch
+   * @param hour
+   */
+  void cache_hour(int64_t hour);
+
+  // Time zone values are converted to
+  const Time_zone *time_zone = nullptr;
+
+  // Hour since the epoch the offset is cached for, -1 if none
+  int64_t cached_hour = -1;
+
+  // The offset is the same for the whole cached hour
+  bool cached_offset_valid = false;
+
+  // UTC offset in seconds of the cached hour
+  int64_t cached_offset = 0;
+
+  // Local hour since the epoch the round trip is cached for, -1 if none
+  int64_t cached_local_hour = -1;
+
+  // Epoch seconds of the start of the cached local hour, if the whole hour
+  // maps back to consecutive seconds
+  bool cached_local_valid = false;
+  my_time_t cached_local_start = 0;
+};
+
+/**
+ * Seconds since the epoch of a datetime, ignoring time zones
+ * @param time
+ * @return seconds
+ */
+int64_t datetime_to_epoch_seconds(const MYSQL_TIME &time);
+
+/**
+ * Decompose seconds since the epoch into a datetime, ignoring time zones
+ * @param to
+ * @param seconds non negative seconds
+ */
+void epoch_seconds_to_datetime(MYSQL_TIME *to, int64_t seconds);
+
+/**
+ * Check if epoch seconds are converted without consulting the time zone for
+ * any UTC offset, they are at least a day away from the epoch and from the
+ * largest datetime
+ * @param seconds
+ * @return true if converted arithmetically
+ */
+bool datetime_seconds_cached(int64_t seconds);
+} // namespace tile
+
+#endif // MYTILE_DATETIME_H
@@ -31,6 +31,7 @@
  */
 
 #include "mytile-discovery.h"
+#include "mytile-context-pool.h"
 #include "mytile.h"
 #include "mytile-sysvars.h"
 #include "utils.h"
@@ -76,7 +77,9 @@ int tile::discover_array(THD *thd, TABLE_SHARE *ts, HA_CREATE_INFO *info) {
   }
 #endif
 
-  tiledb::Context ctx = build_context(config);
+  std::shared_ptr<tiledb::Context> pooled_ctx =
+      tile::contextpool::get_context(config);
+  tiledb::Context &ctx = *pooled_ctx;
 
   tiledb::VFS vfs(ctx);
 
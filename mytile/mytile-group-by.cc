@@ -0,0 +1,524 @@
+/**
+ * @file   mytile-group-by.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This implements the hash table aggregating the cells of a GROUP BY
+ */
+
+#include "mytile-group-by.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// Slots of an empty table, always a power of two
+static const uint64_t MIN_GROUP_SLOTS = 1024;
+
+// Group of a cell left to another partition
+static const uint64_t NO_GROUP = UINT64_MAX;
+
+/**
+ * FNV-1a hash of a key, mixed so the low bits pick slots and the high bits
+ * pick partitions
+ * @param key
+ * @param size
+ * @return hash
+ */
+static uint64_t hash_key(const char *key, uint64_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint64_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(key[i]);
+    hash *= 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+/**
+ * Member of an aggregate state holding values of a type
+ * @tparam T type of the values
+ * @param state
+ * @return sum or bound
+ */
+template <typename T>
+static auto &state_value(tile::group_aggregate_state &state) {
+  if constexpr (std::is_floating_point_v<T>)
+    return state.double_value;
+  else if constexpr (std::is_signed_v<T>)
+    return state.int_value;
+  else
+    return state.uint_value;
+}
+
+/**
+ * Calls a function with a value of the C++ type the cells of a datatype are
+ * aggregated as. Datetimes are epoch values and booleans single bytes
+ * @param type The datatype
+ * @param f function taking a value of the type
+ * @return false if the values of the type can only be counted
+ */
+template <typename F>
+static bool with_value_type(tiledb_datatype_t type, F &&f) {
+  switch (type) {
+  case TILEDB_FLOAT32:
+    f(float());
+    return true;
+  case TILEDB_FLOAT64:
+    f(double());
+    return true;
+  case TILEDB_INT8:
+    f(int8_t());
+    return true;
+  case TILEDB_UINT8:
+  case TILEDB_BOOL:
+    f(uint8_t());
+    return true;
+  case TILEDB_INT16:
+    f(int16_t());
+    return true;
+  case TILEDB_UINT16:
+    f(uint16_t());
+    return true;
+  case TILEDB_INT32:
+    f(int32_t());
+    return true;
+  case TILEDB_UINT32:
+    f(uint32_t());
+    return true;
+  case TILEDB_UINT64:
+    f(uint64_t());
+    return true;
+  case TILEDB_INT64:
+  case TILEDB_DATETIME_YEAR:
+  case TILEDB_DATETIME_MONTH:
+  case TILEDB_DATETIME_WEEK:
+  case TILEDB_DATETIME_DAY:
+  case TILEDB_DATETIME_HR:
+  case TILEDB_DATETIME_MIN:
+  case TILEDB_DATETIME_SEC:
+  case TILEDB_DATETIME_MS:
+  case TILEDB_DATETIME_US:
+  case TILEDB_DATETIME_NS:
+  case TILEDB_DATETIME_PS:
+  case TILEDB_DATETIME_FS:
+  case TILEDB_DATETIME_AS:
+  case TILEDB_TIME_HR:
+  case TILEDB_TIME_MIN:
+  case TILEDB_TIME_SEC:
+  case TILEDB_TIME_MS:
+  case TILEDB_TIME_US:
+  case TILEDB_TIME_NS:
+  case TILEDB_TIME_PS:
+  case TILEDB_TIME_FS:
+  case TILEDB_TIME_AS:
+    f(int64_t());
+    return true;
+  default:
+    return false;
+  }
+}
+
+/**
+ * Aggregate the cells of a column of a batch into the states of their groups
+ * @tparam T type of the column
+ * @param function aggregate function
+ * @param column cells of the batch
+ * @param cell_groups group of each cell
+ * @param states states of all groups
+ * @param stride aggregates per group
+ * @param aggregate index of the aggregate
+ */
+template <typename T>
+static void aggregate_column(tile::group_aggregate_function function,
+                             const tile::group_column &column,
+                             const std::vector<uint64_t> &cell_groups,
+                             std::vector<tile::group_aggregate_state> &states,
+                             uint64_t stride, size_t aggregate) {
+  const T *values = reinterpret_cast<const T *>(column.data);
+  for (uint64_t cell = 0; cell < cell_groups.size(); cell++) {
+    uint64_t group = cell_groups[cell];
+    if (group == NO_GROUP ||
+        (column.validity != nullptr && column.validity[cell] == 0))
+      continue;
+
+    tile::group_aggregate_state &state = states[group * stride + aggregate];
+    auto &value = state_value<T>(state);
+    switch (function) {
+    case tile::group_aggregate_function::SUM:
+    case tile::group_aggregate_function::AVG:
+      value += values[cell];
+      break;
+    case tile::group_aggregate_function::MIN:
+      if (state.values == 0 || values[cell] < value)
+        value = values[cell];
+      break;
+    case tile::group_aggregate_function::MAX:
+      if (state.values == 0 || values[cell] > value)
+        value = values[cell];
+      break;
+    case tile::group_aggregate_function::COUNT:
+      break;
+    }
+    state.values++;
+  }
+}
+
+/**
+ * Reduce the cells of a column of a batch into a single state. Each function
+ * has its own loop without branches, nulls are replaced by the identity of
+ * the reduction, so the loops vectorize
+ * @tparam T type of the column
+ * @param function aggregate function other than COUNT
+ * @param column cells of the batch
+ * @param cells cells in the batch
+ * @param state state of the only group
+ */
+template <typename T>
+static void reduce_column(tile::group_aggregate_function function,
+                          const tile::group_column &column, uint64_t cells,
+                          tile::group_aggregate_state &state) {
+  const T *values = reinterpret_cast<const T *>(column.data);
+  const uint8_t *validity = column.validity;
+  uint64_t valid = cells;
+  if (validity != nullptr) {
+    valid = 0;
+    for (uint64_t cell = 0; cell < cells; cell++)
+      valid += validity[cell] != 0;
+  }
+  if (valid == 0)
+    return;
+
+  auto &value = state_value<T>(state);
+  using value_type = std::remove_reference_t<decltype(value)>;
+  switch (function) {
+  case tile::group_aggregate_function::SUM:
+  case tile::group_aggregate_function::AVG: {
+    value_type sum = 0;
+    if (validity == nullptr) {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        sum += values[cell];
+    } else {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        sum += validity[cell] != 0 ? values[cell] : T(0);
+    }
+    value += sum;
+    break;
+  }
+  case tile::group_aggregate_function::MIN: {
+    T bound = std::numeric_limits<T>::max();
+    if (validity == nullptr) {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        bound = std::min(bound, values[cell]);
+    } else {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        bound = std::min(bound, validity[cell] != 0
+                                    ? values[cell]
+                                    : std::numeric_limits<T>::max());
+    }
+    if (state.values == 0 || bound < value)
+      value = bound;
+    break;
+  }
+  case tile::group_aggregate_function::MAX: {
+    T bound = std::numeric_limits<T>::lowest();
+    if (validity == nullptr) {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        bound = std::max(bound, values[cell]);
+    } else {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        bound = std::max(bound, validity[cell] != 0
+                                    ? values[cell]
+                                    : std::numeric_limits<T>::lowest());
+    }
+    if (state.values == 0 || bound > value)
+      value = bound;
+    break;
+  }
+  case tile::group_aggregate_function::COUNT:
+    break;
+  }
+  state.values += valid;
+}
+
+static const int64_t SECONDS_PER_HOUR = 60 * 60;
+static const int64_t SECONDS_PER_DAY = SECONDS_PER_HOUR * 24;
+
+/**
+ * Compute the buckets of datetimes, the loop of each unit only converts the
+ * epoch values and divides
+ * @tparam seconds_per_unit seconds of a unit of one second or more
+ * @tparam units_per_second units of a second for sub second units
+ */
+template <int64_t seconds_per_unit, int64_t units_per_second>
+static void bucket_datetimes(const int64_t *values, uint64_t cells,
+                             const tile::datetime_bucket &bucket,
+                             tile::datetime_converter &datetimes,
+                             int64_t *buckets) {
+  auto seconds = [values](uint64_t cell) {
+    return values[cell] * seconds_per_unit / units_per_second;
+  };
+
+  switch (bucket.unit) {
+  case tile::datetime_bucket_unit::INTERVAL:
+    if (!bucket.round_trip) {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        buckets[cell] = seconds(cell) / bucket.interval;
+    } else {
+      for (uint64_t cell = 0; cell < cells; cell++)
+        buckets[cell] =
+            datetimes.to_round_trip_seconds(seconds(cell)) / bucket.interval;
+    }
+    break;
+  case tile::datetime_bucket_unit::DAY:
+    for (uint64_t cell = 0; cell < cells; cell++)
+      buckets[cell] =
+          datetimes.to_local_seconds(seconds(cell)) / SECONDS_PER_DAY;
+    break;
+  case tile::datetime_bucket_unit::HOUR:
+    for (uint64_t cell = 0; cell < cells; cell++)
+      buckets[cell] =
+          datetimes.to_local_seconds(seconds(cell)) / SECONDS_PER_HOUR % 24;
+    break;
+  }
+}
+
+void tile::bucket_datetimes(const group_column &column, uint64_t cells,
+                            const datetime_bucket &bucket,
+                            datetime_converter &datetimes, int64_t *buckets) {
+  const int64_t *values = reinterpret_cast<const int64_t *>(column.data);
+  switch (column.type) {
+  case TILEDB_DATETIME_HR:
+    return ::bucket_datetimes<SECONDS_PER_HOUR, 1>(values, cells, bucket,
+                                                   datetimes, buckets);
+  case TILEDB_DATETIME_MIN:
+    return ::bucket_datetimes<60, 1>(values, cells, bucket, datetimes, buckets);
+  case TILEDB_DATETIME_SEC:
+    return ::bucket_datetimes<1, 1>(values, cells, bucket, datetimes, buckets);
+  case TILEDB_DATETIME_MS:
+    return ::bucket_datetimes<1, 1000>(values, cells, bucket, datetimes,
+                                       buckets);
+  case TILEDB_DATETIME_US:
+    return ::bucket_datetimes<1, 1000000>(values, cells, bucket, datetimes,
+                                          buckets);
+  case TILEDB_DATETIME_NS:
+    return ::bucket_datetimes<1, 1000000000>(values, cells, bucket, datetimes,
+                                             buckets);
+  case TILEDB_DATETIME_PS:
+    return ::bucket_datetimes<1, 1000000000000>(values, cells, bucket,
+                                                datetimes, buckets);
+  case TILEDB_DATETIME_FS:
+    return ::bucket_datetimes<1, 1000000000000000>(values, cells, bucket,
+                                                   datetimes, buckets);
+  case TILEDB_DATETIME_AS:
+    return ::bucket_datetimes<1, 1000000000000000000>(values, cells, bucket,
+                                                      datetimes, buckets);
+  default:
+    throw tiledb::TileDBError(
+        std::string("Unknown or Unsupported type for datetime buckets"));
+  }
+}
+
+int64_t tile::datetime_epoch_seconds(int64_t value, tiledb_datatype_t type) {
+  switch (type) {
+  case TILEDB_DATETIME_HR:
+    return value * SECONDS_PER_HOUR;
+  case TILEDB_DATETIME_MIN:
+    return value * 60;
+  case TILEDB_DATETIME_SEC:
+    return value;
+  case TILEDB_DATETIME_MS:
+    return value / 1000;
+  case TILEDB_DATETIME_US:
+    return value / 1000000;
+  case TILEDB_DATETIME_NS:
+    return value / 1000000000;
+  case TILEDB_DATETIME_PS:
+    return value / 1000000000000;
+  case TILEDB_DATETIME_FS:
+    return value / 1000000000000000;
+  case TILEDB_DATETIME_AS:
+    return value / 1000000000000000000;
+  default:
+    throw tiledb::TileDBError(
+        std::string("Unknown or Unsupported type for datetime buckets"));
+  }
+}
+
+tile::group_by_table::group_by_table(const std::vector<group_column> &columns,
+                                     std::vector<size_t> key_columns,
+                                     std::vector<group_aggregate> aggregates)
+    : key_columns(std::move(key_columns)), aggregates(std::move(aggregates)) {
+  for (size_t column : this->key_columns) {
+    bool nullable = columns[column].validity != nullptr;
+    this->key_offsets.push_back(this->key_size);
+    this->key_nullable.push_back(nullable);
+    this->key_size += columns[column].cell_size + (nullable ? 1 : 0);
+  }
+  this->key.resize(this->key_size);
+  clear();
+}
+
+uint64_t tile::group_by_table::find_or_insert(const char *key, uint64_t hash) {
+  uint64_t mask = this->slots.size() - 1;
+  for (uint64_t slot = hash & mask;; slot = (slot + 1) & mask) {
+    uint64_t entry = this->slots[slot];
+    if (entry == 0) {
+      // New group, the table is kept at most half full
+      uint64_t group = this->hashes.size();
+      this->keys.insert(this->keys.end(), key, key + this->key_size);
+      this->hashes.push_back(hash);
+      this->states.resize(this->states.size() + this->aggregates.size());
+      this->slots[slot] = group + 1;
+      if (2 * this->hashes.size() > this->slots.size())
+        grow();
+      return group;
+    }
+
+    uint64_t group = entry - 1;
+    if (this->hashes[group] == hash &&
+        memcmp(this->keys.data() + group * this->key_size, key,
+               this->key_size) == 0)
+      return group;
+  }
+}
+
+void tile::group_by_table::grow() {
+  std::vector<uint64_t> grown(2 * this->slots.size(), 0);
+  uint64_t mask = grown.size() - 1;
+  for (uint64_t group = 0; group < this->hashes.size(); group++) {
+    uint64_t slot = this->hashes[group] & mask;
+    while (grown[slot] != 0)
+      slot = (slot + 1) & mask;
+    grown[slot] = group + 1;
+  }
+  this->slots = std::move(grown);
+}
+
+void tile::group_by_table::aggregate_batch(
+    const std::vector<group_column> &columns, uint64_t rows,
+    uint64_t partitions, uint64_t partition) {
+  // Groups of the cells are found first, then every aggregate runs over its
+  // column. Without grouping columns every cell is in the only group
+  this->cell_groups.assign(rows, this->key_columns.empty() ? 0 : NO_GROUP);
+  for (uint64_t cell = 0; cell < rows && !this->key_columns.empty(); cell++) {
+    for (size_t i = 0; i < this->key_columns.size(); i++) {
+      const group_column &column = columns[this->key_columns[i]];
+      char *part = this->key.data() + this->key_offsets[i];
+      bool valid = column.validity == nullptr || column.validity[cell] != 0;
+      if (valid) {
+        memcpy(part, column.data + cell * column.cell_size, column.cell_size);
+      } else {
+        memset(part, 0, column.cell_size);
+      }
+      if (this->key_nullable[i])
+        part[column.cell_size] = valid ? 1 : 0;
+    }
+
+    uint64_t hash = hash_key(this->key.data(), this->key_size);
+    if (partitions > 1 && (hash >> 32) % partitions != partition)
+      continue;
+    this->cell_groups[cell] = find_or_insert(this->key.data(), hash);
+  }
+
+  uint64_t stride = this->aggregates.size();
+  for (size_t aggregate = 0; aggregate < this->aggregates.size();
+       aggregate++) {
+    const group_aggregate &aggr = this->aggregates[aggregate];
+    const group_column *column =
+        aggr.column == SIZE_MAX ? nullptr : &columns[aggr.column];
+
+    // Values of multi value cells and of other types are only counted
+    bool reduced =
+        column != nullptr &&
+        aggr.function != group_aggregate_function::COUNT &&
+        column->cell_size == tiledb_datatype_size(column->type) &&
+        with_value_type(column->type, [&](auto type_value) {
+          using T = decltype(type_value);
+          if (this->key_columns.empty())
+            reduce_column<T>(aggr.function, *column, rows,
+                             this->states[aggregate]);
+          else
+            aggregate_column<T>(aggr.function, *column, this->cell_groups,
+                                this->states, stride, aggregate);
+        });
+    if (reduced)
+      continue;
+
+    // Every cell with a value is counted
+    for (uint64_t cell = 0; cell < rows; cell++) {
+      uint64_t group = this->cell_groups[cell];
+      if (group != NO_GROUP &&
+          (column == nullptr || column->validity == nullptr ||
+           column->validity[cell] != 0))
+        this->states[group * stride + aggregate].values++;
+    }
+  }
+}
+
+uint64_t tile::group_by_table::size() const { return this->hashes.size(); }
+
+uint64_t tile::group_by_table::memory() const {
+  return this->keys.capacity() + this->hashes.capacity() * sizeof(uint64_t) +
+         this->states.capacity() * sizeof(group_aggregate_state) +
+         this->slots.capacity() * sizeof(uint64_t);
+}
+
+void tile::group_by_table::clear() {
+  // The storage is released, the memory of the next partition is measured
+  // from its own groups
+  std::vector<char>().swap(this->keys);
+  std::vector<uint64_t>().swap(this->hashes);
+  std::vector<group_aggregate_state>().swap(this->states);
+  std::vector<uint64_t>(MIN_GROUP_SLOTS, 0).swap(this->slots);
+
+  // Without grouping columns there is a single group, even without cells
+  if (this->key_columns.empty())
+    find_or_insert(this->key.data(), hash_key(this->key.data(), 0));
+}
+
+const char *tile::group_by_table::key_value(uint64_t group,
+                                            size_t key_column) const {
+  uint64_t offset = this->key_offsets[key_column];
+  const char *key = this->keys.data() + group * this->key_size;
+
+  // The validity byte is the last one of the column in the key
+  uint64_t end = key_column + 1 < this->key_offsets.size()
+                     ? this->key_offsets[key_column + 1]
+                     : this->key_size;
+  if (this->key_nullable[key_column] && key[end - 1] == 0)
+    return nullptr;
+  return key + offset;
+}
+
+const tile::group_aggregate_state &
+tile::group_by_table::state(uint64_t group, size_t aggregate) const {
+  return this->states[group * this->aggregates.size() + aggregate];
+}
@@ -0,0 +1,236 @@
+/**
+ * @file   mytile-group-by.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the hash table aggregating the cells of a GROUP BY
+ */
+
+#pragma once
+
+#ifndef MYTILE_GROUP_BY_H
+#define MYTILE_GROUP_BY_H
+
+#include "mytile-datetime.h"
+#include <cstdint>
+#include <string>
+#include <tiledb/tiledb>
+#include <vector>
+
+namespace tile {
+/**
+ * Aggregate functions computed per group
+ */
+enum class group_aggregate_function { COUNT, SUM, AVG, MIN, MAX };
+
+/**
+ * An aggregate computed per group
+ */
+typedef struct group_aggregate {
+  group_aggregate_function function;
+  // Index of the column aggregated, SIZE_MAX when every cell is counted
+  size_t column = SIZE_MAX;
+} group_aggregate;
+
+/**
+ * State of an aggregate of a group. Sums and bounds are kept in the member
+ * matching the type of the column
+ */
+typedef struct group_aggregate_state {
+  // Non null values aggregated
+  uint64_t values = 0;
+  int64_t int_value = 0;
+  uint64_t uint_value = 0;
+  double double_value = 0;
+} group_aggregate_state;
+
+/**
+ * Cells of a fixed size column read in a batch
+ */
+typedef struct group_column {
+  // Datatype of the column
+  tiledb_datatype_t type = TILEDB_ANY;
+  // Bytes of a cell
+  uint64_t cell_size = 0;
+  // Cells of the batch
+  const char *data = nullptr;
+  // Validity of the cells, nullptr if the column is not nullable
+  const uint8_t *validity = nullptr;
+} group_column;
+
+/**
+ * Units datetimes are grouped by
+ */
+enum class datetime_bucket_unit {
+  // Epoch seconds divided by an interval, FLOOR(UNIX_TIMESTAMP(ts) / n)
+  INTERVAL,
+  // Local day, DATE(ts)
+  DAY,
+  // Local hour of the day, HOUR(ts)
+  HOUR
+};
+
+/**
+ * Buckets a datetime grouping expression puts the cells of a datetime column
+ * in
+ */
+typedef struct datetime_bucket {
+  datetime_bucket_unit unit = datetime_bucket_unit::INTERVAL;
+  // Seconds of an interval
+  int64_t interval = 1;
+  // Set if intervals count the seconds of the local datetime converted back
+  // to UTC, as UNIX_TIMESTAMP() does for DATETIME columns
+  bool round_trip = false;
+} datetime_bucket;
+
+/**
+ * Compute the buckets of the cells of a datetime column read in a batch
+ * straight from their epoch values. The cells must be within the range
+ * datetime_seconds_cached accepts
+ * @param column cells of a TILEDB_DATETIME_HR to TILEDB_DATETIME_AS column
+ * @param cells cells in the batch
+ * @param bucket the buckets
+ * @param datetimes converter to the session time zone
+ * @param buckets bucket of each cell
+ */
+void bucket_datetimes(const group_column &column, uint64_t cells,
+                      const datetime_bucket &bucket,
+                      datetime_converter &datetimes, int64_t *buckets);
+
+/**
+ * Seconds of a datetime read from a TILEDB_DATETIME_HR to TILEDB_DATETIME_AS
+ * column, sub second units are truncated
+ * @param value epoch value in the unit of the type
+ * @param type datetime type
+ * @return epoch seconds
+ */
+int64_t datetime_epoch_seconds(int64_t value, tiledb_datatype_t type);
+
+/**
+ * Open addressing hash table of the groups of a GROUP BY. Keys are the raw
+ * cells of the grouping columns, a nullable column adds a validity byte and
+ * zeroes the cell of nulls so every null falls in the same group. Without
+ * grouping columns the table holds a single group whose aggregates reduce
+ * whole batches
+ */
+class group_by_table {
+public:
+  /**
+   * @param columns all columns read, their data is set for each batch
+   * @param key_columns indexes of the grouping columns in columns
+   * @param aggregates aggregates computed per group
+   */
+  group_by_table(const std::vector<group_column> &columns,
+                 std::vector<size_t> key_columns,
+                 std::vector<group_aggregate> aggregates);
+
+  /**
+   * Aggregate a batch of cells into their groups. Only groups of one hash
+   * partition are kept, the others are left to another scan
+   * @param columns columns with the cells of the batch
+   * @param rows cells in the batch
+   * @param partitions number of hash partitions of the groups
+   * @param partition the partition kept
+   */
+  void aggregate_batch(const std::vector<group_column> &columns, uint64_t rows,
+                       uint64_t partitions, uint64_t partition);
+
+  /**
+   * @return number of groups
+   */
+  uint64_t size() const;
+
+  /**
+   * @return bytes allocated for the groups and their slots
+   */
+  uint64_t memory() const;
+
+  /**
+   * Remove all groups
+   */
+  void clear();
+
+  /**
+   * Value of a grouping column for a group
+   * @param group index of the group
+   * @param key_column index of the column in the key columns
+   * @return cell of the column, nullptr if it is null
+   */
+  const char *key_value(uint64_t group, size_t key_column) const;
+
+  /**
+   * State of an aggregate for a group
+   * @param group index of the group
+   * @param aggregate index of the aggregate
+   * @return state
+   */
+  const group_aggregate_state &state(uint64_t group, size_t aggregate) const;
+
+private:
+  /**
+   * Find the group of a key, adding it if new
+   * @param key the key
+   * @param hash hash of the key
+   * @return index of the group
+   */
+  uint64_t find_or_insert(const char *key, uint64_t hash);
+
+  /**
+   * Double the slots and place every group again
+   */
+  void grow();
+
+  // Columns the key is built from and their offsets in the key
+  std::vector<size_t> key_columns;
+  std::vector<uint64_t> key_offsets;
+  std::vector<bool> key_nullable;
+
+  // Bytes of a key
+  uint64_t key_size = 0;
+
+  // Aggregates computed per group
+  std::vector<group_aggregate> aggregates;
+
+  // Keys of the groups, key_size bytes each
+  std::vector<char> keys;
+
+  // Hashes of the group keys
+  std::vector<uint64_t> hashes;
+
+  // Aggregate states, one per aggregate for each group
+  std::vector<group_aggregate_state> states;
+
+  // Slots holding a group index plus one, zero when empty
+  std::vector<uint64_t> slots;
+
+  // Key of the current cell and group of each cell of the batch
+  std::string key;
+  std::vector<uint64_t> cell_groups;
+};
+} // namespace tile
+
+#endif // MYTILE_GROUP_BY_H
@@ -0,0 +1,642 @@
+/**
+ * @file   mytile-metadata-aggregates.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This implements aggregates answered from array metadata without reading tiles
+ */
+
+#include "mytile-metadata-aggregates.h"
+#include "mytile-range.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <istream>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Fragments of arrays without duplicates are compared pairwise for overlaps,
+// counting more than this many is left to a scan
+static const uint64_t MAX_COUNTED_FRAGMENTS = 256;
+
+// Partially covered fragments are each scanned by a query, reads partially
+// covering more than this many are left to a single scan of the ranges
+static const uint64_t MAX_SCANNED_FRAGMENTS = 64;
+
+// Lower and upper bound of a dimension as raw bytes
+typedef std::pair<std::string, std::string> raw_bounds;
+
+/**
+ * Collect the ranges of a dense dimension, sorted by their lower bound
+ * @tparam T type of the dimension
+ * @return ranges, nullopt if they overlap or leave the non empty domain
+ */
+template <typename T>
+static std::optional<std::vector<std::pair<T, T>>>
+dense_dimension_ranges(tiledb::Context &ctx, const tiledb::Subarray &subarray,
+                       uint32_t dim_idx, const std::vector<uint8_t> &bounds) {
+  const T *non_empty = reinterpret_cast<const T *>(bounds.data());
+  std::vector<std::pair<T, T>> ranges;
+  for (uint64_t range_idx = 0; range_idx < subarray.range_num(dim_idx);
+       range_idx++) {
+    const void *start, *end, *stride;
+    ctx.handle_error(tiledb_subarray_get_range(ctx.ptr().get(),
+                                               subarray.ptr().get(), dim_idx,
+                                               range_idx, &start, &end,
+                                               &stride));
+    T lower = *static_cast<const T *>(start);
+    T upper = *static_cast<const T *>(end);
+    if (lower > upper || lower < non_empty[0] || upper > non_empty[1])
+      return std::nullopt;
+    ranges.emplace_back(lower, upper);
+  }
+
+  std::sort(ranges.begin(), ranges.end());
+  for (size_t i = 1; i < ranges.size(); i++) {
+    if (ranges[i].first <= ranges[i - 1].second)
+      return std::nullopt;
+  }
+  return ranges;
+}
+
+/**
+ * Number of cells the ranges of a dense dimension cover
+ * @tparam T type of the dimension
+ * @return cells, nullopt if the ranges can not be counted
+ */
+template <typename T>
+static std::optional<uint64_t>
+dense_dimension_cells(tiledb::Context &ctx, const tiledb::Subarray &subarray,
+                      uint32_t dim_idx, const std::vector<uint8_t> &bounds) {
+  auto ranges = dense_dimension_ranges<T>(ctx, subarray, dim_idx, bounds);
+  if (!ranges.has_value())
+    return std::nullopt;
+
+  uint64_t cells = 0;
+  for (const auto &range : *ranges) {
+    // Unsigned arithmetic gives the width of signed ranges too, it only wraps
+    // to zero for a range spanning all 64 bit values
+    uint64_t width = static_cast<uint64_t>(range.second) -
+                     static_cast<uint64_t>(range.first) + 1;
+    if (width == 0 || cells > UINT64_MAX - width)
+      return std::nullopt;
+    cells += width;
+  }
+  return cells;
+}
+
+/**
+ * Lowest or highest value the ranges of a dense dimension cover
+ * @tparam T type of the dimension
+ * @return value as raw bytes, nullopt if the ranges can not be used
+ */
+template <typename T>
+static std::optional<std::string>
+dense_dimension_bound(tiledb::Context &ctx, const tiledb::Subarray &subarray,
+                      uint32_t dim_idx, const std::vector<uint8_t> &bounds,
+                      bool upper) {
+  auto ranges = dense_dimension_ranges<T>(ctx, subarray, dim_idx, bounds);
+  if (!ranges.has_value() || ranges->empty())
+    return std::nullopt;
+
+  // Ranges are sorted and disjoint
+  T value = upper ? ranges->back().second : ranges->front().first;
+  return std::string(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/**
+ * Dispatch on the datatype of a dense dimension, dense dimensions are always
+ * integers or datetimes
+ */
+#define DENSE_DIMENSION_DISPATCH(type, fn, ...)                               \
+  switch (type) {                                                             \
+  case TILEDB_INT8:                                                           \
+    return fn<int8_t>(__VA_ARGS__);                                           \
+  case TILEDB_UINT8:                                                          \
+    return fn<uint8_t>(__VA_ARGS__);                                          \
+  case TILEDB_INT16:                                                          \
+    return fn<int16_t>(__VA_ARGS__);                                          \
+  case TILEDB_UINT16:                                                         \
+    return fn<uint16_t>(__VA_ARGS__);                                         \
+  case TILEDB_INT32:                                                          \
+    return fn<int32_t>(__VA_ARGS__);                                          \
+  case TILEDB_UINT32:                                                         \
+    return fn<uint32_t>(__VA_ARGS__);                                         \
+  case TILEDB_UINT64:                                                         \
+    return fn<uint64_t>(__VA_ARGS__);                                         \
+  default:                                                                    \
+    if (tile::TileDBDateTimeType(type) || type == TILEDB_INT64)             \
+      return fn<int64_t>(__VA_ARGS__);                                        \
+    return std::nullopt;                                                      \
+  }
+
+static std::optional<uint64_t>
+dense_cell_count(tiledb::Context &ctx, const tiledb::Domain &domain,
+                 const tile::non_empty_domain &non_empty_domain,
+                 const tiledb::Subarray &subarray, uint32_t dim_idx) {
+  DENSE_DIMENSION_DISPATCH(domain.dimension(dim_idx).type(),
+                           dense_dimension_cells, ctx, subarray, dim_idx,
+                           non_empty_domain.fixed[dim_idx]);
+}
+
+static std::optional<std::string>
+dense_bound(tiledb::Context &ctx, const tiledb::Domain &domain,
+            const tile::non_empty_domain &non_empty_domain,
+            const tiledb::Subarray &subarray, uint32_t dim_idx, bool upper) {
+  DENSE_DIMENSION_DISPATCH(domain.dimension(dim_idx).type(),
+                           dense_dimension_bound, ctx, subarray, dim_idx,
+                           non_empty_domain.fixed[dim_idx], upper);
+}
+
+#undef DENSE_DIMENSION_DISPATCH
+
+/**
+ * Compares two bounds of a dimension
+ * @return negative if lhs is lower than rhs, 0 if equal, positive if higher
+ */
+static int compare_bounds(const std::string &lhs, const std::string &rhs,
+                          const tiledb::Dimension &dimension) {
+  if (dimension.cell_val_num() == TILEDB_VAR_NUM)
+    return lhs.compare(rhs);
+  return tile::compare_typed_buffers(lhs.data(), rhs.data(), lhs.size(),
+                                     dimension.type());
+}
+
+/**
+ * Check if two ranges of a dimension intersect
+ */
+static bool bounds_intersect(const raw_bounds &lhs, const raw_bounds &rhs,
+                             const tiledb::Dimension &dimension) {
+  return compare_bounds(lhs.first, rhs.second, dimension) <= 0 &&
+         compare_bounds(rhs.first, lhs.second, dimension) <= 0;
+}
+
+/**
+ * Check if the non empty domains of two fragments intersect
+ */
+static bool
+fragments_overlap(const std::vector<raw_bounds> &lhs,
+                  const std::vector<raw_bounds> &rhs,
+                  const std::vector<tiledb::Dimension> &dimensions) {
+  for (size_t dim_idx = 0; dim_idx < dimensions.size(); dim_idx++) {
+    if (!bounds_intersect(lhs[dim_idx], rhs[dim_idx], dimensions[dim_idx]))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Non empty domain of a fragment on a dimension
+ */
+static raw_bounds fragment_bounds(tiledb::FragmentInfo &info,
+                                  const tiledb::Dimension &dimension,
+                                  uint32_t fid, uint32_t dim_idx) {
+  if (dimension.cell_val_num() == TILEDB_VAR_NUM)
+    return info.non_empty_domain_var(fid, dim_idx);
+
+  uint64_t size = tiledb_datatype_size(dimension.type());
+  std::string bounds(size * 2, '\0');
+  info.non_empty_domain(fid, dim_idx, bounds.data());
+  return raw_bounds(bounds.substr(0, size), bounds.substr(size));
+}
+
+/**
+ * Check if delete commits were written within a timestamp range. Fragment
+ * metadata still counts the cells they delete, only a read drops them
+ * @param ctx context
+ * @param uri array uri
+ * @param timestamp_start start of the range
+ * @param timestamp_end end of the range
+ * @return true if the range might hold delete commits
+ */
+static bool has_delete_commits(tiledb::Context &ctx, const std::string &uri,
+                               uint64_t timestamp_start,
+                               uint64_t timestamp_end) {
+  tiledb::VFS vfs(ctx);
+  std::string commits_dir = uri + "/__commits";
+  if (!vfs.is_dir(commits_dir))
+    return false;
+
+  for (const std::string &commit : vfs.ls(commits_dir)) {
+    std::string name = commit.substr(commit.find_last_of('/') + 1);
+    if (tile::has_ending(name, ".con")) {
+      // Consolidated commits list the names of the commits they hold
+      tiledb::VFS::filebuf buffer(vfs);
+      buffer.open(commit, std::ios::in);
+      std::istream stream(&buffer);
+      std::string listing((std::istreambuf_iterator<char>(stream)),
+                          std::istreambuf_iterator<char>());
+      if (listing.find(".del") != std::string::npos)
+        return true;
+      continue;
+    }
+    if (!tile::has_ending(name, ".del"))
+      continue;
+
+    // Commits are named __<start>_<end>_<uuid>_<version>
+    unsigned long long start = 0;
+    unsigned long long end = 0;
+    if (sscanf(name.c_str(), "__%llu_%llu_", &start, &end) != 2 ||
+        (end >= timestamp_start && start <= timestamp_end))
+      return true;
+  }
+  return false;
+}
+
+std::shared_ptr<const tile::fragment_listing>
+tile::load_fragment_listing(tiledb::Context &ctx, tiledb::Array &array) {
+  auto listing = std::make_shared<tile::fragment_listing>();
+  try {
+    tiledb::ArraySchema schema = array.schema();
+    // Dense reads are answered from their ranges
+    if (schema.array_type() != TILEDB_SPARSE)
+      return listing;
+
+    // Cells removed by delete commits are only known from a scan
+    uint64_t timestamp_start = array.open_timestamp_start();
+    uint64_t timestamp_end = array.open_timestamp_end();
+    if (has_delete_commits(ctx, array.uri(), timestamp_start, timestamp_end))
+      return listing;
+
+    std::vector<tiledb::Dimension> dimensions = schema.domain().dimensions();
+    tiledb::FragmentInfo info(ctx, array.uri());
+    info.load();
+
+    // Only fragments written within the timestamps the array is opened at are
+    // read. Reads of fragments spanning a bound only return some of their
+    // cells
+    std::vector<uint32_t> fragments;
+    for (uint32_t fid = 0; fid < info.fragment_num(); fid++) {
+      auto timestamps = info.timestamp_range(fid);
+      if (timestamps.second < timestamp_start ||
+          timestamps.first > timestamp_end)
+        continue;
+      if (timestamps.first < timestamp_start ||
+          timestamps.second > timestamp_end)
+        return listing;
+      fragments.push_back(fid);
+    }
+
+    for (uint32_t fid : fragments) {
+      listing->cells.push_back(info.cell_num(fid));
+    }
+    if (fragments.size() <= MAX_COUNTED_FRAGMENTS) {
+      for (uint32_t fid : fragments) {
+        std::vector<raw_bounds> bounds;
+        for (uint32_t dim_idx = 0; dim_idx < dimensions.size(); dim_idx++) {
+          bounds.push_back(
+              fragment_bounds(info, dimensions[dim_idx], fid, dim_idx));
+        }
+        listing->bounds.push_back(std::move(bounds));
+      }
+    }
+    listing->listed = true;
+  } catch (const tiledb::TileDBError &e) {
+    // Metadata that can not be loaded, e.g. of encrypted fragments, leaves the
+    // aggregates to a scan
+    listing = std::make_shared<tile::fragment_listing>();
+  }
+  return listing;
+}
+
+/**
+ * Number of cells of all fragments visible to an opened sparse array
+ * @return cells, nullopt if fragments may hold the same coordinates
+ */
+static std::optional<uint64_t>
+sparse_cell_count(tiledb::Array &array,
+                  const tile::fragment_listing &fragments) {
+  if (!fragments.listed)
+    return std::nullopt;
+
+  // Without duplicates a later fragment replaces the cells of an earlier one
+  // at the same coordinates, the counts only add up if no fragments overlap
+  tiledb::ArraySchema schema = array.schema();
+  if (!schema.allows_dups()) {
+    if (fragments.bounds.size() != fragments.cells.size())
+      return std::nullopt;
+    std::vector<tiledb::Dimension> dimensions = schema.domain().dimensions();
+    for (size_t i = 0; i < fragments.bounds.size(); i++) {
+      for (size_t j = i + 1; j < fragments.bounds.size(); j++) {
+        if (fragments_overlap(fragments.bounds[i], fragments.bounds[j],
+                              dimensions))
+          return std::nullopt;
+      }
+    }
+  }
+
+  uint64_t cells = 0;
+  for (uint64_t fragment_cells : fragments.cells)
+    cells += fragment_cells;
+  return cells;
+}
+
+/**
+ * Ranges of a dimension set on a subarray
+ */
+static std::vector<raw_bounds>
+subarray_ranges(tiledb::Context &ctx, const tiledb::Subarray &subarray,
+                const tiledb::Dimension &dimension, uint32_t dim_idx) {
+  std::vector<raw_bounds> ranges;
+  for (uint64_t range_idx = 0; range_idx < subarray.range_num(dim_idx);
+       range_idx++) {
+    if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
+      uint64_t start_size, end_size;
+      ctx.handle_error(tiledb_subarray_get_range_var_size(
+          ctx.ptr().get(), subarray.ptr().get(), dim_idx, range_idx,
+          &start_size, &end_size));
+      raw_bounds range(std::string(start_size, '\0'),
+                       std::string(end_size, '\0'));
+      ctx.handle_error(tiledb_subarray_get_range_var(
+          ctx.ptr().get(), subarray.ptr().get(), dim_idx, range_idx,
+          range.first.data(), range.second.data()));
+      ranges.push_back(std::move(range));
+    } else {
+      const void *start, *end, *stride;
+      ctx.handle_error(tiledb_subarray_get_range(ctx.ptr().get(),
+                                                 subarray.ptr().get(), dim_idx,
+                                                 range_idx, &start, &end,
+                                                 &stride));
+      uint64_t size = tiledb_datatype_size(dimension.type());
+      ranges.emplace_back(std::string(static_cast<const char *>(start), size),
+                          std::string(static_cast<const char *>(end), size));
+    }
+  }
+  return ranges;
+}
+
+/**
+ * How the ranges of a read cover the non empty domain of a fragment
+ */
+enum class fragment_coverage { COVERED, PARTIAL, MISSED };
+
+/**
+ * Checks how the ranges of a read cover a fragment. A fragment is fully
+ * covered if a single range of every dimension holds its non empty domain
+ * @param bounds non empty domain of the fragment on each dimension
+ * @param ranges ranges of the read on each dimension
+ * @param dimensions dimensions of the array
+ * @return coverage of the fragment
+ */
+static fragment_coverage
+cover_fragment(const std::vector<raw_bounds> &bounds,
+               const std::vector<std::vector<raw_bounds>> &ranges,
+               const std::vector<tiledb::Dimension> &dimensions) {
+  bool covered = true;
+  for (size_t dim_idx = 0; dim_idx < dimensions.size(); dim_idx++) {
+    const tiledb::Dimension &dimension = dimensions[dim_idx];
+    const raw_bounds &fragment = bounds[dim_idx];
+    bool intersected = false;
+    bool dim_covered = false;
+    for (const raw_bounds &range : ranges[dim_idx]) {
+      if (!bounds_intersect(range, fragment, dimension))
+        continue;
+      intersected = true;
+      if (compare_bounds(range.first, fragment.first, dimension) <= 0 &&
+          compare_bounds(fragment.second, range.second, dimension) <= 0) {
+        dim_covered = true;
+        break;
+      }
+    }
+
+    // No cell of the fragment lies in the ranges of this dimension
+    if (!intersected)
+      return fragment_coverage::MISSED;
+    covered = covered && dim_covered;
+  }
+  return covered ? fragment_coverage::COVERED : fragment_coverage::PARTIAL;
+}
+
+/**
+ * Subarray of the ranges of a read clipped to the non empty domain of a
+ * partially covered fragment
+ */
+static std::unique_ptr<tiledb::Subarray>
+clip_subarray(tiledb::Context &ctx, tiledb::Array &array,
+              const std::vector<raw_bounds> &bounds,
+              const std::vector<std::vector<raw_bounds>> &ranges,
+              const std::vector<tiledb::Dimension> &dimensions) {
+  auto clipped = std::make_unique<tiledb::Subarray>(ctx, array);
+  for (uint32_t dim_idx = 0; dim_idx < dimensions.size(); dim_idx++) {
+    const tiledb::Dimension &dimension = dimensions[dim_idx];
+    const raw_bounds &fragment = bounds[dim_idx];
+    for (const raw_bounds &range : ranges[dim_idx]) {
+      if (!bounds_intersect(range, fragment, dimension))
+        continue;
+
+      const std::string &lower =
+          compare_bounds(range.first, fragment.first, dimension) > 0
+              ? range.first
+              : fragment.first;
+      const std::string &upper =
+          compare_bounds(range.second, fragment.second, dimension) < 0
+              ? range.second
+              : fragment.second;
+      if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
+        ctx.handle_error(tiledb_subarray_add_range_var(
+            ctx.ptr().get(), clipped->ptr().get(), dim_idx, lower.data(),
+            lower.size(), upper.data(), upper.size()));
+      } else {
+        ctx.handle_error(tiledb_subarray_add_range(
+            ctx.ptr().get(), clipped->ptr().get(), dim_idx, lower.data(),
+            upper.data(), nullptr));
+      }
+    }
+  }
+  return clipped;
+}
+
+std::optional<tile::fragment_plan>
+tile::plan_sparse_fragments(tiledb::Context &ctx, tiledb::Array &array,
+                            const tile::fragment_listing &fragments,
+                            const tiledb::Subarray &subarray) {
+  // Fragments are only planned over when their bounds are listed
+  if (!fragments.listed || fragments.bounds.size() != fragments.cells.size())
+    return std::nullopt;
+
+  try {
+    tiledb::ArraySchema schema = array.schema();
+    if (schema.array_type() != TILEDB_SPARSE)
+      return std::nullopt;
+
+    std::vector<tiledb::Dimension> dimensions = schema.domain().dimensions();
+    std::vector<std::vector<raw_bounds>> ranges;
+    for (uint32_t dim_idx = 0; dim_idx < dimensions.size(); dim_idx++) {
+      ranges.push_back(
+          subarray_ranges(ctx, subarray, dimensions[dim_idx], dim_idx));
+    }
+
+    // Fragments the ranges do not miss, and if the ranges fully cover them
+    std::vector<size_t> read;
+    std::vector<bool> covered;
+    tile::fragment_plan plan;
+    for (size_t fragment = 0; fragment < fragments.bounds.size(); fragment++) {
+      const std::vector<raw_bounds> &bounds = fragments.bounds[fragment];
+      fragment_coverage coverage = cover_fragment(bounds, ranges, dimensions);
+      if (coverage == fragment_coverage::MISSED)
+        continue;
+
+      if (coverage == fragment_coverage::COVERED) {
+        plan.covered_cells += fragments.cells[fragment];
+        if (plan.bounds.empty()) {
+          plan.bounds = bounds;
+        } else {
+          for (size_t dim_idx = 0; dim_idx < dimensions.size(); dim_idx++) {
+            const tiledb::Dimension &dimension = dimensions[dim_idx];
+            raw_bounds &hull = plan.bounds[dim_idx];
+            if (compare_bounds(bounds[dim_idx].first, hull.first, dimension) <
+                0)
+              hull.first = bounds[dim_idx].first;
+            if (compare_bounds(bounds[dim_idx].second, hull.second,
+                               dimension) > 0)
+              hull.second = bounds[dim_idx].second;
+          }
+        }
+      }
+      read.push_back(fragment);
+      covered.push_back(coverage == fragment_coverage::COVERED);
+    }
+
+    // Without duplicates a later fragment replaces the cells of an earlier one
+    // at the same coordinates. A partially covered fragment is scanned within
+    // its non empty domain, which must not hold cells of other fragments
+    bool allows_dups = schema.allows_dups();
+    for (size_t i = 0; i < read.size(); i++) {
+      for (size_t j = i + 1; j < read.size(); j++) {
+        if (allows_dups && covered[i] && covered[j])
+          continue;
+        if (fragments_overlap(fragments.bounds[read[i]],
+                              fragments.bounds[read[j]], dimensions))
+          return std::nullopt;
+      }
+    }
+
+    for (size_t i = 0; i < read.size(); i++) {
+      if (covered[i])
+        continue;
+      if (plan.partial.size() == MAX_SCANNED_FRAGMENTS)
+        return std::nullopt;
+      plan.partial.push_back(clip_subarray(
+          ctx, array, fragments.bounds[read[i]], ranges, dimensions));
+    }
+    return plan;
+  } catch (const tiledb::TileDBError &e) {
+    // Subarrays that can not be clipped are left to a scan
+    return std::nullopt;
+  }
+}
+
+std::optional<uint64_t>
+tile::metadata_cell_count(tiledb::Context &ctx, tiledb::Array &array,
+                          const tile::non_empty_domain &non_empty_domain,
+                          const tile::fragment_listing &fragments,
+                          const tiledb::Subarray &subarray, bool restricted) {
+  if (non_empty_domain.empty)
+    return 0;
+
+  try {
+    tiledb::ArraySchema schema = array.schema();
+    if (schema.array_type() == TILEDB_SPARSE) {
+      if (!restricted)
+        return sparse_cell_count(array, fragments);
+
+      // Cells of partially covered fragments are only known from a scan
+      auto plan = plan_sparse_fragments(ctx, array, fragments, subarray);
+      if (!plan.has_value() || !plan->partial.empty())
+        return std::nullopt;
+      return plan->covered_cells;
+    }
+
+    tiledb::Domain domain = schema.domain();
+    uint64_t cells = 1;
+    for (uint32_t dim_idx = 0; dim_idx < domain.ndim(); dim_idx++) {
+      auto dim_cells =
+          dense_cell_count(ctx, domain, non_empty_domain, subarray, dim_idx);
+      if (!dim_cells.has_value())
+        return std::nullopt;
+      if (*dim_cells != 0 && cells > UINT64_MAX / *dim_cells)
+        return std::nullopt;
+      cells *= *dim_cells;
+    }
+    return cells;
+  } catch (const tiledb::TileDBError &e) {
+    // Metadata that can not be loaded, e.g. of encrypted fragments, leaves the
+    // count to a scan
+    return std::nullopt;
+  }
+}
+
+std::optional<std::string>
+tile::metadata_dimension_bound(tiledb::Context &ctx, tiledb::Array &array,
+                               const tile::non_empty_domain &non_empty_domain,
+                               const tile::fragment_listing &fragments,
+                               const tiledb::Subarray &subarray,
+                               uint32_t dim_idx, bool upper, bool restricted) {
+  if (non_empty_domain.empty)
+    return std::nullopt;
+
+  try {
+    tiledb::ArraySchema schema = array.schema();
+    tiledb::Domain domain = schema.domain();
+    if (restricted) {
+      // Sparse reads return the cells of the fragments the ranges fully cover
+      // when they miss the others
+      if (schema.array_type() == TILEDB_SPARSE) {
+        auto plan = plan_sparse_fragments(ctx, array, fragments, subarray);
+        if (!plan.has_value() || !plan->partial.empty() ||
+            plan->bounds.empty())
+          return std::nullopt;
+        const auto &bounds = plan->bounds[dim_idx];
+        return upper ? bounds.second : bounds.first;
+      }
+
+      // Only dense reads are known to return a cell at every coordinate of
+      // the ranges, and only if none of them is empty
+      auto cells = metadata_cell_count(ctx, array, non_empty_domain,
+                                       fragments, subarray, restricted);
+      if (!cells.has_value() || *cells == 0)
+        return std::nullopt;
+      return dense_bound(ctx, domain, non_empty_domain, subarray, dim_idx,
+                         upper);
+    }
+
+    if (domain.dimension(dim_idx).cell_val_num() == TILEDB_VAR_NUM) {
+      const auto &bounds = non_empty_domain.var[dim_idx];
+      return upper ? bounds.second : bounds.first;
+    }
+
+    const auto &bounds = non_empty_domain.fixed[dim_idx];
+    size_t size = bounds.size() / 2;
+    return std::string(reinterpret_cast<const char *>(bounds.data()) +
+                           (upper ? size : 0),
+                       size);
+  } catch (const tiledb::TileDBError &e) {
+    return std::nullopt;
+  }
+}
@@ -0,0 +1,173 @@
+/**
+ * @file   mytile-metadata-aggregates.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares aggregates answered from array metadata without reading tiles
+ */
+
+#pragma once
+
+#ifndef MYTILE_METADATA_AGGREGATES_H
+#define MYTILE_METADATA_AGGREGATES_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tiledb/tiledb>
+#include <utility>
+#include <vector>
+#include "mytile-non-empty-domain.h"
+
+namespace tile {
+/**
+ * Result of an aggregate answered from metadata
+ */
+typedef struct metadata_aggregate {
+  // Set for counts, unset for a bound of a dimension
+  bool count = false;
+  // Cells counted
+  uint64_t cells = 0;
+  // Datatype of the dimension
+  tiledb_datatype_t type = TILEDB_ANY;
+  // Set if the dimension is var sized
+  bool var_sized = false;
+  // Bound of the dimension as raw bytes
+  std::string value;
+  // Set for a bound of no cells, the aggregate is null
+  bool empty = false;
+} metadata_aggregate;
+
+/**
+ * Fragments of an opened sparse array, listed once when the array is opened
+ */
+typedef struct fragment_listing {
+  // Set if the fragments of a sparse array were listed
+  bool listed = false;
+  // Cells of each fragment visible to the opened array
+  std::vector<uint64_t> cells;
+  // Non empty domain of each visible fragment per dimension as raw bytes,
+  // empty if the fragments are too many to compare
+  std::vector<std::vector<std::pair<std::string, std::string>>> bounds;
+} fragment_listing;
+
+/**
+ * Fragments of a sparse array a read of a subarray sees, split into those the
+ * ranges fully cover, answered from their metadata, and those they partially
+ * cover, left to a scan. Fragments the ranges miss are left out
+ */
+typedef struct fragment_plan {
+  // Cells of the fully covered fragments
+  uint64_t covered_cells = 0;
+  // Lowest and highest value of each dimension over the fully covered
+  // fragments as raw bytes, empty if no fragment is fully covered
+  std::vector<std::pair<std::string, std::string>> bounds;
+  // Ranges of the read clipped to the non empty domain of each partially
+  // covered fragment, no other fragment has cells in them
+  std::vector<std::unique_ptr<tiledb::Subarray>> partial;
+} fragment_plan;
+
+/**
+ * List the fragments visible to an opened array
+ *
+ * @param ctx context the array is opened with
+ * @param array array open for reads
+ * @return listing, not listed for dense arrays, unreadable fragment metadata,
+ * delete commits or fragments spanning the timestamps the array is opened at
+ */
+std::shared_ptr<const fragment_listing>
+load_fragment_listing(tiledb::Context &ctx, tiledb::Array &array);
+
+/**
+ * Number of cells a read of the subarray returns, computed from metadata.
+ *
+ * A dense read returns every cell of the subarray, so the count is the
+ * volume of its ranges as long as they are disjoint and lie within the non
+ * empty domain. A sparse array is answered by adding up the cell counts of its
+ * fragments when no two fragments can hold the same coordinates, restricted
+ * reads only if their ranges fully cover or miss every fragment.
+ *
+ * @param ctx context the array is opened with
+ * @param array array open for reads
+ * @param non_empty_domain non empty domain of the opened array
+ * @param fragments fragments of the opened array
+ * @param subarray subarray built for the read
+ * @param restricted true if the read is limited by pushed conditions
+ * @return cell count, nullopt if it can not be derived from metadata
+ */
+std::optional<uint64_t>
+metadata_cell_count(tiledb::Context &ctx, tiledb::Array &array,
+                    const tile::non_empty_domain &non_empty_domain,
+                    const tile::fragment_listing &fragments,
+                    const tiledb::Subarray &subarray, bool restricted);
+
+/**
+ * Splits the fragments of a sparse array a read of the subarray sees by how
+ * the ranges cover their non empty domains. Fragments are only answered from
+ * metadata when their cells can not be replaced by other fragments, and
+ * partially covered fragments only scanned on their own when no other
+ * fragment overlaps them.
+ *
+ * @param ctx context the array is opened with
+ * @param array sparse array open for reads
+ * @param fragments fragments of the opened array
+ * @param subarray subarray built for the read
+ * @return plan, nullopt if fragments overlap or are too many to plan
+ */
+std::optional<fragment_plan>
+plan_sparse_fragments(tiledb::Context &ctx, tiledb::Array &array,
+                      const fragment_listing &fragments,
+                      const tiledb::Subarray &subarray);
+
+/**
+ * Lowest or highest value of a dimension a read of the subarray returns,
+ * computed from metadata. Unrestricted reads return the bound of the non empty
+ * domain, restricted dense reads the bound of the pushed ranges and restricted
+ * sparse reads the bound of the fragments the ranges fully cover, if they
+ * miss all others.
+ *
+ * @param ctx context the array is opened with
+ * @param array array open for reads
+ * @param non_empty_domain non empty domain of the opened array
+ * @param fragments fragments of the opened array
+ * @param subarray subarray built for the read
+ * @param dim_idx index of the dimension
+ * @param upper true for the highest value, false for the lowest
+ * @param restricted true if the read is limited by pushed conditions
+ * @return value of the dimension as raw bytes, nullopt if it can not be
+ * derived from metadata
+ */
+std::optional<std::string>
+metadata_dimension_bound(tiledb::Context &ctx, tiledb::Array &array,
+                         const tile::non_empty_domain &non_empty_domain,
+                         const tile::fragment_listing &fragments,
+                         const tiledb::Subarray &subarray, uint32_t dim_idx,
+                         bool upper, bool restricted);
+} // namespace tile
+
+#endif // MYTILE_METADATA_AGGREGATES_H
@@ -0,0 +1,75 @@
+/**
+ * @file   mytile-non-empty-domain.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This implements the non empty domain cached per opened array
+ */
+
+#include "mytile-non-empty-domain.h"
+
+std::shared_ptr<const tile::non_empty_domain>
+tile::load_non_empty_domain(tiledb::Context &ctx, tiledb::Array &array,
+                            const tiledb::Domain &domain) {
+  auto result = std::make_shared<tile::non_empty_domain>();
+  uint32_t ndim = domain.ndim();
+  result->fixed.resize(ndim);
+  result->var.resize(ndim);
+
+  for (uint32_t dim_idx = 0; dim_idx < ndim; dim_idx++) {
+    tiledb::Dimension dimension = domain.dimension(dim_idx);
+    int32_t is_empty = 0;
+
+    if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
+      uint64_t start_size = 0;
+      uint64_t end_size = 0;
+      ctx.handle_error(tiledb_array_get_non_empty_domain_var_size_from_index(
+          ctx.ptr().get(), array.ptr().get(), dim_idx, &start_size, &end_size,
+          &is_empty));
+
+      if (!is_empty) {
+        auto &pair = result->var[dim_idx];
+        pair.first.resize(start_size);
+        pair.second.resize(end_size);
+        ctx.handle_error(tiledb_array_get_non_empty_domain_var_from_index(
+            ctx.ptr().get(), array.ptr().get(), dim_idx, &pair.first[0],
+            &pair.second[0], &is_empty));
+      }
+    } else {
+      auto &bounds = result->fixed[dim_idx];
+      bounds.resize(tiledb_datatype_size(dimension.type()) * 2);
+      ctx.handle_error(tiledb_array_get_non_empty_domain_from_index(
+          ctx.ptr().get(), array.ptr().get(), dim_idx, bounds.data(),
+          &is_empty));
+    }
+
+    // An array is either empty on all dimensions or none
+    result->empty = is_empty;
+  }
+
+  return result;
+}
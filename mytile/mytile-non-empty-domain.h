@@ -0,0 +1,73 @@
+/**
+ * @file   mytile-non-empty-domain.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the non empty domain cached per opened array
+ */
+
+#pragma once
+
+#ifndef MYTILE_NON_EMPTY_DOMAIN_H
+#define MYTILE_NON_EMPTY_DOMAIN_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <tiledb/tiledb>
+
+namespace tile {
+/**
+ * Non empty domain of every dimension of an opened array. It only changes
+ * when the array is reopened, so it is computed once per opened snapshot and
+ * shared by all scans of that snapshot
+ */
+typedef struct non_empty_domain {
+  // Set when the array has no data
+  bool empty = true;
+  // Lower and upper bound packed for fixed sized dimensions, empty for var
+  std::vector<std::vector<uint8_t>> fixed;
+  // Lower and upper bound of var sized dimensions, empty for fixed
+  std::vector<std::pair<std::string, std::string>> var;
+} non_empty_domain;
+
+/**
+ * Fetch the non empty domain of all dimensions of an opened array
+ *
+ * @param ctx context the array is opened with
+ * @param array array open for reads
+ * @param domain domain of the array
+ * @return non empty domain
+ */
+std::shared_ptr<const non_empty_domain>
+load_non_empty_domain(tiledb::Context &ctx, tiledb::Array &array,
+                      const tiledb::Domain &domain);
+} // namespace tile
+
+#endif // MYTILE_NON_EMPTY_DOMAIN_H
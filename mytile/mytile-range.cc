@@ -32,7 +32,12 @@
 
 #include <mysqld_error.h>
 #include "mytile-range.h"
+#include "mytile-sysvars.h"
+#include <algorithm>
+#include <array>
+#include <map>
 #include <limits>
+#include <type_traits>
 
 std::shared_ptr<tile::range> tile::merge_ranges_str(
     const std::vector<std::shared_ptr<tile::range>> &ranges) {
@@ -373,40 +378,40 @@ void tile::setup_range(
 }
 
 void tile::setup_range(THD *thd, const std::shared_ptr<range> &range,
-                       void *non_empty_domain,
+                       const void *non_empty_domain,
                        const tiledb::Dimension &dimension) {
   switch (dimension.type()) {
   case tiledb_datatype_t::TILEDB_FLOAT64:
     return setup_range<double>(thd, range,
-                               static_cast<double *>(non_empty_domain));
+                               static_cast<const double *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_FLOAT32:
     return setup_range<float>(thd, range,
-                              static_cast<float *>(non_empty_domain));
+                              static_cast<const float *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_INT8:
     return setup_range<int8_t>(thd, range,
-                               static_cast<int8_t *>(non_empty_domain));
+                               static_cast<const int8_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_UINT8:
     return setup_range<uint8_t>(thd, range,
-                                static_cast<uint8_t *>(non_empty_domain));
+                                static_cast<const uint8_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_INT16:
     return setup_range<int16_t>(thd, range,
-                                static_cast<int16_t *>(non_empty_domain));
+                                static_cast<const int16_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_UINT16:
-    return setup_range<uint16_t>(thd, range,
-                                 static_cast<uint16_t *>(non_empty_domain));
+    return setup_range<uint16_t>(
+        thd, range, static_cast<const uint16_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_INT32:
     return setup_range<int32_t>(thd, range,
-                                static_cast<int32_t *>(non_empty_domain));
+                                static_cast<const int32_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_UINT32:
-    return setup_range<uint32_t>(thd, range,
-                                 static_cast<uint32_t *>(non_empty_domain));
+    return setup_range<uint32_t>(
+        thd, range, static_cast<const uint32_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_INT64:
   case tiledb_datatype_t::TILEDB_DATETIME_YEAR:
@@ -423,11 +428,11 @@ void tile::setup_range(THD *thd, const std::shared_ptr<range> &range,
   case tiledb_datatype_t::TILEDB_DATETIME_FS:
   case tiledb_datatype_t::TILEDB_DATETIME_AS:
     return setup_range<int64_t>(thd, range,
-                                static_cast<int64_t *>(non_empty_domain));
+                                static_cast<const int64_t *>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_UINT64:
-    return setup_range<uint64_t>(thd, range,
-                                 static_cast<uint64_t *>(non_empty_domain));
+    return setup_range<uint64_t>(
+        thd, range, static_cast<const uint64_t *>(non_empty_domain));
 
     // Uncomment to support BLOB dimensions
     // case tiledb_datatype_t::TILEDB_BLOB:
@@ -435,7 +440,8 @@ void tile::setup_range(THD *thd, const std::shared_ptr<range> &range,
     //                             static_cast<std::byte*>(non_empty_domain));
 
   case tiledb_datatype_t::TILEDB_BOOL:
-    return setup_range<bool>(thd, range, static_cast<bool *>(non_empty_domain));
+    return setup_range<bool>(
+        thd, range, static_cast<const bool *>(non_empty_domain));
   default: {
     const char *datatype_str;
     tiledb_datatype_to_str(range->datatype, &datatype_str);
@@ -1186,42 +1192,362 @@ void tile::update_range_from_key_for_super_range(
   }
 }
 
-void tile::build_subarray(
-    THD *thd, const bool &valid_ranges, const bool &valid_in_ranges,
-    int &empty_read, const tiledb::Domain &domain,
-    const std::vector<std::vector<std::shared_ptr<tile::range>>>
-        &pushdown_ranges,
-    const std::vector<std::vector<std::shared_ptr<tile::range>>>
-        &pushdown_in_ranges,
-    std::unique_ptr<tiledb::Subarray> &subarray, tiledb::Context *ctx,
-    tiledb::Array *array) {
+std::shared_ptr<tile::range>
+tile::copy_range(const std::shared_ptr<tile::range> &range) {
+  std::shared_ptr<tile::range> copy = std::make_shared<tile::range>(tile::range{
+      std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
+      std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free),
+      range->operation_type, range->datatype, range->lower_value_size,
+      range->upper_value_size, range->disjunction});
+
+  if (range->lower_value != nullptr) {
+    copy->lower_value = std::unique_ptr<void, decltype(&std::free)>(
+        std::malloc(std::max<uint64_t>(range->lower_value_size, 1)),
+        &std::free);
+    memcpy(copy->lower_value.get(), range->lower_value.get(),
+           range->lower_value_size);
+  }
+
+  if (range->upper_value != nullptr) {
+    copy->upper_value = std::unique_ptr<void, decltype(&std::free)>(
+        std::malloc(std::max<uint64_t>(range->upper_value_size, 1)),
+        &std::free);
+    memcpy(copy->upper_value.get(), range->upper_value.get(),
+           range->upper_value_size);
+  }
+  return copy;
+}
+
+// Lower and upper bound of a set up range as raw bytes
+typedef std::pair<std::string, std::string> range_bounds;
+
+static std::vector<range_bounds>
+bounds_of_ranges(const std::vector<std::shared_ptr<tile::range>> &ranges) {
+  std::vector<range_bounds> bounds;
+  bounds.reserve(ranges.size());
+  for (const auto &range : ranges) {
+    bounds.emplace_back(
+        std::string(static_cast<const char *>(range->lower_value.get()),
+                    range->lower_value_size),
+        std::string(static_cast<const char *>(range->upper_value.get()),
+                    range->upper_value_size));
+  }
+  return bounds;
+}
+
+static std::vector<std::shared_ptr<tile::range>>
+ranges_of_bounds(const std::vector<range_bounds> &bounds,
+                 tiledb_datatype_t datatype) {
+  std::vector<std::shared_ptr<tile::range>> ranges;
+  ranges.reserve(bounds.size());
+  for (const auto &bound : bounds) {
+    std::shared_ptr<tile::range> range =
+        std::make_shared<tile::range>(tile::range{
+            std::unique_ptr<void, decltype(&std::free)>(
+                std::malloc(std::max<size_t>(bound.first.size(), 1)),
+                &std::free),
+            std::unique_ptr<void, decltype(&std::free)>(
+                std::malloc(std::max<size_t>(bound.second.size(), 1)),
+                &std::free),
+            Item_func::BETWEEN, datatype, bound.first.size(),
+            bound.second.size()});
+    memcpy(range->lower_value.get(), bound.first.data(), bound.first.size());
+    memcpy(range->upper_value.get(), bound.second.data(), bound.second.size());
+    ranges.push_back(std::move(range));
+  }
+  return ranges;
+}
+
+/**
+ * Value of a bound of a fixed sized datatype
+ */
+template <typename T> static T bound_value(const std::string &bound) {
+  T value;
+  memcpy(&value, bound.data(), sizeof(T));
+  return value;
+}
+
+/**
+ * Compare two bounds, strings compare bytewise
+ * @return negative, zero or positive if lhs is less, equal or greater
+ */
+template <typename T>
+static int compare_bounds(const std::string &lhs, const std::string &rhs) {
+  if constexpr (std::is_same<T, char>::value) {
+    return lhs.compare(rhs);
+  } else {
+    T lhs_value = bound_value<T>(lhs);
+    T rhs_value = bound_value<T>(rhs);
+    return lhs_value < rhs_value ? -1 : (rhs_value < lhs_value ? 1 : 0);
+  }
+}
+
+/**
+ * Check if a lower bound directly follows an upper bound, integer ranges
+ * [a, b] and [b + 1, c] cover consecutive values
+ */
+template <typename T>
+static bool bounds_touch(const std::string &upper, const std::string &lower) {
+  if constexpr (std::is_integral<T>::value && !std::is_same<T, bool>::value &&
+                !std::is_same<T, char>::value) {
+    T upper_value = bound_value<T>(upper);
+    return upper_value != std::numeric_limits<T>::max() &&
+           static_cast<T>(upper_value + 1) == bound_value<T>(lower);
+  }
+  return false;
+}
+
+template <typename T>
+static std::vector<range_bounds>
+union_bounds(std::vector<range_bounds> bounds) {
+  bounds.erase(std::remove_if(bounds.begin(), bounds.end(),
+                              [](const range_bounds &bound) {
+                                return compare_bounds<T>(bound.first,
+                                                         bound.second) > 0;
+                              }),
+               bounds.end());
+  std::sort(bounds.begin(), bounds.end(),
+            [](const range_bounds &lhs, const range_bounds &rhs) {
+              return compare_bounds<T>(lhs.first, rhs.first) < 0;
+            });
+
+  std::vector<range_bounds> result;
+  for (auto &bound : bounds) {
+    if (!result.empty() &&
+        (compare_bounds<T>(bound.first, result.back().second) <= 0 ||
+         bounds_touch<T>(result.back().second, bound.first))) {
+      if (compare_bounds<T>(bound.second, result.back().second) > 0)
+        result.back().second = std::move(bound.second);
+    } else {
+      result.push_back(std::move(bound));
+    }
+  }
+  return result;
+}
+
+template <typename T>
+static std::vector<range_bounds>
+intersect_bounds(const std::vector<range_bounds> &lhs,
+                 const std::vector<range_bounds> &rhs) {
+  std::vector<range_bounds> result;
+  size_t lhs_idx = 0;
+  size_t rhs_idx = 0;
+  while (lhs_idx < lhs.size() && rhs_idx < rhs.size()) {
+    const range_bounds &left = lhs[lhs_idx];
+    const range_bounds &right = rhs[rhs_idx];
+    const std::string &lower =
+        compare_bounds<T>(left.first, right.first) >= 0 ? left.first
+                                                        : right.first;
+    bool left_ends_first = compare_bounds<T>(left.second, right.second) <= 0;
+    const std::string &upper = left_ends_first ? left.second : right.second;
+    if (compare_bounds<T>(lower, upper) <= 0)
+      result.emplace_back(lower, upper);
+
+    if (left_ends_first)
+      lhs_idx++;
+    else
+      rhs_idx++;
+  }
+  return result;
+}
+
+template <typename T>
+static std::vector<range_bounds>
+coalesce_bounds(const std::vector<range_bounds> &bounds, uint64_t max_ranges) {
+  if (max_ranges == 0 || bounds.size() <= max_ranges)
+    return bounds;
+
+  std::vector<range_bounds> result;
+  if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, char>::value) {
+    // Merge the neighbours separated by the smallest gaps
+    std::vector<std::pair<double, size_t>> gaps;
+    for (size_t i = 0; i + 1 < bounds.size(); i++) {
+      double next = static_cast<double>(bound_value<T>(bounds[i + 1].first));
+      double last = static_cast<double>(bound_value<T>(bounds[i].second));
+      gaps.emplace_back(next - last, i);
+    }
+    size_t merges = bounds.size() - max_ranges;
+    std::nth_element(gaps.begin(), gaps.begin() + merges - 1, gaps.end());
+    std::vector<bool> merge_next(bounds.size(), false);
+    for (size_t i = 0; i < merges; i++)
+      merge_next[gaps[i].second] = true;
+
+    for (size_t i = 0; i < bounds.size(); i++) {
+      if (i > 0 && merge_next[i - 1])
+        result.back().second = bounds[i].second;
+      else
+        result.push_back(bounds[i]);
+    }
+  } else {
+    // Without a distance between strings, merge runs of neighbours
+    size_t run = (bounds.size() + max_ranges - 1) / max_ranges;
+    for (size_t i = 0; i < bounds.size(); i += run) {
+      size_t last = std::min(i + run, bounds.size()) - 1;
+      result.emplace_back(bounds[i].first, bounds[last].second);
+    }
+  }
+  return result;
+}
+
+/**
+ * Call a generic function with a value of the type matching a datatype
+ */
+template <typename F>
+static std::vector<range_bounds> with_bounds_type(tiledb_datatype_t datatype,
+                                                  F &&fn) {
+  switch (datatype) {
+  case tiledb_datatype_t::TILEDB_FLOAT64:
+    return fn(double());
+  case tiledb_datatype_t::TILEDB_FLOAT32:
+    return fn(float());
+  case tiledb_datatype_t::TILEDB_INT8:
+    return fn(int8_t());
+  case tiledb_datatype_t::TILEDB_UINT8:
+    return fn(uint8_t());
+  case tiledb_datatype_t::TILEDB_INT16:
+    return fn(int16_t());
+  case tiledb_datatype_t::TILEDB_UINT16:
+    return fn(uint16_t());
+  case tiledb_datatype_t::TILEDB_INT32:
+    return fn(int32_t());
+  case tiledb_datatype_t::TILEDB_UINT32:
+    return fn(uint32_t());
+  case tiledb_datatype_t::TILEDB_INT64:
+    return fn(int64_t());
+  case tiledb_datatype_t::TILEDB_UINT64:
+    return fn(uint64_t());
+  case tiledb_datatype_t::TILEDB_STRING_ASCII:
+    return fn(char());
+  case tiledb_datatype_t::TILEDB_BOOL:
+    return fn(bool());
+  default:
+    if (tile::TileDBDateTimeType(datatype))
+      return fn(int64_t());
+    throw tiledb::TileDBError(
+        std::string("Unknown or unsupported datatype for dimension ranges"));
+  }
+}
+
+std::vector<std::shared_ptr<tile::range>>
+tile::union_ranges(const std::vector<std::shared_ptr<tile::range>> &ranges,
+                   tiledb_datatype_t datatype) {
+  std::vector<range_bounds> bounds = bounds_of_ranges(ranges);
+  return ranges_of_bounds(with_bounds_type(datatype,
+                                           [&](auto type) {
+                                             return union_bounds<decltype(
+                                                 type)>(std::move(bounds));
+                                           }),
+                          datatype);
+}
 
-  auto dims = domain.dimensions();
-  uint64_t ndim = domain.ndim();
+std::vector<std::shared_ptr<tile::range>>
+tile::intersect_ranges(const std::vector<std::shared_ptr<tile::range>> &lhs,
+                       const std::vector<std::shared_ptr<tile::range>> &rhs,
+                       tiledb_datatype_t datatype) {
+  std::vector<range_bounds> lhs_bounds = bounds_of_ranges(lhs);
+  std::vector<range_bounds> rhs_bounds = bounds_of_ranges(rhs);
+  return ranges_of_bounds(
+      with_bounds_type(datatype,
+                       [&](auto type) {
+                         return intersect_bounds<decltype(type)>(lhs_bounds,
+                                                                 rhs_bounds);
+                       }),
+      datatype);
+}
 
-  std::vector<std::unique_ptr<void, decltype(&std::free)>> nonEmptyDomains;
-  for (uint64_t dim_idx = 0; dim_idx < ndim; dim_idx++) {
-    nonEmptyDomains.emplace_back(
-        std::unique_ptr<void, decltype(&std::free)>(nullptr, &std::free));
+std::vector<std::shared_ptr<tile::range>>
+tile::coalesce_ranges(const std::vector<std::shared_ptr<tile::range>> &ranges,
+                      tiledb_datatype_t datatype, uint64_t max_ranges) {
+  std::vector<range_bounds> bounds = bounds_of_ranges(ranges);
+  return ranges_of_bounds(
+      with_bounds_type(datatype,
+                       [&](auto type) {
+                         return coalesce_bounds<decltype(type)>(bounds,
+                                                                max_ranges);
+                       }),
+      datatype);
+}
+
+/**
+ * Range covering the non empty domain of a dimension
+ */
+static std::shared_ptr<tile::range>
+non_empty_domain_range(const tile::non_empty_domain &non_empty_domain,
+                       uint64_t dim_idx, tiledb_datatype_t datatype) {
+  range_bounds bounds;
+  if (non_empty_domain.fixed[dim_idx].empty()) {
+    bounds = non_empty_domain.var[dim_idx];
+  } else {
+    const auto &fixed = non_empty_domain.fixed[dim_idx];
+    const char *data = reinterpret_cast<const char *>(fixed.data());
+    bounds.first.assign(data, fixed.size() / 2);
+    bounds.second.assign(data + fixed.size() / 2, fixed.size() / 2);
   }
+  return ranges_of_bounds({bounds}, datatype)[0];
+}
 
-  std::vector<std::pair<std::string, std::string>> nonEmptyDomainVars(ndim);
-  for (uint64_t dim_idx = 0; dim_idx < ndim; dim_idx++) {
-    tiledb::Dimension dimension = domain.dimension(dim_idx);
+/**
+ * Disjoint ranges of a dimension matching its pushed ranges and in ranges
+ * @return ranges sorted by their lower bound, empty if no value matches
+ */
+static std::vector<std::shared_ptr<tile::range>> dimension_ranges(
+    THD *thd, const tiledb::Dimension &dimension,
+    const tile::non_empty_domain &non_empty_domain, uint64_t dim_idx,
+    const std::vector<std::shared_ptr<tile::range>> &ranges,
+    const std::vector<std::shared_ptr<tile::range>> &in_ranges) {
+  tiledb_datatype_t datatype = dimension.type();
 
+  // Setup the range by filling in missing values with non empty domain
+  auto setup = [&](const std::shared_ptr<tile::range> &range) {
     if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
-      nonEmptyDomainVars[dim_idx] = array->non_empty_domain_var(dim_idx);
+      tile::setup_range(thd, range, non_empty_domain.var[dim_idx], dimension);
     } else {
-      uint64_t size = (tiledb_datatype_size(dimension.type()) * 2);
-      auto nonEmptyDomain = std::unique_ptr<void, decltype(&std::free)>(
-          std::malloc(size), &std::free);
-      ctx->handle_error(tiledb_array_get_non_empty_domain_from_index(
-          ctx->ptr().get(), array->ptr().get(), dim_idx, nonEmptyDomain.get(),
-          &empty_read));
-
-      nonEmptyDomains[dim_idx] = std::move(nonEmptyDomain);
+      tile::setup_range(thd, range, non_empty_domain.fixed[dim_idx].data(),
+                        dimension);
     }
+  };
+
+  // All ranges apply, they merge into a single most constrained range
+  std::shared_ptr<tile::range> main_range = nullptr;
+  if (!ranges.empty())
+    main_range = tile::merge_ranges(ranges, datatype);
+  if (main_range != nullptr) {
+    setup(main_range);
+  } else {
+    main_range = non_empty_domain_range(non_empty_domain, dim_idx, datatype);
   }
+  std::vector<std::shared_ptr<tile::range>> result =
+      tile::union_ranges({main_range}, datatype);
+
+  // Each IN or OR predicate allows the union of its alternatives
+  std::map<uint64_t, std::vector<std::shared_ptr<tile::range>>> disjunctions;
+  for (const auto &in_range : in_ranges) {
+    std::shared_ptr<tile::range> range = tile::copy_range(in_range);
+    setup(range);
+    disjunctions[in_range->disjunction].push_back(std::move(range));
+  }
+  for (const auto &disjunction : disjunctions) {
+    result = tile::intersect_ranges(
+        result, tile::union_ranges(disjunction.second, datatype), datatype);
+  }
+  return result;
+}
+
+void tile::build_subarray(
+    THD *thd, const bool &valid_ranges, const bool &valid_in_ranges,
+    int &empty_read, const tiledb::Domain &domain,
+    const tile::non_empty_domain &non_empty_domain,
+    const std::vector<std::vector<std::shared_ptr<tile::range>>>
+        &pushdown_ranges,
+    const std::vector<std::vector<std::shared_ptr<tile::range>>>
+        &pushdown_in_ranges,
+    std::unique_ptr<tiledb::Subarray> &subarray, tiledb::Context *ctx,
+    bool *coalesced) {
+
+  // The non empty domain is fetched once per opened array
+  const auto &nonEmptyDomains = non_empty_domain.fixed;
+  const auto &nonEmptyDomainVars = non_empty_domain.var;
+  empty_read = non_empty_domain.empty;
 
   // if no ranges to add
   if (!valid_ranges && !valid_in_ranges) { // No pushdown
@@ -1236,9 +1562,9 @@ void tile::build_subarray(
         auto &pair = nonEmptyDomainVars[dim_idx];
         subarray->add_range(dim_idx, pair.first, pair.second);
       } else {
-        void *lower = static_cast<char *>(nonEmptyDomains[dim_idx].get());
-        void *upper = static_cast<char *>(nonEmptyDomains[dim_idx].get()) +
-                      tiledb_datatype_size(dimension.type());
+        const void *lower = nonEmptyDomains[dim_idx].data();
+        const void *upper = nonEmptyDomains[dim_idx].data() +
+                            tiledb_datatype_size(dimension.type());
         // set range
         ctx->handle_error(
             tiledb_subarray_add_range(ctx->ptr().get(), subarray->ptr().get(),
@@ -1246,115 +1572,219 @@ void tile::build_subarray(
       }
     }
   } else {
-    // Loop over dimensions and build ranges for that dimension
+    if (empty_read) {
+      return;
+    }
+
+    uint64_t max_ranges = tile::sysvars::max_pushdown_ranges(thd);
     for (uint64_t dim_idx = 0; dim_idx < domain.ndim(); dim_idx++) {
       tiledb::Dimension dimension = domain.dimension(dim_idx);
-
-      // This ranges vector and the ranges it contains will be manipulated in
-      // merge ranges
+      bool var_sized = dimension.cell_val_num() == TILEDB_VAR_NUM;
       const auto &ranges = pushdown_ranges[dim_idx];
-
-      // If there is valid ranges from IN clause, first we must see if they
-      // are contained inside the merged super range we have
       const auto &in_ranges = pushdown_in_ranges[dim_idx];
 
-      if (dimension.cell_val_num() == TILEDB_VAR_NUM) {
-        auto &non_empty_domain = nonEmptyDomainVars[dim_idx];
-        // If the ranges for this dimension are not empty, we'll push it down
-        // else non empty domain is used
-        if (!ranges.empty() || !in_ranges.empty()) {
-          std::shared_ptr<tile::range> range = nullptr;
-          if (!ranges.empty()) {
-            // Merge multiple ranges into single super range
-            range = merge_ranges(ranges, dims[dim_idx].type());
-
-            if (range != nullptr) {
-              // Setup the range by filling in missing values with non empty
-              // domain
-              setup_range(thd, range, non_empty_domain, dims[dim_idx]);
-
-              // set range
-              ctx->handle_error(tiledb_subarray_add_range_var(
-                  ctx->ptr().get(), subarray->ptr().get(), dim_idx,
-                  range->lower_value.get(), range->lower_value_size,
-                  range->upper_value.get(), range->upper_value_size));
-            }
-          }
-
-          // If there are ranges from in conditions let's build proper ranges
-          // for them
-          if (!in_ranges.empty()) {
-            // First make the in ranges unique and remove any which are
-            // contained by the main range (if it is non null)
-            auto unique_in_ranges =
-                get_unique_non_contained_in_ranges(in_ranges, range);
-
-            for (auto &in_range : unique_in_ranges) {
-              // setup range so values are set to correct datatypes
-              setup_range(thd, in_range, non_empty_domain, dims[dim_idx]);
-              // set range
-              ctx->handle_error(tiledb_subarray_add_range_var(
-                  ctx->ptr().get(), subarray->ptr().get(), dim_idx,
-                  in_range->lower_value.get(), in_range->lower_value_size,
-                  in_range->upper_value.get(), in_range->upper_value_size));
-            }
-          }
-        } else { // If the range is empty we need to use the non-empty-domain
-
-          subarray->add_range(dim_idx, non_empty_domain.first,
-                              non_empty_domain.second);
-        }
+      std::vector<std::shared_ptr<tile::range>> dim_ranges;
+      if (ranges.empty() && in_ranges.empty()) {
+        // If the range is empty we need to use the non-empty-domain
+        dim_ranges.push_back(non_empty_domain_range(non_empty_domain, dim_idx,
+                                                    dimension.type()));
       } else {
-        // get start of non empty domain
-        void *lower = static_cast<char *>(nonEmptyDomains[dim_idx].get());
-        // If the ranges for this dimension are not empty, we'll push it down
-        // else non empty domain is used
-        if (!ranges.empty() || !in_ranges.empty()) {
-          std::shared_ptr<tile::range> range = nullptr;
-          if (!ranges.empty()) {
-            // Merge multiple ranges into single super range
-            range = merge_ranges(ranges, dims[dim_idx].type());
-
-            if (range != nullptr) {
-              // Setup the range by filling in missing values with non empty
-              // domain
-              setup_range(thd, range, lower, dims[dim_idx]);
-
-              // set range
-              ctx->handle_error(tiledb_subarray_add_range(
-                  ctx->ptr().get(), subarray->ptr().get(), dim_idx,
-                  range->lower_value.get(), range->upper_value.get(), nullptr));
-            }
-          }
-
-          // If there are ranges from in conditions let's build proper ranges
-          // for them
-          if (!in_ranges.empty()) {
-            // First make the in ranges unique and remove any which are
-            // contained by the main range (if it is non null)
-            auto unique_in_ranges =
-                get_unique_non_contained_in_ranges(in_ranges, range);
-
-            for (auto &in_range : unique_in_ranges) {
-              // setup range so values are set to correct datatypes
-              setup_range(thd, in_range, lower, dims[dim_idx]);
-              // set range
-              ctx->handle_error(tiledb_subarray_add_range(
-                  ctx->ptr().get(), subarray->ptr().get(), dim_idx,
-                  in_range->lower_value.get(), in_range->upper_value.get(),
-                  nullptr));
-            }
-          }
-        } else { // If the range is empty we need to use the non-empty-domain
-          void *upper = static_cast<char *>(lower) +
-                        tiledb_datatype_size(dimension.type());
-          ctx->handle_error(
-              tiledb_subarray_add_range(ctx->ptr().get(), subarray->ptr().get(),
-                                        dim_idx, lower, upper, nullptr));
+        dim_ranges = dimension_ranges(thd, dimension, non_empty_domain,
+                                      dim_idx, ranges, in_ranges);
+      }
+
+      // Many scattered ranges cost more to process than reading the cells
+      // between them
+      if (max_ranges > 0 && dim_ranges.size() > max_ranges) {
+        dim_ranges = coalesce_ranges(dim_ranges, dimension.type(), max_ranges);
+        if (coalesced != nullptr)
+          *coalesced = true;
+      }
+
+      // No cell matches all conditions of the dimension
+      if (dim_ranges.empty()) {
+        empty_read = 1;
+        return;
+      }
+
+      for (const auto &range : dim_ranges) {
+        if (var_sized) {
+          ctx->handle_error(tiledb_subarray_add_range_var(
+              ctx->ptr().get(), subarray->ptr().get(), dim_idx,
+              range->lower_value.get(), range->lower_value_size,
+              range->upper_value.get(), range->upper_value_size));
+        } else {
+          ctx->handle_error(tiledb_subarray_add_range(
+              ctx->ptr().get(), subarray->ptr().get(), dim_idx,
+              range->lower_value.get(), range->upper_value.get(), nullptr));
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Bounds of the partitions of a range on an integer dimension, at tile extent
+ * boundaries
+ * @tparam T type of the dimension
+ * @param range_start
+ * @param range_end
+ * @param domain_start lower bound of the dimension domain
+ * @param tile_extent
+ * @param partitions maximum number of partitions
+ * @return start and end of each partition
+ */
+template <typename T>
+static std::vector<std::pair<T, T>>
+partition_range(T range_start, T range_end, T domain_start, T tile_extent,
+                uint64_t partitions) {
+  // Offsets from the domain start are unsigned, so the full range of signed
+  // types does not overflow
+  using offset_t =
+      typename std::conditional<std::is_signed<T>::value, int64_t,
+                                uint64_t>::type;
+  auto offset = [domain_start](T value) {
+    return static_cast<uint64_t>(static_cast<offset_t>(value)) -
+           static_cast<uint64_t>(static_cast<offset_t>(domain_start));
+  };
+  auto value = [domain_start](uint64_t offset) {
+    return static_cast<T>(static_cast<offset_t>(
+        static_cast<uint64_t>(static_cast<offset_t>(domain_start)) + offset));
+  };
+
+  uint64_t extent = tile_extent > 0 ? static_cast<uint64_t>(tile_extent) : 1;
+  uint64_t first_tile = offset(range_start) / extent;
+  uint64_t tiles = offset(range_end) / extent - first_tile + 1;
+  uint64_t count = std::min(partitions, tiles);
+  uint64_t tiles_per_partition = (tiles + count - 1) / count;
+
+  std::vector<std::pair<T, T>> bounds;
+  T start = range_start;
+  for (uint64_t tile = first_tile + tiles_per_partition;
+       tile < first_tile + tiles; tile += tiles_per_partition) {
+    T next = value(tile * extent);
+    bounds.emplace_back(start, static_cast<T>(next - 1));
+    start = next;
+  }
+  bounds.emplace_back(start, range_end);
+  return bounds;
+}
+
+/**
+ * Add the ranges of the partitions of the first dimension to new subarrays
+ * @tparam T type of the dimension
+ */
+template <typename T>
+static std::vector<std::pair<std::string, std::string>>
+partition_first_dimension(tiledb::Context &ctx, const tiledb::Dimension &dim,
+                          const tiledb::Subarray &subarray,
+                          uint64_t partitions) {
+  const void *start, *end, *stride;
+  ctx.handle_error(tiledb_subarray_get_range(
+      ctx.ptr().get(), subarray.ptr().get(), 0, 0, &start, &end, &stride));
+  const void *domain, *extent;
+  ctx.handle_error(
+      tiledb_dimension_get_domain(ctx.ptr().get(), dim.ptr().get(), &domain));
+  ctx.handle_error(tiledb_dimension_get_tile_extent(
+      ctx.ptr().get(), dim.ptr().get(), &extent));
+
+  T tile_extent = extent != nullptr ? *static_cast<const T *>(extent) : 1;
+  auto bounds = partition_range<T>(
+      *static_cast<const T *>(start), *static_cast<const T *>(end),
+      *static_cast<const T *>(domain), tile_extent, partitions);
+
+  std::vector<std::pair<std::string, std::string>> ranges;
+  for (const auto &bound : bounds) {
+    ranges.emplace_back(
+        std::string(reinterpret_cast<const char *>(&bound.first), sizeof(T)),
+        std::string(reinterpret_cast<const char *>(&bound.second), sizeof(T)));
+  }
+  return ranges;
+}
+
+std::vector<std::unique_ptr<tiledb::Subarray>>
+tile::partition_subarray(tiledb::Context &ctx, const tiledb::Array &array,
+                         const tiledb::Domain &domain,
+                         const tiledb::Subarray &subarray,
+                         uint64_t partitions) {
+  std::vector<std::unique_ptr<tiledb::Subarray>> subarrays;
+  if (partitions < 2 || subarray.range_num(0) != 1)
+    return subarrays;
+
+  // Only integer and datetime dimensions have tile extents to split on
+  tiledb::Dimension dim = domain.dimension(0);
+  std::vector<std::pair<std::string, std::string>> ranges;
+  switch (dim.type()) {
+  case TILEDB_INT8:
+    ranges = partition_first_dimension<int8_t>(ctx, dim, subarray, partitions);
+    break;
+  case TILEDB_UINT8:
+    ranges =
+        partition_first_dimension<uint8_t>(ctx, dim, subarray, partitions);
+    break;
+  case TILEDB_INT16:
+    ranges =
+        partition_first_dimension<int16_t>(ctx, dim, subarray, partitions);
+    break;
+  case TILEDB_UINT16:
+    ranges =
+        partition_first_dimension<uint16_t>(ctx, dim, subarray, partitions);
+    break;
+  case TILEDB_INT32:
+    ranges =
+        partition_first_dimension<int32_t>(ctx, dim, subarray, partitions);
+    break;
+  case TILEDB_UINT32:
+    ranges =
+        partition_first_dimension<uint32_t>(ctx, dim, subarray, partitions);
+    break;
+  case TILEDB_UINT64:
+    ranges =
+        partition_first_dimension<uint64_t>(ctx, dim, subarray, partitions);
+    break;
+  default:
+    // Signed 64 bit integers and datetimes
+    if (dim.type() == TILEDB_FLOAT64 || dim.cell_val_num() == TILEDB_VAR_NUM ||
+        tiledb_datatype_size(dim.type()) != sizeof(int64_t))
+      return subarrays;
+    ranges =
+        partition_first_dimension<int64_t>(ctx, dim, subarray, partitions);
+  }
+
+  if (ranges.size() < 2)
+    return subarrays;
+
+  for (const auto &range : ranges) {
+    auto part = std::unique_ptr<tiledb::Subarray>(
+        new tiledb::Subarray(ctx, array));
+    ctx.handle_error(tiledb_subarray_add_range(
+        ctx.ptr().get(), part->ptr().get(), 0, range.first.data(),
+        range.second.data(), nullptr));
+
+    // Every partition keeps the ranges of the other dimensions
+    for (uint32_t dim_idx = 1; dim_idx < domain.ndim(); dim_idx++) {
+      bool var_sized =
+          domain.dimension(dim_idx).cell_val_num() == TILEDB_VAR_NUM;
+      for (uint64_t range_idx = 0; range_idx < subarray.range_num(dim_idx);
+           range_idx++) {
+        if (var_sized) {
+          std::array<std::string, 2> bounds =
+              subarray.range(dim_idx, range_idx);
+          part->add_range(dim_idx, bounds[0], bounds[1]);
+        } else {
+          const void *start, *end, *stride;
+          ctx.handle_error(tiledb_subarray_get_range(
+              ctx.ptr().get(), subarray.ptr().get(), dim_idx, range_idx,
+              &start, &end, &stride));
+          ctx.handle_error(tiledb_subarray_add_range(
+              ctx.ptr().get(), part->ptr().get(), dim_idx, start, end,
+              nullptr));
         }
       }
     }
+    subarrays.push_back(std::move(part));
   }
+  return subarrays;
 }
 
 int8_t tile::compare_typed_buffers(const void *lhs, const void *rhs,
@@ -45,6 +45,7 @@
 #include <tiledb/tiledb>
 #include <unordered_set>
 #include "mytile.h"
+#include "mytile-non-empty-domain.h"
 #include "utils.h"
 
 namespace tile {
@@ -59,6 +60,9 @@ typedef struct range_struct {
   tiledb_datatype_t datatype;
   uint64_t lower_value_size;
   uint64_t upper_value_size;
+  // In ranges of a dimension sharing this id are alternatives of one IN or OR
+  // predicate, ranges of different predicates all apply
+  uint64_t disjunction = 0;
 
   tiledb::QueryCondition QueryCondition(const tiledb::Context &ctx,
                                         const std::string &field_name) const;
@@ -100,14 +104,15 @@ int set_range_from_item_datetime(THD *thd, Item *lower_const, Item *upper_const,
  * @param dimension
  */
 void setup_range(THD *thd, const std::shared_ptr<tile::range> &range,
-                 void *non_empty_domain, const tiledb::Dimension &dimension);
+                 const void *non_empty_domain,
+                 const tiledb::Dimension &dimension);
 void setup_range(THD *thd, const std::shared_ptr<tile::range> &range,
                  const std::pair<std::string, std::string> &non_empty_domain,
                  const tiledb::Dimension &dimension);
 
 template <typename T>
 void setup_range(THD *thd, const std::shared_ptr<tile::range> &range,
-                 T *non_empty_domain) {
+                 const T *non_empty_domain) {
   T final_lower_value;
   T final_upper_value;
   range->lower_value_size = sizeof(T);
@@ -413,22 +418,93 @@ merge_ranges_to_super(const std::vector<std::shared_ptr<tile::range>> &ranges) {
   return merged_range;
 }
 /**
- * Build the given subarray referenced object from the parameters
+ * Build the given subarray referenced object from the parameters. Ranges of a
+ * dimension are intersected with its in ranges, alternatives of the same
+ * disjunction are unioned, and every resulting disjoint range is added
  * @param thd
  * @param valid_ranges
  * @param valid_in_ranges
  * @param empty_read
  * @param domain
+ * @param non_empty_domain cached non empty domain of the opened array
+ * @param pushdown_ranges
+ * @param pushdown_in_ranges
+ * @param subarray
+ * @param ctx
+ * @param coalesced set if ranges were coalesced, the subarray then covers
+ * cells not matching the pushed conditions
  */
 void build_subarray(THD *thd, const bool &valid_ranges,
                     const bool &valid_in_ranges, int &empty_read,
                     const tiledb::Domain &domain,
+                    const tile::non_empty_domain &non_empty_domain,
                     const std::vector<std::vector<std::shared_ptr<tile::range>>>
                         &pushdown_ranges,
                     const std::vector<std::vector<std::shared_ptr<tile::range>>>
                         &pushdown_in_ranges,
                     std::unique_ptr<tiledb::Subarray> &subarray,
-                    tiledb::Context *ctx, tiledb::Array *array);
+                    tiledb::Context *ctx, bool *coalesced = nullptr);
+
+/**
+ * Copy a range, including its values
+ * @param range
+ * @return copy
+ */
+std::shared_ptr<tile::range>
+copy_range(const std::shared_ptr<tile::range> &range);
+
+/**
+ * Sort ranges of a dimension and union the ones which overlap or touch. The
+ * ranges must be set up with both bounds in the datatype of the dimension,
+ * empty ranges are dropped
+ * @param ranges
+ * @param datatype
+ * @return disjoint ranges sorted by their lower bound
+ */
+std::vector<std::shared_ptr<tile::range>>
+union_ranges(const std::vector<std::shared_ptr<tile::range>> &ranges,
+             tiledb_datatype_t datatype);
+
+/**
+ * Intersect two sets of disjoint ranges sorted by their lower bound
+ * @param lhs
+ * @param rhs
+ * @param datatype
+ * @return disjoint ranges sorted by their lower bound
+ */
+std::vector<std::shared_ptr<tile::range>>
+intersect_ranges(const std::vector<std::shared_ptr<tile::range>> &lhs,
+                 const std::vector<std::shared_ptr<tile::range>> &rhs,
+                 tiledb_datatype_t datatype);
+
+/**
+ * Coalesce disjoint sorted ranges until at most max_ranges remain. Numeric
+ * ranges with the smallest gaps between them are merged first, string ranges
+ * are merged in runs of neighbours
+ * @param ranges
+ * @param datatype
+ * @param max_ranges
+ * @return disjoint ranges sorted by their lower bound
+ */
+std::vector<std::shared_ptr<tile::range>>
+coalesce_ranges(const std::vector<std::shared_ptr<tile::range>> &ranges,
+                tiledb_datatype_t datatype, uint64_t max_ranges);
+
+/**
+ * Split a subarray into disjoint partitions along the first dimension, at tile
+ * extent boundaries. The ranges of the other dimensions are kept
+ * @param ctx
+ * @param array
+ * @param domain
+ * @param subarray subarray to split, with a single range on the first
+ * dimension
+ * @param partitions maximum number of partitions
+ * @return partitions, empty if the subarray can not be split
+ */
+std::vector<std::unique_ptr<tiledb::Subarray>>
+partition_subarray(tiledb::Context &ctx, const tiledb::Array &array,
+                   const tiledb::Domain &domain,
+                   const tiledb::Subarray &subarray, uint64_t partitions);
 
 /**
  * Takes a vector of ranges build from IN predicates and returns a unique vector
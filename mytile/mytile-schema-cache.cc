@@ -0,0 +1,120 @@
+/**
+ * @file   mytile-schema-cache.cc
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This implements the server wide array schema cache
+ */
+
+#include <my_global.h>
+
+#define MYSQL_SERVER 1
+
+#include "mytile-schema-cache.h"
+#include <mutex>
+#include <unordered_map>
+
+namespace tile {
+namespace schemacache {
+
+static std::mutex cache_mutex;
+// Cached schemas keyed by uri, each uri can have one entry per encryption key.
+// Entries are weak so the contexts the schemas were loaded with are released
+// with the last handler using them
+static std::unordered_multimap<
+    std::string, std::pair<std::string, std::weak_ptr<const cached_schema>>>
+    cache;
+// Number of invalidations, used to avoid caching a schema which was
+// invalidated while it was being loaded
+static uint64_t invalidations = 0;
+
+/**
+ * Find the live schema of an array for an encryption key, dropping the
+ * entries no handler holds anymore. Caller must hold cache_mutex
+ * @param uri array uri
+ * @param encryption_key encryption key
+ * @return cached schema, nullptr if none is live
+ */
+static std::shared_ptr<const cached_schema>
+find_schema(const std::string &uri, const std::string &encryption_key) {
+  std::shared_ptr<const cached_schema> entry;
+  auto range = cache.equal_range(uri);
+  for (auto it = range.first; it != range.second;) {
+    std::shared_ptr<const cached_schema> live = it->second.second.lock();
+    if (live == nullptr) {
+      it = cache.erase(it);
+      continue;
+    }
+    if (it->second.first == encryption_key)
+      entry = live;
+    ++it;
+  }
+  return entry;
+}
+
+std::shared_ptr<const cached_schema>
+get_schema(const std::shared_ptr<tiledb::Context> &ctx, const std::string &uri,
+           const std::string &encryption_key) {
+  uint64_t invalidations_at_load;
+  {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto cached = find_schema(uri, encryption_key);
+    if (cached != nullptr)
+      return cached;
+    invalidations_at_load = invalidations;
+  }
+
+  // Load outside of the lock, loading can hit remote storage
+  auto entry = std::make_shared<cached_schema>();
+  entry->ctx = ctx;
+  entry->schema = std::make_shared<tiledb::ArraySchema>(*ctx, uri);
+  entry->domain = std::make_shared<tiledb::Domain>(entry->schema->domain());
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  // Another handler might have loaded it in the mean time
+  auto cached = find_schema(uri, encryption_key);
+  if (cached != nullptr)
+    return cached;
+  if (invalidations_at_load == invalidations) {
+    std::weak_ptr<const cached_schema> weak_entry = entry;
+    cache.emplace(uri, std::make_pair(encryption_key, weak_entry));
+  }
+  return entry;
+}
+
+void invalidate(const std::string &uri) {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache.erase(uri);
+  invalidations++;
+}
+
+void clear() {
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  cache.clear();
+}
+} // namespace schemacache
+} // namespace tile
@@ -0,0 +1,105 @@
+/**
+ * @file   mytile-schema-cache.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the server wide array schema cache
+ */
+
+#pragma once
+
+#ifndef MYTILE_SCHEMA_CACHE_H
+#define MYTILE_SCHEMA_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <tiledb/tiledb>
+
+namespace tile {
+
+/**
+ * Schema details for a single MariaDB field, precomputed once so hot paths do
+ * not need to look up dimensions or attributes by name
+ */
+typedef struct field_details {
+  // True if the field was found in the array schema
+  bool in_array = false;
+  // True if the field is a dimension, else it is an attribute
+  bool dimension = false;
+  // Index of the dimension in the domain or attribute in the schema
+  uint32_t index = 0;
+  tiledb_datatype_t type = TILEDB_ANY;
+  uint32_t cell_val_num = 1;
+  bool var_len = false;
+  bool nullable = false;
+  // Fixed size multi value attribute
+  bool list = false;
+  // Attribute has an enumeration
+  bool enumeration = false;
+} field_details;
+
+/**
+ * A cached array schema along with its domain. Only the handlers using the
+ * schema hold the entry, the cache itself does not keep it alive
+ */
+typedef struct cached_schema {
+  // Context the schema was loaded with, held so it outlives the schema
+  std::shared_ptr<tiledb::Context> ctx;
+  std::shared_ptr<tiledb::ArraySchema> schema;
+  std::shared_ptr<tiledb::Domain> domain;
+} cached_schema;
+
+namespace schemacache {
+
+/**
+ * Fetch the schema of an array, loading it when no handler holds it
+ *
+ * @param ctx context to load the schema with
+ * @param uri array uri
+ * @param encryption_key encryption key, empty if array is not encrypted
+ * @return cached schema
+ */
+std::shared_ptr<const cached_schema>
+get_schema(const std::shared_ptr<tiledb::Context> &ctx, const std::string &uri,
+           const std::string &encryption_key);
+
+/**
+ * Drop the cached schema of an array, must be called after schema evolution
+ *
+ * @param uri array uri
+ */
+void invalidate(const std::string &uri);
+
+/**
+ * Drop all cached schemas, used on plugin shutdown
+ */
+void clear();
+} // namespace schemacache
+} // namespace tile
+
+#endif // MYTILE_SCHEMA_CACHE_H
@@ -34,6 +34,8 @@
 #include <handler.h>
 #include <tiledb/tiledb.h>
 #include "mytile-statusvars.h"
+#include "mytile-buffer-pool.h"
+#include "mytile-context-pool.h"
 #include <tiledb/tiledb>
 
 namespace tile {
@@ -49,8 +51,86 @@ static int show_tiledb_version(MYSQL_THD thd, struct st_mysql_show_var *var,
   return 0;
 }
 
+static int show_context_pool_size(MYSQL_THD thd,
+                                  struct st_mysql_show_var *var, char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::contextpool::size();
+
+  return 0;
+}
+
+static int show_context_pool_hits(MYSQL_THD thd,
+                                  struct st_mysql_show_var *var, char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::contextpool::hits();
+
+  return 0;
+}
+
+static int show_context_pool_misses(MYSQL_THD thd,
+                                    struct st_mysql_show_var *var, char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::contextpool::misses();
+
+  return 0;
+}
+
+static int show_buffer_pool_bytes(MYSQL_THD thd,
+                                  struct st_mysql_show_var *var, char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::bufferpool::pooled_bytes();
+
+  return 0;
+}
+
+static int show_buffer_pool_hits(MYSQL_THD thd,
+                                 struct st_mysql_show_var *var, char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::bufferpool::hits();
+
+  return 0;
+}
+
+static int show_buffer_pool_misses(MYSQL_THD thd,
+                                   struct st_mysql_show_var *var, char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::bufferpool::misses();
+
+  return 0;
+}
+
+static int show_buffer_pool_high_water(MYSQL_THD thd,
+                                       struct st_mysql_show_var *var,
+                                       char *buf) {
+  var->type = SHOW_ULONGLONG;
+  var->value = buf;
+  *reinterpret_cast<ulonglong *>(buf) = tile::bufferpool::high_water_mark();
+
+  return 0;
+}
+
 struct st_mysql_show_var mytile_status_variables[] = {
     {"mytile_tiledb_version", (char *)show_tiledb_version, SHOW_SIMPLE_FUNC},
+    {"mytile_context_pool_size", (char *)show_context_pool_size,
+     SHOW_SIMPLE_FUNC},
+    {"mytile_context_pool_hits", (char *)show_context_pool_hits,
+     SHOW_SIMPLE_FUNC},
+    {"mytile_context_pool_misses", (char *)show_context_pool_misses,
+     SHOW_SIMPLE_FUNC},
+    {"mytile_buffer_pool_bytes", (char *)show_buffer_pool_bytes,
+     SHOW_SIMPLE_FUNC},
+    {"mytile_buffer_pool_hits", (char *)show_buffer_pool_hits,
+     SHOW_SIMPLE_FUNC},
+    {"mytile_buffer_pool_misses", (char *)show_buffer_pool_misses,
+     SHOW_SIMPLE_FUNC},
+    {"mytile_buffer_pool_high_water", (char *)show_buffer_pool_high_water,
+     SHOW_SIMPLE_FUNC},
     {NullS, NullS, SHOW_LONG}};
 } // namespace statusvars
 } // namespace tile
@@ -135,6 +135,80 @@ TYPELIB log_level_typelib = {array_elements(log_level_names) - 1,
 static MYSQL_THDVAR_ENUM(log_level, PLUGIN_VAR_OPCMDARG, "log level for mytile",
                          NULL, NULL, 1, &log_level_typelib);
 
+// Share opened read arrays between all handlers of a table instead of opening
+// the array for every query
+static MYSQL_THDVAR_BOOL(shared_array_cache,
+                         PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+                         "Share opened arrays across handlers of the same "
+                         "table, arrays are reopened only when new fragments "
+                         "are detected",
+                         NULL, NULL, true);
+
+// Minimum time between two checks for new fragments on a shared array
+static MYSQL_THDVAR_ULONGLONG(
+    shared_array_check_interval, PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+    "Minimum milliseconds between checks of a shared array for new fragments "
+    "written by other processes, 0 checks on every statement",
+    NULL, NULL, 0, 0, ~0UL, 0);
+
+// Prefetch the next batch of incomplete reads in the background
+static MYSQL_THDVAR_BOOL(pipelined_reads,
+                         PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+                         "Submit the next batch of an incomplete read in the "
+                         "background while the current batch is returned, "
+                         "uses twice the read buffer memory",
+                         NULL, NULL, false);
+
+// Upper bound of the memory kept by the buffer pool for reuse
+static ulonglong buffer_pool_size_value = 0;
+static MYSQL_SYSVAR_ULONGLONG(
+    buffer_pool_size, buffer_pool_size_value, PLUGIN_VAR_RQCMDARG,
+    "Maximum bytes of released query buffers kept for reuse by later queries. "
+    "Pooled buffers stay allocated and resident after the queries end, until "
+    "they are reused or the plugin is unloaded. Defaults to twice the default "
+    "read buffer size, 0 disables pooling",
+    NULL, NULL, 209715200, 0, ~0UL, 0);
+
+// Back large pooled buffers with transparent huge pages
+static my_bool buffer_pool_huge_pages_value = false;
+static MYSQL_SYSVAR_BOOL(buffer_pool_huge_pages, buffer_pool_huge_pages_value,
+                         PLUGIN_VAR_RQCMDARG,
+                         "Advise transparent huge pages for query buffers of "
+                         "2MB or more",
+                         NULL, NULL, false);
+
+// Read wide columns only for rows which pass the residual condition
+static MYSQL_THDVAR_DOUBLE(
+    late_materialization_selectivity,
+    PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+    "Scan the dimensions and condition columns first and read the other wide "
+    "columns only for rows passing the condition, when the estimated "
+    "selectivity of the condition is at most this fraction, 0 disables",
+    NULL, NULL, 0.1, 0, 1, 0);
+
+// Split table scans and aggregates into partitions read concurrently
+static MYSQL_THDVAR_UINT(
+    parallel_scan_partitions, PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+    "Number of partitions along the first dimension read concurrently by "
+    "unordered scans of sparse arrays and by aggregate pushdown, every "
+    "partition uses its own read buffers, 1 disables parallel scans",
+    NULL, NULL, 1, 1, 256, 0);
+
+// Disjoint ranges of a dimension are coalesced beyond this count
+static MYSQL_THDVAR_ULONGLONG(
+    max_pushdown_ranges, PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+    "Maximum number of disjoint ranges pushed down per dimension, beyond it "
+    "the ranges closest to each other are coalesced, 0 for no limit",
+    NULL, NULL, 1024, 0, UINT64_MAX, 0);
+
+// Memory bound of the groups of a pushed down GROUP BY
+static MYSQL_THDVAR_ULONGLONG(
+    group_by_memory, PLUGIN_VAR_OPCMDARG | PLUGIN_VAR_THDLOCAL,
+    "Bytes the groups of a pushed down GROUP BY may use, beyond it the groups "
+    "are aggregated in hash partitions each scanning the array again, 0 for "
+    "no limit",
+    NULL, NULL, 268435456, 0, UINT64_MAX, 0);
+
 // system variables
 struct st_mysql_sys_var *mytile_system_variables[] = {
     MYSQL_SYSVAR(read_buffer_size),
@@ -150,6 +224,15 @@ struct st_mysql_sys_var *mytile_system_variables[] = {
     MYSQL_SYSVAR(create_allow_subset_existing_array),
     MYSQL_SYSVAR(mrr_support),
     MYSQL_SYSVAR(enable_aggregate_pushdown),
+    MYSQL_SYSVAR(shared_array_cache),
+    MYSQL_SYSVAR(shared_array_check_interval),
+    MYSQL_SYSVAR(pipelined_reads),
+    MYSQL_SYSVAR(buffer_pool_size),
+    MYSQL_SYSVAR(buffer_pool_huge_pages),
+    MYSQL_SYSVAR(late_materialization_selectivity),
+    MYSQL_SYSVAR(parallel_scan_partitions),
+    MYSQL_SYSVAR(max_pushdown_ranges),
+    MYSQL_SYSVAR(group_by_memory),
     NULL};
 
 ulonglong read_buffer_size(THD *thd) { return THDVAR(thd, read_buffer_size); }
@@ -194,5 +277,31 @@ my_bool create_allow_subset_existing_array(THD *thd) {
 my_bool mrr_support(THD *thd) { return THDVAR(thd, mrr_support); }
 
 LOG_LEVEL log_level(THD *thd) { return LOG_LEVEL(THDVAR(thd, log_level)); }
+
+my_bool shared_array_cache(THD *thd) { return THDVAR(thd, shared_array_cache); }
+
+ulonglong shared_array_check_interval(THD *thd) {
+  return THDVAR(thd, shared_array_check_interval);
+}
+
+my_bool pipelined_reads(THD *thd) { return THDVAR(thd, pipelined_reads); }
+
+ulonglong buffer_pool_size() { return buffer_pool_size_value; }
+
+my_bool buffer_pool_huge_pages() { return buffer_pool_huge_pages_value; }
+
+double late_materialization_selectivity(THD *thd) {
+  return THDVAR(thd, late_materialization_selectivity);
+}
+
+uint parallel_scan_partitions(THD *thd) {
+  return THDVAR(thd, parallel_scan_partitions);
+}
+
+ulonglong max_pushdown_ranges(THD *thd) {
+  return THDVAR(thd, max_pushdown_ranges);
+}
+
+ulonglong group_by_memory(THD *thd) { return THDVAR(thd, group_by_memory); }
 } // namespace sysvars
 } // namespace tile
@@ -72,6 +72,24 @@ my_bool mrr_support(THD *thd);
 my_bool enable_aggregate_pushdown(THD *thd);
 
 LOG_LEVEL log_level(THD *thd);
+
+my_bool shared_array_cache(THD *thd);
+
+ulonglong shared_array_check_interval(THD *thd);
+
+my_bool pipelined_reads(THD *thd);
+
+ulonglong buffer_pool_size();
+
+my_bool buffer_pool_huge_pages();
+
+double late_materialization_selectivity(THD *thd);
+
+uint parallel_scan_partitions(THD *thd);
+
+ulonglong max_pushdown_ranges(THD *thd);
+
+ulonglong group_by_memory(THD *thd);
 } // namespace sysvars
 } // namespace tile
 
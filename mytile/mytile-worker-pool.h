@@ -0,0 +1,114 @@
+/**
+ * @file   mytile-worker-pool.h
+ *
+ * @section LICENSE
+ *
+ * The MIT License
+ *
+ * @copyright Copyright (c) 2017-2019 TileDB, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * This declares the worker threads running background reads of a scan
+ */
+
+#pragma once
+
+#ifndef MYTILE_WORKER_POOL_H
+#define MYTILE_WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace tile {
+
+/**
+ * Fixed set of threads running tasks in the order they are submitted. A scan
+ * keeps its workers for all of its batches instead of starting a thread for
+ * every background submit.
+ */
+class worker_pool {
+public:
+  /**
+   * Start the workers
+   * @param threads number of threads, at least one is started
+   */
+  explicit worker_pool(size_t threads);
+
+  /**
+   * Run the tasks already submitted and join the workers
+   */
+  ~worker_pool();
+
+  worker_pool(const worker_pool &) = delete;
+  worker_pool &operator=(const worker_pool &) = delete;
+
+  /**
+   * Queue a task for the next idle worker
+   * @param task callable without arguments
+   * @return future of the result of the task, exceptions are rethrown by get
+   */
+  template <typename F>
+  std::future<decltype(std::declval<F>()())> submit(F task) {
+    typedef decltype(std::declval<F>()()) result_type;
+    auto packaged =
+        std::make_shared<std::packaged_task<result_type()>>(std::move(task));
+    std::future<result_type> result = packaged->get_future();
+    enqueue([packaged]() { (*packaged)(); });
+    return result;
+  }
+
+  /**
+   * @return number of worker threads
+   */
+  size_t size() const;
+
+private:
+  /**
+   * Add a task to the queue and wake up a worker
+   * @param task
+   */
+  void enqueue(std::function<void()> task);
+
+  /**
+   * Loop of a worker thread, runs queued tasks until the pool is destroyed
+   */
+  void run();
+
+  std::mutex mutex;
+  std::condition_variable available;
+  // Tasks not yet picked up by a worker
+  std::deque<std::function<void()>> tasks;
+  std::vector<std::thread> threads;
+  // Set when the pool is destroyed, workers exit once the queue is empty
+  bool stopping = false;
+};
+} // namespace tile
+
+#endif // MYTILE_WORKER_POOL_H
@@ -8,6 +8,8 @@
 #include <mysqld_error.h>
 #include <sql_class.h>
 #include <tztime.h>
+#include <algorithm>
+#include <cmath>
 
 MYSQL_TIME epoch{1970, 1, 1, 0, 0, 0, 0, false, MYSQL_TIMESTAMP_DATETIME};
 
@@ -691,6 +693,9 @@ tiledb::Dimension tile::create_field_dimension(tiledb::Context &ctx,
   return tiledb::Dimension::create<uint8_t>(ctx, field->field_name.str,
                                             std::array<uint8, 2>{{0, 0}}, 10);
 }
+
+void tile::free_buffer(void *buffer) { tile::bufferpool::release(buffer); }
+
 void *tile::alloc_buffer(tiledb_datatype_t type, uint64_t size) {
   // Round the size to the nearest unit for the datatype using integer division
   uint64_t rounded_size =
@@ -1112,6 +1117,233 @@ int tile::set_field(THD *thd, Field *field, std::shared_ptr<buffer> &buff,
   }
   return 0;
 }
+
+/**
+ * Converter for single value fixed size cells
+ * @tparam T
+ */
+template <typename T>
+static int convert_field(THD *thd, Field *field,
+                         std::shared_ptr<buffer> &buff, uint64_t i,
+                         tile::datetime_converter *datetimes) {
+  return tile::set_field<T>(field, i, buff, false, 1);
+}
+
+/**
+ * Converter for fixed size multi value cells
+ * @tparam T
+ */
+template <typename T>
+static int convert_fixed_blob_field(THD *thd, Field *field,
+                                    std::shared_ptr<buffer> &buff, uint64_t i,
+                                    tile::datetime_converter *datetimes) {
+  return tile::set_field<T>(field, i, buff, true, buff->fixed_size_elements);
+}
+
+/**
+ * Converter for string cells
+ * @tparam T
+ * @tparam var_len true if the buffer has offsets
+ */
+template <typename T, bool var_len>
+static int convert_string_field(THD *thd, Field *field,
+                                std::shared_ptr<buffer> &buff, uint64_t i,
+                                tile::datetime_converter *datetimes) {
+  charset_info_st *charset_info;
+  if (std::is_same<T, char>() || std::is_same<T, std::byte>()) {
+    charset_info = &my_charset_latin1;
+  } else if (std::is_same<T, uint8_t>()) {
+#if MYSQL_VERSION_ID < 100500
+    charset_info = &my_charset_utf8_bin;
+#else
+    charset_info = &my_charset_utf8mb3_bin;
+#endif
+  } else if (std::is_same<T, uint16_t>()) {
+    charset_info = buff->type == TILEDB_STRING_UCS2 ? &my_charset_ucs2_bin
+                                                    : &my_charset_utf16_bin;
+  } else {
+    charset_info = &my_charset_utf32_bin;
+  }
+
+  if (var_len) {
+    return tile::set_var_string_field<T>(field, buff, i, charset_info);
+  }
+  return tile::set_fixed_string_field<T>(field, buff, i, charset_info);
+}
+
+/**
+ * Converter for types without a specialized converter
+ */
+static int convert_generic_field(THD *thd, Field *field,
+                                 std::shared_ptr<buffer> &buff, uint64_t i,
+                                 tile::datetime_converter *datetimes) {
+  return tile::set_field(thd, field, buff, i);
+}
+
+/**
+ * Store a datetime in the session time zone
+ * @param field
+ * @param buff
+ * @param i
+ * @param datetimes
+ * @param seconds
+ * @param second_part
+ * @return
+ */
+static int store_datetime_field(Field *field, std::shared_ptr<buffer> &buff,
+                                uint64_t i, tile::datetime_converter *datetimes,
+                                int64_t seconds, uint64_t second_part) {
+  if (tile::set_field_null_from_validity(buff, field, i)) {
+    return 0;
+  }
+
+  // Time zone conversions always produce valid datetimes, so unlike
+  // set_datetime_field no range adjustment is needed
+  MYSQL_TIME to;
+  datetimes->to_time(&to, seconds);
+  to.second_part = second_part;
+  to.time_type = MYSQL_TIMESTAMP_DATETIME;
+  return field->store_time(&to);
+}
+
+/**
+ * Converter for datetimes with a unit of one or more seconds
+ * @tparam seconds_per_unit
+ */
+template <int64_t seconds_per_unit>
+static int convert_datetime_field(THD *thd, Field *field,
+                                  std::shared_ptr<buffer> &buff, uint64_t i,
+                                  tile::datetime_converter *datetimes) {
+  int64_t value = static_cast<int64_t *>(buff->buffer)[i];
+  if (value < 0) {
+    return tile::set_field(thd, field, buff, i);
+  }
+  return store_datetime_field(field, buff, i, datetimes,
+                              value * seconds_per_unit, 0);
+}
+
+/**
+ * Converter for datetimes with a sub second unit
+ * @tparam units_per_second
+ */
+template <int64_t units_per_second>
+static int
+convert_subsecond_datetime_field(THD *thd, Field *field,
+                                 std::shared_ptr<buffer> &buff, uint64_t i,
+                                 tile::datetime_converter *datetimes) {
+  int64_t value = static_cast<int64_t *>(buff->buffer)[i];
+  if (value < 0) {
+    return tile::set_field(thd, field, buff, i);
+  }
+
+  // MariaDB keeps microseconds
+  int64_t units = value % units_per_second;
+  uint64_t us;
+  if constexpr (units_per_second >= 1000000) {
+    us = units / (units_per_second / 1000000);
+  } else {
+    us = units * (1000000 / units_per_second);
+  }
+  return store_datetime_field(field, buff, i, datetimes,
+                              value / units_per_second, us);
+}
+
+/**
+ * Get the converter for a fixed size type
+ * @tparam T
+ * @param buff
+ * @return converter
+ */
+template <typename T>
+static tile::field_converter
+get_fixed_field_converter(const std::shared_ptr<buffer> &buff) {
+  uint64_t fixed_size_elements = buff->fixed_size_elements;
+  if (fixed_size_elements > 1 && fixed_size_elements != TILEDB_VAR_NUM) {
+    return convert_fixed_blob_field<T>;
+  }
+  return convert_field<T>;
+}
+
+/**
+ * Get the converter for a string type
+ * @tparam T
+ * @param buff
+ * @return converter
+ */
+template <typename T>
+static tile::field_converter
+get_string_field_converter(const std::shared_ptr<buffer> &buff) {
+  if (buff->offset_buffer != nullptr) {
+    return convert_string_field<T, true>;
+  }
+  return convert_string_field<T, false>;
+}
+
+tile::field_converter
+tile::get_field_converter(const std::shared_ptr<buffer> &buff) {
+  switch (buff->type) {
+  case TILEDB_INT8:
+    return get_fixed_field_converter<int8_t>(buff);
+  case TILEDB_UINT8:
+    return get_fixed_field_converter<uint8_t>(buff);
+  case TILEDB_INT16:
+    return get_fixed_field_converter<int16_t>(buff);
+  case TILEDB_UINT16:
+    return get_fixed_field_converter<uint16_t>(buff);
+  case TILEDB_INT32:
+    return get_fixed_field_converter<int32_t>(buff);
+  case TILEDB_UINT32:
+    return get_fixed_field_converter<uint32_t>(buff);
+  case TILEDB_INT64:
+    return get_fixed_field_converter<int64_t>(buff);
+  case TILEDB_UINT64:
+    return get_fixed_field_converter<uint64_t>(buff);
+  case TILEDB_FLOAT32:
+    return get_fixed_field_converter<float>(buff);
+  case TILEDB_FLOAT64:
+    return get_fixed_field_converter<double>(buff);
+  case TILEDB_BOOL:
+    return get_fixed_field_converter<bool>(buff);
+  case TILEDB_CHAR:
+  case TILEDB_STRING_ASCII:
+    return get_string_field_converter<char>(buff);
+  case TILEDB_STRING_UTF8:
+    return get_string_field_converter<uint8_t>(buff);
+  case TILEDB_STRING_UTF16:
+  case TILEDB_STRING_UCS2:
+    return get_string_field_converter<uint16_t>(buff);
+  case TILEDB_STRING_UTF32:
+  case TILEDB_STRING_UCS4:
+    return get_string_field_converter<uint32_t>(buff);
+  case TILEDB_BLOB:
+  case TILEDB_GEOM_WKB:
+  case TILEDB_GEOM_WKT:
+    return get_string_field_converter<std::byte>(buff);
+  case TILEDB_DATETIME_HR:
+    return convert_datetime_field<60 * 60>;
+  case TILEDB_DATETIME_MIN:
+    return convert_datetime_field<60>;
+  case TILEDB_DATETIME_SEC:
+    return convert_datetime_field<1>;
+  case TILEDB_DATETIME_MS:
+    return convert_subsecond_datetime_field<1000>;
+  case TILEDB_DATETIME_US:
+    return convert_subsecond_datetime_field<1000000>;
+  case TILEDB_DATETIME_NS:
+    return convert_subsecond_datetime_field<1000000000>;
+  case TILEDB_DATETIME_PS:
+    return convert_subsecond_datetime_field<1000000000000>;
+  case TILEDB_DATETIME_FS:
+    return convert_subsecond_datetime_field<1000000000000000>;
+  case TILEDB_DATETIME_AS:
+    return convert_subsecond_datetime_field<1000000000000000000>;
+  default:
+    // Dates, which are kept in UTC, and times go through the generic
+    // conversion
+    return convert_generic_field;
+  }
+}
+
 int tile::set_buffer_from_field(Field *field, std::shared_ptr<buffer> &buff,
                                 uint64_t i, THD *thd, bool check_null) {
 
@@ -1622,148 +1854,29 @@ bool tile::is_string_datatype(const tiledb_datatype_t &type) {
   return true;
 }
 
-tile::BufferSizeByType tile::compute_buffer_sizes(
-    std::vector<std::tuple<tiledb_datatype_t, bool, bool, bool>> &field_types,
-    const uint64_t &memory_budget) {
-  // Get count of number of query buffers being allocated
-  size_t num_weighted_buffers = 0;
-  // Note: we count signed/unsigned as the same because we are really just
-  // concerned about bytes size We leave float and strings for convenience
-  uint64_t num_char_buffers = 0;
-  uint64_t num_int8_buffers = 0;
-  uint64_t num_int16_buffers = 0;
-  uint64_t num_int32_buffers = 0;
-  uint64_t num_int64_buffers = 0;
-  uint64_t num_float32_buffers = 0;
-  uint64_t num_float64_buffers = 0;
-  uint64_t num_var_length_uint8_buffers = 0;
-  uint64_t num_blob_buffers = 0;
-  uint64_t num_bool_buffers = 0;
-
-  for (const auto &field_type : field_types) {
-    tiledb_datatype_t datatype = std::get<0>(field_type);
-    bool var_len = std::get<1>(field_type);
-    bool nullable = std::get<2>(field_type);
-    bool list = std::get<3>(field_type);
-
-    if (var_len && !list) {
-      num_int64_buffers += 1;
-      num_var_length_uint8_buffers += 1;
-    }
-
-    // nullables use a uint8 buffer
-    if (nullable) {
-      num_int8_buffers += 1;
-    }
-
-    //     Currently we don't support list buffers in TileDB schema but this
-    //     will just work when we do //todo comment irrelevant
-    if (list) {
-      num_blob_buffers += 1;
-    }
-
-    // For non var length we want to count the datatype
-    if (!var_len || !list) {
-      switch (datatype) {
-      case TILEDB_UINT32:
-      case TILEDB_INT32:
-        num_int32_buffers += 1;
-        break;
-      case TILEDB_FLOAT32:
-        num_float32_buffers += 1;
-        break;
-      case TILEDB_FLOAT64:
-        num_float64_buffers += 1;
-        break;
-      case TILEDB_STRING_UTF8:
-      case TILEDB_STRING_ASCII:
-      case TILEDB_CHAR:
-        num_char_buffers += 1;
-        break;
-      case TILEDB_UINT8:
-      case TILEDB_INT8:
-      case TILEDB_ANY:
-        num_int8_buffers += 1;
-        break;
-      case TILEDB_INT16:
-      case TILEDB_UINT16:
-      case TILEDB_STRING_UTF16:
-      case TILEDB_STRING_UCS2:
-        num_int16_buffers += 1;
-        break;
-      case TILEDB_INT64:
-      case TILEDB_UINT64:
-      case TILEDB_STRING_UTF32:
-      case TILEDB_STRING_UCS4:
-      case TILEDB_DATETIME_YEAR:
-      case TILEDB_DATETIME_MONTH:
-      case TILEDB_DATETIME_WEEK:
-      case TILEDB_DATETIME_DAY:
-      case TILEDB_DATETIME_HR:
-      case TILEDB_DATETIME_MIN:
-      case TILEDB_DATETIME_SEC:
-      case TILEDB_DATETIME_MS:
-      case TILEDB_DATETIME_US:
-      case TILEDB_DATETIME_NS:
-      case TILEDB_DATETIME_PS:
-      case TILEDB_DATETIME_FS:
-      case TILEDB_DATETIME_AS:
-      case TILEDB_TIME_HR:
-      case TILEDB_TIME_MIN:
-      case TILEDB_TIME_SEC:
-      case TILEDB_TIME_MS:
-      case TILEDB_TIME_US:
-      case TILEDB_TIME_NS:
-      case TILEDB_TIME_PS:
-      case TILEDB_TIME_FS:
-      case TILEDB_TIME_AS:
-        num_int64_buffers += 1;
-        break;
-      case TILEDB_BLOB:
-      case TILEDB_GEOM_WKB:
-      case TILEDB_GEOM_WKT:
-        num_blob_buffers += 1;
-        break;
-      case TILEDB_BOOL:
-        num_bool_buffers += 1;
-        break;
-      default: {
-        const char *datatype_str;
-        tiledb_datatype_to_str(datatype, &datatype_str);
-        throw std::runtime_error(
-            "Unsupported datatype in compute_buffer_size: " +
-            std::string(datatype_str));
-      }
-      }
-    }
-  }
-
-  num_weighted_buffers = num_char_buffers + num_int8_buffers +
-                         (num_int16_buffers * sizeof(int16_t)) +
-                         (num_int32_buffers * sizeof(int32_t)) +
-                         (num_int64_buffers * sizeof(uint64_t)) +
-                         (num_float32_buffers * sizeof(float)) +
-                         (num_float64_buffers * sizeof(double)) +
-                         (num_var_length_uint8_buffers * sizeof(uint64_t)) +
-                         (num_blob_buffers * sizeof(uint8_t)) +
-                         (num_bool_buffers * sizeof(bool));
-
-  // Every buffer alloc gets the same size.
-  uint64_t nbytes = memory_budget / num_weighted_buffers;
-
-  // Requesting 0 MB will result in a 1 KB allocation. This is used by the
-  // tests to test the path of incomplete TileDB queries.
+std::vector<uint64_t>
+tile::compute_buffer_sizes(const std::vector<double> &bytes_per_cell,
+                           const uint64_t &memory_budget) {
+  double bytes_per_row = 0;
+  for (double bytes : bytes_per_cell)
+    bytes_per_row += bytes;
+
+  // Rows a batch can hold when every buffer fills up at the same row, a
+  // buffer must always fit at least one row
+  uint64_t rows = 1;
+  if (bytes_per_row > 0)
+    rows = std::max<uint64_t>(1, memory_budget / bytes_per_row);
+
+  // Requesting 0 MB will result in 1024 rows. This is used by the tests to
+  // test the path of incomplete TileDB queries.
   if (memory_budget == 0) {
-    nbytes = 1024;
+    rows = 1024;
   }
 
-  tile::BufferSizeByType sizes(
-      nbytes, nbytes, nbytes, nbytes * sizeof(uint16_t),
-      nbytes * sizeof(int16_t), nbytes * sizeof(int32_t),
-      nbytes * sizeof(uint32_t), nbytes * sizeof(uint64_t),
-      nbytes * sizeof(int64_t), nbytes * sizeof(float), nbytes * sizeof(double),
-      nbytes * sizeof(uint64_t), nbytes * sizeof(uint8_t),
-      nbytes * sizeof(bool));
+  std::vector<uint64_t> sizes;
+  sizes.reserve(bytes_per_cell.size());
+  for (double bytes : bytes_per_cell)
+    sizes.push_back(static_cast<uint64_t>(std::ceil(rows * bytes)));
 
   return sizes;
 }
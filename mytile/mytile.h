@@ -8,6 +8,8 @@
 #include "my_global.h" /* ulonglong */
 #include "mytile-errors.h"
 #include "mytile-buffer.h"
+#include "mytile-buffer-pool.h"
+#include "mytile-datetime.h"
 #include <field.h>
 #include <mysqld_error.h> /* ER_UNKNOWN_ERROR */
 #include <tiledb/tiledb>
@@ -39,127 +41,6 @@ namespace tile {
 typedef struct ::ha_table_option_struct ha_table_option_struct;
 typedef struct ::ha_field_option_struct ha_field_option_struct;
 
-struct BufferSizeByType {
-  BufferSizeByType(
-      const uint64_t &char_buffer_size, const uint64_t &uint8_buffer_size,
-      const uint64_t &int8_buffer_size, const uint64_t &uint16_buffer_size,
-      const uint64_t &int16_buffer_size, const uint64_t &int32_buffer_size,
-      const uint64_t &uint32_buffer_size, const uint64_t &uint64_buffer_size,
-      const uint64_t &int64_buffer_size, const uint64_t &float32_buffer_size,
-      const uint64_t &float64_buffer_size,
-      const uint64_t &var_length_uint8_buffer_size,
-      const uint64_t &blob_buffer_size, const uint64_t &bool_buffer_size) {
-    this->char_buffer_size = char_buffer_size;
-    this->uint8_buffer_size = uint8_buffer_size;
-    this->int8_buffer_size = int8_buffer_size;
-    this->uint16_buffer_size = int16_buffer_size;
-    this->int16_buffer_size = int16_buffer_size;
-    this->uint32_buffer_size = int32_buffer_size;
-    this->int32_buffer_size = int32_buffer_size;
-    this->uint64_buffer_size = uint64_buffer_size;
-    this->int64_buffer_size = int64_buffer_size;
-    this->float32_buffer_size = float32_buffer_size;
-    this->float64_buffer_size = float64_buffer_size;
-    this->var_length_uint8_buffer_size = var_length_uint8_buffer_size;
-    this->blob_buffer_size = blob_buffer_size;
-    this->bool_buffer_size = bool_buffer_size;
-  }
-
-  BufferSizeByType() = default;
-
-  uint64_t SizeByType(tiledb_datatype_t &datatype) const {
-    switch (datatype) {
-    case TILEDB_INT32:
-      return int32_buffer_size;
-    case TILEDB_INT64:
-      return int64_buffer_size;
-    case TILEDB_FLOAT32:
-      return float32_buffer_size;
-    case TILEDB_FLOAT64:
-      return float64_buffer_size;
-    case TILEDB_INT8:
-      return int8_buffer_size;
-    case TILEDB_UINT8:
-      return uint8_buffer_size;
-    case TILEDB_INT16:
-      return int16_buffer_size;
-    case TILEDB_UINT16:
-      return uint16_buffer_size;
-    case TILEDB_UINT32:
-      return uint32_buffer_size;
-    case TILEDB_UINT64:
-      return uint64_buffer_size;
-    case TILEDB_STRING_ASCII:
-    case TILEDB_CHAR:
-    case TILEDB_STRING_UTF8:
-      return char_buffer_size;
-    case TILEDB_STRING_UTF16:
-      return int16_buffer_size;
-    case TILEDB_STRING_UTF32:
-      return int32_buffer_size;
-    case TILEDB_STRING_UCS2:
-      return int16_buffer_size;
-    case TILEDB_STRING_UCS4:
-      return int32_buffer_size;
-    case TILEDB_ANY:
-      return uint8_buffer_size;
-    case TILEDB_DATETIME_YEAR:
-    case TILEDB_DATETIME_MONTH:
-    case TILEDB_DATETIME_WEEK:
-    case TILEDB_DATETIME_DAY:
-    case TILEDB_DATETIME_HR:
-    case TILEDB_DATETIME_MIN:
-    case TILEDB_DATETIME_SEC:
-    case TILEDB_DATETIME_MS:
-    case TILEDB_DATETIME_US:
-    case TILEDB_DATETIME_NS:
-    case TILEDB_DATETIME_PS:
-    case TILEDB_DATETIME_FS:
-    case TILEDB_DATETIME_AS:
-    case TILEDB_TIME_HR:
-    case TILEDB_TIME_MIN:
-    case TILEDB_TIME_SEC:
-    case TILEDB_TIME_MS:
-    case TILEDB_TIME_US:
-    case TILEDB_TIME_NS:
-    case TILEDB_TIME_PS:
-    case TILEDB_TIME_FS:
-    case TILEDB_TIME_AS:
-      return int64_buffer_size;
-    case TILEDB_BLOB:
-    case TILEDB_GEOM_WKB:
-    case TILEDB_GEOM_WKT:
-      return blob_buffer_size;
-    case TILEDB_BOOL:
-      return bool_buffer_size;
-    default: {
-      const char *str;
-      tiledb_datatype_to_str(datatype, &str);
-      my_printf_error(ER_UNKNOWN_ERROR,
-                      "Unknown tiledb data type in SizeByType: %s",
-                      ME_ERROR_LOG | ME_FATAL, str);
-    }
-    }
-
-    return 0;
-  }
-
-  uint64_t char_buffer_size = 0;
-  uint64_t uint8_buffer_size = 0;
-  uint64_t int8_buffer_size = 0;
-  uint64_t uint16_buffer_size = 0;
-  uint64_t int16_buffer_size = 0;
-  uint64_t uint32_buffer_size = 0;
-  uint64_t int32_buffer_size = 0;
-  uint64_t uint64_buffer_size = 0;
-  uint64_t int64_buffer_size = 0;
-  uint64_t float32_buffer_size = 0;
-  uint64_t float64_buffer_size = 0;
-  uint64_t var_length_uint8_buffer_size = 0;
-  uint64_t bool_buffer_size = 0;
-  uint64_t blob_buffer_size = 0;
-};
-
 /**
  * Converts a mysql type to a tiledb_datatype_t
  * @param type
@@ -322,15 +203,21 @@ tiledb::Dimension create_dim(tiledb::Context &ctx, Field *field,
 void *alloc_buffer(tiledb_datatype_t type, uint64_t size);
 
 /**
- * alloc buffer
+ * alloc buffer from the buffer pool, must be freed with free_buffer
  * @tparam T
  * @param size
  * @return
  */
 template <typename T> T *alloc_buffer(uint64_t size) {
-  return static_cast<T *>(malloc(size));
+  return static_cast<T *>(tile::bufferpool::allocate(size));
 }
 
+/**
+ * free buffer allocated with alloc_buffer, it is returned to the buffer pool
+ * @param buffer
+ */
+void free_buffer(void *buffer);
+
 /**
  * set field nullable from validity buffer
  * @param buff
@@ -512,6 +399,22 @@ int set_field(Field *field, uint64_t i, std::shared_ptr<buffer> &buff,
   return field->store(val, std::is_signed<T>());
 }
 
+/**
+ * Converts the cell of a buffer at an index to a field, datetimes are
+ * converted to the session time zone with the given converter
+ */
+typedef int (*field_converter)(THD *thd, Field *field,
+                               std::shared_ptr<buffer> &buff, uint64_t i,
+                               datetime_converter *datetimes);
+
+/**
+ * Get the converter for a buffer, resolving its datatype, cell layout and
+ * charset once instead of for every cell
+ * @param buff
+ * @return converter
+ */
+field_converter get_field_converter(const std::shared_ptr<buffer> &buff);
+
 /**
  * Set string buffer from field
  * @tparam T
@@ -720,18 +623,18 @@ bool is_fill_value_default(const tiledb_datatype_t &type, const void *value,
                            const uint64_t &size);
 
 /**
- * Takes a list of field details along with a memory budget and computes the
- * weighted buffer sizes. This lets us build weighted buffers so smaller
- * datatypes don't have unused buffer space. Var length data is treated simply
- * as uint64 (8 bytes), its the best we can do.
- * @param field_types vector of tuple<tiledb_datatype, var_length (bool),
- * nullable (bool), list (bool)>
+ * Split a memory budget between the buffers of a query so every buffer fills
+ * up at the same row, which is the most rows a batch can return for the
+ * budget. Each buffer gets a share of the budget proportional to its
+ * expected bytes per cell.
+ * @param bytes_per_cell expected bytes per cell of each buffer, 0 for buffers
+ * which are not allocated
  * @param memory_budget size in bytes of memory budget
- * @return BufferSizeByteType struct which contains the weighted buffer sizes
+ * @return size in bytes of each buffer
  */
-BufferSizeByType compute_buffer_sizes(
-    std::vector<std::tuple<tiledb_datatype_t, bool, bool, bool>> &field_types,
-    const uint64_t &memory_budget);
+std::vector<uint64_t>
+compute_buffer_sizes(const std::vector<double> &bytes_per_cell,
+                     const uint64_t &memory_budget);
 
 /**
  * Check if a datatype is a string type or not
@@ -0,0 +1,71 @@
+#!/bin/bash
+set -eu
+
+# Compare full scan times of a MyTile table with a session variable off and on
+#
+# Usage: scan-benchmark.sh [variable] [rows]
+#   variable - boolean mytile session variable to compare, default
+#              mytile_pipelined_reads
+#   rows     - number of rows in the benchmark table, default 10000000
+#
+# Environment:
+#   MYSQL       - client command, default "mysql -uroot"
+#   DATABASE    - database to create the table in, default test
+#   ARRAY_URI   - array uri, e.g. s3://bucket/scan_bench, default is a local
+#                 array in the datadir
+#   REPEAT      - number of timed scans per setting, default 3
+#   BUFFER_SIZE - mytile_read_buffer_size for the scans, default 104857600
+
+VARIABLE=${1-mytile_pipelined_reads}
+ROWS=${2-10000000}
+MYSQL=${MYSQL-mysql -uroot}
+DATABASE=${DATABASE-test}
+REPEAT=${REPEAT-3}
+BUFFER_SIZE=${BUFFER_SIZE-104857600}
+
+URI_OPTION=""
+if [[ -n "${ARRAY_URI-}" ]]; then
+  URI_OPTION="uri='${ARRAY_URI}'"
+fi
+
+run_sql() {
+  ${MYSQL} -N -B "${DATABASE}" -e "$1"
+}
+
+echo "Creating scan_bench with ${ROWS} rows"
+run_sql "DROP TABLE IF EXISTS scan_bench"
+run_sql "CREATE TABLE scan_bench (
+  dim0 bigint dimension=1 lower_bound=\"0\" upper_bound=\"$((ROWS * 2))\"
+    tile_extent=\"100000\",
+  attr0 bigint,
+  attr1 double,
+  attr2 varchar(64)
+) ENGINE=mytile ${URI_OPTION}"
+run_sql "INSERT INTO scan_bench SELECT seq, seq * 2, seq / 3, md5(seq)
+  FROM seq_1_to_${ROWS}"
+
+# Time a scan which converts every column of every row, aggregate pushdown is
+# disabled so rows go through the handler
+time_scan() {
+  local start end
+  start=$(date +%s.%N)
+  run_sql "SET mytile_read_buffer_size=${BUFFER_SIZE};
+    SET mytile_enable_aggregate_pushdown=0; SET ${VARIABLE}=$1;
+    SELECT SUM(attr0), SUM(attr1), SUM(LENGTH(attr2)) FROM scan_bench" \
+    >/dev/null
+  end=$(date +%s.%N)
+  echo "${end} - ${start}" | bc
+}
+
+for setting in 0 1; do
+  # Warm up caches so both settings read from the same state
+  time_scan "${setting}" >/dev/null
+  total=0
+  for ((i = 0; i < REPEAT; i++)); do
+    elapsed=$(time_scan "${setting}")
+    total=$(echo "${total} + ${elapsed}" | bc)
+  done
+  echo "${VARIABLE}=${setting}: $(echo "scale=3; ${total} / ${REPEAT}" | bc)s"
+done
+
+run_sql "DROP TABLE scan_bench"